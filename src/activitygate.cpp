@@ -0,0 +1,59 @@
+#include "activitygate.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Level of digital silence, log10 of 0 would be -inf
+    const float SILENCE_DB = -120.0f;
+}
+
+ActivityGate::Settings ActivityGate::defaultSettings()
+{
+    return Settings{9.0f, 6.0f, -60.0f, 0.3f, 1.0f};
+}
+
+ActivityGate::ActivityGate(const Settings &settings)
+    : settings(settings)
+    , floorDb{SILENCE_DB}
+    , seeded{false}
+    , open{false}
+    , quietSec{0.0f}
+{
+}
+
+void ActivityGate::reset()
+{
+    floorDb = SILENCE_DB;
+    seeded = false;
+    open = false;
+    quietSec = 0.0f;
+}
+
+bool ActivityGate::update(float rmsLevel, float durationSec)
+{
+    const float levelDb = rmsLevel > 0.0f ? std::max(20.0f * std::log10(rmsLevel), SILENCE_DB) : SILENCE_DB;
+
+    // Down at once, up slowly and only while closed, the level of an open gate is not the noise
+    if (!seeded || levelDb < floorDb) {
+        floorDb = levelDb;
+        seeded = true;
+    }
+    else if (!open) {
+        floorDb = std::min(levelDb, floorDb + settings.riseDbPerSec * durationSec);
+    }
+
+    const float aboveDb = levelDb - floorDb;
+    if (!open) {
+        open = aboveDb >= settings.openDb && levelDb >= settings.minOpenDb;
+        quietSec = 0.0f;
+    }
+    else if (aboveDb < settings.closeDb || levelDb < settings.minOpenDb) {
+        quietSec += durationSec;
+        if (quietSec >= settings.hangoverSec) open = false;
+    }
+    else {
+        quietSec = 0.0f;
+    }
+    return open;
+}
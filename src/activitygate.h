@@ -0,0 +1,71 @@
+#ifndef ACTIVITYGATE_H
+#define ACTIVITYGATE_H
+
+/**
+ * Tells the frames with activity from those with only the background noise, from their level alone.
+ *
+ * The noise floor starts at the level of the first frame, then follows the level down at once and rises back
+ * slowly while the gate is closed, which tracks the quietest level of the last seconds. It doesn't rise while
+ * the gate is open, so a held note never becomes the floor and closes the gate. The gate opens when the level
+ * rises openDb above the floor, and closes once it stayed closeDb or less above it for the hangover time, so it
+ * doesn't flutter around a single threshold or cut the decay of a note.
+ */
+class ActivityGate
+{
+public:
+    /**
+     * @brief The thresholds and time constants of the gate
+     */
+    struct Settings
+    {
+        float   openDb;             // Level above the floor that opens the gate
+        float   closeDb;            // Level above the floor under which the gate starts closing, below openDb
+        float   minOpenDb;          // Level (dBFS) under which the gate never opens, whatever the floor
+        float   hangoverSec;        // Time the level must stay under closeDb before the gate closes
+        float   riseDbPerSec;       // Rise of the floor while closed
+    };
+
+    /**
+     * @brief Returns the settings used by default
+     */
+    static Settings defaultSettings();
+
+    explicit ActivityGate(const Settings &settings = defaultSettings());
+
+    /**
+     * @brief Changes the settings, the state of the gate is kept
+     */
+    void setSettings(const Settings &settings) { this->settings = settings; }
+
+    /**
+     * @brief Forgets the noise floor and closes the gate, the next frame seeds the floor again
+     */
+    void reset();
+
+    /**
+     * @brief Updates the floor and the gate with the level of a frame
+     * @param rmsLevel The RMS level of the frame, in range 0.0 - 1.0
+     * @param durationSec The time since the previous frame
+     * @return True if the gate is open, the frame has activity
+     */
+    bool update(float rmsLevel, float durationSec);
+
+    /**
+     * @brief Returns whether the gate is open
+     */
+    bool isOpen() const { return open; }
+
+    /**
+     * @brief Returns the noise floor in dBFS, meaningless until the first update
+     */
+    float getFloorDb() const { return floorDb; }
+
+private:
+    Settings    settings;           // Thresholds and time constants
+    float       floorDb;            // Estimate of the level of the background noise, in dBFS
+    bool        seeded;             // True once floorDb was set from the level of a frame
+    bool        open;               // True while the frames have activity
+    float       quietSec;           // Time the level has been under closeDb while open
+};
+
+#endif // ACTIVITYGATE_H
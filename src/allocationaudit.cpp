@@ -0,0 +1,134 @@
+#include "allocationaudit.h"
+
+#ifdef AUDIT_ALLOCATIONS
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    // Number of allocations kept for the report, the following ones are only counted
+    const size_t MAX_RECORDS = 256;
+
+    struct Record
+    {
+        const char* thread;     // Name of the thread that allocated
+        size_t      size;       // Number of bytes allocated
+    };
+
+    struct ThreadState
+    {
+        const char* name    = nullptr;  // Name given when armed, nullptr while disarmed
+        int         allowed = 0;        // Depth of ScopedAllow
+        bool        inHook  = false;    // Guards against recording our own allocations
+    };
+
+    thread_local ThreadState    threadState;
+    std::atomic<uint64_t>       count{0};
+    std::atomic<size_t>         numRecords{0};
+    Record                      records[MAX_RECORDS];
+
+    void record(size_t size)
+    {
+        ThreadState &state = threadState;
+        if (!state.name || state.allowed > 0 || state.inHook) return;
+
+        state.inHook = true;
+        count.fetch_add(1, std::memory_order_relaxed);
+        const size_t index = numRecords.fetch_add(1, std::memory_order_relaxed);
+        if (index < MAX_RECORDS) records[index] = Record{state.name, size};
+        state.inHook = false;
+    }
+}
+
+#ifdef AUDIT_WRAP_MALLOC
+// Linked with -Wl,--wrap=malloc (@see{toneanalyzer.pri}), every call to malloc ends up here
+extern "C" void* __real_malloc(size_t size);
+extern "C" void* __wrap_malloc(size_t size)
+{
+    record(size);
+    return __real_malloc(size);
+}
+#   define AUDIT_MALLOC __real_malloc
+#else
+#   define AUDIT_MALLOC std::malloc
+#endif
+
+namespace {
+    void* allocate(size_t size)
+    {
+        record(size);
+        void *p = AUDIT_MALLOC(size == 0 ? 1 : size);
+        if (!p) throw std::bad_alloc();
+        return p;
+    }
+
+    void* allocateAligned(size_t size, std::align_val_t alignment)
+    {
+        record(size);
+        const size_t align = static_cast<size_t>(alignment);
+        // aligned_alloc wants a multiple of the alignment
+        void *p = std::aligned_alloc(align, (size + align - 1) / align * align);
+        if (!p) throw std::bad_alloc();
+        return p;
+    }
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { record(size); return AUDIT_MALLOC(size == 0 ? 1 : size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { record(size); return AUDIT_MALLOC(size == 0 ? 1 : size); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+namespace allocationaudit {
+    void armThread(const char *name)
+    {
+        threadState.name = name;
+    }
+
+    void disarmThread()
+    {
+        threadState.name = nullptr;
+    }
+
+    uint64_t allocationCount()
+    {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    uint64_t report()
+    {
+        // Printing allocates, don't record it if the calling thread is armed
+        ScopedAllow allow;
+
+        const uint64_t total = allocationCount();
+        if (total == 0) {
+            std::fprintf(stderr, "allocationaudit::report no allocation after warm-up\n");
+            return 0;
+        }
+
+        std::fprintf(stderr, "allocationaudit::report %llu allocation(s) after warm-up\n", static_cast<unsigned long long>(total));
+        const size_t recorded = std::min(numRecords.load(std::memory_order_relaxed), MAX_RECORDS);
+        for (size_t i = 0; i < recorded; ++i) {
+            std::fprintf(stderr, "allocationaudit::report thread %s bytes %zu\n", records[i].thread, records[i].size);
+        }
+        return total;
+    }
+
+    ScopedAllow::ScopedAllow() { ++threadState.allowed; }
+    ScopedAllow::~ScopedAllow() { --threadState.allowed; }
+}
+
+#endif // AUDIT_ALLOCATIONS
@@ -0,0 +1,63 @@
+#ifndef ALLOCATIONAUDIT_H
+#define ALLOCATIONAUDIT_H
+
+#include <cstdint>
+
+/**
+ * Opt-in auditing of the heap allocations made by the real-time threads.
+ *
+ * Built only when AUDIT_ALLOCATIONS is defined (@see{toneanalyzer.pri}): operator new (and malloc with
+ * AUDIT_WRAP_MALLOC) are then replaced by versions recording every allocation made by an armed thread.
+ * A thread arms itself once it is warmed up, from then on any allocation it makes is a regression.
+ * Without AUDIT_ALLOCATIONS every function here is an empty inline and costs nothing.
+ */
+namespace allocationaudit {
+#ifdef AUDIT_ALLOCATIONS
+    /**
+     * @brief Starts recording the allocations made by the calling thread
+     * @param name Name of the thread in the report, must outlive the audit (ie: a string literal)
+     */
+    void armThread(const char *name);
+
+    /**
+     * @brief Stops recording the allocations made by the calling thread
+     */
+    void disarmThread();
+
+    /**
+     * @brief Returns the number of allocations made by armed threads since the start
+     */
+    uint64_t allocationCount();
+
+    /**
+     * @brief Prints the allocations recorded so far
+     * @return The number of allocations made by armed threads, for a headless run to fail on
+     */
+    uint64_t report();
+
+    /**
+     * @brief Allows allocations on the calling thread for its lifetime, for allocations known to be
+     * out of our hands (ie: the event Qt allocates to carry a queued signal, every emit to another thread
+     * is wrapped in one)
+     */
+    class ScopedAllow
+    {
+    public:
+        ScopedAllow();
+        ~ScopedAllow();
+    };
+#else
+    inline void armThread(const char *) {}
+    inline void disarmThread() {}
+    inline uint64_t allocationCount() { return 0; }
+    inline uint64_t report() { return 0; }
+
+    class ScopedAllow
+    {
+    public:
+        ScopedAllow() {}
+    };
+#endif
+}
+
+#endif // ALLOCATIONAUDIT_H
@@ -1,21 +1,24 @@
 #include "audioanalyzerthread.h"
 
-#include <math.h>
+#include <algorithm>
 
-#include <qmath.h>
 #include <QThread>
 
-#include <boost/circular_buffer.hpp>
-
+#include "allocationaudit.h"
+#include "tracer.h"
 #include "util.h"
-#include <notes.h>
 
-AudioAnalyzerThread::AudioAnalyzerThread()
+AudioAnalyzerThread::AudioAnalyzerThread(WorkerPool &pool)
     : thread(new QThread(this))
-    , fftw_in{}
-    , fftw_out{}
-    , data_out{}
-    , plan_initialized{false}
+    , displayChannel{-1}
+    , numFrames{0}
+    , analyzer(pool)
+    , history{}
+    , resultStream{}
+    , spectrogramArchive{}
+    , sharedSpectrum{}
+    , latency{}
+    , displayedSpectra{}
 {
     moveToThread(thread);
     thread->start();
@@ -23,77 +26,106 @@ AudioAnalyzerThread::AudioAnalyzerThread()
 
 AudioAnalyzerThread::~AudioAnalyzerThread() {}
 
-void AudioAnalyzerThread::calculateLevel(const std::vector<float> &data) {
-    float peakLevel = 0.0;
-    float sum = 0.0;
+bool AudioAnalyzerThread::enableHistory(const QString &spillPath, size_t spillBlocks) {
+    history.reset(new SpectralHistory(HISTORY_FRAMES_PER_BLOCK, HISTORY_BLOCKS, HISTORY_SPECTRUM_BINS));
+    const bool enabled = spillPath.isEmpty() || history->enableSpill(spillPath, spillBlocks);
+    if (!enabled) history.reset();
 
-    auto it = data.begin();
-    auto end = data.end();
+    AUDIOANALYZER_DEBUG << "AudioAnalyzerThread::enableHistory" << spillPath << "blocks" << spillBlocks << enabled;
+    return enabled;
+}
 
-    while (it < end) {
-        const float value = *it;
-        peakLevel = std::max(peakLevel, value);
-        sum += std::pow(value, 2.0f);
-        ++it;
-    }
-    size_t numSamples = data.size();
-    float rmsLevel = std::clamp(sqrt(sum / numSamples), 0.0f, 1.0f);
+bool AudioAnalyzerThread::enableResultStream(const QString &path, size_t spectrumBins) {
+    ResultStreamWriter::Settings settings = ResultStreamWriter::defaultSettings();
+    settings.spectrumBins = spectrumBins;
+    const bool opened = resultStream.open(QFile::encodeName(path).constData(), settings);
 
-    //AUDIOANALYZER_DEBUG << "AudioInput::calculateLevel" << "rms" << rmsLevel << "peak" << peakLevel;
+    AUDIOANALYZER_DEBUG << "AudioAnalyzerThread::enableResultStream" << path << "bins" << spectrumBins << opened;
+    return opened;
+}
+
+bool AudioAnalyzerThread::enableSpectrogramArchive(const QString &path, size_t numBins, int bitsPerValue) {
+    SpectrogramArchiveWriter::Settings settings = SpectrogramArchiveWriter::defaultSettings();
+    settings.numBins = numBins;
+    settings.bitsPerValue = bitsPerValue;
+    const bool opened = spectrogramArchive.open(QFile::encodeName(path).constData(), settings);
 
-    emit levelChanged(rmsLevel, peakLevel, numSamples);
+    AUDIOANALYZER_DEBUG << "AudioAnalyzerThread::enableSpectrogramArchive" << path << "bins" << numBins << "bits" << bitsPerValue << opened;
+    return opened;
 }
 
-void AudioAnalyzerThread::applyWindowingFunction() {
-    double x = 0.0;
+bool AudioAnalyzerThread::enableSharedSpectrum(const QString &name) {
+    const bool opened = sharedSpectrum.open(name.toLatin1().constData());
 
-    for (size_t i=0; i<fftw_out.size(); ++i) {
-        x = 0.5 * (1 - qCos((2 * M_PI * i) / (fftw_out.size())));
-        fftw_out[i] = fftw_out[i] * x;
-    }
+    AUDIOANALYZER_DEBUG << "AudioAnalyzerThread::enableSharedSpectrum" << name << opened;
+    return opened;
 }
 
-void AudioAnalyzerThread::calculateNote(const int sampleRate) {
-    // Crude detection of pitch, just take frequency with highest value
-    // TODO: Detection of fundamental harmonics
-    double hz_step = sampleRate / 2.0 / data_out.size() / 2.0;
-    double max_freq = std::numeric_limits<double>::min();
-    int index = 0;
-    for (int i = 0; i < notes::NB_NOTES; i++) {
-        size_t fftw_out_index = static_cast<size_t>(notes::frequencies[i] / hz_step);
-        double v1 = data_out[fftw_out_index];
-        double v2 = data_out[fftw_out_index + 1];
-        double value = (v1 + v2) / 2.0;
-        if (max_freq < value) {
-            index = i;
-            max_freq = value;
-        }
-    }
+void AudioAnalyzerThread::closeOutputs() {
+    // Writes the indexes, once at the end
+    allocationaudit::ScopedAllow allow;
+    const bool streamClosed = resultStream.close();
+    const bool archiveClosed = spectrogramArchive.close();
+    // Tells the readers the publisher is gone
+    sharedSpectrum.close();
 
-    emit noteChanged(notes::notes[index]);
+    AUDIOANALYZER_DEBUG << "AudioAnalyzerThread::closeOutputs" << streamClosed << archiveClosed;
 }
 
-void AudioAnalyzerThread::calculateSpectrum(const int sampleRate, const std::vector<float> &data) {
-    if (!plan_initialized) {
-        fftw_in.resize(data.size());
-        fftw_out.resize(data.size());
-        data_out.resize(data.size());
-        fftw_plan = fftw_plan_dft_r2c_1d(static_cast<int>(fftw_in.size()), fftw_in.data(), reinterpret_cast<fftw_complex*>(fftw_out.data()), FFTW_BACKWARD);
-        plan_initialized = true;
-    }
+size_t AudioAnalyzerThread::displayedChannel(const AudioFrame &frame) const {
+    if (displayChannel >= 0 && static_cast<size_t>(displayChannel) < frame.numChannels) return static_cast<size_t>(displayChannel);
+    return frame.hasMix ? frame.numChannels - 1 : 0;
+}
 
-    // TODO: Correctly implement windowing function, right now it messes up the data
-    // applyWindowingFunction();
+void AudioAnalyzerThread::analyze(const AudioFrame &frame) {
+    TRACE_THREAD_NAME("analysis");
+    TRACE_SCOPE("analyze");
+    TRACE_FLOW_END("frame", frame.sampleOffset);
+
+    const FrameResults &results = analyzer.analyze(frame);
+    // The results hold everything needed from the samples, their slot can take the next frame
+    frame.release();
+
+    // Only the displayed channel goes to the widgets, so the GUI costs the same whatever the number of channels
+    const ChannelAnalyzer &displayed = analyzer.getChannel(displayedChannel(frame));
+    const ChannelResult &result = displayed.getResult();
+
+    {
+        allocationaudit::ScopedAllow allow;
+        emit levelChanged(result.rmsLevel, result.peakLevel, frame.numSamples);
+        // The spectrum of the analyzer is resized when the transform changes, so the display gets a copy. By the time
+        // the copy of a frame is written again, the display usually holds the next one and nothing is allocated, it
+        // is detached only when the display lags behind
+        QVector<double> &spectrum = displayedSpectra[numFrames % 2];
+        spectrum.resize(static_cast<int>(displayed.getSpectrumSize()));
+        std::copy(displayed.getSpectrum(), displayed.getSpectrum() + displayed.getSpectrumSize(), spectrum.begin());
+        emit frequenciesChanged(spectrum);
+        emit noteChanged(result.note);
+        emit chordChanged(result.chord);
+        emit frameAnalyzed(results);
+    }
 
-    std::transform(data.begin(), data.end(), fftw_in.begin(), [](float x) -> double { return double(x); });
-    fftw_execute(fftw_plan);
+    // The results are out, the frame went through the whole pipeline
+    FrameStamps stamps = results.stamps;
+    stamps.us[FrameStamps::PUBLISHED] = LatencyStats::nowUs();
+    latency.record(stamps);
+
+    if (history) {
+        HistoryFrame historyFrame;
+        historyFrame.timestampUs = frame.timestampUs;
+        historyFrame.rmsLevel = result.rmsLevel;
+        historyFrame.peakLevel = result.peakLevel;
+        historyFrame.note = result.note;
+        historyFrame.confidence = result.confidence;
+        history->append(historyFrame, displayed.getSpectrum(), displayed.getSpectrumSize() / 2 + 1);
+    }
 
-    // Transform complex numbers to floating point numbers
-    std::transform(fftw_out.begin(), fftw_out.end(), data_out.begin(), [](std::complex<double> x) -> double {
-        return std::sqrt(std::pow(x.real(), 2) + std::pow(x.imag(), 2));
-    });
+    // Dropped (and counted) rather than waiting when the disk lags behind
+    if (resultStream.isOpen()) resultStream.append(results, &analyzer);
+    // Never waits on the readers, a slow one loses the oldest frames
+    if (sharedSpectrum.isOpen()) sharedSpectrum.publish(results, analyzer, frame.sampleRate);
+    if (spectrogramArchive.isOpen()) spectrogramArchive.append(frame.timestampUs, displayed.getSpectrum(), displayed.getSpectrumSize());
 
-    // We only need half, the rest is not useful by the nature of Discrete Fourier Transform / Fast Fourier Transform
-    emit frequenciesChanged(data_out.data(), data_out.size());
-    calculateNote(sampleRate);
+    // The first frames plan the FFT and size the buffers, after that nothing should allocate
+    if (++numFrames == WARMUP_FRAMES) allocationaudit::armThread("analysis");
 }
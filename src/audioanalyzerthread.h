@@ -1,58 +1,123 @@
 #ifndef AUDIOANALYZERTHREAD_H
 #define AUDIOANALYZERTHREAD_H
 
-#include <map>
-#include <complex>
+#include <memory>
 
+#include <QMetaType>
 #include <QObject>
+#include <QVector>
 
-#include <boost/circular_buffer.hpp>
-#include <fftw3.h>
+#include "audioframe.h"
+#include "frameanalyzer.h"
+#include "latencystats.h"
+#include "resultstream.h"
+#include "sharedspectrum.h"
+#include "spectralhistory.h"
+#include "spectrogramarchive.h"
+
+Q_DECLARE_METATYPE(FrameResults)
 
 class AudioAnalyzerThread : public QObject
 {
     Q_OBJECT
+
+enum {
+    HISTORY_FRAMES_PER_BLOCK = 256, HISTORY_BLOCKS = 64, HISTORY_SPECTRUM_BINS = 512, WARMUP_FRAMES = 10
+};
+
 public:
-    AudioAnalyzerThread();
+    /**
+     * @param pool The threads analyzing the channels of the frames, shared with the other streams
+     */
+    explicit AudioAnalyzerThread(WorkerPool &pool);
     ~AudioAnalyzerThread();
-private:
-    // The thread it will be running on
-    QThread* thread;
 
-    std::vector<double>                 fftw_in;
-    std::vector<std::complex<double>>   fftw_out;
-    fftw_plan                           fftw_plan;
+    /**
+     * @brief Keeps the history of the analyzed frames of the displayed channel, for a consumer querying the past
+     * @param spillPath Path of the memory-mapped file the frames evicted from memory are kept in, empty to drop them
+     * @param spillBlocks Number of blocks of HISTORY_FRAMES_PER_BLOCK frames kept in the file
+     * @return True if the history (and its file) could be created
+     * @note Must be called before listening, the history costs a quantized spectrum a frame and HISTORY_BLOCKS blocks
+     */
+    bool enableHistory(const QString &spillPath, size_t spillBlocks);
 
-    std::vector<double>                 data_out;
-    bool                                plan_initialized;
+    /**
+     * @brief Returns the history of the analyzed frames of the displayed channel, safe to query from any thread
+     * @return The history, nullptr unless enableHistory was called
+     */
+    const SpectralHistory* getHistory() const { return history.get(); }
 
     /**
-     * @brief Applies a windowing function to the frequency spectrum (fftw_out)
+     * @brief Writes the results of every channel of the frames analyzed to a binary result stream
+     * @param path Path of the file, created or truncated
+     * @param spectrumBins Number of bins of the quantized spectrum stored with each result, 0 to store none
+     * @return True if the file could be created
+     * @note Must be called before listening, the stream is closed by closeOutputs
      */
-    void applyWindowingFunction();
+    bool enableResultStream(const QString &path, size_t spectrumBins);
 
     /**
-     * @brief Calculates the note of the frequency spectrum (data_out)
-     * @param sampleRate The sample rate of the incoming audio to analyze
+     * @brief Writes the spectra of the displayed channel to a compressed spectrogram archive, for hours of waterfall
+     * @param path Path of the file, created or truncated
+     * @param numBins Number of bins stored of each spectrum
+     * @param bitsPerValue Bits of each stored bin, 8 or 16
+     * @return True if the file could be created
+     * @note Must be called before listening, the archive is closed by closeOutputs
      */
-    void calculateNote(const int sampleRate);
+    bool enableSpectrogramArchive(const QString &path, size_t numBins, int bitsPerValue);
+
+    /**
+     * @brief Publishes every channel of the frames analyzed to a ring in shared memory, for other local processes
+     * @param name Name of the ring @see{SharedSpectrumPublisher::open}
+     * @return True if the shared memory could be created
+     * @note Must be called before listening, the ring is closed by closeOutputs
+     */
+    bool enableSharedSpectrum(const QString &name);
+
+    /**
+     * @brief Returns the latency of the stages of the pipeline for the frames analyzed, safe to query from any thread
+     * @return The latency statistics
+     */
+    const LatencyStats& getLatency() const { return latency; }
+
+    /**
+     * @brief Sets the channel whose level, spectrum and note are sent to the display
+     * @param channel Index of the channel, -1 for the mixed down channel (or the first one if there is none)
+     */
+    void setDisplayChannel(int channel) { displayChannel = channel; }
+private:
+    // The thread it will be running on
+    QThread* thread;
+
+    int                                             displayChannel;     // Channel sent to the display, -1 for the mix
+    size_t                                          numFrames;          // Number of frames analyzed
+    FrameAnalyzer                                   analyzer;           // Analysis of every channel of the frames
+    std::unique_ptr<SpectralHistory>                history;            // Results of the previous frames of the displayed channel, when enabled
+    ResultStreamWriter                              resultStream;       // Results of every channel, written to a file when enabled
+    SpectrogramArchiveWriter                        spectrogramArchive; // Spectra of the displayed channel, written to a file when enabled
+    SharedSpectrumPublisher                         sharedSpectrum;     // Every channel, published to shared memory when enabled
+    LatencyStats                                    latency;            // Latency of the stages of the pipeline
+    QVector<double>                                 displayedSpectra[2];// Copies of the displayed spectrum handed to the display, one per frame in turn
+
+    /**
+     * @brief Returns the index of the channel sent to the display for a frame
+     */
+    size_t displayedChannel(const AudioFrame &frame) const;
 public slots:
     /**
-     * ** Some code taken/inspired from Qt example "Spectrum" **
-     * @brief Calculates the audio level and emits a levelChanged signal
-     * @param data The data to analyze
+     * @brief Analyzes every channel of a frame in parallel and publishes the results
+     * @param frame The frame to analyze
      */
-    void calculateLevel(const std::vector<float> &data);
+    void analyze(const AudioFrame &frame);
 
     /**
-     * @brief Calculates the frequency spectrum and emits frequenciesChanged signal
-     * @param sampleRate The sample rate of the incoming audio to analyze
-     * @param data The data to analyze
+     * @brief Finishes the files written and closes the shared ring, after the frames already queued, the frames
+     * that follow are not written
      */
-    void calculateSpectrum(const int sampleRate, const std::vector<float> &data);
+    void closeOutputs();
 signals:
     /**
-     * Signal for audio level change
+     * Signal for audio level change of the displayed channel
      * \param rmsLevel RMS level in range 0.0 - 1.0
      * \param peakLevel Peak level in range 0.0 - 1.0
      * \param numSamples Number of audio samples analyzed
@@ -60,17 +125,28 @@ signals:
     void levelChanged(float rmsLevel, float peakLevel, size_t numSamples);
 
     /**
-     * @brief Signal for audio frequencies change
-     * @param frequencies The frequencies and their value
-     * @param numSamples Number of audio samples analyzed
+     * @brief Signal for audio frequencies change of the displayed channel
+     * @param frequencies The magnitude of the frequencies, a copy the receiver can keep
+     */
+    void frequenciesChanged(const QVector<double> &frequencies);
+
+    /**
+     * @brief Signal for when the note of the displayed channel is updated
+     * @param note Index of the changed note in notes::notes
+     */
+    void noteChanged(int note);
+
+    /**
+     * @brief Signal for when the chord played on the displayed channel is updated
+     * @param chord The chord @see{MultiPitchEstimator::chordRoot}, -1 if none
      */
-    void frequenciesChanged(const double* frequencies, size_t numSamples);
+    void chordChanged(int chord);
 
     /**
-     * @brief Signal for when the note is updated
-     * @param note The changed note
+     * @brief Signal for the results of every channel of a frame
+     * @param results The results
      */
-    void noteChanged(const QString note);
+    void frameAnalyzed(const FrameResults &results);
 };
 
 #endif // AUDIOANALYZERTHREAD_H
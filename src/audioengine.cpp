@@ -1,10 +1,19 @@
 #include "audioengine.h"
 
+#include <algorithm>
+
+#include "allocationaudit.h"
 #include "util.h"
 
 AudioEngine::AudioEngine()
-    : audioInputThread(new AudioInputThread(NOTIFY_INTERVAL_MS))
-    , audioAnalyzerThread(new AudioAnalyzerThread())
+    : analysisPool(WorkerPool::defaultNumThreads())
+    , sessions{}
+    , deviceEnumerator{nullptr}
+    , noteServer{nullptr}
+    , channelCount{1}
+    , mixdown{false}
+    , analysisRate{0}
+    , overrunPolicy{Framer::DROP_OLDEST}
 {
     // Initializes the audio format
     format = QAudioFormat();
@@ -15,35 +24,121 @@ AudioEngine::AudioEngine()
     format.setCodec("audio/pcm");
     format.setChannelCount(1);
 
-    // Fetched the list of available audio input devices
-    QList<QAudioDeviceInfo> audioDevices = QAudioDeviceInfo::availableDevices(QAudio::AudioInput);
-    std::for_each(audioDevices.begin(), audioDevices.end(), [&](QAudioDeviceInfo audioDevice) {
-        if (audioDevice.isFormatSupported(format)) {
-            this->availableAudioInputDevices.push_back(audioDevice);
+    sessions.push_back(createSession());
+
+    // The devices are listed off the GUI thread, they are available once devicesChanged is emitted
+    deviceEnumerator = new DeviceEnumerator(format);
+    connect(deviceEnumerator, &DeviceEnumerator::devicesChanged, this, [this]() {
+        availableAudioInputDevices.clear();
+        availableAudioInputFormats.clear();
+        for (const DeviceEnumerator::Device &device : deviceEnumerator->getDevices()) {
+            availableAudioInputDevices.push_back(device.info);
+            availableAudioInputFormats.push_back(device.format);
         }
     });
+    QMetaObject::invokeMethod(deviceEnumerator, "enumerate", Qt::QueuedConnection);
+}
+
+AudioEngine::~AudioEngine() {
+    // The files are finished on the threads writing them, after the frames already queued
+    for (const Session &session : sessions) QMetaObject::invokeMethod(session.analyzer, "closeOutputs", Qt::BlockingQueuedConnection);
+
+    allocationaudit::report();
+#ifdef REPORT_LATENCY
+    for (const Session &session : sessions) session.analyzer->getLatency().report(stderr);
+#endif
+}
+
+void AudioEngine::startNoteServer(const QString &name) {
+    if (!noteServer) {
+        // The events are made on the thread of the server, from the results the analyzer publishes anyway
+        noteServer = new NoteEventServer;
+        connect(sessions.front().analyzer, &AudioAnalyzerThread::frameAnalyzed, noteServer, &NoteEventServer::frameAnalyzed);
+    }
+    QMetaObject::invokeMethod(noteServer, "listen", Qt::QueuedConnection, Q_ARG(QString, name));
+}
 
-    // Connects with the audioInputThread
-    connect(audioInputThread, &AudioInputThread::dataReady, this, &AudioEngine::receiveAudioData);
+bool AudioEngine::startResultStream(const QString &path) {
+    return sessions.front().analyzer->enableResultStream(path, ResultStreamWriter::defaultSettings().spectrumBins);
+}
+
+bool AudioEngine::startSpectrogramArchive(const QString &path) {
+    const SpectrogramArchiveWriter::Settings settings = SpectrogramArchiveWriter::defaultSettings();
+    return sessions.front().analyzer->enableSpectrogramArchive(path, settings.numBins, settings.bitsPerValue);
+}
+
+bool AudioEngine::startSharedSpectrum(const QString &name) {
+    return sessions.front().analyzer->enableSharedSpectrum(name);
+}
+
+AudioEngine::Session AudioEngine::createSession() {
+    Session session{new AudioInputThread(FRAME_DURATION_MS), new AudioAnalyzerThread(analysisPool), QAudioDeviceInfo(), format};
+
+    // The frames go straight from the input thread to the analyzer thread
+    connect(session.input, &AudioInputThread::dataReady, session.analyzer, &AudioAnalyzerThread::analyze);
+    return session;
 }
 
 void AudioEngine::setAudioInputDevice(size_t index) {
     Q_ASSERT(index < availableAudioInputDevices.size());
 
     // Sets the selected audio input device
-    if (audioInputDevice.deviceName() != availableAudioInputDevices.at(index).deviceName()) {
-        audioInputDevice = availableAudioInputDevices.at(index);
-        initialize();
+    Session &session = sessions.front();
+    if (session.device.deviceName() != availableAudioInputDevices.at(index).deviceName()) {
+        initialize(session, index);
     }
 }
 
-bool AudioEngine::initialize() {
-    audioInputThread->setFormat(format);
-    audioInputThread->setAudioInputDevice(audioInputDevice);
+size_t AudioEngine::addSession(size_t index) {
+    Q_ASSERT(index < availableAudioInputDevices.size());
 
-    AUDIOENGINE_DEBUG << "AudioEngine::initialize" << "device" << audioInputDevice.deviceName();
-    AUDIOENGINE_DEBUG << "AudioEngine::initialize" << "format" << format;
-    AUDIOENGINE_DEBUG << "AudioEngine::initialize" << "notifyIntervalMs" << NOTIFY_INTERVAL_MS;
+    sessions.push_back(createSession());
+    initialize(sessions.back(), index);
+    return sessions.size() - 1;
+}
+
+void AudioEngine::setChannelCount(int channelCount, bool mixdown) {
+    this->channelCount = channelCount;
+    this->mixdown = mixdown;
+}
+
+void AudioEngine::setAnalysisRate(int analysisRate) {
+    this->analysisRate = analysisRate;
+}
+
+void AudioEngine::setOverrunPolicy(Framer::OverrunPolicy policy) {
+    this->overrunPolicy = policy;
+}
+
+QAudioFormat AudioEngine::captureFormat(const QAudioDeviceInfo &device, const QAudioFormat &deviceFormat) const {
+    int channels = channelCount;
+    if (channels <= 0) {
+        const QList<int> counts = device.supportedChannelCounts();
+        channels = counts.isEmpty() ? 1 : *std::max_element(counts.begin(), counts.end());
+    }
+
+    QAudioFormat capture = deviceFormat;
+    capture.setChannelCount(std::min<int>(channels, AudioFrame::MAX_CHANNELS));
+    if (!device.isFormatSupported(capture)) capture = device.nearestFormat(capture);
+
+    // Falls back to the format found when listing the devices, which we know works
+    return util::isFormatConvertible(capture) && capture.channelCount() <= AudioFrame::MAX_CHANNELS ? capture : deviceFormat;
+}
+
+bool AudioEngine::initialize(Session &session, size_t index) {
+    session.device = availableAudioInputDevices.at(index);
+    session.format = captureFormat(session.device, availableAudioInputFormats.at(index));
+
+    session.input->setMixdown(mixdown);
+    session.input->setAnalysisRate(analysisRate);
+    session.input->setOverrunPolicy(overrunPolicy);
+    session.input->setFormat(session.format);
+    session.input->setAudioInputDevice(session.device);
+
+    AUDIOENGINE_DEBUG << "AudioEngine::initialize" << "device" << session.device.deviceName();
+    AUDIOENGINE_DEBUG << "AudioEngine::initialize" << "format" << session.format;
+    AUDIOENGINE_DEBUG << "AudioEngine::initialize" << "analysisRate" << analysisRate;
+    AUDIOENGINE_DEBUG << "AudioEngine::initialize" << "frameDurationMs" << FRAME_DURATION_MS;
 
     return true;
 }
@@ -53,16 +148,10 @@ bool AudioEngine::initialize() {
 /*      PUBLIC SLOTS                                        */
 /************************************************************/
 void AudioEngine::startListening() {
-    audioInputThread->startListening();
+    // Queued behind a device change still being staged by the input thread
+    for (Session &session : sessions) QMetaObject::invokeMethod(session.input, "startListening", Qt::QueuedConnection);
 }
 
 void AudioEngine::stopListening() {
-    audioInputThread->stopListening();
-}
-
-void AudioEngine::receiveAudioData(const std::vector<float> &data){
-    AUDIOENGINE_DEBUG_S << "AudioEngine::receiveAudioData" << "size" << data.size();
-
-    audioAnalyzerThread->calculateLevel(data);
-    audioAnalyzerThread->calculateSpectrum(SAMPLE_RATE, data);
+    for (Session &session : sessions) QMetaObject::invokeMethod(session.input, "stopListening", Qt::QueuedConnection);
 }
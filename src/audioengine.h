@@ -5,41 +5,154 @@
 
 #include "audioanalyzerthread.h"
 #include "audioinputthread.h"
+#include "deviceenumerator.h"
+#include "noteeventserver.h"
+#include "workerpool.h"
 
+/**
+ * Captures and analyzes audio input devices.
+ *
+ * Every device is captured by a session, its own input thread and analyzer thread, so the streams don't wait
+ * for each other. The channels of every session are analyzed on one shared pool of threads, with FFT plans and
+ * note maps shared through PlanCache, so adding a stream only adds its own work. The first session is the one
+ * selected with setAudioInputDevice, the others are added with addSession.
+ */
 class AudioEngine : public QObject
 {
 enum {
-    NOTIFY_INTERVAL_MS = 100, SAMPLE_RATE = 44100, SAMPLE_SIZE = 32
+    FRAME_DURATION_MS = 100, SAMPLE_RATE = 44100, SAMPLE_SIZE = 32
 };
 
 public:
     AudioEngine();
+    ~AudioEngine();
 
     /**
      * @brief Returns the available audio input devices on the system
-     * @return List of devices @see{QAudioDeviceInfo}
+     * @return List of devices @see{QAudioDeviceInfo}, empty until the enumerator emits devicesChanged the first time
      */
     const std::vector<QAudioDeviceInfo>& getAvailableAudioInputDevices() const { return availableAudioInputDevices; }
 
     /**
-     * @brief Returns the audio analyzer thread
+     * @brief Returns the audio analyzer thread of a session
+     * @param session Index of the session, the first one by default
      * @return The analyzer thread
      */
-    const AudioAnalyzerThread* getAudioAnalyzerThread() {return audioAnalyzerThread; }
+    const AudioAnalyzerThread* getAudioAnalyzerThread(size_t session = 0) { return sessions.at(session).analyzer; }
 
     /**
-     * @brief Sets the current audio input device
+     * @brief Sets the current audio input device, the one of the first session
      * @param The index of of the audio input device as returned by QAudioDeviceInfo::availableDevices @see{QAudioDeviceInfo::availableDevices::availableDevices}
      */
     void setAudioInputDevice(size_t index);
 
+    /**
+     * @brief Adds a session capturing and analyzing another audio input device, along with the others
+     * @param index The index of the audio input device in getAvailableAudioInputDevices()
+     * @return The index of the session
+     * @note Listens with the others at the next startListening()
+     */
+    size_t addSession(size_t index);
+
+    /**
+     * @brief Returns the number of sessions, at least the first one
+     */
+    size_t getNumSessions() const { return sessions.size(); }
+
+    /**
+     * @brief Sets the number of channels to capture and analyze
+     * @param channelCount The number of channels, 0 for every channel of the device (up to AudioFrame::MAX_CHANNELS)
+     * @param mixdown True to also analyze the mix of the captured channels
+     * @note Takes effect at the next change of audio input device
+     */
+    void setChannelCount(int channelCount, bool mixdown);
+
+    /**
+     * @brief Sets the sample rate the audio is resampled to before being analyzed
+     * @param analysisRate The sample rate, 0 to analyze at the sample rate of the device
+     * @note Takes effect at the next change of audio input device
+     */
+    void setAnalysisRate(int analysisRate);
+
+    /**
+     * @brief Sets what to do with the samples captured when the analysis lags behind
+     * @param policy The policy @see{Framer::OverrunPolicy}
+     * @note Takes effect at the next change of audio input device
+     */
+    void setOverrunPolicy(Framer::OverrunPolicy policy);
+
+    /**
+     * @brief Returns the audio input thread of a session, for its counters and its samplesLost signal
+     * @param session Index of the session, the first one by default
+     * @return The input thread
+     */
+    const AudioInputThread* getAudioInputThread(size_t session = 0) { return sessions.at(session).input; }
+
+    /**
+     * @brief Returns the enumerator of the audio input devices, for its devicesChanged signal
+     * @return The enumerator
+     */
+    const DeviceEnumerator* getDeviceEnumerator() { return deviceEnumerator; }
+
+    /**
+     * @brief Pushes the note events of the first session to the subscribers of a local socket
+     * @param name Name of the socket @see{NoteEventServer::listen}
+     */
+    void startNoteServer(const QString &name);
+
+    /**
+     * @brief Returns the note event server, nullptr until startNoteServer is called
+     */
+    const NoteEventServer* getNoteServer() const { return noteServer; }
+
+    /**
+     * @brief Writes the results of every channel of the first session to a binary result stream
+     * @param path Path of the file @see{AudioAnalyzerThread::enableResultStream}
+     * @return True if the file could be created
+     * @note Must be called before listening, the file is finished when the engine is destroyed
+     */
+    bool startResultStream(const QString &path);
+
+    /**
+     * @brief Writes the spectra of the displayed channel of the first session to a spectrogram archive
+     * @param path Path of the file @see{AudioAnalyzerThread::enableSpectrogramArchive}
+     * @return True if the file could be created
+     * @note Must be called before listening, the file is finished when the engine is destroyed
+     */
+    bool startSpectrogramArchive(const QString &path);
+
+    /**
+     * @brief Publishes every channel of the first session to a ring in shared memory, for other local processes
+     * @param name Name of the ring @see{AudioAnalyzerThread::enableSharedSpectrum}
+     * @return True if the shared memory could be created
+     * @note Must be called before listening, the ring is closed when the engine is destroyed
+     */
+    bool startSharedSpectrum(const QString &name);
+
 private:
-    AudioInputThread                *audioInputThread;      // The thread for the instance of the audio input class
-    AudioAnalyzerThread             *audioAnalyzerThread;   // The thread for the instance of the audio analyzer class
+    /**
+     * @brief The capture and analysis of one audio input device
+     */
+    struct Session
+    {
+        AudioInputThread            *input;             // The thread for the instance of the audio input class
+        AudioAnalyzerThread         *analyzer;          // The thread for the instance of the audio analyzer class
+        QAudioDeviceInfo            device;             // The audio input device captured
+        QAudioFormat                format;             // Format of the receiving audio data
+    };
 
-    QAudioFormat                    format;                         // Format of the receiving audio data
-    QAudioDeviceInfo                audioInputDevice;               // Currently selected audio input device
+    WorkerPool                      analysisPool;                   // Threads analyzing the channels of every session
+    std::vector<Session>            sessions;                       // The sessions, the first one always exists
+
+    QAudioFormat                    format;                         // Preferred format of the receiving audio data
+    DeviceEnumerator                *deviceEnumerator;              // Lists the devices and their formats off the GUI thread
+    NoteEventServer                 *noteServer;                    // Pushes the note events to local subscribers, nullptr if not started
     std::vector<QAudioDeviceInfo>   availableAudioInputDevices;     // List of available audio input devices
+    std::vector<QAudioFormat>       availableAudioInputFormats;     // Format used for each available audio input device
+    int                             channelCount;                   // Number of channels to capture, 0 for all
+    bool                            mixdown;                        // True to analyze the mix of the captured channels
+    int                             analysisRate;                   // Sample rate to analyze at, 0 for the rate of the device
+    Framer::OverrunPolicy           overrunPolicy;                  // What to do when the analysis lags behind
 
 public slots:
     /**
@@ -51,18 +164,28 @@ public slots:
      * @brief Stops listening on the audio input device
      */
     void stopListening();
-
+private:
     /**
-     * @brief Receives the audio data sent by the instance of AudioInputThread
-     * @param data
+     * @brief Creates the threads of a new session, not capturing any device yet
+     * @return The session
      */
-    void receiveAudioData(const std::vector<float> &data);
-private:
+    Session createSession();
+
     /**
-     * @brief Initializes the audio input device for listening
+     * @brief Initializes the audio input device of a session for listening
+     * @param session The session
+     * @param index The index of the audio input device in availableAudioInputDevices
      * @return True if the initilization was successful
      */
-    bool initialize();
+    bool initialize(Session &session, size_t index);
+
+    /**
+     * @brief Returns the format to capture a device with, for the requested number of channels
+     * @param device The audio input device
+     * @param deviceFormat The format found for the device when listing the devices
+     * @return The format
+     */
+    QAudioFormat captureFormat(const QAudioDeviceInfo &device, const QAudioFormat &deviceFormat) const;
 };
 
 #endif // AUDIOENGINE_H
@@ -0,0 +1,87 @@
+#ifndef AUDIOFRAME_H
+#define AUDIOFRAME_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Times a frame went through each stage of the pipeline, in microseconds of the steady clock
+ * (@see{LatencyStats::nowUs}), 0 for the stages it did not go through
+ */
+struct FrameStamps
+{
+    enum Stage {
+        CAPTURED,           // The newest sample of the frame was captured by the device
+        READ,               // The newest sample of the frame was read from the device
+        FRAMED,             // The frame was built
+        ANALYSIS_STARTED,   // The analysis of the frame started
+        ANALYZED,           // The analysis of the frame ended
+        PUBLISHED,          // The results of the frame were published
+        NUM_STAGES
+    };
+
+    int64_t     us[NUM_STAGES]; // Time of each stage
+};
+
+/**
+ * @brief A frame of samples of every captured channel, as handed from the input thread to the analysis
+ */
+struct AudioFrame
+{
+    enum { MAX_CHANNELS = 16 };
+
+    const float*    data;           // numChannels blocks of numSamples samples, one block per channel
+    size_t          numChannels;    // Number of channels in data, including the mixed down one if any
+    size_t          numSamples;     // Number of samples of each channel
+    int             sampleRate;     // Sample rate of the samples
+    bool            hasMix;         // True if the last channel is the mix of all the others
+    int64_t         timestampUs;    // Time of the frame in microseconds, shared by all its channels
+    uint64_t        sampleOffset;   // Position in the stream of the sample following the frame, at sampleRate
+    FrameStamps     stamps;         // Times the frame went through the stages of the pipeline
+    std::atomic<bool>* inUse;       // Flag of the pool slot holding data, nullptr if the samples are not pooled
+
+    /**
+     * @brief Returns the samples of a channel
+     */
+    const float* channel(size_t index) const { return data + index * numSamples; }
+
+    /**
+     * @brief Hands the samples back to their pool, to be called by the consumer once done with them
+     */
+    void release() const { if (inUse) inUse->store(false, std::memory_order_release); }
+};
+
+/**
+ * @brief Result of the analysis of one channel of a frame
+ */
+struct ChannelResult
+{
+    enum { MAX_NOTES = 6 };
+
+    float       rmsLevel;       // RMS level in range 0.0 - 1.0
+    float       peakLevel;      // Peak level in range 0.0 - 1.0
+    int         note;           // Index of the note in notes::notes, -1 if none
+    float       confidence;     // Confidence of the note in range 0.0 - 1.0
+    float       pitchHz;        // Pitch of the note in Hz from the tracked partials, 0 if none
+    bool        active;         // False if the activity gate took the frame for background noise, only the levels are set
+    bool        onset;          // True if a note starts in the frame, its note then comes from a short window at its end
+    size_t      numNotes;       // Number of notes played together found in the frame, 0 if none are looked for
+    int         notes[MAX_NOTES]; // Index of each of them in notes::notes, the most salient first
+    float       noteConfidences[MAX_NOTES]; // Share of the energy of the spectrum in the harmonics of each of them
+    int         chord;          // Chord they make @see{MultiPitchEstimator::chordRoot}, -1 if none
+};
+
+/**
+ * @brief Results of the analysis of every channel of a frame, published together
+ */
+struct FrameResults
+{
+    int64_t         timestampUs;                            // Time of the frame in microseconds
+    size_t          numChannels;                            // Number of channels analyzed
+    bool            hasMix;                                 // True if the last channel is the mix of all the others
+    FrameStamps     stamps;                                 // Times the frame went through the stages of the pipeline
+    ChannelResult   channels[AudioFrame::MAX_CHANNELS + 1]; // Results of each channel
+};
+
+#endif // AUDIOFRAME_H
@@ -1,16 +1,38 @@
 #include "audioinputthread.h"
 
+#include <algorithm>
+
 #include <QAudioInput>
 
+#include "allocationaudit.h"
+#include "channelanalyzer.h"
+#include "latencystats.h"
+#include "plancache.h"
+#include "tracer.h"
 #include "util.h"
 
-AudioInputThread::AudioInputThread(int notifyIntervalMs)
+AudioInputThread::AudioInputThread(int frameDurationMs)
     :   thread{new QThread}
-    ,   notifyIntervalMs{notifyIntervalMs}
-    ,   numBytesRead{0}
+    ,   frameDurationMs{frameDurationMs}
+    ,   mixdown{false}
+    ,   analysisRate{0}
+    ,   overrunPolicy{Framer::DROP_OLDEST}
     ,   tempBuffer(0)
-    ,   cbuffer(0)
-    ,   first_half{}
+    ,   framer{}
+    ,   audioInput{nullptr}
+    ,   audioInputIODevice{nullptr}
+    ,   stagedBuffer(0)
+    ,   stagedFramer{}
+    ,   stagedInput{nullptr}
+    ,   retiredFramers{}
+    ,   numFrames{0}
+    ,   streamEpochUs{0}
+    ,   lastReadUs{0}
+    ,   framesAtNotify{0}
+    ,   deviceOverruns{0}
+    ,   underruns{0}
+    ,   numSamplesLost{0}
+    ,   droppedSeen{0}
 {
     moveToThread(thread);
     thread->start();
@@ -23,9 +45,13 @@ AudioInputThread::~AudioInputThread() {
 void AudioInputThread::setAudioInputDevice(const QAudioDeviceInfo &audioInputDevice)
 {
     // Sets the selected audio input device
-    if (audioInputDevice.deviceName() != this->audioInputDevice.deviceName()) {
+    if (audioInputDevice.deviceName() != this->audioInputDevice.deviceName() || format != deviceFormat) {
         this->audioInputDevice = audioInputDevice;
-        initialize();
+        deviceFormat = format;
+
+        // Built on the thread of the capture, after whatever it is doing, while the current device keeps capturing
+        const QAudioFormat requested = format;
+        QMetaObject::invokeMethod(this, [this, audioInputDevice, requested]() { stage(audioInputDevice, requested); }, Qt::QueuedConnection);
     }
 }
 
@@ -34,37 +60,105 @@ void AudioInputThread::setFormat(const QAudioFormat &format)
     this->format = format;
 }
 
-bool AudioInputThread::initialize() {
-    audioInput = new QAudioInput(audioInputDevice, format, this);
-    audioInput->setNotifyInterval(notifyIntervalMs);
+bool AudioInputThread::stage(const QAudioDeviceInfo &device, const QAudioFormat &format) {
+    TRACE_SCOPE("stage");
+
+    // A newer request replaces the one not swapped in yet
+    if (stagedInput) stagedInput->deleteLater();
+    stagedInput = nullptr;
+    stagedFramer.reset();
 
-    bufferLength = util::bufferLength(format, notifyIntervalMs);
-    tempBuffer.resize(bufferLength);
-    cbuffer.set_capacity(bufferLength * 2);
-    first_half.resize(bufferLength / 2);
-    std::fill(first_half.begin(), first_half.end(), 0);
+    // The raw data of a read is at most the data of a frame at the rate of the device, a read may take several
+    const size_t bytesPerFrame = static_cast<size_t>(format.bytesPerFrame());
+    const size_t bufferLength = util::bufferLength(format, frameDurationMs) / bytesPerFrame * bytesPerFrame;
+
+    // Everything a frame needs is allocated here, none of it while listening
+    std::unique_ptr<Framer> staged(new Framer);
+    staged->setMixdown(mixdown);
+    staged->setAnalysisRate(analysisRate);
+    staged->setOverrunPolicy(overrunPolicy);
+    if (!staged->configure(util::sampleFormat(format), format.sampleRate(), frameDurationMs, bufferLength / bytesPerFrame)) {
+        AUDIOINPUT_DEBUG << "AudioInputThread::stage" << "Unsupported format" << format;
+        return false;
+    }
 
-    AUDIOINPUT_DEBUG_S << "AudioInputThread::initialize" << "bufferLength" << bufferLength;
+    // The analysis of the first frame would plan the FFT of the new frame size (at the default transform sizing), it is done now instead
+    PlanCache::shared().getPlan(ChannelAnalyzer::transformSize(staged->getFrameSize()));
+    PlanCache::shared().getNoteMap(ChannelAnalyzer::transformSize(staged->getFrameSize()), staged->getFrameRate());
+    PlanCache::shared().getPlan(ChannelAnalyzer::shortWindowSize(staged->getFrameSize()));
+    PlanCache::shared().getNoteMap(ChannelAnalyzer::shortWindowSize(staged->getFrameSize()), staged->getFrameRate());
 
+    stagedInput = new QAudioInput(device, format, this);
+    // The frames are emitted as soon as their samples are read, the notifications only check the device keeps up
+    stagedInput->setNotifyInterval(frameDurationMs);
+    stagedBuffer.assign(bufferLength, 0);
+    stagedFramer = std::move(staged);
+
+    AUDIOINPUT_DEBUG_S << "AudioInputThread::stage" << "bufferLength" << bufferLength << "outputs" << stagedFramer->getNumOutputs()
+                       << "deviceRate" << format.sampleRate() << "frameRate" << stagedFramer->getFrameRate();
+
+    // While listening, the swap waits for the frames of the current read to be out
+    if (!audioInputIODevice) swap();
     return true;
 }
 
-void AudioInputThread::startListening() {
-    if (audioInput) {
-        bufferPosition = 0;
-        connect(audioInput, &QAudioInput::stateChanged, this, &AudioInputThread::audioStateChanged);
-        connect(audioInput, &QAudioInput::notify,  this, &AudioInputThread::audioNotify);
+void AudioInputThread::swap() {
+    TRACE_SCOPE("swap");
+    const bool listening = audioInputIODevice != nullptr;
+    if (listening) stopDevice();
+
+    // The swap may happen in a signal of the old audio input
+    if (audioInput) audioInput->deleteLater();
+    audioInput = stagedInput;
+    stagedInput = nullptr;
 
-        audioInputIODevice = audioInput->start();
-        connect(audioInputIODevice, &QIODevice::readyRead, this, &AudioInputThread::audioDataReady);
+    // The analysis may still hold frames of the old framer, it is kept until they are released
+    retiredFramers.erase(std::remove_if(retiredFramers.begin(), retiredFramers.end(), [](const std::unique_ptr<Framer> &retired) {
+        return !retired->hasFramesInUse();
+    }), retiredFramers.end());
+    if (framer && framer->hasFramesInUse()) retiredFramers.push_back(std::move(framer));
+    framer = std::move(stagedFramer);
+    droppedSeen = 0;
+    tempBuffer.swap(stagedBuffer);
+    stagedBuffer = std::vector<char>();
+
+    if (listening) startDevice();
+}
+
+void AudioInputThread::startListening() {
+    if (audioInput && !audioInputIODevice) {
+        numFrames = 0;
+        framesAtNotify = 0;
+        deviceOverruns.store(0, std::memory_order_relaxed);
+        underruns.store(0, std::memory_order_relaxed);
+        numSamplesLost.store(0, std::memory_order_relaxed);
+        droppedSeen = framer->getStats().samplesDropped;
+        startDevice();
     }
 }
 
 void AudioInputThread::stopListening() {
+    if (audioInputIODevice) stopDevice();
+
+    // Nothing to wait for anymore
+    if (stagedFramer) swap();
+}
+
+void AudioInputThread::startDevice() {
+    streamEpochUs = 0;
+    lastReadUs = 0;
+    framer->reset();
+    connect(audioInput, &QAudioInput::stateChanged, this, &AudioInputThread::audioStateChanged);
+    connect(audioInput, &QAudioInput::notify,  this, &AudioInputThread::audioNotify);
+
+    audioInputIODevice = audioInput->start();
+    connect(audioInputIODevice, &QIODevice::readyRead, this, &AudioInputThread::audioDataReady);
+}
+
+void AudioInputThread::stopDevice() {
     audioInput->stop();
     audioInput->disconnect();
     audioInputIODevice = nullptr;
-    bufferPosition = 0;
 }
 
 
@@ -73,23 +167,52 @@ void AudioInputThread::stopListening() {
 /************************************************************/
 void AudioInputThread::audioNotify()
 {
-    // If we have gathered sampleRate / notifyInterval samples, emit data ready for analysis
-    if (cbuffer.size() >= bufferLength) {
-        // Converts the circular buffer of char to a vector of float (sample type)
-        // TODO: Don't hardcode the type, do it based on audio format
-        AUDIOINPUT_DEBUG_S << "bufferLength" << bufferLength << "cbuffer.size()" << cbuffer.size();
+    TRACE_THREAD_NAME("capture");
+    TRACE_SCOPE("audioNotify");
 
-        std::vector<char> data = util::overlap(first_half, cbuffer, bufferLength);
-        emit dataReady(util::charToFloatVector(data, bufferLength));
+    // A frame duration of audio went by without a frame, either the device is late or the analysis holds every frame
+    if (numFrames == framesAtNotify) underruns.fetch_add(1, std::memory_order_relaxed);
+    framesAtNotify = numFrames;
+}
 
-        // Keep last half of current set of samples which will become first half of next set of samples
-        std::copy(cbuffer.begin() + bufferLength / 2, cbuffer.begin() + static_cast<int>(bufferLength), first_half.begin());
+void AudioInputThread::emitFrames()
+{
+    AudioFrame frame;
+    const int64_t nowUs = LatencyStats::nowUs();
+    while (framer->pop(nowUs, frame)) {
+        // The position of the frame in the stream gives the time its newest sample was captured
+        if (streamEpochUs != 0) {
+            frame.stamps.us[FrameStamps::CAPTURED] = streamEpochUs + static_cast<int64_t>(frame.sampleOffset * 1000000 / static_cast<uint64_t>(frame.sampleRate));
+            frame.timestampUs = frame.stamps.us[FrameStamps::CAPTURED];
+        }
+        frame.stamps.us[FrameStamps::READ] = lastReadUs;
+        frame.stamps.us[FrameStamps::FRAMED] = nowUs;
+        TRACE_FLOW_BEGIN("frame", frame.sampleOffset);
 
-        // Changes the position of begin()
-        cbuffer.erase(cbuffer.begin(), cbuffer.begin() + static_cast<int>(bufferLength));
+        {
+            allocationaudit::ScopedAllow allow;
+            emit dataReady(frame);
+        }
+
+        if (++numFrames == WARMUP_FRAMES) allocationaudit::armThread("capture");
     }
 }
 
+void AudioInputThread::checkSamplesLost()
+{
+    const uint64_t dropped = framer->getStats().samplesDropped;
+    if (dropped == droppedSeen) return;
+
+    const uint64_t count = dropped - droppedSeen;
+    const uint64_t total = numSamplesLost.load(std::memory_order_relaxed) + count;
+    droppedSeen = dropped;
+    numSamplesLost.store(total, std::memory_order_relaxed);
+    AUDIOINPUT_DEBUG << "AudioInputThread::checkSamplesLost" << "lost" << count << "total" << total;
+
+    allocationaudit::ScopedAllow allow;
+    emit samplesLost(count, total);
+}
+
 void AudioInputThread::audioStateChanged(QAudio::State state)
 {
     AUDIOINPUT_DEBUG_S << "Engine::audioStateChanged" << "state" << state;
@@ -112,10 +235,40 @@ void AudioInputThread::audioStateChanged(QAudio::State state)
  */
 void AudioInputThread::audioDataReady()
 {
+    TRACE_THREAD_NAME("capture");
+    TRACE_SCOPE("audioDataReady");
+
+    // A full buffer means the device may have had to drop what it captured since
     size_t bytesReady = static_cast<size_t>(audioInput->bytesReady());
-    size_t bytesToBeRead = std::min(bytesReady, tempBuffer.size());
+    if (bytesReady > 0 && bytesReady >= static_cast<size_t>(audioInput->bufferSize())) deviceOverruns.fetch_add(1, std::memory_order_relaxed);
+
+    /*
+     * Drains the device, whatever is left would only add to the latency of the next read (or overflow).
+     * Every frame is emitted as soon as its samples are pushed, when the device delivers several frames at
+     * once they go out in a row to catch up
+     */
+    while (bytesReady > 0) {
+        const size_t bytesToBeRead = std::min(bytesReady, tempBuffer.size());
+        const long long bytesRead = audioInputIODevice->read(tempBuffer.data(), static_cast<long long>(bytesToBeRead));
+        AUDIOINPUT_DEBUG << "bytesRead" << bytesRead;
+        if (bytesRead <= 0) break;
+
+        /*
+         * processedUSecs is the duration of the audio captured so far, so the stream started at the latest
+         * processedUSecs before now. The smallest such estimate is the closest to when it actually started,
+         * the others include the time the data waited to be delivered
+         */
+        lastReadUs = LatencyStats::nowUs();
+        const int64_t epochUs = lastReadUs - audioInput->processedUSecs();
+        if (streamEpochUs == 0 || epochUs < streamEpochUs) streamEpochUs = epochUs;
+
+        framer->push(tempBuffer.data(), static_cast<size_t>(bytesRead));
+        emitFrames();
+        bytesReady = static_cast<size_t>(audioInput->bytesReady());
+    }
+
+    checkSamplesLost();
 
-    const long long bytesRead = audioInputIODevice->read(reinterpret_cast<char*>(tempBuffer.data()), static_cast<long long>(bytesToBeRead));
-    cbuffer.insert(cbuffer.end(), tempBuffer.begin(), tempBuffer.begin() + bytesRead);
-    AUDIOINPUT_DEBUG << "bytesRead" << bytesRead;
+    // Every complete frame of the current device is out, a staged device can take over
+    if (stagedFramer) swap();
 }
@@ -1,14 +1,20 @@
 #ifndef AUDIOINPUTTHREAD_H
 #define AUDIOINPUTTHREAD_H
 
+#include <atomic>
+#include <memory>
 #include <vector>
 
 #include <QAudioDeviceInfo>
 #include <QAudioFormat>
 #include <QIODevice>
+#include <QMetaType>
 #include <QThread>
 
-#include <boost/circular_buffer.hpp>
+#include "audioframe.h"
+#include "framer.h"
+
+Q_DECLARE_METATYPE(AudioFrame)
 
 QT_BEGIN_NAMESPACE
     class QAudioInput;
@@ -17,12 +23,24 @@ QT_END_NAMESPACE
 class AudioInputThread : public QObject
 {
     Q_OBJECT
+
+enum {
+    WARMUP_FRAMES = 10
+};
+
 public:
-    AudioInputThread(int notifyIntervalMs);
+    /**
+     * @param frameDurationMs The duration of the new samples of a frame in ms, a frame is emitted as soon as they are read
+     */
+    AudioInputThread(int frameDurationMs);
     ~AudioInputThread();
 
     /**
-     * @brief Sets the current audio input device
+     * @brief Sets the current audio input device, with the format set by setFormat
+     *
+     * The pipeline of the new device (its audio input, framing and FFT plan) is built on the thread of the
+     * capture while the current device keeps capturing, then swapped in between two frames.
+     *
      * @param audioInputDevice The audio input device to set
      */
     void setAudioInputDevice(const QAudioDeviceInfo &audioInputDevice);
@@ -30,35 +48,119 @@ public:
     /**
      * @brief Sets the audio format for the input device
      * @param format The audio input device format to set
+     * @note Takes effect at the next setAudioInputDevice, even for the same device
      */
     void setFormat(const QAudioFormat &format);
 
+    /**
+     * @brief Sets whether the frames get an extra channel, the mix of all the captured ones
+     * @param mixdown True to add the mixed down channel (only when capturing more than one channel)
+     * @note Must be called before setting the audio input device
+     */
+    void setMixdown(bool mixdown) { this->mixdown = mixdown; }
+
+    /**
+     * @brief Sets the sample rate the frames are resampled to before analysis
+     * @param analysisRate The sample rate, 0 to analyze at the sample rate of the device
+     * @note Must be called before setting the audio input device
+     */
+    void setAnalysisRate(int analysisRate) { this->analysisRate = analysisRate; }
+
+    /**
+     * @brief Sets what to do with the samples captured when the analysis lags behind
+     * @param policy The policy, Framer::DROP_OLDEST by default
+     * @note Must be called before setting the audio input device
+     */
+    void setOverrunPolicy(Framer::OverrunPolicy policy) { this->overrunPolicy = policy; }
+
+    /**
+     * @brief Returns the number of times the buffer of the device was found full, data may have been lost, safe to query from any thread
+     */
+    uint64_t getDeviceOverruns() const { return deviceOverruns.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Returns the number of frame durations that went by without a frame emitted, safe to query from any thread
+     */
+    uint64_t getUnderruns() const { return underruns.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Returns the number of samples (of each channel, at the frame rate) dropped since listening, safe to query from any thread
+     */
+    uint64_t getSamplesLost() const { return numSamplesLost.load(std::memory_order_relaxed); }
+
 private:
     QThread*                        thread;             // The thread it will be running on
 
-    int                             notifyIntervalMs;   // The interval in ms we want to process the raw data
-    size_t                          numBytesRead;       // The number of bytes read since analysis
-    size_t                          bufferLength;       // The length of the buffer
-    size_t                          bufferPosition;     // The position in which to insert newly received data
-
-    std::vector<char>               tempBuffer;         // Temp buffer for storing the raw data coming from audio device
-    boost::circular_buffer<char>    cbuffer;            // Circular buffer container the fetched raw datas
+    int                             frameDurationMs;    // The duration of the new samples of a frame, also the interval of the starvation check
+    bool                            mixdown;            // True to add the mix of the captured channels to the frames
+    int                             analysisRate;       // Sample rate of the frames, 0 for the rate of the device
+    Framer::OverrunPolicy           overrunPolicy;      // What to do when the analysis lags behind
 
-    QAudioFormat                    format;             // Format of the receiving audio data
+    // Requested by the caller's thread
+    QAudioFormat                    format;             // Format to capture the next device with
     QAudioDeviceInfo                audioInputDevice;   // Currently selected audio input device
+    QAudioFormat                    deviceFormat;       // Format the selected device was requested with
+
+    // The pipeline capturing, only used by the thread of the capture
+    std::vector<char>               tempBuffer;         // Temp buffer for storing the raw data coming from audio device
+    std::unique_ptr<Framer>         framer;             // Turns the raw data into frames
     QAudioInput*                    audioInput;         // Interface for receiving audio data
-    QIODevice*                      audioInputIODevice; // Interface receiving audio data (returned by audioInput->start())
-    std::vector<char>               first_half;
+    QIODevice*                      audioInputIODevice; // Interface receiving audio data (returned by audioInput->start()), nullptr when not listening
+
+    // The pipeline of the next device, ready to be swapped in
+    std::vector<char>               stagedBuffer;       // Temp buffer sized for the next device
+    std::unique_ptr<Framer>         stagedFramer;       // Framer configured for the next device, nullptr if none is staged
+    QAudioInput*                    stagedInput;        // Audio input of the next device
+
+    std::vector<std::unique_ptr<Framer>> retiredFramers; // Framers of previous devices whose frames are still being analyzed
+
+    size_t                          numFrames;          // Number of frames emitted since listening
+    int64_t                         streamEpochUs;      // Time (steady clock) the first sample of the stream was captured, 0 if unknown
+    int64_t                         lastReadUs;         // Time (steady clock) of the last read from the device
+    size_t                          framesAtNotify;     // Value of numFrames at the last notification
+
+    std::atomic<uint64_t>           deviceOverruns;     // Number of reads that found the buffer of the device full
+    std::atomic<uint64_t>           underruns;          // Number of notifications without a frame emitted since the previous one
+    std::atomic<uint64_t>           numSamplesLost;     // Number of samples dropped by the framer since listening
+    uint64_t                        droppedSeen;        // Samples dropped by the current framer already counted in numSamplesLost
+
+    /**
+     * @brief Emits samplesLost if the framer dropped samples since the last check
+     */
+    void checkSamplesLost();
+
+    /**
+     * @brief Emits every frame complete in the framer, in a row when catching up
+     */
+    void emitFrames();
 private:
     /**
-     * @brief Initializes the audio input device for listening
-     * @return True if the initilization was successful
+     * @brief Builds the pipeline of a device (audio input, framing, FFT plan) next to the one capturing, and
+     * swaps it in right away if not listening. To be called on the thread of the capture
+     * @param device The audio input device
+     * @param format The format to capture it with
+     * @return True if the format can be framed
      */
-    bool initialize();
+    bool stage(const QAudioDeviceInfo &device, const QAudioFormat &format);
+
+    /**
+     * @brief Replaces the pipeline capturing with the staged one, between two frames
+     */
+    void swap();
+
+    /**
+     * @brief Starts the audio input of the current pipeline, at the start of a new stream
+     */
+    void startDevice();
+
+    /**
+     * @brief Stops the audio input of the current pipeline
+     */
+    void stopDevice();
 
 private slots:
     /**
-     * @brief To be called when receiving a certain timeframe of data (NOTIFY_INTERVAL_MS)
+     * @brief To be called every frameDurationMs of audio captured, counts an underrun if no frame was emitted since the previous call
      */
     void audioNotify();
 
@@ -87,11 +189,17 @@ public slots:
 signals:
 
     /**
-     * @brief Signal for audio frequencies change
-     * @param frequencies The frequencies and their value
-     * @param numSamples Number of audio samples analyzed
+     * @brief Signal for a new frame of samples ready for analysis
+     * @param frame The frame, the receiver must call frame.release() once done with its samples
+     */
+    void dataReady(const AudioFrame &frame);
+
+    /**
+     * @brief Signal for samples dropped because the analysis lags behind (according to the overrun policy)
+     * @param count The number of samples of each channel just dropped, at the frame rate
+     * @param total The number of samples of each channel dropped since listening
      */
-    void dataReady(const std::vector<float> &data);
+    void samplesLost(quint64 count, quint64 total);
 };
 
 #endif // AUDIOINPUTTHREAD_H
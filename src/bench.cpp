@@ -0,0 +1,956 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "channelanalyzer.h"
+#include "frameanalyzer.h"
+#include "framer.h"
+#include "notes.h"
+#include "pitchestimators.h"
+#include "resampler.h"
+#include "sampleconverter.h"
+#include "sharedspectrum.h"
+#include "spectrogramarchive.h"
+#include "spectrumquantizer.h"
+
+/*
+ * Micro-benchmarks of the hot kernels of the core, on synthetic input so they run anywhere.
+ *
+ * Every benchmark is run in batches long enough to be timed reliably, the best batch of a few is kept
+ * (the least disturbed by the rest of the machine). The results can be printed as a table, or as CSV or
+ * JSON lines to be diffed between builds.
+ *
+ * With --check, the kernels are checked instead of timed: the pitch estimators on synthetic tones, the
+ * spectrogram archive written and read back, and the shared memory ring read while it is published. The exit
+ * status is 1 if an estimator is confident in a wrong note or if a file or the ring doesn't read back what was
+ * written.
+ */
+namespace {
+    struct Options
+    {
+        std::string     output;     // table, csv or json
+        std::string     filter;     // Only run the benchmarks whose name contains it
+        double          minTimeMs;  // Minimum duration of a batch
+        int             repeats;    // Number of batches, the best one is kept
+        bool            check;      // Check the kernels instead of timing
+    };
+
+    struct Result
+    {
+        std::string     name;       // Name of the benchmark, with its parameters
+        double          nsPerOp;    // Time of an operation (a frame, a block) in ns
+        double          samples;    // Number of samples processed by an operation
+        double          bytes;      // Number of bytes read by an operation
+        size_t          iterations; // Number of operations of the best batch
+    };
+
+    struct Format
+    {
+        const char*     name;
+        SampleFormat    format;
+    };
+
+    const Format FORMATS[] = {
+        {"u8",    {SampleFormat::UnsignedInt, SampleFormat::LittleEndian, 8, 1}},
+        {"s16le", {SampleFormat::SignedInt, SampleFormat::LittleEndian, 16, 1}},
+        {"s16be", {SampleFormat::SignedInt, SampleFormat::BigEndian, 16, 1}},
+        {"s24le", {SampleFormat::SignedInt, SampleFormat::LittleEndian, 24, 1}},
+        {"s32le", {SampleFormat::SignedInt, SampleFormat::LittleEndian, 32, 1}},
+        {"f32le", {SampleFormat::Float, SampleFormat::LittleEndian, 32, 1}},
+        {"f32be", {SampleFormat::Float, SampleFormat::BigEndian, 32, 1}},
+        {"f64le", {SampleFormat::Float, SampleFormat::LittleEndian, 64, 1}},
+    };
+
+    const int CHANNEL_COUNTS[] = {1, 2, 8};
+
+    // Powers of two and the sizes of 100 ms frames at the common rates
+    const size_t FFT_SIZES[] = {512, 1024, 2048, 4096, 4410, 4800, 8192, 16384};
+
+    const int SAMPLE_RATE = 44100;
+
+    // The window configurations of the analysis: the rates of the devices and the frame durations
+    const int WINDOW_RATES[] = {22050, 44100, 48000, 96000};
+    const int WINDOW_MS[] = {20, 50, 100};
+
+    /*
+     * The transform sizings compared for each window configuration
+     */
+    struct Sizing
+    {
+        const char*                         name;
+        ChannelAnalyzer::TransformSizing    sizing;
+        bool                                powersOfTwo;
+    };
+
+    const Sizing SIZINGS[] = {
+        {"exact",       ChannelAnalyzer::EXACT_SIZE,  false},
+        {"pad",         ChannelAnalyzer::ZERO_PAD,    false},
+        {"interpolate", ChannelAnalyzer::INTERPOLATE, false},
+        {"pad-pow2",    ChannelAnalyzer::ZERO_PAD,    true},
+    };
+
+    const size_t NUM_SIZINGS = sizeof(SIZINGS) / sizeof(SIZINGS[0]);
+
+    // The tones the pitch estimators are checked on: the low and high strings of a guitar, and the notes between
+    // whose harmonics or subharmonics fall on a boundary of the ranges of the estimators
+    const double CHECK_PITCHES[] = {82.41, 110.0, 196.0, 440.0, 1318.51};
+    const int CHECK_RATES[] = {44100, 48000};
+
+    // A sinusoid alone, and a tone with the harmonics of a string
+    const int CHECK_HARMONICS[] = {1, 5};
+
+    // An estimate of a wrong note at least this confident fails the check, a less confident one is outvoted
+    const float CHECK_CONFIDENCE = 0.5f;
+
+    /*
+     * The spectrum of a window configuration at every sizing, for the table of the speedups
+     */
+    struct WindowResult
+    {
+        int         rate;                       // Sample rate of the frames
+        int         frameMs;                    // Duration of the frames
+        size_t      frameSize;                  // Number of samples of the frames
+        size_t      sizes[NUM_SIZINGS];         // Size of the transform of each sizing
+        double      nsPerOp[NUM_SIZINGS];       // Time of the spectrum of a frame at each sizing, 0 if not run
+    };
+
+    // Keeps the compiler from optimizing away the results
+    volatile double sink;
+
+    /*
+     * Times op in batches and keeps the best batch
+     */
+    Result measure(const Options &options, const std::string &name, double samples, double bytes, const std::function<void()> &op)
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        // Warm-up, also sizes the first batch
+        size_t iterations = 1;
+        for (;;) {
+            const Clock::time_point start = Clock::now();
+            for (size_t i = 0; i < iterations; ++i) op();
+            const double elapsedMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            if (elapsedMs >= options.minTimeMs / 4) {
+                iterations = std::max<size_t>(1, static_cast<size_t>(iterations * options.minTimeMs / std::max(elapsedMs, 1e-3)));
+                break;
+            }
+            iterations *= 4;
+        }
+
+        double best = 0.0;
+        for (int r = 0; r < options.repeats; ++r) {
+            const Clock::time_point start = Clock::now();
+            for (size_t i = 0; i < iterations; ++i) op();
+            const double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(iterations);
+            if (r == 0 || ns < best) best = ns;
+        }
+
+        return Result{name, best, samples, bytes, iterations};
+    }
+
+    /*
+     * Raw samples of a format holding a chord, so the spectrum and note are realistic
+     */
+    std::vector<char> synthesize(const SampleFormat &format, size_t numFrames)
+    {
+        std::vector<float> samples(numFrames * static_cast<size_t>(format.channelCount));
+        for (size_t i = 0; i < numFrames; ++i) {
+            const double t = static_cast<double>(i) / SAMPLE_RATE;
+            const double value = 0.4 * std::sin(2 * M_PI * 440.0 * t) + 0.2 * std::sin(2 * M_PI * 554.37 * t) + 0.1 * std::sin(2 * M_PI * 659.26 * t);
+            for (int c = 0; c < format.channelCount; ++c) samples[i * static_cast<size_t>(format.channelCount) + static_cast<size_t>(c)] = static_cast<float>(value);
+        }
+
+        // Encodes the floats in the format, as a device would
+        std::vector<char> raw(numFrames * format.bytesPerFrame());
+        const size_t bytesPerSample = format.bytesPerSample();
+        for (size_t i = 0; i < samples.size(); ++i) {
+            unsigned char bytes[8] = {};
+            if (format.type == SampleFormat::Float && format.sampleSize == 32) {
+                const float value = samples[i];
+                std::memcpy(bytes, &value, 4);
+            }
+            else if (format.type == SampleFormat::Float) {
+                const double value = samples[i];
+                std::memcpy(bytes, &value, 8);
+            }
+            else {
+                const int bits = format.sampleSize;
+                int64_t value = static_cast<int64_t>(std::lround(samples[i] * std::ldexp(1.0, bits - 1)));
+                value = std::min<int64_t>(value, (int64_t(1) << (bits - 1)) - 1);
+                if (format.type == SampleFormat::UnsignedInt) value += int64_t(1) << (bits - 1);
+                for (size_t b = 0; b < bytesPerSample; ++b) bytes[b] = static_cast<unsigned char>(value >> (8 * b));
+            }
+            if (format.byteOrder == SampleFormat::BigEndian) std::reverse(bytes, bytes + bytesPerSample);
+            std::memcpy(raw.data() + i * bytesPerSample, bytes, bytesPerSample);
+        }
+        return raw;
+    }
+
+    bool selected(const Options &options, const std::string &name)
+    {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    }
+
+    void benchConversion(const Options &options, std::vector<Result> &results)
+    {
+        const size_t numFrames = 4096;
+
+        for (const Format &entry : FORMATS) {
+            for (int channels : CHANNEL_COUNTS) {
+                SampleFormat format = entry.format;
+                format.channelCount = channels;
+                const std::vector<char> raw = synthesize(format, numFrames);
+                std::vector<float> out(numFrames * static_cast<size_t>(channels));
+                std::vector<float*> planes(static_cast<size_t>(channels));
+                for (size_t c = 0; c < planes.size(); ++c) planes[c] = out.data() + c * numFrames;
+
+                SampleConverter converter;
+                converter.setFormat(format);
+                const std::string suffix = std::string("/") + entry.name + "/ch" + std::to_string(channels);
+                const double samples = static_cast<double>(numFrames) * channels;
+
+                if (selected(options, "deinterleave" + suffix)) {
+                    results.push_back(measure(options, "deinterleave" + suffix, samples, static_cast<double>(raw.size()), [&]() {
+                        converter.deinterleave(raw.data(), numFrames, planes.data());
+                        sink = out[0];
+                    }));
+                }
+                if (selected(options, "downmix" + suffix)) {
+                    results.push_back(measure(options, "downmix" + suffix, samples, static_cast<double>(raw.size()), [&]() {
+                        converter.downmix(raw.data(), numFrames, out.data());
+                        sink = out[0];
+                    }));
+                }
+            }
+        }
+    }
+
+    void benchFraming(const Options &options, std::vector<Result> &results)
+    {
+        const int frameMs = 100;
+        const size_t hop = static_cast<size_t>(SAMPLE_RATE * frameMs / 1000);
+
+        for (const Format &entry : FORMATS) {
+            for (int channels : CHANNEL_COUNTS) {
+                const std::string name = std::string("framing/") + entry.name + "/ch" + std::to_string(channels);
+                if (!selected(options, name)) continue;
+
+                SampleFormat format = entry.format;
+                format.channelCount = channels;
+                const std::vector<char> raw = synthesize(format, hop);
+
+                // A frame worth of raw data pushed, then the frame (with its overlap) popped
+                Framer framer;
+                framer.configure(format, SAMPLE_RATE, frameMs, hop);
+                results.push_back(measure(options, name, static_cast<double>(hop) * channels, static_cast<double>(raw.size()), [&]() {
+                    AudioFrame frame;
+                    framer.push(raw.data(), raw.size());
+                    while (framer.pop(0, frame)) {
+                        sink = frame.data[0];
+                        frame.release();
+                    }
+                }));
+            }
+        }
+    }
+
+    void benchResampling(const Options &options, std::vector<Result> &results)
+    {
+        const int RATES[][2] = {{48000, 44100}, {44100, 48000}, {96000, 44100}, {22050, 44100}};
+        const size_t block = 4096;
+
+        for (const auto &rates : RATES) {
+            const std::string name = "resample/" + std::to_string(rates[0]) + "-" + std::to_string(rates[1]);
+            if (!selected(options, name)) continue;
+
+            std::vector<float> in(block);
+            for (size_t i = 0; i < block; ++i) in[i] = static_cast<float>(std::sin(2 * M_PI * 440.0 * static_cast<double>(i) / rates[0]));
+
+            Resampler resampler;
+            resampler.configure(rates[0], rates[1], block);
+            std::vector<float> out(resampler.maxOutput(block));
+            results.push_back(measure(options, name, static_cast<double>(block), static_cast<double>(block * sizeof(float)), [&]() {
+                sink = resampler.process(in.data(), block, out.data());
+            }));
+        }
+    }
+
+    void benchAnalysis(const Options &options, std::vector<Result> &results)
+    {
+        SampleFormat format{SampleFormat::Float, SampleFormat::LittleEndian, 32, 1};
+
+        for (size_t size : FFT_SIZES) {
+            const std::vector<char> raw = synthesize(format, size);
+            const float *data = reinterpret_cast<const float*>(raw.data());
+            const std::string suffix = "/n" + std::to_string(size);
+            const double samples = static_cast<double>(size);
+            const double bytes = static_cast<double>(size * sizeof(float));
+
+            ChannelAnalyzer analyzer;
+            analyzer.analyze(data, size, SAMPLE_RATE);
+
+            if (selected(options, "level" + suffix)) {
+                results.push_back(measure(options, "level" + suffix, samples, bytes, [&]() {
+                    analyzer.calculateLevel(data, size);
+                    sink = analyzer.getResult().rmsLevel;
+                }));
+            }
+            if (selected(options, "spectrum" + suffix)) {
+                results.push_back(measure(options, "spectrum" + suffix, samples, bytes, [&]() {
+                    analyzer.calculateSpectrum(data, size);
+                    sink = analyzer.getSpectrum()[1];
+                }));
+            }
+            if (selected(options, "note" + suffix)) {
+                results.push_back(measure(options, "note" + suffix, samples, bytes, [&]() {
+                    analyzer.calculateNote(SAMPLE_RATE);
+                    sink = analyzer.getResult().note;
+                }));
+            }
+            if (selected(options, "notes" + suffix)) {
+                results.push_back(measure(options, "notes" + suffix, samples, bytes, [&]() {
+                    analyzer.calculateNotes(SAMPLE_RATE);
+                    sink = analyzer.getResult().numNotes;
+                }));
+            }
+            if (selected(options, "partials" + suffix)) {
+                results.push_back(measure(options, "partials" + suffix, samples, bytes, [&]() {
+                    analyzer.calculatePartials(size, SAMPLE_RATE);
+                    sink = analyzer.getResult().pitchHz;
+                }));
+            }
+
+            // The estimators voting for the note, alone and all of them fused
+            PitchEstimators estimators;
+            const size_t spectrumSize = analyzer.getSpectrumSize();
+            const int spectrumRate = analyzer.getSpectrumRate(SAMPLE_RATE);
+            if (selected(options, "hps" + suffix)) {
+                results.push_back(measure(options, "hps" + suffix, samples, bytes, [&]() {
+                    sink = estimators.harmonicProduct(analyzer.getSpectrum(), spectrumSize, spectrumRate).frequency;
+                }));
+            }
+            if (selected(options, "cepstrum" + suffix)) {
+                results.push_back(measure(options, "cepstrum" + suffix, samples, bytes, [&]() {
+                    sink = estimators.cepstrum(analyzer.getSpectrum(), spectrumSize, spectrumRate).frequency;
+                }));
+            }
+            if (selected(options, "pitch" + suffix)) {
+                analyzer.setPitchEstimators(PitchEstimators::ALL_ESTIMATORS);
+                analyzer.analyze(data, size, SAMPLE_RATE);
+                results.push_back(measure(options, "pitch" + suffix, samples, bytes, [&]() {
+                    analyzer.calculatePitch(SAMPLE_RATE);
+                    sink = analyzer.getResult().pitchHz;
+                }));
+            }
+        }
+
+        // Every channel of a frame on the pool, as the analysis thread does it
+        for (int channels : CHANNEL_COUNTS) {
+            const size_t size = 4410;
+            const std::string name = "frame/n" + std::to_string(size) + "/ch" + std::to_string(channels);
+            if (!selected(options, name)) continue;
+
+            std::vector<float> data(size * static_cast<size_t>(channels));
+            for (size_t i = 0; i < data.size(); ++i) data[i] = static_cast<float>(std::sin(2 * M_PI * 440.0 * static_cast<double>(i % size) / SAMPLE_RATE));
+            AudioFrame frame{};
+            frame.data = data.data();
+            frame.numChannels = static_cast<size_t>(channels);
+            frame.numSamples = size;
+            frame.sampleRate = SAMPLE_RATE;
+
+            FrameAnalyzer analyzer(WorkerPool::defaultNumThreads());
+            results.push_back(measure(options, name, static_cast<double>(data.size()), static_cast<double>(data.size() * sizeof(float)), [&]() {
+                sink = analyzer.analyze(frame).channels[0].rmsLevel;
+            }));
+        }
+    }
+
+    /*
+     * The spectrum of frame t of a spectrogram: partials gliding over the frames on a noise floor that moves by a
+     * few dB
+     */
+    void synthesizeSpectrum(size_t t, size_t numSamples, uint32_t &noise, std::vector<double> &spectrum)
+    {
+        for (size_t i = 0; i < spectrum.size(); ++i) {
+            noise = noise * 1664525u + 1013904223u;
+            spectrum[i] = 1e-3 * numSamples * (1.0 + 0.5 * (noise >> 8) / 16777216.0);
+        }
+        for (size_t partial = 1; partial <= 8 && (40 + t / 16) * partial < spectrum.size(); ++partial) {
+            spectrum[(40 + t / 16) * partial] = 0.2 * numSamples / partial;
+        }
+    }
+
+    /*
+     * The quantized spectrogram of synthesizeSpectrum, column after column
+     */
+    std::vector<uint16_t> synthesizeSpectrogram(size_t frames, size_t bins, size_t numSamples, int bits, std::vector<double> &spectrum)
+    {
+        std::vector<uint16_t> values(frames * bins);
+        spectrum.resize(numSamples / 2 + 1);
+        uint32_t noise = 1;
+        for (size_t t = 0; t < frames; ++t) {
+            synthesizeSpectrum(t, numSamples, noise, spectrum);
+            spectrumquantizer::quantizeSpectrum(spectrum.data(), spectrum.size(), numSamples, bits, values.data() + t, bins, frames);
+        }
+        return values;
+    }
+
+    /*
+     * Codes the columns of a spectrogram chunk after chunk into a buffer followed by the 8 bytes the decoder may
+     * read past the last one
+     * @return The end of each chunk in coded
+     */
+    std::vector<size_t> encodeChunks(const std::vector<uint16_t> &values, size_t frames, size_t bins, size_t binsPerChunk, int bits,
+                                     std::vector<uint8_t> &coded)
+    {
+        std::vector<size_t> chunkEnds;
+        coded.clear();
+        for (size_t first = 0; first < bins; first += binsPerChunk) {
+            spectrogramarchive::encodeChunk(values.data() + first * frames, frames, std::min(binsPerChunk, bins - first), frames, bits, coded);
+            chunkEnds.push_back(coded.size());
+        }
+        coded.resize(coded.size() + 8, 0);
+        return chunkEnds;
+    }
+
+    /*
+     * Decodes the chunks of encodeChunks
+     * @return False if a chunk is corrupt
+     */
+    bool decodeChunks(const std::vector<uint8_t> &coded, const std::vector<size_t> &chunkEnds, size_t frames, size_t bins, size_t binsPerChunk,
+                      int bits, std::vector<uint16_t> &values)
+    {
+        bool valid = true;
+        size_t start = 0;
+        for (size_t c = 0; c < chunkEnds.size(); ++c) {
+            const size_t first = c * binsPerChunk;
+            valid = spectrogramarchive::decodeChunk(coded.data() + start, chunkEnds[c] - start, frames, std::min(binsPerChunk, bins - first), frames,
+                                                    bits, values.data() + first * frames) && valid;
+            start = chunkEnds[c];
+        }
+        return valid;
+    }
+
+    /*
+     * Coding a block of the spectrogram archive and decoding it back, per bin of every frame
+     */
+    void benchArchive(const Options &options, std::vector<Result> &results)
+    {
+        const size_t frames = 256, bins = 512, binsPerChunk = 64, numSamples = 4096;
+
+        for (int bits : {8, 16}) {
+            const std::string suffix = "/" + std::to_string(bits);
+
+            std::vector<double> spectrum;
+            std::vector<uint16_t> values = synthesizeSpectrogram(frames, bins, numSamples, bits, spectrum);
+
+            // Encoding reuses its buffer, decoding reads a copy padded for the decoder
+            std::vector<uint8_t> encoded;
+            const auto encode = [&]() {
+                encoded.clear();
+                for (size_t first = 0; first < bins; first += binsPerChunk) {
+                    spectrogramarchive::encodeChunk(values.data() + first * frames, frames, binsPerChunk, frames, bits, encoded);
+                }
+            };
+            std::vector<uint8_t> coded;
+            const std::vector<size_t> chunkEnds = encodeChunks(values, frames, bins, binsPerChunk, bits, coded);
+
+            const double numValues = static_cast<double>(frames * bins);
+            if (selected(options, "archive/quantize" + suffix)) {
+                results.push_back(measure(options, "archive/quantize" + suffix, static_cast<double>(bins), static_cast<double>(spectrum.size() * sizeof(double)), [&]() {
+                    spectrumquantizer::quantizeSpectrum(spectrum.data(), spectrum.size(), numSamples, bits, values.data(), bins, frames);
+                }));
+            }
+            if (selected(options, "archive/encode" + suffix)) {
+                results.push_back(measure(options, "archive/encode" + suffix, numValues, numValues * sizeof(uint16_t), [&]() {
+                    encode();
+                    sink = encoded.size();
+                }));
+            }
+            if (selected(options, "archive/decode" + suffix)) {
+                std::vector<uint16_t> decoded(frames * bins);
+                results.push_back(measure(options, "archive/decode" + suffix, numValues, static_cast<double>(chunkEnds.back()), [&]() {
+                    decodeChunks(coded, chunkEnds, frames, bins, binsPerChunk, bits, decoded);
+                    sink = decoded[0];
+                }));
+            }
+        }
+    }
+
+    /*
+     * Publishing a channel to the shared memory ring and reading it back in place, as another process would
+     */
+    void benchSharing(const Options &options, std::vector<Result> &results)
+    {
+        const size_t numSamples = 4096;
+        const std::string suffix = "/n" + std::to_string(numSamples);
+        if (!selected(options, "share/publish" + suffix) && !selected(options, "share/read" + suffix)) return;
+
+        SharedSpectrumPublisher publisher;
+        SharedSpectrumReader reader;
+        const std::string name = "toneanalyzer-bench-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+        if (!publisher.open(name.c_str()) || !reader.open(name.c_str())) return;
+
+        std::vector<double> spectrum(numSamples / 2 + 1, 1.0);
+        ChannelResult result{};
+        result.note = -1;
+        const double bytes = static_cast<double>(spectrum.size() * sizeof(double));
+        if (selected(options, "share/publish" + suffix)) {
+            results.push_back(measure(options, "share/publish" + suffix, static_cast<double>(spectrum.size()), bytes, [&]() {
+                publisher.publish(0, 0, result, false, spectrum.data(), numSamples, SAMPLE_RATE);
+            }));
+        }
+        if (selected(options, "share/read" + suffix)) {
+            publisher.publish(0, 0, result, false, spectrum.data(), numSamples, SAMPLE_RATE);
+            const uint64_t latest = reader.getHead() - 1;
+            results.push_back(measure(options, "share/read" + suffix, static_cast<double>(spectrum.size()), bytes, [&]() {
+                SharedSpectrumReader::View view;
+                float strongest = 0.0f;
+                if (reader.acquire(latest, view)) {
+                    for (uint32_t j = 0; j < view.slot->frame.numBins; ++j) strongest = std::max(strongest, view.spectrum[j]);
+                }
+                sink = reader.validate(view) ? strongest : 0.0f;
+            }));
+        }
+    }
+
+    /*
+     * The spectrum stage at every transform sizing, for the frame sizes the analysis actually gets
+     */
+    void benchWindows(const Options &options, std::vector<Result> &results, std::vector<WindowResult> &windows)
+    {
+        SampleFormat format{SampleFormat::Float, SampleFormat::LittleEndian, 32, 1};
+
+        for (int rate : WINDOW_RATES) {
+            for (int frameMs : WINDOW_MS) {
+                // As the framer sizes the frames
+                const size_t size = static_cast<size_t>(rate) * static_cast<size_t>(frameMs) / 1000 / 2 * 2;
+                const std::vector<char> raw = synthesize(format, size);
+                const float *data = reinterpret_cast<const float*>(raw.data());
+                WindowResult window{rate, frameMs, size, {}, {}};
+
+                for (size_t s = 0; s < NUM_SIZINGS; ++s) {
+                    const Sizing &sizing = SIZINGS[s];
+                    window.sizes[s] = ChannelAnalyzer::transformSize(size, sizing.sizing, sizing.powersOfTwo);
+                    const std::string name = "window/r" + std::to_string(rate) + "/" + std::to_string(frameMs) + "ms/" + sizing.name
+                                           + "/n" + std::to_string(window.sizes[s]);
+                    if (!selected(options, name)) continue;
+
+                    ChannelAnalyzer analyzer;
+                    analyzer.setTransformSizing(sizing.sizing, sizing.powersOfTwo);
+                    analyzer.analyze(data, size, rate);
+                    results.push_back(measure(options, name, static_cast<double>(size), static_cast<double>(size * sizeof(float)), [&]() {
+                        analyzer.calculateSpectrum(data, size);
+                        sink = analyzer.getSpectrum()[1];
+                    }));
+                    window.nsPerOp[s] = results.back().nsPerOp;
+                }
+                if (std::any_of(window.nsPerOp, window.nsPerOp + NUM_SIZINGS, [](double ns) { return ns > 0.0; })) windows.push_back(window);
+            }
+        }
+    }
+
+    /*
+     * The speedup of each sizing over the exact size of the frames
+     */
+    void printWindows(const std::vector<WindowResult> &windows)
+    {
+        if (windows.empty()) return;
+        std::printf("\n%-8s %6s %7s", "rate", "frame", "samples");
+        for (const Sizing &sizing : SIZINGS) std::printf(" %22s", sizing.name);
+        std::printf("\n");
+
+        for (const WindowResult &window : windows) {
+            std::printf("%-8d %4dms %7zu", window.rate, window.frameMs, window.frameSize);
+            for (size_t s = 0; s < NUM_SIZINGS; ++s) {
+                if (window.nsPerOp[s] <= 0.0) {
+                    std::printf(" %22s", "-");
+                    continue;
+                }
+
+                // Size of the transform, time of the spectrum and speedup over the exact size
+                char cell[64];
+                if (window.nsPerOp[0] > 0.0) {
+                    std::snprintf(cell, sizeof(cell), "%zu %.1fus x%.2f", window.sizes[s], window.nsPerOp[s] / 1000.0, window.nsPerOp[0] / window.nsPerOp[s]);
+                }
+                else {
+                    std::snprintf(cell, sizeof(cell), "%zu %.1fus", window.sizes[s], window.nsPerOp[s] / 1000.0);
+                }
+                std::printf(" %22s", cell);
+            }
+            std::printf("\n");
+        }
+    }
+
+    /*
+     * A frame of a tone, the amplitude of harmonic h is 1/h
+     */
+    std::vector<float> synthesizeTone(double frequency, int numHarmonics, int rate, size_t numSamples)
+    {
+        std::vector<float> samples(numSamples);
+        for (size_t i = 0; i < numSamples; ++i) {
+            const double t = static_cast<double>(i) / rate;
+            double value = 0.0;
+            double total = 0.0;
+            for (int h = 1; h <= numHarmonics && frequency * h < rate / 2; ++h) {
+                value += std::sin(2 * M_PI * frequency * h * t + h) / h;
+                total += 1.0 / h;
+            }
+            samples[i] = static_cast<float>(0.5 * value / total);
+        }
+        return samples;
+    }
+
+    /*
+     * Prints an estimate of a tone, and returns whether it is confident in a wrong note
+     */
+    bool printEstimate(const PitchEstimators::Estimate &estimate, int note)
+    {
+        if (estimate.note < 0) {
+            std::printf(" %24s", "-");
+            return false;
+        }
+
+        const bool wrong = estimate.note != note && estimate.confidence >= CHECK_CONFIDENCE;
+        char cell[64];
+        std::snprintf(cell, sizeof(cell), "%s%s %.2f %.2f", wrong ? "!" : "", notes::notes[estimate.note], static_cast<double>(estimate.frequency),
+                      static_cast<double>(estimate.confidence));
+        std::printf(" %24s", cell);
+        return wrong;
+    }
+
+    /*
+     * The pitch estimators on synthetic tones, at every rate and transform sizing. An estimator may give up (the
+     * cepstrum on a sinusoid alone) or be unsure, not be confident in a wrong note
+     */
+    bool checkEstimators()
+    {
+        std::printf("%-8s %6s %9s %-12s %24s %24s\n", "tone", "rate", "harmonics", "sizing", "harmonic product", "cepstrum");
+
+        size_t numWrong = 0;
+        PitchEstimators estimators;
+        for (double frequency : CHECK_PITCHES) {
+            const int note = notes::nearest(frequency);
+            for (int rate : CHECK_RATES) {
+                for (int numHarmonics : CHECK_HARMONICS) {
+                    // A frame of the default duration
+                    const size_t size = static_cast<size_t>(rate) / 10;
+                    const std::vector<float> tone = synthesizeTone(frequency, numHarmonics, rate, size);
+
+                    for (const Sizing &sizing : SIZINGS) {
+                        ChannelAnalyzer analyzer;
+                        analyzer.setTransformSizing(sizing.sizing, sizing.powersOfTwo);
+                        analyzer.calculateSpectrum(tone.data(), size);
+                        const double *spectrum = analyzer.getSpectrum();
+                        const size_t numSamples = analyzer.getSpectrumSize();
+                        const int spectrumRate = analyzer.getSpectrumRate(rate);
+
+                        std::printf("%-8.2f %6d %9d %-12s", frequency, rate, numHarmonics, sizing.name);
+                        numWrong += printEstimate(estimators.harmonicProduct(spectrum, numSamples, spectrumRate), note);
+                        numWrong += printEstimate(estimators.cepstrum(spectrum, numSamples, spectrumRate), note);
+                        std::printf("\n");
+                    }
+                }
+            }
+        }
+
+        std::printf("\n%zu confident wrong estimates (marked !)\n", numWrong);
+        return numWrong == 0;
+    }
+
+    /*
+     * Prints the outcome of a check and returns it
+     */
+    bool printCheck(const std::string &name, bool passed)
+    {
+        std::printf("%-40s %s\n", name.c_str(), passed ? "ok" : "FAILED");
+        return passed;
+    }
+
+    /*
+     * Returns whether an archive reads back the frames from to to (included) of the band of expected, frame t
+     * being at t * frameUs
+     */
+    bool readsBack(SpectrogramArchiveReader &reader, const std::vector<uint16_t> &expected, size_t numBins, int64_t frameUs,
+                   size_t from, size_t to, size_t firstBin, size_t band)
+    {
+        std::vector<int64_t> timestamps;
+        std::vector<uint16_t> values;
+        if (reader.read(static_cast<int64_t>(from) * frameUs, static_cast<int64_t>(to) * frameUs, firstBin, band, timestamps, values) != to - from + 1) {
+            return false;
+        }
+
+        for (size_t f = 0; f <= to - from; ++f) {
+            const auto row = expected.begin() + static_cast<long>((from + f) * numBins + firstBin);
+            if (timestamps[f] != static_cast<int64_t>(from + f) * frameUs) return false;
+            if (!std::equal(row, row + static_cast<long>(band), values.begin() + static_cast<long>(f * band))) return false;
+        }
+        return true;
+    }
+
+    /*
+     * The spectrogram archive: its chunks decode to the values coded, a closed archive reads back a time range
+     * of a band, and one cut short before its index (its writer died) reads back its complete blocks
+     */
+    bool checkArchive()
+    {
+        const size_t frames = 256, bins = 512, binsPerChunk = 64, numSamples = 4096;
+        const size_t fileFrames = 100, fileSamples = 256;
+        const int64_t frameUs = 10000;
+
+        size_t numFailed = 0;
+        for (int bits : {8, 16}) {
+            const std::string suffix = "/" + std::to_string(bits);
+
+            std::vector<double> spectrum;
+            const std::vector<uint16_t> values = synthesizeSpectrogram(frames, bins, numSamples, bits, spectrum);
+            std::vector<uint8_t> coded;
+            const std::vector<size_t> chunkEnds = encodeChunks(values, frames, bins, binsPerChunk, bits, coded);
+            std::vector<uint16_t> decoded(frames * bins);
+            numFailed += !printCheck("archive/chunks" + suffix, decodeChunks(coded, chunkEnds, frames, bins, binsPerChunk, bits, decoded)
+                                                                && decoded == values);
+
+            // Blocks of 16 frames in chunks of 16 bins, the last block is partial
+            const SpectrogramArchiveWriter::Settings settings{64, bits, 16, 16, 4, true};
+            const std::string path = "toneanalyzer-check-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".tasg";
+            std::vector<uint16_t> expected(fileFrames * settings.numBins);
+            spectrum.resize(fileSamples / 2 + 1);
+            uint32_t noise = 1;
+
+            SpectrogramArchiveWriter writer;
+            bool written = writer.open(path.c_str(), settings);
+            for (size_t t = 0; written && t < fileFrames; ++t) {
+                synthesizeSpectrum(t, fileSamples, noise, spectrum);
+                spectrumquantizer::quantizeSpectrum(spectrum.data(), spectrum.size(), fileSamples, bits, expected.data() + t * settings.numBins,
+                                                    settings.numBins, 1);
+                written = writer.append(static_cast<int64_t>(t) * frameUs, spectrum.data(), fileSamples);
+            }
+            written = writer.close() && written;
+
+            // A range across blocks, in a band across chunks
+            SpectrogramArchiveReader reader;
+            numFailed += !printCheck("archive/read" + suffix, written && reader.open(path.c_str()) && reader.isIndexed()
+                                                              && reader.getNumFrames() == fileFrames
+                                                              && readsBack(reader, expected, settings.numBins, frameUs, 20, 57, 10, 20));
+
+            // Cut in the middle of the last block, the index and the trailer are gone
+            std::vector<char> bytes;
+            {
+                std::ifstream file(path, std::ios::binary);
+                bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            }
+            spectrogramarchive::Trailer trailer{};
+            if (bytes.size() >= sizeof(trailer)) std::memcpy(&trailer, bytes.data() + bytes.size() - sizeof(trailer), sizeof(trailer));
+            const bool cut = written && trailer.indexOffset > 0 && trailer.indexOffset < bytes.size();
+            if (cut) {
+                std::ofstream file(path, std::ios::binary | std::ios::trunc);
+                file.write(bytes.data(), static_cast<std::streamsize>(trailer.indexOffset - 1));
+            }
+
+            const size_t complete = fileFrames / settings.framesPerBlock * settings.framesPerBlock;
+            SpectrogramArchiveReader unindexed;
+            numFailed += !printCheck("archive/truncated" + suffix, cut && unindexed.open(path.c_str()) && !unindexed.isIndexed()
+                                                                   && unindexed.getNumFrames() == complete
+                                                                   && readsBack(unindexed, expected, settings.numBins, frameUs, 0, complete - 1, 0,
+                                                                                settings.numBins));
+            std::remove(path.c_str());
+        }
+
+        std::printf("\n%zu failed archive checks\n", numFailed);
+        return numFailed == 0;
+    }
+
+    /*
+     * Publishes frame n of the sharing check: its level and every magnitude of its spectrum are n + 1
+     */
+    void publishMarked(SharedSpectrumPublisher &publisher, uint64_t n, std::vector<double> &spectrum, size_t numSamples)
+    {
+        const double marker = static_cast<double>(n + 1);
+        ChannelResult result{};
+        result.note = -1;
+        result.rmsLevel = static_cast<float>(marker);
+        // Scaled back by the publisher to the amplitude of a sinusoid, exactly for a power of two
+        std::fill(spectrum.begin(), spectrum.end(), marker * static_cast<double>(numSamples) / 2);
+        publisher.publish(static_cast<int64_t>(n) * 1000, static_cast<size_t>(n % 4), result, false, spectrum.data(), numSamples, SAMPLE_RATE);
+    }
+
+    /*
+     * Returns whether a frame read from the ring is frame n of publishMarked, whole
+     */
+    bool isMarked(const sharedspectrum::Frame &frame, const float *spectrum, size_t numBins, uint64_t n)
+    {
+        const float marker = static_cast<float>(n + 1);
+        if (frame.number != n || frame.timestampUs != static_cast<int64_t>(n) * 1000 || frame.channel != n % 4) return false;
+        if (frame.rmsLevel != marker || frame.numBins != numBins) return false;
+        return std::all_of(spectrum, spectrum + numBins, [marker](float magnitude) { return magnitude == marker; });
+    }
+
+    /*
+     * The shared memory ring: the frames are read in order, a reader lapped by the publisher counts the frames
+     * it lost exactly, and a frame read in place while the publisher races round the ring is either whole or
+     * rejected by validate()
+     */
+    bool checkSharing()
+    {
+        const size_t numSamples = 256, numSlots = 16, numBins = 64;
+        const SharedSpectrumPublisher::Settings settings{numSlots, numBins};
+        const std::string name = "toneanalyzer-check-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+        std::vector<double> spectrum(numSamples / 2 + 1);
+
+        SharedSpectrumPublisher publisher;
+        SharedSpectrumReader reader;
+        if (!printCheck("share/open", publisher.open(name.c_str(), settings) && reader.open(name.c_str())
+                                      && reader.getHeader().numSlots == numSlots)) {
+            return false;
+        }
+
+        size_t numFailed = 0;
+        sharedspectrum::Frame frame{};
+        std::vector<float> magnitudes;
+
+        // Less than a ring: every frame, in order
+        bool inOrder = true;
+        for (uint64_t n = 0; n < 10; ++n) publishMarked(publisher, n, spectrum, numSamples);
+        for (uint64_t n = 0; n < 10; ++n) inOrder = reader.next(frame, magnitudes) && isMarked(frame, magnitudes.data(), magnitudes.size(), n) && inOrder;
+        numFailed += !printCheck("share/order", inOrder && !reader.next(frame, magnitudes) && reader.getNumLost() == 0);
+
+        // Lapped: the frames older than a ring are lost, the reader goes on from the oldest one kept
+        bool lapped = true;
+        for (uint64_t n = 10; n < 50; ++n) publishMarked(publisher, n, spectrum, numSamples);
+        for (uint64_t n = 50 - numSlots; n < 50; ++n) lapped = reader.next(frame, magnitudes) && isMarked(frame, magnitudes.data(), magnitudes.size(), n) && lapped;
+        numFailed += !printCheck("share/lapped", lapped && !reader.next(frame, magnitudes) && reader.getNumLost() == 50 - numSlots - 10);
+
+        // Racing: the publisher goes round the ring many times while a reader reads in place and another copies
+        const uint64_t numRaced = 200000;
+        std::atomic<bool> publishing(true);
+        std::thread thread([&]() {
+            std::vector<double> raced(numSamples / 2 + 1);
+            for (uint64_t n = 50; n < 50 + numRaced; ++n) publishMarked(publisher, n, raced, numSamples);
+            publishing = false;
+        });
+
+        SharedSpectrumReader copier;
+        copier.open(name.c_str());
+        copier.setCursor(reader.getHead());
+        const uint64_t start = copier.getCursor();
+        uint64_t numValid = 0, numTorn = 0, numCopied = 0;
+        bool copiedInOrder = true;
+        while (publishing) {
+            const uint64_t head = reader.getHead();
+            SharedSpectrumReader::View view;
+            if (reader.acquire(head - 1, view)) {
+                const bool marked = isMarked(view.slot->frame, view.spectrum, numBins, head - 1);
+                if (reader.validate(view)) {
+                    ++numValid;
+                    numTorn += !marked;
+                }
+            }
+            if (copier.next(frame, magnitudes)) {
+                ++numCopied;
+                copiedInOrder = copiedInOrder && isMarked(frame, magnitudes.data(), magnitudes.size(), copier.getCursor() - 1)
+                                && copier.getCursor() - start == numCopied + copier.getNumLost();
+            }
+        }
+        thread.join();
+        numFailed += !printCheck("share/race", numValid > 0 && numTorn == 0 && numCopied > 0 && copiedInOrder);
+        std::printf("%-40s %llu valid, %llu torn, %llu copied, %llu lost\n", "", static_cast<unsigned long long>(numValid),
+                    static_cast<unsigned long long>(numTorn), static_cast<unsigned long long>(numCopied),
+                    static_cast<unsigned long long>(copier.getNumLost()));
+
+        copier.close();
+        reader.close();
+        publisher.close();
+        std::printf("\n%zu failed sharing checks\n", numFailed);
+        return numFailed == 0;
+    }
+
+    void print(const Options &options, const std::vector<Result> &results)
+    {
+        if (options.output == "csv") {
+            std::printf("name,ns_per_op,samples_per_s,bytes_per_s,iterations\n");
+            for (const Result &r : results) {
+                std::printf("%s,%.1f,%.0f,%.0f,%zu\n", r.name.c_str(), r.nsPerOp, r.samples * 1e9 / r.nsPerOp, r.bytes * 1e9 / r.nsPerOp, r.iterations);
+            }
+        }
+        else if (options.output == "json") {
+            for (const Result &r : results) {
+                std::printf("{\"name\":\"%s\",\"ns_per_op\":%.1f,\"samples_per_s\":%.0f,\"bytes_per_s\":%.0f,\"iterations\":%zu}\n",
+                            r.name.c_str(), r.nsPerOp, r.samples * 1e9 / r.nsPerOp, r.bytes * 1e9 / r.nsPerOp, r.iterations);
+            }
+        }
+        else {
+            std::printf("%-32s %14s %14s %12s\n", "benchmark", "ns/op", "Msamples/s", "MB/s");
+            for (const Result &r : results) {
+                std::printf("%-32s %14.1f %14.2f %12.2f\n", r.name.c_str(), r.nsPerOp, r.samples * 1e3 / r.nsPerOp, r.bytes * 1e3 / r.nsPerOp);
+            }
+        }
+    }
+
+    void usage(const char *program)
+    {
+        std::fprintf(stderr,
+                     "Usage: %s [options]\n"
+                     "  --output table|csv|json   format of the results (default table)\n"
+                     "  --filter TEXT             only run the benchmarks whose name contains TEXT\n"
+                     "  --min-time MS             minimum duration of a batch (default 50)\n"
+                     "  --repeats N               number of batches, the best one is kept (default 5)\n"
+                     "  --check                   check the pitch estimators, the spectrogram archive and the shared\n"
+                     "                            ring instead, fails if an estimator is confident in a wrong note or\n"
+                     "                            if the archive or the ring doesn't read back what was written\n",
+                     program);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Options options{"table", "", 50.0, 5, false};
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--output" && hasValue) options.output = argv[++i];
+        else if (arg == "--filter" && hasValue) options.filter = argv[++i];
+        else if (arg == "--min-time" && hasValue) options.minTimeMs = std::atof(argv[++i]);
+        else if (arg == "--repeats" && hasValue) options.repeats = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--check") options.check = true;
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (options.check) {
+        const bool estimators = checkEstimators();
+        std::printf("\n");
+        const bool archive = checkArchive();
+        std::printf("\n");
+        const bool sharing = checkSharing();
+        return estimators && archive && sharing ? 0 : 1;
+    }
+
+    std::vector<Result> results;
+    benchConversion(options, results);
+    benchFraming(options, results);
+    benchResampling(options, results);
+    benchAnalysis(options, results);
+    benchArchive(options, results);
+    benchSharing(options, results);
+
+    std::vector<WindowResult> windows;
+    benchWindows(options, results, windows);
+    print(options, results);
+    if (options.output == "table") printWindows(windows);
+
+    return 0;
+}
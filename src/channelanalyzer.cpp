@@ -0,0 +1,338 @@
+#include "channelanalyzer.h"
+
+#include <math.h>
+#include <algorithm>
+#include <limits>
+
+#include "notes.h"
+#include "tracer.h"
+
+namespace {
+    // Ratio of the frequencies of two notes a semitone apart
+    const double    SEMITONE_RATIO  = 1.0594630943592953;
+
+    /**
+     * @brief Finds the note with the most energy in a magnitude spectrum
+     * @param spectrum The magnitude spectrum
+     * @param noteMap The bins of the notes for the size of the spectrum
+     * @param result Receives the note and its confidence
+     */
+    void findNote(const double *spectrum, const PlanCache::NoteMap &noteMap, ChannelResult &result)
+    {
+        // Crude detection of pitch, just take frequency with highest value
+        // TODO: Detection of fundamental harmonics
+        double max_freq = std::numeric_limits<double>::min();
+        double sum = 0.0;
+        int index = 0;
+        for (size_t i = 0; i < noteMap.bins.size(); i++) {
+            const size_t fftw_out_index = noteMap.bins[i];
+
+            double v1 = spectrum[fftw_out_index];
+            double v2 = spectrum[fftw_out_index + 1];
+            double value = (v1 + v2) / 2.0;
+            sum += value;
+            if (max_freq < value) {
+                index = static_cast<int>(i);
+                max_freq = value;
+            }
+        }
+
+        // Share of the energy of all the notes that went to the detected one
+        result.note = index;
+        result.confidence = sum > 0.0 ? static_cast<float>(max_freq / sum) : 0.0f;
+    }
+}
+
+ChannelAnalyzer::ChannelAnalyzer(PlanCache &plans)
+    : plans(plans)
+    , fftw_in{}
+    , fftw_out{}
+    , plan{nullptr}
+    , noteMap{nullptr}
+    , data_out{}
+    , onsets{}
+    , short_in{}
+    , short_out{}
+    , short_magnitudes{}
+    , shortPlan{nullptr}
+    , shortNoteMap{nullptr}
+    , shortNote{false}
+    , polyphony{}
+    , tracker{}
+    , estimators{plans}
+    , enabledEstimators{PitchEstimators::PARTIALS}
+    , strongestBin{-1, 0.0f, 0.0f}
+    , result{0.0f, 0.0f, -1, 0.0f, 0.0f, false, false, 0, {}, {}, -1}
+    , gate{}
+    , gating{true}
+    , spectrumCleared{false}
+    , sizing{ZERO_PAD}
+    , powersOfTwo{false}
+    , frameSize{0}
+{
+}
+
+ChannelAnalyzer::~ChannelAnalyzer()
+{
+    // The plan belongs to the cache
+}
+
+void ChannelAnalyzer::analyze(const float *data, size_t numSamples, int sampleRate)
+{
+    calculateLevel(data, numSamples);
+
+    // The frames follow each other by their number of samples, the hop of the framer
+    result.active = !gating || gate.update(result.rmsLevel, static_cast<float>(numSamples) / static_cast<float>(sampleRate));
+    if (!result.active) {
+        skipSpectrum(numSamples);
+        return;
+    }
+
+    calculateSpectrum(data, numSamples);
+    if (enabledEstimators & PitchEstimators::STRONGEST_BIN) calculateNote(sampleRate);
+    calculateNotes(sampleRate);
+    calculateOnset(data, numSamples, sampleRate);
+    if (enabledEstimators & PitchEstimators::PARTIALS) calculatePartials(numSamples, sampleRate);
+    calculatePitch(sampleRate);
+}
+
+size_t ChannelAnalyzer::shortWindowSize(size_t numSamples)
+{
+    // The end of the frame is taken as is, a fast size around a quarter of it needs no padding
+    return std::min(numSamples, std::max<size_t>(PlanCache::nearestFastSize(numSamples / SHORT_WINDOW_DIVISOR), MIN_SHORT_WINDOW));
+}
+
+void ChannelAnalyzer::setTransformSizing(TransformSizing sizing, bool powersOfTwo)
+{
+    this->sizing = sizing;
+    this->powersOfTwo = powersOfTwo;
+
+    // The spectra to come have another size, the previous ones can't be compared with them
+    onsets.reset();
+    tracker.reset();
+}
+
+size_t ChannelAnalyzer::transformSize(size_t numSamples, TransformSizing sizing, bool powersOfTwo)
+{
+    switch (sizing) {
+    case ZERO_PAD: return PlanCache::nextFastSize(numSamples, powersOfTwo);
+    // Interpolating down to a smaller size would fold the frequencies above its Nyquist back into the spectrum
+    case INTERPOLATE: return PlanCache::nextFastSize(numSamples, powersOfTwo);
+    case EXACT_SIZE: break;
+    }
+    return numSamples;
+}
+
+int ChannelAnalyzer::getSpectrumRate(int sampleRate) const
+{
+    // The interpolated frames last as long with another number of samples, the rate is rounded to the Hz
+    if (sizing != INTERPOLATE || frameSize == 0 || frameSize == data_out.size()) return sampleRate;
+    return static_cast<int>(std::lround(static_cast<double>(sampleRate) * static_cast<double>(data_out.size()) / static_cast<double>(frameSize)));
+}
+
+void ChannelAnalyzer::setPitchEstimators(unsigned estimators)
+{
+    enabledEstimators = estimators;
+
+    // The partials not followed in the meantime are stale
+    tracker.reset();
+}
+
+void ChannelAnalyzer::setGating(bool gating)
+{
+    this->gating = gating;
+    gate.reset();
+}
+
+void ChannelAnalyzer::skipSpectrum(size_t numSamples)
+{
+    result.note = -1;
+    result.confidence = 0.0f;
+    result.pitchHz = 0.0f;
+    result.onset = false;
+    shortNote = false;
+    result.numNotes = 0;
+    result.chord = -1;
+
+    // Only cleared once, the following frames of noise leave it as is. The first frame after the noise is compared to silence
+    const size_t size = transformSize(numSamples, sizing, powersOfTwo);
+    if (data_out.size() != size) {
+        frameSize = numSamples;
+        data_out.assign(size, 0.0);
+        onsets.reset();
+        tracker.reset();
+    }
+    else if (!spectrumCleared) {
+        std::fill(data_out.begin(), data_out.end(), 0.0);
+        onsets.reset();
+        tracker.reset();
+    }
+    spectrumCleared = true;
+}
+
+void ChannelAnalyzer::calculateLevel(const float *data, size_t numSamples) {
+    TRACE_SCOPE("level");
+    float peakLevel = 0.0;
+    float sum = 0.0;
+
+    auto it = data;
+    auto end = data + numSamples;
+
+    while (it < end) {
+        const float value = *it;
+        peakLevel = std::max(peakLevel, value);
+        sum += std::pow(value, 2.0f);
+        ++it;
+    }
+
+    result.rmsLevel = std::clamp(sqrt(sum / numSamples), 0.0f, 1.0f);
+    result.peakLevel = peakLevel;
+}
+
+void ChannelAnalyzer::applyWindowingFunction() {
+    double x = 0.0;
+
+    for (size_t i=0; i<fftw_out.size(); ++i) {
+        x = 0.5 * (1 - cos((2 * M_PI * i) / (fftw_out.size())));
+        fftw_out[i] = fftw_out[i] * x;
+    }
+}
+
+void ChannelAnalyzer::calculateNote(const int sampleRate) {
+    TRACE_SCOPE("note");
+    const int spectrumRate = getSpectrumRate(sampleRate);
+    if (!noteMap || noteMap->numSamples != data_out.size() || noteMap->sampleRate != spectrumRate) {
+        noteMap = &plans.getNoteMap(data_out.size(), spectrumRate);
+    }
+
+    findNote(data_out.data(), *noteMap, result);
+    strongestBin = PitchEstimators::Estimate{result.note, static_cast<float>(notes::frequencies[result.note]), result.confidence};
+}
+
+void ChannelAnalyzer::calculateNotes(const int sampleRate) {
+    TRACE_SCOPE("notes");
+    if (polyphony.getSettings().maxNotes == 0) {
+        result.numNotes = 0;
+        result.chord = -1;
+        return;
+    }
+
+    const int spectrumRate = getSpectrumRate(sampleRate);
+    if (!polyphony.isConfigured(data_out.size(), spectrumRate)) polyphony.configure(data_out.size(), spectrumRate);
+    polyphony.estimate(data_out.data(), result);
+}
+
+void ChannelAnalyzer::calculatePartials(size_t numSamples, int sampleRate) {
+    TRACE_SCOPE("partials");
+    const int spectrumRate = getSpectrumRate(sampleRate);
+    if (!tracker.isConfigured(data_out.size(), spectrumRate)) tracker.configure(data_out.size(), spectrumRate);
+    const size_t frameSize = sizing == ZERO_PAD ? numSamples : data_out.size();
+    tracker.process(data_out.data(), frameSize, static_cast<float>(numSamples) / static_cast<float>(sampleRate), result.onset);
+    result.pitchHz = tracker.getPitch();
+
+    // On an onset the note may come from the short window, the partials of the new note were only just born
+    if (shortNote) return;
+    result.note = tracker.getNote();
+    result.confidence = tracker.getConfidence();
+}
+
+void ChannelAnalyzer::calculatePitch(const int sampleRate) {
+    TRACE_SCOPE("pitch");
+    // On an onset the note may come from the short window, the long one still holds the previous note. So does
+    // the pitch of the partials, the pitch is the one of the note
+    if (shortNote) {
+        result.pitchHz = static_cast<float>(notes::frequencies[result.note]);
+        return;
+    }
+
+    // From the cheapest to the most expensive, the strongest bin and the partials were estimated by their stages
+    PitchEstimators::Estimate votes[4];
+    size_t count = 0;
+    const int spectrumRate = getSpectrumRate(sampleRate);
+    if (enabledEstimators & PitchEstimators::STRONGEST_BIN) votes[count++] = strongestBin;
+    if (enabledEstimators & PitchEstimators::HARMONIC_PRODUCT) votes[count++] = estimators.harmonicProduct(data_out.data(), data_out.size(), spectrumRate);
+    if (enabledEstimators & PitchEstimators::CEPSTRUM) votes[count++] = estimators.cepstrum(data_out.data(), data_out.size(), spectrumRate);
+    if (enabledEstimators & PitchEstimators::PARTIALS) votes[count++] = PitchEstimators::Estimate{tracker.getNote(), tracker.getPitch(), tracker.getConfidence()};
+    if (count == 0) return;
+
+    const PitchEstimators::Estimate fused = PitchEstimators::fuse(votes, count);
+    result.note = fused.note;
+    result.confidence = fused.confidence;
+    result.pitchHz = fused.frequency;
+}
+
+void ChannelAnalyzer::calculateOnset(const float *data, size_t numSamples, int sampleRate) {
+    TRACE_SCOPE("onset");
+    // The zero padding adds no signal, the magnitudes are in proportion to the samples of the frame
+    result.onset = onsets.process(data_out.data(), data_out.size() / 2 + 1, sizing == ZERO_PAD ? numSamples : data_out.size());
+    shortNote = false;
+    if (!result.onset) return;
+
+    // The newest samples are at the end of the frame, the note that just started is all there is in them
+    const size_t shortSize = shortWindowSize(numSamples);
+    if (!shortPlan || short_in.size() != shortSize) {
+        short_in.resize(shortSize);
+        short_out.resize(shortSize / 2 + 1);
+        short_magnitudes.resize(shortSize);
+        shortPlan = plans.getPlan(shortSize);
+    }
+    if (!shortNoteMap || shortNoteMap->numSamples != shortSize || shortNoteMap->sampleRate != sampleRate) {
+        shortNoteMap = &plans.getNoteMap(shortSize, sampleRate);
+    }
+
+    std::transform(data + numSamples - shortSize, data + numSamples, short_in.begin(), [](float x) -> double { return double(x); });
+    fftw_execute_dft_r2c(shortPlan, short_in.data(), reinterpret_cast<fftw_complex*>(short_out.data()));
+    std::transform(short_out.begin(), short_out.end(), short_magnitudes.begin(), [](std::complex<double> x) -> double { return std::abs(x); });
+
+    // Only the notes a semitone apart from their neighbours by more than a bin are told apart (ie: above about
+    // 700 Hz for 1200 samples at 48 kHz), the lower ones stay with the long window
+    const int longNote = result.note;
+    const float longConfidence = result.confidence;
+    findNote(short_magnitudes.data(), *shortNoteMap, result);
+    const double binHz = static_cast<double>(sampleRate) / static_cast<double>(shortSize);
+    shortNote = notes::frequencies[result.note] * (SEMITONE_RATIO - 1.0) > binHz;
+    if (!shortNote) {
+        result.note = longNote;
+        result.confidence = longConfidence;
+    }
+}
+
+void ChannelAnalyzer::calculateSpectrum(const float *data, size_t numSamples) {
+    TRACE_SCOPE("fft");
+    const size_t size = transformSize(numSamples, sizing, powersOfTwo);
+    if (!plan || fftw_in.size() != size) {
+        fftw_in.resize(size);
+        fftw_out.resize(size);
+        data_out.resize(size);
+        plan = plans.getPlan(size);
+    }
+    frameSize = numSamples;
+
+    // TODO: Correctly implement windowing function, right now it messes up the data
+    // applyWindowingFunction();
+
+    if (size == numSamples) {
+        std::transform(data, data + numSamples, fftw_in.begin(), [](float x) -> double { return double(x); });
+    }
+    else if (sizing == INTERPOLATE) {
+        // Linear interpolation up over the same duration, the sample rate of the transform rises in proportion
+        const double step = static_cast<double>(numSamples) / static_cast<double>(size);
+        for (size_t j = 0; j < size; ++j) {
+            const double position = static_cast<double>(j) * step;
+            const size_t i = static_cast<size_t>(position);
+            const size_t next = std::min(i + 1, numSamples - 1);
+            fftw_in[j] = data[i] + (data[next] - data[i]) * (position - static_cast<double>(i));
+        }
+    }
+    else {
+        std::transform(data, data + numSamples, fftw_in.begin(), [](float x) -> double { return double(x); });
+        std::fill(fftw_in.begin() + static_cast<long>(numSamples), fftw_in.end(), 0.0);
+    }
+    fftw_execute_dft_r2c(plan, fftw_in.data(), reinterpret_cast<fftw_complex*>(fftw_out.data()));
+
+    // Transform complex numbers to floating point numbers
+    std::transform(fftw_out.begin(), fftw_out.end(), data_out.begin(), [](std::complex<double> x) -> double {
+        return std::sqrt(std::pow(x.real(), 2) + std::pow(x.imag(), 2));
+    });
+    spectrumCleared = false;
+}
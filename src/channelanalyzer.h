@@ -0,0 +1,241 @@
+#ifndef CHANNELANALYZER_H
+#define CHANNELANALYZER_H
+
+#include <complex>
+#include <vector>
+
+#include <fftw3.h>
+
+#include "activitygate.h"
+#include "audioframe.h"
+#include "multipitchestimator.h"
+#include "onsetdetector.h"
+#include "partialtracker.h"
+#include "pitchestimators.h"
+#include "plancache.h"
+
+/**
+ * Level, spectrum and note analysis of a single channel.
+ *
+ * Holds the FFT buffers of the channel, so one instance per channel can run in parallel with the others.
+ * The plans and note maps come from a PlanCache shared with the other instances. The results stay valid
+ * until the next call to analyze().
+ *
+ * When gating is on, an activity gate in front of the spectral stages lets the frames of background noise
+ * through with their levels only: no FFT and no note, their spectrum is zero.
+ *
+ * An onset detector compares each spectrum with the previous one. When a note starts, its pitch is estimated
+ * again on a short window at the end of the frame, so the note changes without waiting for the frame to be
+ * filled with it, while the other frames keep their long window. The bins of the short window are coarse, only
+ * the notes it tells from their neighbours (the high ones) are taken from it.
+ *
+ * The notes played together and their chord are estimated from the same spectrum as the main note.
+ *
+ * The note reported is the one of the partials tracked from frame to frame, it only changes once the new
+ * note held a little (or on an onset), instead of the strongest bin of each frame. Other estimators (the
+ * harmonic product spectrum, the cepstrum) can be enabled alongside, or instead, and vote for the note.
+ *
+ * The size of the frames follows from the sample rate and the frame duration (ie: 4410 samples), rarely a
+ * size FFTW transforms fast. The transform is negotiated to a fast size instead, the frames zero-padded or
+ * interpolated to it, and every spectral stage works at the resolution of the transform.
+ */
+class ChannelAnalyzer
+{
+enum {
+    SHORT_WINDOW_DIVISOR = 4, MIN_SHORT_WINDOW = 256
+};
+
+public:
+    /**
+     * @brief How the size of the transform is chosen from the size of the frames
+     */
+    enum TransformSizing {
+        EXACT_SIZE,         // The size of the frames, whatever it is
+        ZERO_PAD,           // The next fast size, the frames are padded with zeros (finer bins, same resolution)
+        INTERPOLATE         // The next fast size, the frames are interpolated up to it over the same duration
+    };
+
+    /**
+     * @param plans The cache of the FFT plans and note maps
+     */
+    explicit ChannelAnalyzer(PlanCache &plans = PlanCache::shared());
+    ~ChannelAnalyzer();
+
+    ChannelAnalyzer(const ChannelAnalyzer&) = delete;
+    ChannelAnalyzer& operator=(const ChannelAnalyzer&) = delete;
+
+    /**
+     * @brief Analyzes the samples of a frame of the channel
+     * @param data The samples to analyze
+     * @param numSamples Number of samples in data
+     * @param sampleRate The sample rate of the samples
+     */
+    void analyze(const float *data, size_t numSamples, int sampleRate);
+
+    /**
+     * @brief Returns the result of the last analysis
+     */
+    const ChannelResult& getResult() const { return result; }
+
+    /**
+     * @brief Sets whether the frames of background noise skip the spectrum and the note
+     * @param gating True to gate the frames (the default)
+     */
+    void setGating(bool gating);
+
+    /**
+     * @brief Returns the activity gate, for its noise floor
+     */
+    const ActivityGate& getGate() const { return gate; }
+
+    /**
+     * @brief Sets the detection function and threshold of the onsets
+     * @param settings The settings @see{OnsetDetector::defaultSettings}
+     */
+    void setOnsetSettings(const OnsetDetector::Settings &settings) { onsets.setSettings(settings); }
+
+    /**
+     * @brief Returns the size of the short window the pitch of an onset is estimated on
+     * @param numSamples Number of samples of the frames
+     */
+    static size_t shortWindowSize(size_t numSamples);
+
+    /**
+     * @brief Sets how the size of the transform is chosen, forgets the previous frames
+     * @param sizing The sizing, ZERO_PAD by default
+     * @param powersOfTwo True to only use powers of two, false to also use the sizes made of 2, 3 and 5
+     */
+    void setTransformSizing(TransformSizing sizing, bool powersOfTwo = false);
+
+    /**
+     * @brief Returns the size of the transform of the frames
+     * @param numSamples Number of samples of the frames
+     * @param sizing How the size is chosen
+     * @param powersOfTwo True to only use powers of two
+     */
+    static size_t transformSize(size_t numSamples, TransformSizing sizing = ZERO_PAD, bool powersOfTwo = false);
+
+    /**
+     * @brief Sets how many notes played together are looked for and how weak they can be
+     * @param settings The settings @see{MultiPitchEstimator::defaultSettings}, maxNotes 0 to look for none
+     */
+    void setPolyphonySettings(const MultiPitchEstimator::Settings &settings) { polyphony.setSettings(settings); }
+
+    /**
+     * @brief Sets the estimators voting for the note, the more of them the more robust and the more expensive
+     * @param estimators A mask of PitchEstimators::Estimator, PitchEstimators::PARTIALS by default
+     */
+    void setPitchEstimators(unsigned estimators);
+
+    /**
+     * @brief Returns the magnitude spectrum of the last analysis (only the first half is meaningful)
+     */
+    const double* getSpectrum() const { return data_out.data(); }
+
+    /**
+     * @brief Returns the number of values of the magnitude spectrum, the size of the transform
+     */
+    size_t getSpectrumSize() const { return data_out.size(); }
+
+    /**
+     * @brief Returns the sample rate the spectrum was transformed at, bin k is at k * rate / getSpectrumSize() Hz
+     * @param sampleRate The sample rate of the frames
+     */
+    int getSpectrumRate(int sampleRate) const;
+
+    // The stages of analyze(), in order, public so the benchmarks can measure them one by one
+    /**
+     * ** Some code taken/inspired from Qt example "Spectrum" **
+     * @brief Calculates the audio level
+     * @param data The samples to analyze
+     * @param numSamples Number of samples in data
+     */
+    void calculateLevel(const float *data, size_t numSamples);
+
+    /**
+     * @brief Calculates the frequency spectrum (data_out), at the size of the transform
+     * @param data The samples to analyze
+     * @param numSamples Number of samples in data
+     */
+    void calculateSpectrum(const float *data, size_t numSamples);
+
+    /**
+     * @brief Calculates the note of the frequency spectrum (data_out)
+     * @param sampleRate The sample rate of the incoming audio to analyze
+     */
+    void calculateNote(const int sampleRate);
+
+    /**
+     * @brief Detects an onset in the frequency spectrum (data_out) and estimates its note again on a short window
+     * @param data The samples analyzed
+     * @param numSamples Number of samples in data
+     * @param sampleRate The sample rate of the samples
+     */
+    void calculateOnset(const float *data, size_t numSamples, int sampleRate);
+
+    /**
+     * @brief Calculates the notes played together in the frequency spectrum (data_out) and their chord
+     * @param sampleRate The sample rate of the incoming audio to analyze
+     */
+    void calculateNotes(const int sampleRate);
+
+    /**
+     * @brief Tracks the partials of the frequency spectrum (data_out) and takes the note from them
+     * @param numSamples Number of samples analyzed
+     * @param sampleRate The sample rate of the samples
+     */
+    void calculatePartials(size_t numSamples, int sampleRate);
+
+    /**
+     * @brief Fuses the votes of the estimators enabled into the note of the frequency spectrum (data_out)
+     * @param sampleRate The sample rate of the incoming audio to analyze
+     */
+    void calculatePitch(const int sampleRate);
+
+private:
+    typedef std::vector<double, FftwAllocator<double>> RealBuffer;
+    typedef std::vector<std::complex<double>, FftwAllocator<std::complex<double>>> ComplexBuffer;
+
+    PlanCache&                          plans;          // Where the plans and note maps come from
+    RealBuffer                          fftw_in;
+    ComplexBuffer                       fftw_out;
+    fftw_plan                           plan;           // Plan for the size of fftw_in, owned by plans, nullptr until the first frame
+    const PlanCache::NoteMap*           noteMap;        // Bins of the notes for the size and rate of the last frame
+
+    std::vector<double>                 data_out;
+
+    OnsetDetector                       onsets;         // Compares the spectrum with the previous one
+    RealBuffer                          short_in;       // The end of the frame, for the pitch of an onset
+    ComplexBuffer                       short_out;
+    std::vector<double>                 short_magnitudes;
+    fftw_plan                           shortPlan;      // Plan for the size of short_in, owned by plans
+    const PlanCache::NoteMap*           shortNoteMap;   // Bins of the notes for the short window
+    bool                                shortNote;      // True if the note of the frame comes from the short window
+
+    MultiPitchEstimator                 polyphony;      // Notes played together and their chord
+    PartialTracker                      tracker;        // Partials of the previous frames and the stable note
+    PitchEstimators                     estimators;     // Harmonic product spectrum and cepstrum of the spectrum
+    unsigned                            enabledEstimators; // Mask of the PitchEstimators::Estimator voting for the note
+    PitchEstimators::Estimate           strongestBin;   // Vote of calculateNote()
+
+    ChannelResult                       result;         // Result of the last analysis
+    ActivityGate                        gate;           // Tells the frames with activity from the background noise
+    bool                                gating;         // True to skip the spectral stages of the frames the gate closes on
+    bool                                spectrumCleared; // True if data_out was zeroed since the last spectrum
+    TransformSizing                     sizing;         // How the size of the transform is chosen
+    bool                                powersOfTwo;    // True to only transform at powers of two
+    size_t                              frameSize;      // Number of samples of the last frame transformed
+
+    /**
+     * @brief Clears the spectrum and the note of a frame of background noise
+     * @param numSamples Number of samples of the frame
+     */
+    void skipSpectrum(size_t numSamples);
+
+    /**
+     * @brief Applies a windowing function to the frequency spectrum (fftw_out)
+     */
+    void applyWindowingFunction();
+};
+
+#endif // CHANNELANALYZER_H
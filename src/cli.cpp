@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "allocationaudit.h"
+#include "frameanalyzer.h"
+#include "framer.h"
+#include "latencystats.h"
+#include "multipitchestimator.h"
+#include "notes.h"
+#include "pitchestimators.h"
+#include "resultstream.h"
+#include "sharedspectrum.h"
+#include "spectrogramarchive.h"
+#include "streamreader.h"
+#include "tracer.h"
+
+/*
+ * Headless front end of the analysis: reads raw PCM samples from a file or from the standard input and prints
+ * the results of every channel of every frame, one line each. Only links the core library, no Qt.
+ * Built with AUDIT_ALLOCATIONS, it fails when the analysis allocates once warmed up (@see{allocationaudit.h}).
+ */
+namespace {
+    // Frames analyzed before the allocation audit is armed, the buffers have their size by then
+    const int WARMUP_FRAMES = 10;
+
+    struct Options
+    {
+        std::string     path;               // File of raw samples, "-" for the standard input
+        SampleFormat    format;             // Format of the samples
+        int             sampleRate;         // Sample rate of the samples
+        int             analysisRate;       // Sample rate to analyze at, 0 for the rate of the samples
+        int             frameMs;            // Duration of the new samples of a frame in ms
+        bool            mixdown;            // True to also analyze the mix of the channels
+        bool            latency;            // True to print the latency of the stages on exit
+        bool            gate;               // True to skip the spectrum and note of the frames of background noise
+        int             maxNotes;           // Number of notes played together looked for, 0 for none
+        ChannelAnalyzer::TransformSizing sizing; // How the size of the transform is chosen from the size of the frames
+        bool            powersOfTwo;        // True to only transform at powers of two
+        unsigned        estimators;         // Mask of the PitchEstimators::Estimator voting for the note
+        std::string     streamPath;         // File to write a result stream to instead of printing the results, empty for none
+        int             streamBins;         // Number of bins of the quantized spectra of the result stream, 0 for none
+        std::string     spectrogramPath;    // File to write a spectrogram archive of the analyzed channel to, empty for none
+        int             spectrogramBits;    // Bits of each value of the spectrogram archive, 8 or 16
+        std::string     publishName;        // Name of the shared memory ring to publish the frames to, empty for none
+        std::string     tracePath;          // File to write a trace of the activity to, empty for none
+    };
+
+    void usage(const char *program)
+    {
+        std::fprintf(stderr,
+                     "Usage: %s [options] FILE|--stdin\n"
+                     "  --stdin               read the samples from the standard input, an unbounded stream (or FILE -)\n"
+                     "  --format FMT          sample format: s8, u8, s16le, s16be, s24le, s24be, s32le, s32be,\n"
+                     "                        u16le, u16be, f32le, f32be, f64le, f64be (default f32le)\n"
+                     "  --rate HZ             sample rate of the file (default 44100)\n"
+                     "  --channels N          number of interleaved channels (default 1)\n"
+                     "  --analysis-rate HZ    resample to this rate before analysis (default: none)\n"
+                     "  --frame-ms MS         duration of the new samples of a frame (default 100)\n"
+                     "  --mixdown             also analyze the mix of the channels\n"
+                     "  --no-gate             analyze the spectrum and note of every frame, even of background noise\n"
+                     "  --notes N             number of notes played together looked for, 0 for none (default 4)\n"
+                     "  --transform MODE      size of the transform: exact (the frame size), pad (zero-pad to the next\n"
+                     "                        fast size) or interpolate (stretch the frame to that size) (default pad)\n"
+                     "  --pow2                only use powers of two as fast sizes (default: sizes made of 2, 3 and 5)\n"
+                     "  --pitch LIST          estimators voting for the note, separated by commas, from the cheapest:\n"
+                     "                        bin, hps, cepstrum, partials, or all (default partials)\n"
+                     "  --stream FILE         write the results to a binary result stream instead of printing them\n"
+                     "  --stream-bins N       store the spectra in the result stream, quantized to N bins (default 0)\n"
+                     "  --spectrogram FILE    write the spectra of the mix (or of the first channel) to a compressed archive\n"
+                     "  --spectrogram-bits N  bits of each value of the spectrogram archive, 8 or 16 (default 8)\n"
+                     "  --publish NAME        publish the frames to a shared memory ring for other processes\n"
+                     "  --latency             print the latency of the stages on exit\n"
+                     "  --trace FILE          write a Chrome trace of the activity (builds with TRACE_EVENTS)\n",
+                     program);
+    }
+
+    /*
+     * Parses the names used by most audio tools (sox, ffmpeg): type, size in bits, byte order
+     */
+    bool parseFormat(const std::string &name, SampleFormat &format)
+    {
+        if (name.size() < 2) return false;
+
+        switch (name[0]) {
+        case 's': format.type = SampleFormat::SignedInt; break;
+        case 'u': format.type = SampleFormat::UnsignedInt; break;
+        case 'f': format.type = SampleFormat::Float; break;
+        default: return false;
+        }
+
+        // The byte order is optional, little endian by default
+        std::string bits = name.substr(1);
+        format.byteOrder = SampleFormat::LittleEndian;
+        const std::string suffix = bits.size() > 2 ? bits.substr(bits.size() - 2) : std::string();
+        if (suffix == "le" || suffix == "be") {
+            format.byteOrder = suffix == "be" ? SampleFormat::BigEndian : SampleFormat::LittleEndian;
+            bits.resize(bits.size() - 2);
+        }
+
+        // Whether the size exists for the type is up to the sample converter
+        char *end = nullptr;
+        format.sampleSize = static_cast<int>(std::strtol(bits.c_str(), &end, 10));
+        return end != bits.c_str() && *end == '\0';
+    }
+
+    /*
+     * Parses a list of estimators separated by commas into a mask
+     */
+    bool parseEstimators(const std::string &list, unsigned &estimators)
+    {
+        estimators = 0;
+        size_t start = 0;
+        while (start <= list.size()) {
+            const size_t end = std::min(list.find(',', start), list.size());
+            const std::string name = list.substr(start, end - start);
+            if (name == "bin") estimators |= PitchEstimators::STRONGEST_BIN;
+            else if (name == "hps") estimators |= PitchEstimators::HARMONIC_PRODUCT;
+            else if (name == "cepstrum") estimators |= PitchEstimators::CEPSTRUM;
+            else if (name == "partials") estimators |= PitchEstimators::PARTIALS;
+            else if (name == "all") estimators |= PitchEstimators::ALL_ESTIMATORS;
+            else return false;
+            start = end + 1;
+        }
+        return estimators != 0;
+    }
+
+    bool parseOptions(int argc, char *argv[], Options &options)
+    {
+        options.format = SampleFormat{SampleFormat::Float, SampleFormat::LittleEndian, 32, 1};
+        options.sampleRate = 44100;
+        options.analysisRate = 0;
+        options.frameMs = 100;
+        options.mixdown = false;
+        options.latency = false;
+        options.gate = true;
+        options.maxNotes = static_cast<int>(MultiPitchEstimator::defaultSettings().maxNotes);
+        options.sizing = ChannelAnalyzer::ZERO_PAD;
+        options.powersOfTwo = false;
+        options.estimators = PitchEstimators::PARTIALS;
+        options.streamBins = 0;
+        options.spectrogramBits = SpectrogramArchiveWriter::defaultSettings().bitsPerValue;
+
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (arg == "--format" && hasValue) {
+                const int channelCount = options.format.channelCount;
+                if (!parseFormat(argv[++i], options.format)) return false;
+                options.format.channelCount = channelCount;
+            }
+            else if (arg == "--rate" && hasValue) options.sampleRate = std::atoi(argv[++i]);
+            else if (arg == "--channels" && hasValue) options.format.channelCount = std::atoi(argv[++i]);
+            else if (arg == "--analysis-rate" && hasValue) options.analysisRate = std::atoi(argv[++i]);
+            else if (arg == "--frame-ms" && hasValue) options.frameMs = std::atoi(argv[++i]);
+            else if (arg == "--mixdown") options.mixdown = true;
+            else if (arg == "--latency") options.latency = true;
+            else if (arg == "--no-gate") options.gate = false;
+            else if (arg == "--notes" && hasValue) options.maxNotes = std::atoi(argv[++i]);
+            else if (arg == "--transform" && hasValue) {
+                const std::string mode = argv[++i];
+                if (mode == "exact") options.sizing = ChannelAnalyzer::EXACT_SIZE;
+                else if (mode == "pad") options.sizing = ChannelAnalyzer::ZERO_PAD;
+                else if (mode == "interpolate") options.sizing = ChannelAnalyzer::INTERPOLATE;
+                else return false;
+            }
+            else if (arg == "--pow2") options.powersOfTwo = true;
+            else if (arg == "--pitch" && hasValue) {
+                if (!parseEstimators(argv[++i], options.estimators)) return false;
+            }
+            else if (arg == "--stream" && hasValue) options.streamPath = argv[++i];
+            else if (arg == "--stream-bins" && hasValue) options.streamBins = std::atoi(argv[++i]);
+            else if (arg == "--spectrogram" && hasValue) options.spectrogramPath = argv[++i];
+            else if (arg == "--spectrogram-bits" && hasValue) options.spectrogramBits = std::atoi(argv[++i]);
+            else if (arg == "--publish" && hasValue) options.publishName = argv[++i];
+            else if (arg == "--trace" && hasValue) options.tracePath = argv[++i];
+            else if (arg == "--stdin" && options.path.empty()) options.path = "-";
+            else if (arg.compare(0, 2, "--") != 0 && options.path.empty()) options.path = arg;
+            else return false;
+        }
+
+        return !options.path.empty() && options.sampleRate > 0 && options.frameMs > 0 && options.format.channelCount > 0
+            && options.maxNotes >= 0 && options.maxNotes <= ChannelResult::MAX_NOTES && options.streamBins >= 0
+            && (options.spectrogramBits == 8 || options.spectrogramBits == 16);
+    }
+
+    void printResults(const FrameResults &results)
+    {
+        for (size_t c = 0; c < results.numChannels; ++c) {
+            const ChannelResult &result = results.channels[c];
+            const bool isMix = results.hasMix && c + 1 == results.numChannels;
+            // The notes played together, separated by spaces
+            std::string played;
+            for (size_t i = 0; i < result.numNotes; ++i) {
+                if (i > 0) played += ' ';
+                played += notes::notes[result.notes[i]];
+            }
+
+            std::printf("%.3f\t%s\t%.6f\t%.6f\t%s\t%.2f\t%.3f\t%d\t%s\t%s%s\n",
+                        static_cast<double>(results.timestampUs) / 1000000.0,
+                        isMix ? "mix" : std::to_string(c).c_str(),
+                        static_cast<double>(result.rmsLevel),
+                        static_cast<double>(result.peakLevel),
+                        result.note >= 0 ? notes::notes[result.note] : "-",
+                        static_cast<double>(result.pitchHz),
+                        static_cast<double>(result.confidence),
+                        result.onset ? 1 : 0,
+                        played.empty() ? "-" : played.c_str(),
+                        result.chord >= 0 ? MultiPitchEstimator::chordRoot(result.chord) : "-",
+                        MultiPitchEstimator::chordSuffix(result.chord));
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // Read ahead in large blocks, the analysis of a block overlaps the reading of the next ones
+    StreamReader input;
+    if (!input.open(options.path.c_str())) {
+        std::fprintf(stderr, "Cannot open %s\n", options.path.c_str());
+        return 1;
+    }
+
+    // A push is the data of a frame, every frame it completes is analyzed before the next push
+    const size_t readFrames = static_cast<size_t>(options.sampleRate) * static_cast<size_t>(options.frameMs) / 1000 + 1;
+    Framer framer;
+    framer.setMixdown(options.mixdown);
+    framer.setAnalysisRate(options.analysisRate);
+    if (!framer.configure(options.format, options.sampleRate, options.frameMs, readFrames)) {
+        std::fprintf(stderr, "Unsupported sample format\n");
+        return 1;
+    }
+
+    TRACE_THREAD_NAME("main");
+    if (!options.tracePath.empty()) tracer::start();
+
+    FrameAnalyzer analyzer(WorkerPool::defaultNumThreads());
+    analyzer.setGating(options.gate);
+    MultiPitchEstimator::Settings polyphony = MultiPitchEstimator::defaultSettings();
+    polyphony.maxNotes = static_cast<size_t>(options.maxNotes);
+    analyzer.setPolyphonySettings(polyphony);
+    analyzer.setTransformSizing(options.sizing, options.powersOfTwo);
+    analyzer.setPitchEstimators(options.estimators);
+    const size_t pushBytes = readFrames * options.format.bytesPerFrame();
+
+    // The time of a frame is the position of its new samples in the stream
+    const int64_t frameDurationUs = static_cast<int64_t>(framer.getFrameSize()) * 1000000 / framer.getFrameRate();
+    int64_t timestampUs = 0;
+    int numFrames = 0;
+    LatencyStats latency;
+
+    // Every record is kept, the stream is read no faster than they are written
+    ResultStreamWriter stream;
+    if (!options.streamPath.empty()) {
+        ResultStreamWriter::Settings settings = ResultStreamWriter::defaultSettings();
+        settings.spectrumBins = static_cast<size_t>(options.streamBins);
+        settings.lossless = true;
+        if (!stream.open(options.streamPath.c_str(), settings)) {
+            std::fprintf(stderr, "Cannot create %s\n", options.streamPath.c_str());
+            return 1;
+        }
+    }
+    SpectrogramArchiveWriter spectrogram;
+    if (!options.spectrogramPath.empty()) {
+        SpectrogramArchiveWriter::Settings settings = SpectrogramArchiveWriter::defaultSettings();
+        settings.bitsPerValue = options.spectrogramBits;
+        settings.lossless = true;
+        if (!spectrogram.open(options.spectrogramPath.c_str(), settings)) {
+            std::fprintf(stderr, "Cannot create %s\n", options.spectrogramPath.c_str());
+            return 1;
+        }
+    }
+    SharedSpectrumPublisher publisher;
+    if (!options.publishName.empty() && !publisher.open(options.publishName.c_str())) {
+        std::fprintf(stderr, "Cannot create the shared memory ring %s\n", options.publishName.c_str());
+        return 1;
+    }
+    if (!stream.isOpen()) {
+        std::printf("time\tchannel\trms\tpeak\tnote\tpitch\tconfidence\tonset\tnotes\tchord\n");
+    }
+    const char *block;
+    size_t blockBytes;
+    while (input.read(block, blockBytes)) {
+        for (size_t offset = 0; offset < blockBytes; offset += pushBytes) {
+            TRACE_SCOPE("push");
+            const int64_t readUs = LatencyStats::nowUs();
+            framer.push(block + offset, std::min(pushBytes, blockBytes - offset));
+
+            AudioFrame frame;
+            while (framer.pop(timestampUs, frame)) {
+                // A stream has no capture time, the stages start at the push
+                frame.stamps.us[FrameStamps::READ] = readUs;
+                frame.stamps.us[FrameStamps::FRAMED] = LatencyStats::nowUs();
+
+                FrameStamps stamps = analyzer.analyze(frame).stamps;
+                frame.release();
+                if (stream.isOpen()) stream.append(analyzer.getResults(), &analyzer);
+                else printResults(analyzer.getResults());
+                if (publisher.isOpen()) publisher.publish(analyzer.getResults(), analyzer, frame.sampleRate);
+                if (spectrogram.isOpen()) {
+                    // The mix is the last channel
+                    const ChannelAnalyzer &archived = analyzer.getChannel(frame.hasMix ? frame.numChannels - 1 : 0);
+                    spectrogram.append(analyzer.getResults().timestampUs, archived.getSpectrum(), archived.getSpectrumSize());
+                }
+                stamps.us[FrameStamps::PUBLISHED] = LatencyStats::nowUs();
+                latency.record(stamps);
+
+                timestampUs += frameDurationUs;
+                if (++numFrames == WARMUP_FRAMES) allocationaudit::armThread("analysis");
+            }
+        }
+        // Down a pipeline, the results of a block go out with it rather than when the buffer of stdout fills
+        if (!stream.isOpen()) std::fflush(stdout);
+    }
+    allocationaudit::disarmThread();
+    if (input.hasFailed()) std::fprintf(stderr, "Cannot read %s\n", options.path.c_str());
+
+    if (stream.isOpen() && !stream.close()) {
+        std::fprintf(stderr, "Cannot write the result stream to %s\n", options.streamPath.c_str());
+        return 1;
+    }
+    if (spectrogram.isOpen() && !spectrogram.close()) {
+        std::fprintf(stderr, "Cannot write the spectrogram archive to %s\n", options.spectrogramPath.c_str());
+        return 1;
+    }
+    if (options.latency) latency.report(stderr);
+    if (!options.tracePath.empty()) {
+        tracer::stop();
+        if (!tracer::write(options.tracePath.c_str())) std::fprintf(stderr, "Cannot write the trace to %s\n", options.tracePath.c_str());
+    }
+    return allocationaudit::report() > 0 ? 1 : 0;
+}
@@ -0,0 +1,21 @@
+# Third party libraries of the core, shared by every target building against it
+
+# Libraries for fftw3 32 bits does not seem to be working... Must compile with 64 bits for now.
+#!contains(QMAKE_TARGET.arch, x86_64) {
+#    message( "Building for 32 bits machine...")
+#    LIBS += -L$$PWD/vendor/fftw/fftw-3.3.5-dll32 -lfftw3-3 -lfftw3l-3 -lfftw3f-3
+
+#    INCLUDEPATH += $$PWD/vendor/fftw/fftw-3.3.5-dll32
+#    DEPENDPATH += $$PWD/vendor/fftw/fftw-3.3.5-dll32
+#}
+#else {
+    message( "Building for 64 bits machine...")
+    LIBS += -L$$PWD/vendor/fftw/fftw-3.3.5-dll64 -lfftw3-3 -lfftw3l-3 -lfftw3f-3
+
+    INCLUDEPATH += $$PWD/vendor/fftw/fftw-3.3.5-dll64
+    DEPENDPATH += $$PWD/vendor/fftw/fftw-3.3.5-dll64
+#}
+
+
+INCLUDEPATH += C:\Dev\boost_1_69_0
+DEPENDPATH += C:\Dev\boost_1_69_0
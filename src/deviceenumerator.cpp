@@ -0,0 +1,178 @@
+#include "deviceenumerator.h"
+
+#include <QSettings>
+#include <QStringList>
+
+#include "util.h"
+
+namespace {
+    // Common rates and sample layouts, probed after the preferred format
+    const int PROBED_RATES[] = {44100, 48000, 96000, 22050};
+    const int PROBED_CHANNELS[] = {1, 2};
+    const struct { QAudioFormat::SampleType type; int size; } PROBED_SAMPLES[] = {
+        {QAudioFormat::Float, 32}, {QAudioFormat::SignedInt, 16}, {QAudioFormat::SignedInt, 32}, {QAudioFormat::SignedInt, 24}
+    };
+
+    QString encode(const QAudioFormat &format)
+    {
+        return QString("%1/%2/%3/%4/%5").arg(format.sampleRate()).arg(format.channelCount()).arg(format.sampleSize())
+                                        .arg(static_cast<int>(format.sampleType())).arg(static_cast<int>(format.byteOrder()));
+    }
+
+    bool decode(const QString &text, QAudioFormat &format)
+    {
+        const QStringList fields = text.split('/');
+        if (fields.size() != 5) return false;
+
+        format.setSampleRate(fields.at(0).toInt());
+        format.setChannelCount(fields.at(1).toInt());
+        format.setSampleSize(fields.at(2).toInt());
+        format.setSampleType(static_cast<QAudioFormat::SampleType>(fields.at(3).toInt()));
+        format.setByteOrder(static_cast<QAudioFormat::Endian>(fields.at(4).toInt()));
+        format.setCodec("audio/pcm");
+        return util::isFormatConvertible(format);
+    }
+
+    QStringList deviceNames(const QList<QAudioDeviceInfo> &infos)
+    {
+        QStringList names;
+        for (const QAudioDeviceInfo &info : infos) names.append(info.deviceName());
+        return names;
+    }
+}
+
+DeviceEnumerator::DeviceEnumerator(const QAudioFormat &preferredFormat)
+    : thread{new QThread}
+    , preferredFormat{preferredFormat}
+    , mutex{}
+    , devices{}
+{
+    moveToThread(thread);
+    thread->start();
+}
+
+DeviceEnumerator::~DeviceEnumerator() {}
+
+std::vector<DeviceEnumerator::Device> DeviceEnumerator::getDevices() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return devices;
+}
+
+void DeviceEnumerator::enumerate(bool force)
+{
+    // Listing the devices is cheap, probing their formats is what takes long
+    const QList<QAudioDeviceInfo> infos = QAudioDeviceInfo::availableDevices(QAudio::AudioInput);
+
+    std::vector<Device> found;
+    if (force || !load(infos, found)) {
+        found.clear();
+        for (const QAudioDeviceInfo &info : infos) {
+            Device device;
+            if (probe(info, device)) found.push_back(device);
+        }
+        save(infos, found);
+    }
+
+    AUDIOENGINE_DEBUG << "DeviceEnumerator::enumerate" << "devices" << infos.size() << "capturable" << found.size();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        devices.swap(found);
+    }
+    emit devicesChanged();
+}
+
+QList<QAudioFormat> DeviceEnumerator::candidateFormats() const
+{
+    QList<QAudioFormat> candidates;
+    candidates.append(preferredFormat);
+
+    for (int rate : PROBED_RATES) {
+        for (const auto &sample : PROBED_SAMPLES) {
+            for (int channels : PROBED_CHANNELS) {
+                QAudioFormat candidate = preferredFormat;
+                candidate.setSampleRate(rate);
+                candidate.setSampleType(sample.type);
+                candidate.setSampleSize(sample.size);
+                candidate.setChannelCount(channels);
+                if (candidate != preferredFormat) candidates.append(candidate);
+            }
+        }
+    }
+    return candidates;
+}
+
+bool DeviceEnumerator::probe(const QAudioDeviceInfo &info, Device &device) const
+{
+    device.info = info;
+    device.formats.clear();
+    for (const QAudioFormat &candidate : candidateFormats()) {
+        if (info.isFormatSupported(candidate) && util::isFormatConvertible(candidate)) device.formats.append(candidate);
+    }
+
+    // None of the common formats, the closest one to the preferred format may still do
+    if (device.formats.isEmpty()) {
+        const QAudioFormat nearest = info.nearestFormat(preferredFormat);
+        if (util::isFormatConvertible(nearest)) device.formats.append(nearest);
+    }
+
+    if (device.formats.isEmpty()) return false;
+    device.format = device.formats.first();
+    return true;
+}
+
+bool DeviceEnumerator::load(const QList<QAudioDeviceInfo> &infos, std::vector<Device> &cached) const
+{
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope, "ToneAnalyzer", "devices");
+    if (settings.value("version").toInt() != CACHE_VERSION) return false;
+    if (settings.value("preferred").toString() != encode(preferredFormat)) return false;
+    if (settings.value("names").toStringList() != deviceNames(infos)) return false;
+
+    // One entry per device present, with no format for those that cannot be captured
+    const int size = settings.beginReadArray("devices");
+    if (size != infos.size()) {
+        settings.endArray();
+        return false;
+    }
+
+    for (int i = 0; i < size; ++i) {
+        settings.setArrayIndex(i);
+        Device device;
+        device.info = infos.at(i);
+        for (const QString &text : settings.value("formats").toStringList()) {
+            QAudioFormat format;
+            if (decode(text, format)) device.formats.append(format);
+        }
+        if (device.formats.isEmpty()) continue;
+
+        device.format = device.formats.first();
+        cached.push_back(device);
+    }
+    settings.endArray();
+    return true;
+}
+
+void DeviceEnumerator::save(const QList<QAudioDeviceInfo> &infos, const std::vector<Device> &probed) const
+{
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope, "ToneAnalyzer", "devices");
+    settings.clear();
+    settings.setValue("version", static_cast<int>(CACHE_VERSION));
+    settings.setValue("preferred", encode(preferredFormat));
+    settings.setValue("names", deviceNames(infos));
+
+    settings.beginWriteArray("devices", infos.size());
+    size_t next = 0;
+    for (int i = 0; i < infos.size(); ++i) {
+        settings.setArrayIndex(i);
+
+        // The devices probed are in the order of infos, without the ones that cannot be captured
+        QStringList formats;
+        if (next < probed.size() && probed[next].info.deviceName() == infos.at(i).deviceName()) {
+            for (const QAudioFormat &format : probed[next].formats) formats.append(encode(format));
+            ++next;
+        }
+        settings.setValue("formats", formats);
+    }
+    settings.endArray();
+}
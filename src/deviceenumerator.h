@@ -0,0 +1,101 @@
+#ifndef DEVICEENUMERATOR_H
+#define DEVICEENUMERATOR_H
+
+#include <mutex>
+#include <vector>
+
+#include <QAudioDeviceInfo>
+#include <QAudioFormat>
+#include <QList>
+#include <QObject>
+#include <QThread>
+
+/**
+ * Lists the audio input devices and the formats each one can be captured with, off the GUI thread.
+ *
+ * Probing the formats of a device asks its backend, which on machines with many endpoints takes long. The
+ * probing runs on the thread of the enumerator and its results are cached across runs (in the user's
+ * settings). The cache is used as long as the list of device names is the one it was made for, any device
+ * added or removed invalidates it. devicesChanged is emitted once the devices are known.
+ */
+class DeviceEnumerator : public QObject
+{
+    Q_OBJECT
+
+enum {
+    CACHE_VERSION = 1
+};
+
+public:
+    /**
+     * @brief An audio input device and the formats it can be captured with
+     */
+    struct Device
+    {
+        QAudioDeviceInfo        info;           // The device
+        QAudioFormat            format;         // Format to capture it with, the first supported of the probed ones
+        QList<QAudioFormat>     formats;        // Every probed format it supports and we can convert
+    };
+
+    /**
+     * @param preferredFormat The format to capture with when a device supports it, probed first
+     */
+    explicit DeviceEnumerator(const QAudioFormat &preferredFormat);
+    ~DeviceEnumerator();
+
+    /**
+     * @brief Returns the devices found by the last enumeration, safe to call from any thread
+     * @return The devices, empty until the first enumeration is done
+     */
+    std::vector<Device> getDevices() const;
+
+public slots:
+    /**
+     * @brief Lists the devices, from the cache when the device list did not change, probing them otherwise
+     * @param force True to probe the devices even if the cache is valid
+     */
+    void enumerate(bool force = false);
+
+signals:
+    /**
+     * @brief Signal for the devices found by an enumeration, to be fetched with getDevices()
+     */
+    void devicesChanged();
+
+private:
+    QThread*                thread;             // The thread it will be running on
+
+    QAudioFormat            preferredFormat;    // Format probed first
+    mutable std::mutex      mutex;              // Guards devices
+    std::vector<Device>     devices;            // Devices found by the last enumeration
+
+    /**
+     * @brief Returns the formats to probe, the preferred one first, then the common rates, sample types and channel counts
+     */
+    QList<QAudioFormat> candidateFormats() const;
+
+    /**
+     * @brief Probes the formats a device supports
+     * @param info The device
+     * @param device Receives the device and its formats
+     * @return False if none can be captured
+     */
+    bool probe(const QAudioDeviceInfo &info, Device &device) const;
+
+    /**
+     * @brief Reads the formats of the devices from the cache
+     * @param infos The devices present, the cache is only valid for exactly these
+     * @param cached Receives the devices with their formats
+     * @return False if the cache is missing or was made for other devices
+     */
+    bool load(const QList<QAudioDeviceInfo> &infos, std::vector<Device> &cached) const;
+
+    /**
+     * @brief Writes the formats of the devices to the cache
+     * @param infos The devices present
+     * @param probed The devices that can be captured, with their formats
+     */
+    void save(const QList<QAudioDeviceInfo> &infos, const std::vector<Device> &probed) const;
+};
+
+#endif // DEVICEENUMERATOR_H
@@ -0,0 +1,99 @@
+#include "frameanalyzer.h"
+
+#include <cassert>
+
+#include "latencystats.h"
+#include "tracer.h"
+
+FrameAnalyzer::FrameAnalyzer(size_t numThreads)
+    : ownPool(new WorkerPool(numThreads))
+    , pool(*ownPool)
+    , plans(PlanCache::shared())
+    , channelAnalyzers{}
+    , currentFrame{nullptr}
+    , results{}
+    , gating{true}
+    , polyphony{MultiPitchEstimator::defaultSettings()}
+    , sizing{ChannelAnalyzer::ZERO_PAD}
+    , powersOfTwo{false}
+    , estimators{PitchEstimators::PARTIALS}
+{
+}
+
+FrameAnalyzer::FrameAnalyzer(WorkerPool &pool, PlanCache &plans)
+    : ownPool{}
+    , pool(pool)
+    , plans(plans)
+    , channelAnalyzers{}
+    , currentFrame{nullptr}
+    , results{}
+    , gating{true}
+    , polyphony{MultiPitchEstimator::defaultSettings()}
+    , sizing{ChannelAnalyzer::ZERO_PAD}
+    , powersOfTwo{false}
+    , estimators{PitchEstimators::PARTIALS}
+{
+}
+
+void FrameAnalyzer::setGating(bool gating)
+{
+    this->gating = gating;
+    for (std::unique_ptr<ChannelAnalyzer> &channel : channelAnalyzers) channel->setGating(gating);
+}
+
+void FrameAnalyzer::setPolyphonySettings(const MultiPitchEstimator::Settings &settings)
+{
+    polyphony = settings;
+    for (std::unique_ptr<ChannelAnalyzer> &channel : channelAnalyzers) channel->setPolyphonySettings(settings);
+}
+
+void FrameAnalyzer::setTransformSizing(ChannelAnalyzer::TransformSizing sizing, bool powersOfTwo)
+{
+    this->sizing = sizing;
+    this->powersOfTwo = powersOfTwo;
+    for (std::unique_ptr<ChannelAnalyzer> &channel : channelAnalyzers) channel->setTransformSizing(sizing, powersOfTwo);
+}
+
+void FrameAnalyzer::setPitchEstimators(unsigned estimators)
+{
+    this->estimators = estimators;
+    for (std::unique_ptr<ChannelAnalyzer> &channel : channelAnalyzers) channel->setPitchEstimators(estimators);
+}
+
+void FrameAnalyzer::analyzeChannel(void *context, size_t channel)
+{
+    FrameAnalyzer *analyzer = static_cast<FrameAnalyzer*>(context);
+    const AudioFrame &frame = *analyzer->currentFrame;
+
+    analyzer->channelAnalyzers[channel]->analyze(frame.channel(channel), frame.numSamples, frame.sampleRate);
+}
+
+const FrameResults& FrameAnalyzer::analyze(const AudioFrame &frame)
+{
+    assert(frame.numChannels <= AudioFrame::MAX_CHANNELS + 1);
+    TRACE_SCOPE("analysis");
+    results.stamps = frame.stamps;
+    results.stamps.us[FrameStamps::ANALYSIS_STARTED] = LatencyStats::nowUs();
+
+    // One analyzer per channel, only reallocated when the number of channels changes
+    while (channelAnalyzers.size() < frame.numChannels) {
+        channelAnalyzers.emplace_back(new ChannelAnalyzer(plans));
+        channelAnalyzers.back()->setGating(gating);
+        channelAnalyzers.back()->setPolyphonySettings(polyphony);
+        channelAnalyzers.back()->setTransformSizing(sizing, powersOfTwo);
+        channelAnalyzers.back()->setPitchEstimators(estimators);
+    }
+    channelAnalyzers.resize(frame.numChannels);
+
+    currentFrame = &frame;
+    pool.run(frame.numChannels, &FrameAnalyzer::analyzeChannel, this);
+    currentFrame = nullptr;
+
+    results.timestampUs = frame.timestampUs;
+    results.numChannels = frame.numChannels;
+    results.hasMix = frame.hasMix;
+    for (size_t i = 0; i < frame.numChannels; ++i) results.channels[i] = channelAnalyzers[i]->getResult();
+    results.stamps.us[FrameStamps::ANALYZED] = LatencyStats::nowUs();
+
+    return results;
+}
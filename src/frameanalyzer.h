@@ -0,0 +1,99 @@
+#ifndef FRAMEANALYZER_H
+#define FRAMEANALYZER_H
+
+#include <memory>
+#include <vector>
+
+#include "audioframe.h"
+#include "channelanalyzer.h"
+#include "workerpool.h"
+
+/**
+ * Analysis of every channel of a frame: level, spectrum and note.
+ *
+ * Each channel has its own analyzer and the channels are analyzed in parallel by a pool of threads, the
+ * calling thread included. The pool can be shared by the analyzers of several streams, their loops then
+ * take turns on its threads. The results and spectra stay valid until the next call to analyze().
+ */
+class FrameAnalyzer
+{
+public:
+    /**
+     * @brief Creates the analyzer and its threads
+     * @param numThreads Number of threads besides the calling one (@see{WorkerPool::defaultNumThreads})
+     */
+    explicit FrameAnalyzer(size_t numThreads);
+
+    /**
+     * @brief Creates the analyzer on the threads of a shared pool
+     * @param pool The pool, must outlive the analyzer
+     * @param plans The cache of the FFT plans and note maps of the channels
+     */
+    explicit FrameAnalyzer(WorkerPool &pool, PlanCache &plans = PlanCache::shared());
+
+    FrameAnalyzer(const FrameAnalyzer&) = delete;
+    FrameAnalyzer& operator=(const FrameAnalyzer&) = delete;
+
+    /**
+     * @brief Analyzes every channel of a frame
+     * @param frame The frame to analyze
+     * @return The results of every channel, with the stamps of the frame and of the analysis
+     */
+    const FrameResults& analyze(const AudioFrame &frame);
+
+    /**
+     * @brief Returns the results of the last frame analyzed
+     */
+    const FrameResults& getResults() const { return results; }
+
+    /**
+     * @brief Sets whether the frames of background noise skip the spectrum and the note, on every channel
+     * @param gating True to gate the frames (the default)
+     */
+    void setGating(bool gating);
+
+    /**
+     * @brief Sets how many notes played together are looked for and how weak they can be, on every channel
+     * @param settings The settings @see{MultiPitchEstimator::defaultSettings}, maxNotes 0 to look for none
+     */
+    void setPolyphonySettings(const MultiPitchEstimator::Settings &settings);
+
+    /**
+     * @brief Sets how the size of the transform is chosen from the size of the frames, on every channel
+     * @param sizing The sizing, ChannelAnalyzer::ZERO_PAD by default
+     * @param powersOfTwo True to only use powers of two
+     */
+    void setTransformSizing(ChannelAnalyzer::TransformSizing sizing, bool powersOfTwo = false);
+
+    /**
+     * @brief Sets the estimators voting for the note, on every channel
+     * @param estimators A mask of PitchEstimators::Estimator, PitchEstimators::PARTIALS by default
+     */
+    void setPitchEstimators(unsigned estimators);
+
+    /**
+     * @brief Returns the analyzer of a channel of the last frame, for its spectrum
+     * @param channel Index of the channel
+     */
+    const ChannelAnalyzer& getChannel(size_t channel) const { return *channelAnalyzers[channel]; }
+
+private:
+    std::unique_ptr<WorkerPool>                     ownPool;            // The pool when it is not shared
+    WorkerPool&                                     pool;               // Threads analyzing the channels in parallel
+    PlanCache&                                      plans;              // FFT plans and note maps of the channels
+    std::vector<std::unique_ptr<ChannelAnalyzer>>   channelAnalyzers;   // One analyzer per channel
+    const AudioFrame*                               currentFrame;       // Frame being analyzed by the pool
+    FrameResults                                    results;            // Results of the last frame
+    bool                                            gating;             // True to gate the frames of background noise
+    MultiPitchEstimator::Settings                   polyphony;          // Notes played together looked for on every channel
+    ChannelAnalyzer::TransformSizing                sizing;             // How the size of the transform is chosen
+    bool                                            powersOfTwo;        // True to only transform at powers of two
+    unsigned                                        estimators;         // Mask of the estimators voting for the note
+
+    /**
+     * @brief Task of the pool, analyzes one channel of currentFrame
+     */
+    static void analyzeChannel(void *context, size_t channel);
+};
+
+#endif // FRAMEANALYZER_H
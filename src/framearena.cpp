@@ -0,0 +1,42 @@
+#include "framearena.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+// Every allocation is aligned to at least this so the buffers can be used by vectorized loops
+const size_t MIN_ALIGNMENT = 32;
+
+FrameArena::FrameArena(size_t capacity)
+    : buffer{}
+    , used{0}
+    , highWater{0}
+{
+    if (capacity > 0) reserve(capacity);
+}
+
+void FrameArena::reserve(size_t capacity)
+{
+    // Extra room so the first allocation can be aligned whatever the address of the buffer is
+    buffer.assign(capacity + MIN_ALIGNMENT, 0);
+    used = 0;
+    highWater = 0;
+}
+
+char* FrameArena::allocateBytes(size_t size, size_t alignment)
+{
+    alignment = std::max(alignment, MIN_ALIGNMENT);
+
+    const uintptr_t base = reinterpret_cast<uintptr_t>(buffer.data());
+    const uintptr_t start = (base + used + alignment - 1) / alignment * alignment;
+    const size_t end = static_cast<size_t>(start - base) + size;
+
+    if (end > buffer.size()) {
+        assert(false && "FrameArena::allocateBytes: arena too small for the frame");
+        return nullptr;
+    }
+
+    used = end;
+    highWater = std::max(highWater, used);
+    return reinterpret_cast<char*>(start);
+}
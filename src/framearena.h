@@ -0,0 +1,60 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Scratch memory of a processing stage, allocated once and reset at the start of every frame.
+ *
+ * Allocating is only bumping an offset, so a stage can carve its temporary buffers out of the arena
+ * without ever going to the heap once the arena has been sized at initialization.
+ */
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t capacity = 0);
+
+    /**
+     * @brief Sets the capacity of the arena, this allocates and invalidates previous allocations
+     * @param capacity The capacity in bytes
+     * @note Only to be called at initialization, never while processing frames
+     */
+    void reserve(size_t capacity);
+
+    /**
+     * @brief Releases everything allocated since the last reset, to be called at the start of a frame
+     */
+    void reset() { used = 0; }
+
+    /**
+     * @brief Allocates uninitialized space for count values of type T
+     * @param count The number of values
+     * @return The space, nullptr if the arena is too small (which is a sizing bug)
+     */
+    template <typename T>
+    T* allocate(size_t count)
+    {
+        char *address = allocateBytes(count * sizeof(T), alignof(T));
+        return reinterpret_cast<T*>(address);
+    }
+
+    /**
+     * @brief Returns the capacity of the arena in bytes
+     */
+    size_t getCapacity() const { return buffer.size(); }
+
+    /**
+     * @brief Returns the highest number of bytes ever used in a frame
+     */
+    size_t getHighWater() const { return highWater; }
+
+private:
+    std::vector<char>   buffer;     // The memory of the arena
+    size_t              used;       // Number of bytes used since the last reset
+    size_t              highWater;  // Highest number of bytes used since the arena was sized
+
+    char* allocateBytes(size_t size, size_t alignment);
+};
+
+#endif // FRAMEARENA_H
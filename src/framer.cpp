@@ -0,0 +1,305 @@
+#include "framer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "tracer.h"
+
+Framer::Framer()
+    : converter{}
+    , bytesPerFrame{0}
+    , partial{}
+    , pendingBytes{0}
+    , maxPushFrames{0}
+    , numChannels{0}
+    , mixdown{false}
+    , numOutputs{0}
+    , analysisRate{0}
+    , frameRate{0}
+    , framesPerBuffer{0}
+    , resamplers{}
+    , rings{}
+    , first_halves{}
+    , arena{}
+    , pool{}
+    , nextFrame{0}
+    , framedSamples{0}
+    , policy{DROP_OLDEST}
+    , stats{}
+    , lagging{false}
+    , gapPosition{0}
+    , gapLength{0}
+{
+}
+
+bool Framer::configure(const SampleFormat &format, int sampleRate, int frameDurationMs, size_t maxPushFrames)
+{
+    if (!converter.setFormat(format) || sampleRate <= 0) return false;
+
+    bytesPerFrame = format.bytesPerFrame();
+    partial.assign(bytesPerFrame, 0);
+    pendingBytes = 0;
+    this->maxPushFrames = std::max<size_t>(maxPushFrames, 1);
+
+    numChannels = std::min<size_t>(static_cast<size_t>(format.channelCount), AudioFrame::MAX_CHANNELS);
+    numOutputs = numChannels + (mixdown && numChannels > 1 ? 1 : 0);
+
+    // The frames are at the analysis rate when there is one, so their size doesn't depend on the input
+    frameRate = analysisRate > 0 ? analysisRate : sampleRate;
+    resamplers.clear();
+    if (frameRate != sampleRate) {
+        resamplers.resize(numOutputs);
+        for (Resampler &resampler : resamplers) {
+            if (!resampler.configure(sampleRate, frameRate, this->maxPushFrames)) {
+                // The ratio of the rates is too complex, frame at the rate of the input
+                resamplers.clear();
+                frameRate = sampleRate;
+                break;
+            }
+        }
+    }
+
+    // Frames are made of two halves, the number of samples must be even
+    framesPerBuffer = static_cast<size_t>(frameRate) * static_cast<size_t>(frameDurationMs) / 1000 / 2 * 2;
+    const size_t maxResampled = resamplers.empty() ? this->maxPushFrames : resamplers.front().maxOutput(this->maxPushFrames);
+
+    // One ring and one half frame per channel of the frames, a ring holds two frames and a push
+    rings.assign(numOutputs, boost::circular_buffer<float>(framesPerBuffer * 2 + maxResampled));
+    first_halves.assign(numOutputs, std::vector<float>(framesPerBuffer / 2, 0.0f));
+
+    // The arena holds the samples of each channel of a push and their resampled version (plus room to align them)
+    arena.reserve(numOutputs * (this->maxPushFrames * sizeof(float) + 64) + maxResampled * sizeof(float) + 64);
+    pool.clear();
+    for (size_t i = 0; i < FRAME_POOL_SIZE; ++i) {
+        pool.emplace_back(new Slot);
+        pool.back()->inUse.store(false, std::memory_order_relaxed);
+        pool.back()->data.assign(numOutputs * framesPerBuffer, 0.0f);
+    }
+    nextFrame = 0;
+    stats = Stats{};
+
+    return true;
+}
+
+void Framer::reset()
+{
+    pendingBytes = 0;
+    framedSamples = 0;
+    lagging = false;
+    gapLength = 0;
+    for (Resampler &resampler : resamplers) resampler.reset();
+    for (boost::circular_buffer<float> &ring : rings) ring.clear();
+    for (std::vector<float> &half : first_halves) std::fill(half.begin(), half.end(), 0.0f);
+}
+
+void Framer::push(const char *data, size_t numBytes)
+{
+    TRACE_SCOPE("framer.push");
+
+    // Completes the audio frame left incomplete by the previous push
+    if (pendingBytes > 0) {
+        const size_t missing = std::min(bytesPerFrame - pendingBytes, numBytes);
+        std::memcpy(partial.data() + pendingBytes, data, missing);
+        pendingBytes += missing;
+        data += missing;
+        numBytes -= missing;
+
+        if (pendingBytes < bytesPerFrame) return;
+        process(partial.data(), 1);
+        pendingBytes = 0;
+    }
+
+    size_t numAudioFrames = numBytes / bytesPerFrame;
+    while (numAudioFrames > 0) {
+        const size_t count = std::min(numAudioFrames, maxPushFrames);
+        process(data, count);
+        data += count * bytesPerFrame;
+        numBytes -= count * bytesPerFrame;
+        numAudioFrames -= count;
+    }
+
+    // Only whole audio frames can be deinterleaved, the rest waits for the next push
+    std::memcpy(partial.data(), data, numBytes);
+    pendingBytes = numBytes;
+}
+
+void Framer::process(const char *data, size_t numAudioFrames)
+{
+    arena.reset();
+    float *channels[AudioFrame::MAX_CHANNELS + 1];
+    for (size_t c = 0; c < numOutputs; ++c) channels[c] = arena.allocate<float>(numAudioFrames);
+
+    // Converts the raw data of the format to floats, one buffer per channel (and their mix)
+    converter.deinterleave(data, numAudioFrames, channels);
+    if (numOutputs > numChannels) converter.downmix(data, numAudioFrames, channels[numChannels]);
+
+    if (resamplers.empty()) {
+        const size_t numKept = makeRoom(numAudioFrames);
+        for (size_t c = 0; c < numOutputs; ++c) rings[c].insert(rings[c].end(), channels[c], channels[c] + numKept);
+        return;
+    }
+
+    // Every channel is resampled from the same number of samples, so they all give the same number
+    float *resampled = arena.allocate<float>(resamplers.front().maxOutput(numAudioFrames));
+    size_t numKept = 0;
+    for (size_t c = 0; c < numOutputs; ++c) {
+        const size_t numResampled = resamplers[c].process(channels[c], numAudioFrames, resampled);
+        if (c == 0) numKept = makeRoom(numResampled);
+        rings[c].insert(rings[c].end(), resampled, resampled + numKept);
+    }
+}
+
+size_t Framer::makeRoom(size_t numSamples)
+{
+    boost::circular_buffer<float> &ring = rings.front();
+    const size_t room = ring.capacity() - ring.size();
+    if (numSamples <= room) return numSamples;
+
+    switch (policy) {
+    case DROP_OLDEST:
+        // A ring holds more than a push, the samples waiting make room for all the new ones
+        ++stats.overruns;
+        dropOldest(numSamples - room);
+        return numSamples;
+
+    case SKIP_TO_LATEST:
+        // Only the latest frame worth of samples is kept
+        ++stats.overruns;
+        dropOldest(numSamples >= framesPerBuffer ? ring.size() : ring.size() + numSamples - framesPerBuffer);
+        return numSamples;
+
+    case DROP_NEWEST: {
+        // The samples that don't fit are lost, the stream skips over them once the rings reach them
+        ++stats.overruns;
+        const size_t numDropped = numSamples - room;
+        if (gapLength == 0) gapPosition = framedSamples + ring.size() + room;
+        gapLength += numDropped;
+        stats.samplesDropped += numDropped;
+        return room;
+    }
+
+    case GROW:
+        ++stats.growths;
+        for (boost::circular_buffer<float> &grown : rings) grown.set_capacity(std::max(grown.capacity() * 2, grown.size() + numSamples));
+        return numSamples;
+    }
+    return room;
+}
+
+void Framer::dropOldest(size_t numSamples)
+{
+    for (boost::circular_buffer<float> &ring : rings) ring.erase_begin(numSamples);
+    framedSamples += numSamples;
+    stats.samplesDropped += numSamples;
+}
+
+Framer::Slot* Framer::freeSlot()
+{
+    // The consumer usually releases the frames in order, the next slot is most likely free
+    for (size_t i = 0; i < pool.size(); ++i) {
+        const size_t index = (nextFrame + i) % pool.size();
+        if (!pool[index]->inUse.load(std::memory_order_acquire)) {
+            nextFrame = (index + 1) % pool.size();
+            return pool[index].get();
+        }
+    }
+
+    switch (policy) {
+    case GROW:
+        ++stats.growths;
+        pool.emplace_back(new Slot);
+        pool.back()->inUse.store(false, std::memory_order_relaxed);
+        pool.back()->data.assign(numOutputs * framesPerBuffer, 0.0f);
+        nextFrame = 0;
+        return pool.back().get();
+
+    case DROP_NEWEST:
+        // The frame is skipped, its last half still starts the next frame so the overlap stays continuous
+        ++stats.overruns;
+        ++stats.framesDropped;
+        for (size_t c = 0; c < numOutputs; ++c) {
+            const boost::circular_buffer<float> &ring = rings[c];
+            std::copy(ring.begin() + static_cast<long>(framesPerBuffer / 2), ring.begin() + static_cast<long>(framesPerBuffer), first_halves[c].begin());
+        }
+        dropOldest(framesPerBuffer);
+        return nullptr;
+
+    case DROP_OLDEST:
+    case SKIP_TO_LATEST:
+        // The samples wait in the rings, until they overflow
+        lagging = true;
+        return nullptr;
+    }
+    return nullptr;
+}
+
+bool Framer::pop(int64_t timestampUs, AudioFrame &frame)
+{
+    if (rings.empty() || rings.front().size() < framesPerBuffer) return false;
+    TRACE_SCOPE("framer.pop");
+
+    Slot *slot = freeSlot();
+    if (!slot) return false;
+
+    if (lagging) {
+        // The consumer caught up, the frames it could not take are skipped
+        lagging = false;
+        if (policy == SKIP_TO_LATEST && rings.front().size() > framesPerBuffer) {
+            ++stats.overruns;
+            dropOldest(rings.front().size() - framesPerBuffer);
+        }
+    }
+
+    slot->inUse.store(true, std::memory_order_relaxed);
+    float *data = slot->data.data();
+
+    for (size_t c = 0; c < numOutputs; ++c) {
+        boost::circular_buffer<float> &ring = rings[c];
+        overlap(first_halves[c], ring, framesPerBuffer, data + c * framesPerBuffer);
+
+        // Keep last half of current set of samples which will become first half of next set of samples
+        std::copy(ring.begin() + static_cast<long>(framesPerBuffer / 2), ring.begin() + static_cast<long>(framesPerBuffer), first_halves[c].begin());
+
+        // Changes the position of begin()
+        ring.erase(ring.begin(), ring.begin() + static_cast<long>(framesPerBuffer));
+    }
+
+    frame.data = data;
+    frame.numChannels = numOutputs;
+    frame.numSamples = framesPerBuffer;
+    frame.sampleRate = frameRate;
+    frame.hasMix = numOutputs > numChannels;
+    frame.timestampUs = timestampUs;
+    frame.stamps = FrameStamps{};
+    frame.inUse = &slot->inUse;
+
+    // The frame ends with the first half of the samples just removed from the rings
+    frame.sampleOffset = framedSamples + framesPerBuffer / 2;
+    framedSamples += framesPerBuffer;
+
+    // The samples dropped by DROP_NEWEST are skipped once the rings reach them
+    if (gapLength > 0 && framedSamples >= gapPosition) {
+        framedSamples += gapLength;
+        gapLength = 0;
+    }
+    return true;
+}
+
+bool Framer::hasFramesInUse() const
+{
+    for (const std::unique_ptr<Slot> &slot : pool) {
+        if (slot->inUse.load(std::memory_order_acquire)) return true;
+    }
+    return false;
+}
+
+void Framer::overlap(const std::vector<float> &first_half, const boost::circular_buffer<float> &rest, size_t size, float *overlapped)
+{
+    assert(rest.size() >= size / 2);
+    assert(first_half.size() == size / 2);
+
+    std::memcpy(overlapped, first_half.data(), (size / 2) * sizeof(float));
+    // The circular buffer may wrap around, it is not contiguous
+    std::copy(rest.begin(), rest.begin() + static_cast<long>(size / 2), overlapped + (size / 2));
+}
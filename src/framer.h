@@ -0,0 +1,207 @@
+#ifndef FRAMER_H
+#define FRAMER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <boost/circular_buffer.hpp>
+
+#include "audioframe.h"
+#include "framearena.h"
+#include "resampler.h"
+#include "sampleconverter.h"
+
+/**
+ * Turns a stream of raw PCM bytes into overlapping frames of float samples, one block per channel.
+ *
+ * The raw bytes are converted, deinterleaved (and optionally mixed down), resampled to the analysis rate
+ * when there is one, and accumulated per channel. Every frame is made of the last half of the previous frame
+ * followed by the new samples. Everything is allocated by configure(), pushing and popping never allocate
+ * (unless the overrun policy is GROW).
+ *
+ * The frames are handed out from a pool of FRAME_POOL_SIZE slots, each slot is busy until the consumer
+ * releases its frame. When the consumer lags and every slot is busy, or when the samples pushed don't fit
+ * in the rings anymore, the overrun policy decides which samples are lost.
+ */
+class Framer
+{
+public:
+    enum { FRAME_POOL_SIZE = 4 };
+
+    /**
+     * @brief What to do when the consumer lags behind or the samples pushed don't fit
+     */
+    enum OverrunPolicy {
+        DROP_OLDEST,        // Keep the samples waiting, the oldest ones are overwritten when the rings are full
+        DROP_NEWEST,        // Drop the frame that has no free slot, and the samples pushed that don't fit
+        SKIP_TO_LATEST,     // Keep the samples waiting, then skip to the latest frame once the consumer catches up
+        GROW                // Add slots and grow the rings, nothing is lost but memory is allocated
+    };
+
+    /**
+     * @brief Counters of the samples lost, since configure()
+     */
+    struct Stats
+    {
+        uint64_t    overruns;           // Number of times samples were dropped
+        uint64_t    samplesDropped;     // Number of samples of each channel dropped, at the frame rate
+        uint64_t    framesDropped;      // Number of frames dropped because every slot was busy (DROP_NEWEST)
+        uint64_t    growths;            // Number of times a slot was added or a ring was grown (GROW)
+    };
+
+    Framer();
+
+    Framer(const Framer&) = delete;
+    Framer& operator=(const Framer&) = delete;
+
+    /**
+     * @brief Sets whether the frames get an extra channel, the mix of all the input ones
+     * @param mixdown True to add the mixed down channel (only when there is more than one channel)
+     * @note Takes effect at the next configure()
+     */
+    void setMixdown(bool mixdown) { this->mixdown = mixdown; }
+
+    /**
+     * @brief Sets the sample rate the frames are resampled to
+     * @param analysisRate The sample rate, 0 to keep the sample rate of the input
+     * @note Takes effect at the next configure()
+     */
+    void setAnalysisRate(int analysisRate) { this->analysisRate = analysisRate; }
+
+    /**
+     * @brief Sets what to do when the consumer lags behind or the samples pushed don't fit
+     * @param policy The policy, DROP_OLDEST by default
+     */
+    void setOverrunPolicy(OverrunPolicy policy) { this->policy = policy; }
+
+    /**
+     * @brief Sets the format of the input and allocates everything the framing needs
+     * @param format The format of the raw samples
+     * @param sampleRate The sample rate of the input
+     * @param frameDurationMs The duration of the new samples of a frame in ms
+     * @param maxPushFrames The number of audio frames (one sample per channel) converted at once, bigger pushes are split
+     * @return False if the format cannot be converted
+     */
+    bool configure(const SampleFormat &format, int sampleRate, int frameDurationMs, size_t maxPushFrames);
+
+    /**
+     * @brief Forgets the samples pushed so far
+     */
+    void reset();
+
+    /**
+     * @brief Adds raw samples to the stream, they don't need to be made of whole audio frames
+     * @param data The raw samples
+     * @param numBytes The number of bytes in data
+     */
+    void push(const char *data, size_t numBytes);
+
+    /**
+     * @brief Builds the next frame if enough samples have been pushed
+     * @param timestampUs The time of the frame in microseconds
+     * @param frame Receives the frame, its samples are valid until the consumer calls frame.release().
+     * Its stamps are cleared, they are up to the caller
+     * @return True if a frame was built, false if there are not enough samples or no free slot
+     */
+    bool pop(int64_t timestampUs, AudioFrame &frame);
+
+    /**
+     * @brief Returns the number of samples of each channel of a frame
+     */
+    size_t getFrameSize() const { return framesPerBuffer; }
+
+    /**
+     * @brief Returns the sample rate of the frames
+     */
+    int getFrameRate() const { return frameRate; }
+
+    /**
+     * @brief Returns the number of channels of the frames (input channels and mix)
+     */
+    size_t getNumOutputs() const { return numOutputs; }
+
+    /**
+     * @brief Returns the counters of the samples lost
+     */
+    const Stats& getStats() const { return stats; }
+
+    /**
+     * @brief Returns whether frames handed out have not been released yet, the framer must outlive them
+     */
+    bool hasFramesInUse() const;
+
+private:
+    SampleConverter                 converter;          // Converts the raw samples to floats
+    size_t                          bytesPerFrame;      // Number of bytes of an audio frame (one sample per channel)
+    std::vector<char>               partial;            // Bytes of an incomplete audio frame waiting for the next push
+    size_t                          pendingBytes;       // Number of bytes in partial
+    size_t                          maxPushFrames;      // Number of audio frames converted at once
+
+    size_t                          numChannels;        // Number of channels of the input (up to AudioFrame::MAX_CHANNELS)
+    bool                            mixdown;            // True to add the mix of the input channels to the frames
+    size_t                          numOutputs;         // Number of channels of the frames (input and mix)
+    int                             analysisRate;       // Sample rate to resample to, 0 to keep the rate of the input
+    int                             frameRate;          // Sample rate of the frames
+    size_t                          framesPerBuffer;    // Number of samples of each channel of a frame, at frameRate
+    std::vector<Resampler>          resamplers;         // One resampler per channel of the frames, when resampling
+
+    std::vector<boost::circular_buffer<float>> rings;   // Samples of each channel of the frames not yet framed
+    std::vector<std::vector<float>> first_halves;       // Last half of the previous frame of each channel
+
+    FrameArena                      arena;              // Scratch memory of a push
+
+    /**
+     * @brief A frame of the pool
+     */
+    struct Slot
+    {
+        std::atomic<bool>           inUse;              // True until the consumer releases the frame
+        std::vector<float>          data;               // The samples of every channel of the frame
+    };
+
+    std::vector<std::unique_ptr<Slot>> pool;            // Frames handed out in turn, FRAME_POOL_SIZE unless grown
+    size_t                          nextFrame;          // Index of the next slot to fill
+    uint64_t                        framedSamples;      // Position in the stream of the first sample of the rings
+
+    OverrunPolicy                   policy;             // What to do when the consumer lags behind
+    Stats                           stats;              // Counters of the samples lost
+    bool                            lagging;            // True when a frame could not be handed out for lack of a free slot
+    uint64_t                        gapPosition;        // Position in the stream of the samples dropped by DROP_NEWEST on push
+    uint64_t                        gapLength;          // Number of samples dropped at gapPosition, 0 if none
+
+    /**
+     * @brief Converts whole audio frames and adds them to the rings
+     */
+    void process(const char *data, size_t numAudioFrames);
+
+    /**
+     * @brief Makes room in the rings for new samples according to the policy
+     * @param numSamples The number of samples of each channel about to be added
+     * @return The number of them to add, the following ones are dropped
+     */
+    size_t makeRoom(size_t numSamples);
+
+    /**
+     * @brief Drops the oldest samples of the rings
+     * @param numSamples The number of samples of each channel to drop
+     */
+    void dropOldest(size_t numSamples);
+
+    /**
+     * @brief Returns a free slot according to the policy, nullptr if there is none
+     */
+    Slot* freeSlot();
+
+    /**
+     * @brief Builds a frame made of the end of the previous frame followed by the start of the new samples
+     * @param first_half The last size / 2 samples of the previous frame
+     * @param rest The new samples, must hold at least size / 2 samples
+     * @param size The number of samples of the frame
+     * @param overlapped Receives the size samples of the frame
+     */
+    static void overlap(const std::vector<float> &first_half, const boost::circular_buffer<float> &rest, size_t size, float *overlapped);
+};
+
+#endif // FRAMER_H
@@ -7,6 +7,8 @@
 
 #include <QDebug>
 
+#include "tracer.h"
+
 FrequencySpectrum::FrequencySpectrum(QWidget *parent)
     :   QWidget(parent)
     ,   numSamples(0)
@@ -17,10 +19,11 @@ FrequencySpectrum::FrequencySpectrum(QWidget *parent)
 
 }
 
-void FrequencySpectrum::frequenciesChanged(const double* frequencies, const size_t numSamples)
+void FrequencySpectrum::frequenciesChanged(const QVector<double> &frequencies)
 {
+    // Shared with the analysis until it writes the next spectrum, which then detaches from the one painted here
     this->frequencies = frequencies;
-    this->numSamples = numSamples;
+    this->numSamples = static_cast<size_t>(frequencies.size());
     qDebug() << numSamples;
     update();
 }
@@ -41,6 +44,7 @@ void FrequencySpectrum::redrawTimerExpired()
 
 void FrequencySpectrum::paintEvent(QPaintEvent *event)
 {
+    TRACE_SCOPE("paint.spectrum");
     Q_UNUSED(event)
 
     if (numSamples == 0) return;
@@ -58,17 +62,17 @@ void FrequencySpectrum::paintEvent(QPaintEvent *event)
     int currentX = 0;
     double avg = 0;
     for (int i = 0; i < static_cast<int>(numSamples); i++) {
-        maxPower = std::max(maxPower, frequencies[i]);
+        maxPower = std::max(maxPower, frequencies.at(i));
 
         // We have more samples than pixels wide, so we average samplesPerX samples per x coord
         if (static_cast<int>(i / samplesPerX) == currentX) {
-            avg += frequencies[i];
+            avg += frequencies.at(i);
         }
         else {
             avg = avg / samplesPerX;
             currentX++;
 
-            QPoint currentPoint = QPoint(i, maxHeight - static_cast<int>(frequencies[i] / maxPower * maxHeight));
+            QPoint currentPoint = QPoint(i, maxHeight - static_cast<int>(frequencies.at(i) / maxPower * maxHeight));
             painter.drawLine(lastPoint, currentPoint);
             lastPoint = currentPoint;
             currentX++;
@@ -2,6 +2,7 @@
 #define FREQUENCYSPECTRUM_H
 
 #include <QTime>
+#include <QVector>
 #include <QWidget>
 
 #include <complex>
@@ -21,7 +22,7 @@ public:
 
 public slots:
     void reset();
-    void frequenciesChanged(const double* frequencies, const size_t numSamples);
+    void frequenciesChanged(const QVector<double> &frequencies);
 
 private slots:
     void redrawTimerExpired();
@@ -32,7 +33,7 @@ private:
      * This is calculated by decaying m_peakLevel depending on the
      * elapsed time since m_peakLevelChanged, and the value of m_decayRate.
      */
-    const double* frequencies;
+    QVector<double> frequencies;
 
     size_t numSamples;
 
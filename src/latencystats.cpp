@@ -0,0 +1,125 @@
+#include "latencystats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+LatencyHistogram::LatencyHistogram()
+    : count{0}
+    , max{0}
+{
+    for (std::atomic<uint64_t> &bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t us)
+{
+    if (us < LINEAR_BUCKETS) return static_cast<size_t>(us);
+
+    // Index of the highest bit, then the next 5 bits select the bucket within the power of two
+    size_t exponent = 63;
+    while (!(us >> exponent)) --exponent;
+    exponent = std::min<size_t>(exponent, 39);
+
+    const size_t sub = static_cast<size_t>(us >> (exponent - 5)) & (SUB_BUCKETS - 1);
+    return std::min<size_t>(LINEAR_BUCKETS + (exponent - 6) * SUB_BUCKETS + sub, NUM_BUCKETS - 1);
+}
+
+int64_t LatencyHistogram::valueOf(size_t bucket)
+{
+    if (bucket < LINEAR_BUCKETS) return static_cast<int64_t>(bucket);
+
+    const size_t exponent = (bucket - LINEAR_BUCKETS) / SUB_BUCKETS + 6;
+    const size_t sub = (bucket - LINEAR_BUCKETS) % SUB_BUCKETS;
+    const int64_t width = int64_t(1) << (exponent - 5);
+    return static_cast<int64_t>(SUB_BUCKETS + sub) * width + width / 2;
+}
+
+void LatencyHistogram::record(int64_t us)
+{
+    us = std::max<int64_t>(us, 0);
+    buckets[bucketOf(static_cast<uint64_t>(us))].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+
+    // Single writer, no need for a compare and swap loop
+    if (us > max.load(std::memory_order_relaxed)) max.store(us, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::reset()
+{
+    for (std::atomic<uint64_t> &bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+    count.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::getPercentile(double percentile) const
+{
+    // The buckets may be updated while we walk them, their own sum is the consistent total
+    uint64_t total = 0;
+    for (const std::atomic<uint64_t> &bucket : buckets) total += bucket.load(std::memory_order_relaxed);
+    if (total == 0) return 0;
+
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(total))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) return std::min(valueOf(i), getMax());
+    }
+    return getMax();
+}
+
+namespace {
+    // First and last stamp of each interval of LatencyStats
+    const FrameStamps::Stage INTERVAL_STAGES[LatencyStats::NUM_INTERVALS][2] = {
+        {FrameStamps::CAPTURED, FrameStamps::READ},
+        {FrameStamps::READ, FrameStamps::FRAMED},
+        {FrameStamps::FRAMED, FrameStamps::ANALYSIS_STARTED},
+        {FrameStamps::ANALYSIS_STARTED, FrameStamps::ANALYZED},
+        {FrameStamps::ANALYZED, FrameStamps::PUBLISHED},
+        {FrameStamps::CAPTURED, FrameStamps::PUBLISHED},
+    };
+
+    const char* const INTERVAL_NAMES[LatencyStats::NUM_INTERVALS] = {
+        "device", "framing", "queue", "analysis", "publish", "end-to-end"
+    };
+}
+
+void LatencyStats::record(const FrameStamps &stamps)
+{
+    for (size_t i = 0; i < NUM_INTERVALS; ++i) {
+        const int64_t from = stamps.us[INTERVAL_STAGES[i][0]];
+        const int64_t to = stamps.us[INTERVAL_STAGES[i][1]];
+        if (from != 0 && to != 0) histograms[i].record(to - from);
+    }
+}
+
+void LatencyStats::reset()
+{
+    for (LatencyHistogram &histogram : histograms) histogram.reset();
+}
+
+LatencyStats::Summary LatencyStats::getSummary(Interval interval) const
+{
+    const LatencyHistogram &histogram = histograms[interval];
+    return Summary{histogram.getCount(), histogram.getPercentile(50.0), histogram.getPercentile(99.0), histogram.getMax()};
+}
+
+const char* LatencyStats::getName(Interval interval)
+{
+    return INTERVAL_NAMES[interval];
+}
+
+void LatencyStats::report(FILE *file) const
+{
+    std::fprintf(file, "%-12s %10s %10s %10s %10s\n", "latency", "frames", "p50 (us)", "p99 (us)", "max (us)");
+    for (size_t i = 0; i < NUM_INTERVALS; ++i) {
+        const Summary summary = getSummary(static_cast<Interval>(i));
+        if (summary.count == 0) continue;
+        std::fprintf(file, "%-12s %10llu %10lld %10lld %10lld\n", INTERVAL_NAMES[i], static_cast<unsigned long long>(summary.count),
+                     static_cast<long long>(summary.p50), static_cast<long long>(summary.p99), static_cast<long long>(summary.max));
+    }
+}
+
+int64_t LatencyStats::nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
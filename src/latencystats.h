@@ -0,0 +1,144 @@
+#ifndef LATENCYSTATS_H
+#define LATENCYSTATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+#include "audioframe.h"
+
+/**
+ * Histogram of durations in microseconds, with buckets about 3% wide.
+ *
+ * Durations below 64 us have a bucket each, above that every power of two is split in 32 buckets, so the
+ * relative error of a percentile is bounded whatever the magnitude. The counters are atomic: one thread
+ * records while any number of threads query, nothing is allocated and nothing is locked.
+ */
+class LatencyHistogram
+{
+public:
+    enum { LINEAR_BUCKETS = 64, SUB_BUCKETS = 32, NUM_BUCKETS = LINEAR_BUCKETS + (40 - 6) * SUB_BUCKETS };
+
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    /**
+     * @brief Records a duration
+     * @param us The duration in microseconds, negative durations count as 0
+     */
+    void record(int64_t us);
+
+    /**
+     * @brief Forgets every duration recorded
+     */
+    void reset();
+
+    /**
+     * @brief Returns the number of durations recorded
+     */
+    uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Returns the longest duration recorded in microseconds
+     */
+    int64_t getMax() const { return max.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Returns a percentile of the durations recorded
+     * @param percentile The percentile in range 0.0 - 100.0
+     * @return The duration in microseconds (the middle of its bucket), 0 if nothing was recorded
+     */
+    int64_t getPercentile(double percentile) const;
+
+private:
+    std::atomic<uint64_t>   buckets[NUM_BUCKETS];   // Number of durations in each bucket
+    std::atomic<uint64_t>   count;                  // Number of durations recorded
+    std::atomic<int64_t>    max;                    // Longest duration recorded
+
+    /**
+     * @brief Returns the bucket of a duration
+     */
+    static size_t bucketOf(uint64_t us);
+
+    /**
+     * @brief Returns the middle of the range of durations of a bucket
+     */
+    static int64_t valueOf(size_t bucket);
+};
+
+/**
+ * Latency of every stage of the pipeline, from the capture of the newest sample of a frame to the
+ * publication of its results, built from the stamps of the frames (@see{FrameStamps}).
+ */
+class LatencyStats
+{
+public:
+    /**
+     * @brief The intervals measured, between two stamps of FrameStamps
+     */
+    enum Interval {
+        DEVICE,         // CAPTURED -> READ: buffering of the audio device
+        FRAMING,        // READ -> FRAMED: waiting for the rest of the frame
+        QUEUE,          // FRAMED -> ANALYSIS_STARTED: hand-off to the analysis thread
+        ANALYSIS,       // ANALYSIS_STARTED -> ANALYZED: analysis of every channel
+        PUBLISH,        // ANALYZED -> PUBLISHED: emission of the results
+        END_TO_END,     // CAPTURED -> PUBLISHED
+        NUM_INTERVALS
+    };
+
+    /**
+     * @brief Summary of the durations of an interval, in microseconds
+     */
+    struct Summary
+    {
+        uint64_t    count;      // Number of frames measured
+        int64_t     p50;        // Median
+        int64_t     p99;        // 99th percentile
+        int64_t     max;        // Longest
+    };
+
+    LatencyStats() {}
+
+    LatencyStats(const LatencyStats&) = delete;
+    LatencyStats& operator=(const LatencyStats&) = delete;
+
+    /**
+     * @brief Records the intervals of a frame, the stamps left to 0 are skipped
+     * @param stamps The stamps of the frame
+     */
+    void record(const FrameStamps &stamps);
+
+    /**
+     * @brief Forgets every frame recorded
+     */
+    void reset();
+
+    /**
+     * @brief Returns the summary of an interval, safe to call from any thread
+     * @param interval The interval
+     */
+    Summary getSummary(Interval interval) const;
+
+    /**
+     * @brief Returns the name of an interval
+     */
+    static const char* getName(Interval interval);
+
+    /**
+     * @brief Prints the summary of every interval
+     * @param file The file to print to
+     */
+    void report(FILE *file) const;
+
+    /**
+     * @brief Returns the time of the steady clock every stamp is taken with, in microseconds
+     */
+    static int64_t nowUs();
+
+private:
+    LatencyHistogram    histograms[NUM_INTERVALS];  // Durations of each interval
+};
+
+#endif // LATENCYSTATS_H
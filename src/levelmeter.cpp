@@ -5,6 +5,8 @@
 #include <QPainter>
 #include <QTimer>
 
+#include "tracer.h"
+
 // Constants (sorry Patrice)
 const int REDRAW_INTERVAL = 100;         // ms
 const float PEAK_DECAY_RATE = 0.001f;
@@ -76,6 +78,7 @@ void LevelMeter::redrawTimerExpired()
 
 void LevelMeter::paintEvent(QPaintEvent *event)
 {
+    TRACE_SCOPE("paint.level");
     Q_UNUSED(event)
 
     QPainter painter(this);
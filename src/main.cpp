@@ -1,14 +1,33 @@
 #include "mainwindow.h"
 #include <QApplication>
+#include <QVector>
 
+#include "audioframe.h"
+#include "tracer.h"
+
+#include <cstdlib>
 #include <vector>
 
 int main(int argc, char *argv[])
 {
-    qRegisterMetaType<std::vector<float>>("std::vector<float>");
+    qRegisterMetaType<AudioFrame>("AudioFrame");
+    qRegisterMetaType<FrameResults>("FrameResults");
+    qRegisterMetaType<size_t>("size_t");
+    qRegisterMetaType<QVector<double>>("QVector<double>");
     QApplication a(argc, argv);
+
+    // Records a trace of the whole session when built with TRACE_EVENTS (@see{tracer.h})
+    const char *tracePath = std::getenv("TONEANALYZER_TRACE");
+    TRACE_THREAD_NAME("gui");
+    if (tracePath) tracer::start();
+
     MainWindow w;
     w.show();
 
-    return a.exec();
+    const int result = a.exec();
+    if (tracePath) {
+        tracer::stop();
+        tracer::write(tracePath);
+    }
+    return result;
 }
@@ -4,7 +4,13 @@
 #include "levelmeter.h"
 #include "audioengine.h"
 #include "frequencyspectrum.h"
+#include "multipitchestimator.h"
+#include "notes.h"
+#include "tracer.h"
 
+#include <algorithm>
+
+#include <QFile>
 #include <QList>
 
 MainWindow::MainWindow(QWidget *parent)
@@ -16,10 +22,6 @@ MainWindow::MainWindow(QWidget *parent)
 {
     ui->setupUi(this);
 
-    // Fill the combobox filled with the available audio input devices on the machine
-    const auto devices = audioEngine->getAvailableAudioInputDevices();
-    for (size_t i = 0; i < devices.size(); ++i) ui->cb_devices->addItem(devices.at(i).deviceName(), QVariant::fromValue(i));
-
     ui->pb_toggle_listen->setText(tr("Start"));
 
     // Connect the events
@@ -29,8 +31,24 @@ MainWindow::MainWindow(QWidget *parent)
     connect(audioEngine->getAudioAnalyzerThread(), &AudioAnalyzerThread::levelChanged, ui->w_level, &LevelMeter::levelChanged);
     connect(audioEngine->getAudioAnalyzerThread(), &AudioAnalyzerThread::frequenciesChanged, ui->w_spectrum, &FrequencySpectrum::frequenciesChanged);
     connect(audioEngine->getAudioAnalyzerThread(), &AudioAnalyzerThread::noteChanged, this, &MainWindow::noteChanged);
+    connect(audioEngine->getAudioAnalyzerThread(), &AudioAnalyzerThread::chordChanged, this, &MainWindow::chordChanged);
+
+    // Lighting and tuning displays follow the notes from a local socket when it is named
+    const QByteArray noteSocket = qgetenv("TONEANALYZER_NOTE_SOCKET");
+    if (!noteSocket.isEmpty()) audioEngine->startNoteServer(QString::fromLocal8Bit(noteSocket));
+
+    // The results and the spectrogram are recorded to files when they are named, for a later look at the session
+    const QByteArray resultStream = qgetenv("TONEANALYZER_RESULT_STREAM");
+    if (!resultStream.isEmpty()) audioEngine->startResultStream(QFile::decodeName(resultStream));
+    const QByteArray spectrogram = qgetenv("TONEANALYZER_SPECTROGRAM");
+    if (!spectrogram.isEmpty()) audioEngine->startSpectrogramArchive(QFile::decodeName(spectrogram));
+
+    // Other local processes follow every channel from shared memory when the ring is named
+    const QByteArray sharedSpectrum = qgetenv("TONEANALYZER_SHARED_SPECTRUM");
+    if (!sharedSpectrum.isEmpty()) audioEngine->startSharedSpectrum(QString::fromLatin1(sharedSpectrum));
 
-    selectDevice(0);
+    // The devices come later, the window shows up without waiting for them
+    connect(audioEngine->getDeviceEnumerator(), &DeviceEnumerator::devicesChanged, this, &MainWindow::devicesChanged);
 }
 
 MainWindow::~MainWindow()
@@ -51,10 +69,31 @@ void MainWindow::toggleListen() {
     }
 }
 
+void MainWindow::devicesChanged() {
+    // Fill the combobox filled with the available audio input devices on the machine, keeping the selected one if still there
+    const QString selected = ui->cb_devices->currentText();
+    const auto devices = audioEngine->getAvailableAudioInputDevices();
+    ui->cb_devices->clear();
+    for (size_t i = 0; i < devices.size(); ++i) ui->cb_devices->addItem(devices.at(i).deviceName(), QVariant::fromValue(i));
+    if (devices.empty()) return;
+
+    const int index = std::max(ui->cb_devices->findText(selected), 0);
+    ui->cb_devices->setCurrentIndex(index);
+    selectDevice(index);
+}
+
 void MainWindow::selectDevice(int index) {
     audioEngine->setAudioInputDevice(static_cast<size_t>(index));
 }
 
-void MainWindow::noteChanged(const QString note) {
-    ui->lbl_note->setText(note);
+void MainWindow::noteChanged(int note) {
+    TRACE_SCOPE("paint.note");
+    // -1 when no note stands out of the spectrum
+    ui->lbl_note->setText(note >= 0 ? notes::notes[note] : "");
+}
+
+void MainWindow::chordChanged(int chord) {
+    TRACE_SCOPE("paint.chord");
+    // -1 when the notes played together make no known chord
+    ui->lbl_chord->setText(chord >= 0 ? QString(MultiPitchEstimator::chordRoot(chord)) + MultiPitchEstimator::chordSuffix(chord) : QString());
 }
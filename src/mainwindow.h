@@ -29,7 +29,9 @@ private:
 private slots:
     void toggleListen();
     void selectDevice(int i);
-    void noteChanged(const QString note);
+    void devicesChanged();
+    void noteChanged(int note);
+    void chordChanged(int chord);
 };
 
 #endif // MAINWINDOW_H
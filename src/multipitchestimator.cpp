@@ -0,0 +1,249 @@
+#include "multipitchestimator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#   include <emmintrin.h>
+#   define MULTIPITCHESTIMATOR_SSE2
+#endif
+
+#include "notes.h"
+
+namespace {
+    const char* const ROOTS[MultiPitchEstimator::NUM_PITCH_CLASSES] = {
+        "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"
+    };
+
+    const char* const SUFFIXES[MultiPitchEstimator::NUM_QUALITIES] = {
+        "", "m", "dim", "aug", "sus2", "sus4", "7", "maj7", "m7"
+    };
+
+    // Pitch classes of each chord above its root, one bit per semitone
+    const unsigned TEMPLATES[MultiPitchEstimator::NUM_QUALITIES] = {
+        (1u << 0) | (1u << 4) | (1u << 7),
+        (1u << 0) | (1u << 3) | (1u << 7),
+        (1u << 0) | (1u << 3) | (1u << 6),
+        (1u << 0) | (1u << 4) | (1u << 8),
+        (1u << 0) | (1u << 2) | (1u << 7),
+        (1u << 0) | (1u << 5) | (1u << 7),
+        (1u << 0) | (1u << 4) | (1u << 7) | (1u << 10),
+        (1u << 0) | (1u << 4) | (1u << 7) | (1u << 11),
+        (1u << 0) | (1u << 3) | (1u << 7) | (1u << 10)
+    };
+
+    // Favours the chord whose root is the lowest note, between templates matching as well (ie: inversions of augmented chords)
+    const float BASS_ROOT_BONUS = 0.05f;
+}
+
+MultiPitchEstimator::Settings MultiPitchEstimator::defaultSettings()
+{
+    return Settings{4, 0.3f, 0.8f};
+}
+
+MultiPitchEstimator::MultiPitchEstimator(const Settings &settings)
+    : settings(settings)
+    , numSamples{0}
+    , sampleRate{0}
+    , firstNote{0}
+    , numCandidates{0}
+    , numBins{0}
+    , harmonicBins{}
+    , peaks{}
+    , salience{}
+    , weights{}
+{
+    // The higher harmonics count less, so a note an octave below the one played doesn't collect it all
+    for (size_t h = 0; h < NUM_HARMONICS; ++h) weights[h] = 1.0f / static_cast<float>(h + 1);
+}
+
+void MultiPitchEstimator::configure(size_t numSamples, int sampleRate)
+{
+    this->numSamples = numSamples;
+    this->sampleRate = sampleRate;
+    numBins = numSamples / 2;
+    const double binsPerHz = static_cast<double>(numSamples) / sampleRate;
+
+    // Two neighbouring notes must fall in different bins at least at their second harmonic, lower notes can't be told apart
+    const double semitone = std::pow(2.0, 1.0 / 12.0) - 1.0;
+    firstNote = 0;
+    while (firstNote < static_cast<size_t>(notes::NB_NOTES) && 2.0 * notes::frequencies[firstNote] * semitone * binsPerHz < 1.0) ++firstNote;
+    size_t lastNote = firstNote;
+    while (lastNote < static_cast<size_t>(notes::NB_NOTES) && notes::frequencies[lastNote] * binsPerHz + 1.0 < numBins) ++lastNote;
+    numCandidates = lastNote - firstNote;
+
+    // The harmonics above the spectrum read the zero bin that follows it
+    harmonicBins.resize(NUM_HARMONICS * numCandidates);
+    for (size_t h = 0; h < NUM_HARMONICS; ++h) {
+        for (size_t n = 0; n < numCandidates; ++n) {
+            const size_t bin = static_cast<size_t>(notes::frequencies[firstNote + n] * static_cast<double>(h + 1) * binsPerHz);
+            harmonicBins[h * numCandidates + n] = static_cast<int32_t>(std::min(bin, numBins));
+        }
+    }
+
+    peaks.assign(numBins + 1, 0.0f);
+    salience.assign(numCandidates, 0.0f);
+}
+
+void MultiPitchEstimator::estimate(const double *magnitudes, ChannelResult &result)
+{
+    result.numNotes = 0;
+    result.chord = -1;
+    const size_t maxNotes = std::min<size_t>(settings.maxNotes, ChannelResult::MAX_NOTES);
+    if (maxNotes == 0 || numCandidates == 0) return;
+
+    // A frequency between two bins is split between them, the largest of the two stands for it
+    double energy = 0.0;
+    for (size_t k = 0; k < numBins; ++k) {
+        peaks[k] = static_cast<float>(std::max(magnitudes[k], magnitudes[k + 1]));
+        energy += magnitudes[k] * magnitudes[k];
+    }
+    peaks[numBins] = 0.0f;
+    if (energy <= 0.0) return;
+
+    float firstSalience = 0.0f;
+    float weightsFound[ChannelResult::MAX_NOTES];
+    while (result.numNotes < maxNotes) {
+        computeSalience();
+
+        // The notes already found are out of the running, their harmonics were cancelled
+        size_t best = numCandidates;
+        for (size_t n = 0; n < numCandidates; ++n) {
+            bool found = false;
+            for (size_t i = 0; i < result.numNotes; ++i) found = found || result.notes[i] == static_cast<int>(firstNote + n);
+            if (!found && (best == numCandidates || salience[n] > salience[best])) best = n;
+        }
+        if (best == numCandidates || salience[best] <= 0.0f) break;
+        if (result.numNotes == 0) firstSalience = salience[best];
+        else if (salience[best] < firstSalience * settings.minSalience) break;
+
+        // The confidence is the share of the energy of the spectrum the cancelled harmonics carried
+        double before = 0.0;
+        for (size_t h = 0; h < NUM_HARMONICS; ++h) {
+            const float peak = peaks[static_cast<size_t>(harmonicBins[h * numCandidates + best])];
+            before += static_cast<double>(peak) * peak;
+        }
+        cancel(best);
+        double after = 0.0;
+        for (size_t h = 0; h < NUM_HARMONICS; ++h) {
+            const float peak = peaks[static_cast<size_t>(harmonicBins[h * numCandidates + best])];
+            after += static_cast<double>(peak) * peak;
+        }
+
+        result.notes[result.numNotes] = static_cast<int>(firstNote + best);
+        result.noteConfidences[result.numNotes] = static_cast<float>(std::min((before - after) / energy, 1.0));
+        weightsFound[result.numNotes] = salience[best];
+        ++result.numNotes;
+    }
+
+    result.chord = matchChord(result.notes, weightsFound, result.numNotes, settings.minChordScore);
+}
+
+void MultiPitchEstimator::computeSalience()
+{
+    float *sum = salience.data();
+    const float *spectrum = peaks.data();
+    size_t n = 0;
+#ifdef MULTIPITCHESTIMATOR_SSE2
+    // SSE2 has no gather: the harmonics of four candidates are loaded one by one, and summed in a register over every harmonic
+    for (; n + 4 <= numCandidates; n += 4) {
+        __m128 total = _mm_setzero_ps();
+        for (size_t h = 0; h < NUM_HARMONICS; ++h) {
+            const int32_t *bins = harmonicBins.data() + h * numCandidates + n;
+            const __m128 values = _mm_setr_ps(spectrum[bins[0]], spectrum[bins[1]], spectrum[bins[2]], spectrum[bins[3]]);
+            total = _mm_add_ps(total, _mm_mul_ps(_mm_set1_ps(weights[h]), values));
+        }
+        _mm_storeu_ps(sum + n, total);
+    }
+#endif
+    for (; n < numCandidates; ++n) {
+        float total = 0.0f;
+        for (size_t h = 0; h < NUM_HARMONICS; ++h) total += weights[h] * spectrum[harmonicBins[h * numCandidates + n]];
+        sum[n] = total;
+    }
+}
+
+void MultiPitchEstimator::cancel(size_t candidate)
+{
+    float amplitudes[NUM_HARMONICS];
+    size_t bins[NUM_HARMONICS];
+    for (size_t h = 0; h < NUM_HARMONICS; ++h) {
+        bins[h] = static_cast<size_t>(harmonicBins[h * numCandidates + candidate]);
+        amplitudes[h] = peaks[bins[h]];
+    }
+
+    for (size_t h = 0; h < NUM_HARMONICS; ++h) {
+        if (bins[h] >= numBins || amplitudes[h] <= 0.0f) continue;
+
+        // The envelope of a note is smooth, a harmonic standing out of its neighbours also belongs to another note.
+        // The fundamental is the note's own, a lower note was found first if it shared it
+        float mean = amplitudes[h];
+        if (h > 0) {
+            const size_t high = h + 1 < NUM_HARMONICS ? h + 1 : h;
+            mean = 0.0f;
+            for (size_t i = h - 1; i <= high; ++i) mean += amplitudes[i];
+            mean /= static_cast<float>(high - h + 2);
+        }
+        const float kept = 1.0f - std::min(amplitudes[h], mean) / amplitudes[h];
+
+        // The neighbouring bins hold the same partial, the candidates next to this one must not find it there
+        const size_t first = bins[h] > 0 ? bins[h] - 1 : 0;
+        const size_t last = std::min(bins[h] + 1, numBins - 1);
+        for (size_t k = first; k <= last; ++k) peaks[k] *= kept;
+    }
+}
+
+int MultiPitchEstimator::matchChord(const int *notes, const float *weights, size_t numNotes, float minScore)
+{
+    float chroma[NUM_PITCH_CLASSES] = {};
+    unsigned present = 0;
+    int bass = -1;
+    for (size_t i = 0; i < numNotes; ++i) {
+        const int pitchClass = notes[i] % NUM_PITCH_CLASSES;
+        chroma[pitchClass] += weights[i];
+        present |= 1u << pitchClass;
+        if (bass < 0 || notes[i] < bass) bass = notes[i];
+    }
+
+    // Two pitch classes fit several chords equally well
+    int numPresent = 0;
+    for (unsigned bits = present; bits; bits &= bits - 1) ++numPresent;
+    if (numPresent < 3) return -1;
+
+    float norm = 0.0f;
+    for (float value : chroma) norm += value * value;
+    norm = std::sqrt(norm);
+
+    // Cosine similarity of the chroma with each template on each root
+    int best = -1;
+    float bestScore = 0.0f;
+    for (int root = 0; root < NUM_PITCH_CLASSES; ++root) {
+        for (int quality = 0; quality < NUM_QUALITIES; ++quality) {
+            float dot = 0.0f;
+            int size = 0;
+            for (int interval = 0; interval < NUM_PITCH_CLASSES; ++interval) {
+                if (!(TEMPLATES[quality] & (1u << interval))) continue;
+                dot += chroma[(root + interval) % NUM_PITCH_CLASSES];
+                ++size;
+            }
+
+            const float score = dot / (norm * std::sqrt(static_cast<float>(size)));
+            const float ranked = score + (root == bass % NUM_PITCH_CLASSES ? BASS_ROOT_BONUS : 0.0f);
+            if (score >= minScore && (best < 0 || ranked > bestScore)) {
+                best = root * NUM_QUALITIES + quality;
+                bestScore = ranked;
+            }
+        }
+    }
+    return best;
+}
+
+const char* MultiPitchEstimator::chordRoot(int chord)
+{
+    return chord >= 0 ? ROOTS[chord / NUM_QUALITIES] : "";
+}
+
+const char* MultiPitchEstimator::chordSuffix(int chord)
+{
+    return chord >= 0 ? SUFFIXES[chord % NUM_QUALITIES] : "";
+}
@@ -0,0 +1,125 @@
+#ifndef MULTIPITCHESTIMATOR_H
+#define MULTIPITCHESTIMATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "audioframe.h"
+
+/**
+ * Finds the notes played together in a magnitude spectrum, and the chord they make.
+ *
+ * The salience of every candidate note is the weighted sum of the spectrum at its first NUM_HARMONICS
+ * harmonics. The most salient note is taken, its harmonics are cancelled from the spectrum (only as much as
+ * a smooth harmonic envelope explains, so a harmonic shared with another note keeps the rest) and the
+ * salience is computed again for the next note, until maxNotes notes or until the next one is too weak.
+ *
+ * The bins of the harmonics of every candidate are computed by configure(), a salience pass is then a fixed
+ * number of lookups and multiply-adds, four candidates at a time with SSE2. Nothing is allocated while estimating.
+ *
+ * The chord is found by matching the pitch classes of the notes, weighted by their salience, against
+ * templates of the common chords on every root.
+ */
+class MultiPitchEstimator
+{
+public:
+    enum { NUM_HARMONICS = 8, NUM_PITCH_CLASSES = 12 };
+
+    /**
+     * @brief The chords matched, on every root
+     */
+    enum ChordQuality {
+        MAJOR, MINOR, DIMINISHED, AUGMENTED, SUSPENDED_2, SUSPENDED_4, DOMINANT_7, MAJOR_7, MINOR_7, NUM_QUALITIES
+    };
+
+    /**
+     * @brief How many notes are looked for and how weak they can be
+     */
+    struct Settings
+    {
+        size_t  maxNotes;       // Number of notes looked for, up to ChannelResult::MAX_NOTES, 0 to look for none
+        float   minSalience;    // Salience of a note relative to the most salient one, below it the search stops
+        float   minChordScore;  // Similarity of the pitch classes with a chord template, below it there is no chord
+    };
+
+    /**
+     * @brief Returns sensible settings
+     */
+    static Settings defaultSettings();
+
+    explicit MultiPitchEstimator(const Settings &settings = defaultSettings());
+
+    /**
+     * @brief Changes the number of notes looked for and the thresholds
+     */
+    void setSettings(const Settings &settings) { this->settings = settings; }
+
+    /**
+     * @brief Returns the number of notes looked for and the thresholds
+     */
+    const Settings& getSettings() const { return settings; }
+
+    /**
+     * @brief Computes the bins of the harmonics of the candidate notes and allocates the working buffers
+     * @param numSamples Size of the transform of the spectra
+     * @param sampleRate Sample rate of the samples
+     */
+    void configure(size_t numSamples, int sampleRate);
+
+    /**
+     * @brief Returns whether configure() was called for a size and a sample rate
+     */
+    bool isConfigured(size_t numSamples, int sampleRate) const { return this->numSamples == numSamples && this->sampleRate == sampleRate; }
+
+    /**
+     * @brief Finds the notes of a spectrum and their chord
+     * @param magnitudes The magnitude spectrum, of the size and sample rate given to configure()
+     * @param result Receives the notes, their confidences and the chord
+     */
+    void estimate(const double *magnitudes, ChannelResult &result);
+
+    /**
+     * @brief Returns the chord made by notes
+     * @param notes Index of each note in notes::notes
+     * @param weights Weight of each note
+     * @param numNotes Number of notes
+     * @param minScore Similarity with the best template below which there is no chord
+     * @return The chord (root * NUM_QUALITIES + quality), -1 if none
+     */
+    static int matchChord(const int *notes, const float *weights, size_t numNotes, float minScore);
+
+    /**
+     * @brief Returns the name of the root of a chord (ie: "C#")
+     */
+    static const char* chordRoot(int chord);
+
+    /**
+     * @brief Returns the suffix of the quality of a chord (ie: "m7")
+     */
+    static const char* chordSuffix(int chord);
+
+private:
+    Settings                settings;       // Number of notes looked for and thresholds
+    size_t                  numSamples;     // Size of the transform configured
+    int                     sampleRate;     // Sample rate configured
+    size_t                  firstNote;      // Index in notes::notes of the first candidate
+    size_t                  numCandidates;  // Number of candidate notes, from firstNote
+    size_t                  numBins;        // Number of bins of the spectrum used, the zero bin follows them
+    std::vector<int32_t>    harmonicBins;   // Bin of each harmonic of each candidate, NUM_HARMONICS rows of numCandidates
+    std::vector<float>      peaks;          // Largest of each bin and the next one, then cancelled note after note
+    std::vector<float>      salience;       // Salience of each candidate
+    float                   weights[NUM_HARMONICS]; // Weight of each harmonic in the salience
+
+    /**
+     * @brief Computes the salience of every candidate from peaks
+     */
+    void computeSalience();
+
+    /**
+     * @brief Removes from peaks the part of the harmonics of a candidate a smooth harmonic envelope explains
+     */
+    void cancel(size_t candidate);
+};
+
+#endif // MULTIPITCHESTIMATOR_H
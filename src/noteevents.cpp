@@ -0,0 +1,118 @@
+#include "noteevents.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+#include "notes.h"
+
+static_assert(sizeof(noteevents::Event) == 24, "The events keep their size on the wire");
+
+namespace {
+    // Smallest move of the pitch of a held note sent to the subscribers
+    const int   MIN_PITCH_CHANGE_CENTS  = 1;
+
+    // Farthest a pitch can be from its note, half a semitone
+    const long  MAX_DEVIATION_CENTS     = 50;
+}
+
+NoteEventTracker::NoteEventTracker()
+    : notes{}
+    , cents{}
+    , pitches{}
+    , velocities{}
+    , lastUs{0}
+    , sequence{0}
+{
+    reset();
+}
+
+void NoteEventTracker::reset()
+{
+    std::fill(std::begin(notes), std::end(notes), -1);
+    std::fill(std::begin(cents), std::end(cents), 0);
+    std::fill(std::begin(pitches), std::end(pitches), 0.0f);
+    std::fill(std::begin(velocities), std::end(velocities), 0);
+}
+
+size_t NoteEventTracker::update(const FrameResults &results, noteevents::Event *events)
+{
+    size_t numEvents = 0;
+    lastUs = results.timestampUs;
+    const auto add = [&](uint8_t type, size_t channel, int note, int16_t deviation, float pitchHz, float peakLevel) {
+        noteevents::Event &event = events[numEvents++];
+        event.timestampUs = results.timestampUs;
+        event.pitchHz = pitchHz;
+        event.cents = deviation;
+        event.type = type;
+        event.channel = static_cast<uint8_t>(channel);
+        event.note = static_cast<int8_t>(note);
+        event.velocity = static_cast<uint8_t>(std::lround(std::clamp(peakLevel, 0.0f, 1.0f) * 127.0f));
+        event.reserved = 0;
+        event.sequence = sequence++;
+    };
+
+    for (size_t c = 0; c < results.numChannels; ++c) {
+        const ChannelResult &result = results.channels[c];
+        const int note = result.active ? result.note : -1;
+        // The note and the pitch may come from different estimators, a pitch outside of the note is unknown
+        int16_t deviation = 0;
+        float pitchHz = 0.0f;
+        if (note >= 0 && result.pitchHz > 0.0f) {
+            const long offset = std::lround(1200.0 * std::log2(result.pitchHz / notes::frequencies[note]));
+            if (std::abs(offset) <= MAX_DEVIATION_CENTS) {
+                deviation = static_cast<int16_t>(offset);
+                pitchHz = result.pitchHz;
+            }
+        }
+
+        if (note != notes[c] || (note >= 0 && result.onset)) {
+            if (notes[c] >= 0) add(noteevents::Event::NOTE_OFF, c, notes[c], 0, 0.0f, 0.0f);
+            if (note >= 0) {
+                add(noteevents::Event::NOTE_ON, c, note, deviation, pitchHz, result.peakLevel);
+                velocities[c] = events[numEvents - 1].velocity;
+            }
+        }
+        else if (note >= 0 && std::abs(deviation - cents[c]) >= MIN_PITCH_CHANGE_CENTS) {
+            add(noteevents::Event::PITCH, c, note, deviation, pitchHz, result.peakLevel);
+        }
+        else {
+            continue;
+        }
+
+        notes[c] = note;
+        cents[c] = deviation;
+        pitches[c] = pitchHz;
+    }
+
+    // The channels that went away with a change of device end their notes
+    for (size_t c = results.numChannels; c < AudioFrame::MAX_CHANNELS + 1; ++c) {
+        if (notes[c] < 0) continue;
+        add(noteevents::Event::NOTE_OFF, c, notes[c], 0, 0.0f, 0.0f);
+        notes[c] = -1;
+    }
+    return numEvents;
+}
+
+size_t NoteEventTracker::getHeldNotes(noteevents::Event *events) const
+{
+    const size_t numHeld = static_cast<size_t>(std::count_if(std::begin(notes), std::end(notes), [](int note) { return note >= 0; }));
+
+    size_t numEvents = 0;
+    for (size_t c = 0; c < AudioFrame::MAX_CHANNELS + 1; ++c) {
+        if (notes[c] < 0) continue;
+
+        noteevents::Event &event = events[numEvents];
+        event.timestampUs = lastUs;
+        event.pitchHz = pitches[c];
+        event.cents = cents[c];
+        event.type = noteevents::Event::NOTE_ON;
+        event.channel = static_cast<uint8_t>(c);
+        event.note = static_cast<int8_t>(notes[c]);
+        event.velocity = velocities[c];
+        event.reserved = 0;
+        event.sequence = sequence - static_cast<uint32_t>(numHeld - numEvents);
+        ++numEvents;
+    }
+    return numEvents;
+}
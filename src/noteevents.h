@@ -0,0 +1,93 @@
+#ifndef NOTEEVENTS_H
+#define NOTEEVENTS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "audioframe.h"
+
+/**
+ * Compact binary note events, for the subscribers of the note event server (lighting, tuning displays).
+ *
+ * A subscriber first receives a Hello, then a stream of fixed-size events. The values are in the byte order of
+ * the machine, the server and its subscribers are local.
+ */
+namespace noteevents {
+    enum { VERSION = 1 };
+
+    /**
+     * @brief Sent once to every subscriber when it connects
+     */
+    struct Hello
+    {
+        char        magic[8];       // "TANOTES1"
+        uint32_t    version;        // VERSION
+        uint32_t    eventBytes;     // Size of an event
+    };
+
+    /**
+     * @brief A note starting or ending on a channel, or the pitch of a held note moving
+     */
+    struct Event
+    {
+        enum Type { NOTE_ON = 1, NOTE_OFF = 2, PITCH = 3 };
+
+        int64_t     timestampUs;    // Time of the frame in microseconds
+        float       pitchHz;        // Pitch of the note in Hz, 0 if unknown
+        int16_t     cents;          // Deviation of the pitch from the note in cents
+        uint8_t     type;           // Type
+        uint8_t     channel;        // Index of the channel in the frame
+        int8_t      note;           // Index of the note in notes::notes
+        uint8_t     velocity;       // Peak level of the frame in range 0 - 127, 0 for NOTE_OFF
+        uint16_t    reserved;
+        uint32_t    sequence;       // Number of the event, consecutive, so a subscriber can tell none were missed
+    };
+}
+
+/**
+ * Turns the notes of the analyzed frames into note events.
+ *
+ * A channel's note starting or changing gives a NOTE_OFF of the previous note (if any) then a NOTE_ON, and so
+ * does an onset on the held note (the note is played again). A channel going silent or losing its note gives a
+ * NOTE_OFF. The pitch of a held note moving by at least a cent gives a PITCH.
+ */
+class NoteEventTracker
+{
+public:
+    // At most a NOTE_OFF and a NOTE_ON per channel of a frame
+    enum { MAX_EVENTS = 2 * (AudioFrame::MAX_CHANNELS + 1) };
+
+    NoteEventTracker();
+
+    /**
+     * @brief Forgets the notes held, the next frame starts them again
+     */
+    void reset();
+
+    /**
+     * @brief Compares the notes of a frame with the ones held
+     * @param results The results of the frame
+     * @param events Receives the events, room for MAX_EVENTS
+     * @return The number of events
+     */
+    size_t update(const FrameResults &results, noteevents::Event *events);
+
+    /**
+     * @brief Describes the notes held, for a subscriber joining after they started
+     * @param events Receives a NOTE_ON per held note, room for AudioFrame::MAX_CHANNELS + 1
+     * @return The number of events
+     * @note The events are at the time of the last frame, with the pitch as last sent, and numbered right
+     * before the next event so the numbers a subscriber receives stay consecutive
+     */
+    size_t getHeldNotes(noteevents::Event *events) const;
+
+private:
+    int         notes[AudioFrame::MAX_CHANNELS + 1];    // Note held by each channel, -1 if none
+    int16_t     cents[AudioFrame::MAX_CHANNELS + 1];    // Deviation of the pitch of the held notes, as last sent
+    float       pitches[AudioFrame::MAX_CHANNELS + 1];  // Pitch of the held notes in Hz, as last sent
+    uint8_t     velocities[AudioFrame::MAX_CHANNELS + 1]; // Velocity of the NOTE_ON of the held notes
+    int64_t     lastUs;                                 // Time of the last frame in microseconds
+    uint32_t    sequence;                               // Number of the next event
+};
+
+#endif // NOTEEVENTS_H
@@ -0,0 +1,121 @@
+#include "noteeventserver.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <QLocalServer>
+#include <QLocalSocket>
+
+#include "tracer.h"
+#include "util.h"
+
+namespace {
+    const char      HELLO_MAGIC[8]  = {'T', 'A', 'N', 'O', 'T', 'E', 'S', '1'};
+}
+
+NoteEventServer::NoteEventServer()
+    : thread{new QThread}
+    , server{nullptr}
+    , clients{}
+    , tracker{}
+    , batch{}
+    , flushPending{false}
+    , numClients{0}
+    , numDropped{0}
+{
+    moveToThread(thread);
+    thread->start();
+}
+
+NoteEventServer::~NoteEventServer() {}
+
+void NoteEventServer::listen(const QString &name) {
+    TRACE_THREAD_NAME("note events");
+
+    if (!server) {
+        server = new QLocalServer(this);
+        connect(server, &QLocalServer::newConnection, this, &NoteEventServer::accept);
+    }
+    server->close();
+
+    // A socket file left behind by a run that crashed would keep the server from listening
+    QLocalServer::removeServer(name);
+    const bool listening = server->listen(name);
+
+    AUDIOANALYZER_DEBUG << "NoteEventServer::listen" << name << listening << server->fullServerName();
+}
+
+void NoteEventServer::frameAnalyzed(const FrameResults &results) {
+    noteevents::Event events[NoteEventTracker::MAX_EVENTS];
+    const size_t numEvents = tracker.update(results, events);
+    if (numEvents == 0 || clients.empty()) return;
+
+    batch.append(reinterpret_cast<const char*>(events), static_cast<int>(numEvents * sizeof(noteevents::Event)));
+
+    // Queued behind the frames already waiting, so under load they all go in the same write
+    if (!flushPending) {
+        flushPending = true;
+        QMetaObject::invokeMethod(this, &NoteEventServer::flush, Qt::QueuedConnection);
+    }
+}
+
+
+/************************************************************/
+/*      PRIVATE                                             */
+/************************************************************/
+void NoteEventServer::accept() {
+    // The subscribers connected get the events of the notes held first, so the new ones start from the same notes
+    if (!batch.isEmpty()) flush();
+
+    while (QLocalSocket *client = server->nextPendingConnection()) {
+        // The subscribers have nothing to say, what they send is dropped
+        connect(client, &QLocalSocket::readyRead, client, [client]() { client->readAll(); });
+        connect(client, &QLocalSocket::disconnected, this, [this, client]() { remove(client); });
+
+        noteevents::Hello hello{};
+        std::memcpy(hello.magic, HELLO_MAGIC, sizeof(hello.magic));
+        hello.version = noteevents::VERSION;
+        hello.eventBytes = sizeof(noteevents::Event);
+        client->write(reinterpret_cast<const char*>(&hello), sizeof(hello));
+
+        // The notes already held, their NOTE_ON went out before the subscriber connected
+        noteevents::Event held[AudioFrame::MAX_CHANNELS + 1];
+        const size_t numHeld = tracker.getHeldNotes(held);
+        if (numHeld > 0) client->write(reinterpret_cast<const char*>(held), static_cast<qint64>(numHeld * sizeof(noteevents::Event)));
+
+        clients.push_back(client);
+        numClients.store(clients.size(), std::memory_order_relaxed);
+
+        AUDIOANALYZER_DEBUG << "NoteEventServer::accept" << "clients" << clients.size();
+    }
+}
+
+void NoteEventServer::flush() {
+    TRACE_SCOPE("send note events");
+    flushPending = false;
+
+    // Iterates over a copy, dropping a subscriber changes the list
+    const std::vector<QLocalSocket*> current = clients;
+    for (QLocalSocket *client : current) {
+        if (client->bytesToWrite() + batch.size() > MAX_PENDING_BYTES) {
+            numDropped.fetch_add(1, std::memory_order_relaxed);
+            AUDIOANALYZER_DEBUG << "NoteEventServer::flush" << "dropping a subscriber" << client->bytesToWrite() << "bytes behind";
+            remove(client);
+            continue;
+        }
+        client->write(batch);
+    }
+    batch.clear();
+}
+
+void NoteEventServer::remove(QLocalSocket *client) {
+    const auto found = std::find(clients.begin(), clients.end(), client);
+    if (found == clients.end()) return;
+
+    clients.erase(found);
+    numClients.store(clients.size(), std::memory_order_relaxed);
+
+    client->disconnect(this);
+    client->abort();
+    client->deleteLater();
+}
@@ -0,0 +1,91 @@
+#ifndef NOTEEVENTSERVER_H
+#define NOTEEVENTSERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <QThread>
+
+#include "audioframe.h"
+#include "noteevents.h"
+
+class QLocalServer;
+class QLocalSocket;
+
+/**
+ * Pushes note events to any number of local subscribers, over a local socket (Unix domain socket, or named
+ * pipe on Windows) @see{noteevents}.
+ *
+ * The server runs on its own thread and turns the results of the analyzed frames into events there, so the
+ * analysis only pays for the queued frameAnalyzed signal it emits anyway. The events of every frame that
+ * arrived since the last write go to each subscriber in a single write, so a backlog of frames costs one
+ * write per subscriber, not one per frame. The data waiting to be sent to a subscriber is bounded: a
+ * subscriber that doesn't keep up is disconnected rather than buffered for.
+ */
+class NoteEventServer : public QObject
+{
+    Q_OBJECT
+
+enum {
+    MAX_PENDING_BYTES = 64 * 1024
+};
+
+public:
+    NoteEventServer();
+    ~NoteEventServer();
+
+    /**
+     * @brief Returns the number of subscribers connected, safe to call from any thread
+     */
+    size_t getNumClients() const { return numClients.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Returns the number of subscribers disconnected because they did not keep up, safe to call from any thread
+     */
+    uint64_t getNumDropped() const { return numDropped.load(std::memory_order_relaxed); }
+
+public slots:
+    /**
+     * @brief Listens for subscribers, replacing a socket left behind by a previous run
+     * @param name Name of the socket, a path or a name in the local socket directory @see{QLocalServer::listen}
+     */
+    void listen(const QString &name);
+
+    /**
+     * @brief Sends the note events of an analyzed frame to the subscribers
+     * @param results The results of the frame
+     */
+    void frameAnalyzed(const FrameResults &results);
+
+private:
+    QThread*                    thread;         // The thread it will be running on
+
+    QLocalServer*               server;         // Accepts the subscribers, created on the thread of the server
+    std::vector<QLocalSocket*>  clients;        // The subscribers connected
+    NoteEventTracker            tracker;        // Turns the results into events
+    QByteArray                  batch;          // Events waiting to be sent
+    bool                        flushPending;   // True once a flush of batch is queued
+    std::atomic<size_t>         numClients;     // Number of subscribers connected
+    std::atomic<uint64_t>       numDropped;     // Number of subscribers disconnected for not keeping up
+
+    /**
+     * @brief Accepts the subscribers waiting and sends them the hello, then a NOTE_ON for each note held
+     */
+    void accept();
+
+    /**
+     * @brief Writes the events waiting to every subscriber, once the frames already queued are in the batch
+     */
+    void flush();
+
+    /**
+     * @brief Disconnects a subscriber and forgets it
+     */
+    void remove(QLocalSocket *client);
+};
+
+#endif // NOTEEVENTSERVER_H
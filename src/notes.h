@@ -1,6 +1,7 @@
 #ifndef NOTES_H
 #define NOTES_H
-#include <QString>
+
+#include <cmath>
 
 /**
  * The possible notes and their respective frequencies
@@ -8,7 +9,7 @@
 namespace notes {
     enum { NB_NOTES = 108 };
 
-    const QString notes[NB_NOTES] = {
+    const char* const notes[NB_NOTES] = {
         "C0",
         "C#0/Db0",
         "D0",
@@ -229,5 +230,17 @@ namespace notes {
         7458.62,
         7902.13
     };
+
+    /**
+     * @brief Returns the index of the note closest to a frequency, -1 if it is out of the notes
+     */
+    inline int nearest(double frequency)
+    {
+        if (frequency <= 0.0) return -1;
+
+        // The notes start at C0, A4 is the 57th note
+        const long index = std::lround(57.0 + 12.0 * std::log2(frequency / 440.0));
+        return index >= 0 && index < NB_NOTES ? static_cast<int>(index) : -1;
+    }
 }
 #endif // NOTES_H
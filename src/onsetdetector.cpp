@@ -0,0 +1,79 @@
+#include "onsetdetector.h"
+
+#include <algorithm>
+
+OnsetDetector::Settings OnsetDetector::defaultSettings(Method method)
+{
+    // The values are in units of the amplitude of the samples (energy for high frequency content)
+    return method == SPECTRAL_FLUX ? Settings{SPECTRAL_FLUX, 1.5, 0.02} : Settings{HIGH_FREQUENCY_CONTENT, 1.5, 0.0005};
+}
+
+OnsetDetector::OnsetDetector(const Settings &settings)
+    : settings(settings)
+    , previous{}
+    , previousHfc{0.0}
+    , history{}
+    , historyCount{0}
+    , historyNext{0}
+    , value{0.0}
+    , wasOnset{false}
+{
+}
+
+void OnsetDetector::setSettings(const Settings &settings)
+{
+    this->settings = settings;
+    reset();
+}
+
+void OnsetDetector::reset()
+{
+    std::fill(previous.begin(), previous.end(), 0.0);
+    previousHfc = 0.0;
+    historyCount = 0;
+    historyNext = 0;
+    value = 0.0;
+    wasOnset = false;
+}
+
+bool OnsetDetector::process(const double *magnitudes, size_t numBins, size_t numSamples)
+{
+    if (previous.size() != numBins) {
+        previous.assign(numBins, 0.0);
+        previousHfc = 0.0;
+    }
+
+    // In amplitudes, so the threshold holds whatever the length of the frame
+    const double scale = 2.0 / static_cast<double>(numSamples);
+    if (settings.method == SPECTRAL_FLUX) {
+        double flux = 0.0;
+        for (size_t k = 0; k < numBins; ++k) {
+            const double magnitude = magnitudes[k] * scale;
+            flux += std::max(magnitude - previous[k], 0.0);
+            previous[k] = magnitude;
+        }
+        value = flux;
+    }
+    else {
+        double hfc = 0.0;
+        for (size_t k = 0; k < numBins; ++k) {
+            const double magnitude = magnitudes[k] * scale;
+            hfc += static_cast<double>(k) / static_cast<double>(numBins) * magnitude * magnitude;
+        }
+        value = std::max(hfc - previousHfc, 0.0);
+        previousHfc = hfc;
+    }
+
+    // The threshold follows the mean of the recent values, so a steady texture doesn't trigger onsets
+    double mean = 0.0;
+    for (size_t i = 0; i < historyCount; ++i) mean += history[i];
+    if (historyCount > 0) mean /= static_cast<double>(historyCount);
+
+    const bool onset = !wasOnset && value > mean * settings.multiplier + settings.delta;
+
+    history[historyNext] = value;
+    historyNext = (historyNext + 1) % HISTORY_SIZE;
+    historyCount = std::min<size_t>(historyCount + 1, HISTORY_SIZE);
+    wasOnset = onset;
+    return onset;
+}
@@ -0,0 +1,78 @@
+#ifndef ONSETDETECTOR_H
+#define ONSETDETECTOR_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Detects the start of notes from the magnitude spectra of consecutive frames.
+ *
+ * Works on the spectrum the analysis already computed, only keeping the previous one: spectral flux sums
+ * the rise of every bin since the previous frame, high frequency content measures the rise of the energy
+ * weighted by frequency (sharper on percussive attacks). A frame is an onset when its detection value
+ * stands out of the mean of the recent ones, and not right after another onset.
+ */
+class OnsetDetector
+{
+public:
+    enum Method {
+        SPECTRAL_FLUX,              // Sum of the rise of the magnitude of every bin
+        HIGH_FREQUENCY_CONTENT      // Rise of the sum of the energy of every bin weighted by its frequency
+    };
+
+    /**
+     * @brief The detection function and its adaptive threshold
+     */
+    struct Settings
+    {
+        Method  method;         // The detection function
+        double  multiplier;     // Factor of the mean of the recent detection values
+        double  delta;          // Added to the threshold, the smallest detection value that can be an onset
+    };
+
+    enum { HISTORY_SIZE = 16 };
+
+    /**
+     * @brief Returns sensible settings for a method
+     */
+    static Settings defaultSettings(Method method = SPECTRAL_FLUX);
+
+    explicit OnsetDetector(const Settings &settings = defaultSettings());
+
+    /**
+     * @brief Changes the detection function and its threshold, forgets the previous frames
+     */
+    void setSettings(const Settings &settings);
+
+    /**
+     * @brief Forgets the previous frames, the next frame is compared to silence
+     */
+    void reset();
+
+    /**
+     * @brief Compares the spectrum of a frame with the one of the previous frame
+     * @param magnitudes The magnitude spectrum of the frame
+     * @param numBins Number of meaningful bins of magnitudes (half the size of the transform plus one)
+     * @param numSamples Number of samples transformed, without the zero padding, to scale the magnitudes
+     * @return True if the frame is an onset
+     * @note Allocates when the number of bins changes
+     */
+    bool process(const double *magnitudes, size_t numBins, size_t numSamples);
+
+    /**
+     * @brief Returns the detection value of the last frame
+     */
+    double getValue() const { return value; }
+
+private:
+    Settings                settings;       // Detection function and threshold
+    std::vector<double>     previous;       // Scaled magnitudes of the previous frame
+    double                  previousHfc;    // High frequency content of the previous frame
+    double                  history[HISTORY_SIZE]; // Detection values of the recent frames
+    size_t                  historyCount;   // Number of values in history, up to HISTORY_SIZE
+    size_t                  historyNext;    // Index of the next value of history
+    double                  value;          // Detection value of the last frame
+    bool                    wasOnset;       // True if the last frame was an onset
+};
+
+#endif // ONSETDETECTOR_H
@@ -0,0 +1,263 @@
+#include "partialtracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "notes.h"
+
+namespace {
+    // The peaks below this amplitude (-80 dBFS) or this far below the strongest one (-30 dB) are ignored
+    const float MIN_AMPLITUDE       = 1e-4f;
+    const float MIN_RELATIVE        = 0.03f;
+
+    // A peak continues a partial when their frequencies are within a quarter of a tone (or a bin)
+    const float MAX_DEVIATION       = 0.03f;
+
+    // Harmonics of a fundamental taken into account, and number of strongest partials the fundamentals are taken from
+    const int   NUM_HARMONICS       = 8;
+    const size_t NUM_STRONGEST      = 4;
+    const int   MAX_DIVISOR         = 3;
+
+    // Another note must hold for this long, and at least two frames, before it replaces the current one
+    const float HOLD_SEC            = 0.05f;
+}
+
+PartialTracker::PartialTracker()
+    : numSamples{0}
+    , sampleRate{0}
+    , binHz{0.0f}
+    , candidates{}
+    , peaks{}
+    , numPeaks{0}
+    , partials{}
+    , numPartials{0}
+    , linked{}
+    , nextId{0}
+    , pitch{0.0f}
+    , note{-1}
+    , confidence{0.0f}
+    , pendingNote{-1}
+    , pendingFrames{0}
+    , pendingSec{0.0f}
+    , staleFrames{0}
+    , staleSec{0.0f}
+{
+}
+
+void PartialTracker::configure(size_t numSamples, int sampleRate)
+{
+    this->numSamples = numSamples;
+    this->sampleRate = sampleRate;
+    binHz = static_cast<float>(sampleRate) / static_cast<float>(numSamples);
+
+    // Local maxima are at least two bins apart
+    candidates.reserve(numSamples / 4 + 1);
+    reset();
+}
+
+void PartialTracker::reset()
+{
+    numPeaks = 0;
+    numPartials = 0;
+    pitch = 0.0f;
+    note = -1;
+    confidence = 0.0f;
+    pendingNote = -1;
+    pendingFrames = 0;
+    pendingSec = 0.0f;
+    staleFrames = 0;
+    staleSec = 0.0f;
+}
+
+void PartialTracker::process(const double *magnitudes, size_t frameSize, float durationSec, bool onset)
+{
+    findPeaks(magnitudes, frameSize);
+    link();
+
+    // The partials of a note that just started were only just born
+    float frequency = 0.0f;
+    const float share = findFundamental(!onset, frequency);
+    const int candidate = notes::nearest(frequency);
+
+    int accepted = candidate;
+    if (candidate != note && !onset) {
+        if (candidate != pendingNote) {
+            pendingNote = candidate;
+            pendingFrames = 0;
+            pendingSec = 0.0f;
+        }
+        ++pendingFrames;
+        pendingSec += durationSec;
+        ++staleFrames;
+        staleSec += durationSec;
+
+        // A note replaces the current one once it held, the current one goes once nothing held in its place (ie: noise)
+        const bool held = pendingFrames >= 2 && pendingSec >= HOLD_SEC;
+        const bool stale = staleFrames >= 2 && staleSec >= HOLD_SEC;
+        if (!held && !stale) return;
+        if (!held) accepted = -1;
+    }
+
+    pendingNote = accepted;
+    pendingFrames = 0;
+    pendingSec = 0.0f;
+    staleFrames = 0;
+    staleSec = 0.0f;
+
+    note = accepted;
+    pitch = accepted >= 0 ? frequency : 0.0f;
+    confidence = accepted >= 0 ? share : 0.0f;
+}
+
+void PartialTracker::findPeaks(const double *magnitudes, size_t frameSize)
+{
+    // Amplitudes of the sinusoids, the zero padding adds nothing to their bins
+    const double scale = 2.0 / static_cast<double>(frameSize);
+    const size_t numBins = numSamples / 2 + 1;
+
+    candidates.clear();
+    float strongest = 0.0f;
+    for (size_t k = 1; k + 1 < numBins; ++k) {
+        const double magnitude = magnitudes[k];
+        if (magnitude <= magnitudes[k - 1] || magnitude < magnitudes[k + 1]) continue;
+        const float amplitude = static_cast<float>(magnitude * scale);
+        if (amplitude < MIN_AMPLITUDE) continue;
+
+        // Parabola through the log magnitudes of the bin and its neighbours, its top is the frequency of the sinusoid
+        const double alpha = std::log(magnitudes[k - 1] + 1e-12);
+        const double beta = std::log(magnitude + 1e-12);
+        const double gamma = std::log(magnitudes[k + 1] + 1e-12);
+        const double denominator = alpha - 2.0 * beta + gamma;
+        const double offset = denominator < 0.0 ? std::clamp(0.5 * (alpha - gamma) / denominator, -0.5, 0.5) : 0.0;
+        const float interpolated = static_cast<float>(std::exp(beta - 0.25 * (alpha - gamma) * offset) * scale);
+
+        candidates.push_back(Peak{static_cast<float>((static_cast<double>(k) + offset) * binHz), interpolated});
+        strongest = std::max(strongest, interpolated);
+    }
+
+    // The weak peaks are mostly the side lobes of the strong ones
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [strongest](const Peak &peak) {
+        return peak.amplitude < strongest * MIN_RELATIVE;
+    }), candidates.end());
+    if (candidates.size() > MAX_PEAKS) {
+        std::nth_element(candidates.begin(), candidates.begin() + MAX_PEAKS, candidates.end(), [](const Peak &a, const Peak &b) {
+            return a.amplitude > b.amplitude;
+        });
+        candidates.resize(MAX_PEAKS);
+        std::sort(candidates.begin(), candidates.end(), [](const Peak &a, const Peak &b) { return a.frequency < b.frequency; });
+    }
+
+    numPeaks = candidates.size();
+    std::copy(candidates.begin(), candidates.end(), peaks);
+}
+
+void PartialTracker::link()
+{
+    // Both lists are sorted by frequency, the peak of each partial is at or after the peak of the previous one
+    int match[MAX_PARTIALS];
+    bool used[MAX_PEAKS] = {};
+    size_t first = 0;
+    for (size_t i = 0; i < numPartials; ++i) {
+        const float frequency = partials[i].frequency;
+        const float tolerance = std::max(frequency * MAX_DEVIATION, binHz);
+        while (first < numPeaks && peaks[first].frequency < frequency - tolerance) ++first;
+
+        match[i] = -1;
+        float closest = tolerance;
+        for (size_t j = first; j < numPeaks && peaks[j].frequency <= frequency + tolerance; ++j) {
+            const float distance = std::abs(peaks[j].frequency - frequency);
+            if (!used[j] && distance <= closest) {
+                match[i] = static_cast<int>(j);
+                closest = distance;
+            }
+        }
+        if (match[i] >= 0) used[match[i]] = true;
+    }
+
+    // Merges the partials that go on with the peaks giving birth to new ones, keeping them sorted
+    size_t count = 0;
+    size_t j = 0;
+    for (size_t i = 0; i <= numPartials; ++i) {
+        const float next = i < numPartials ? (match[i] >= 0 ? peaks[match[i]].frequency : partials[i].frequency) : INFINITY;
+        for (; j < numPeaks && peaks[j].frequency < next; ++j) {
+            // The partials alive have priority over the births
+            if (used[j] || count + (numPartials - i) >= MAX_PARTIALS) continue;
+            linked[count++] = Partial{peaks[j].frequency, peaks[j].amplitude, nextId++, 1, 0};
+        }
+        if (i == numPartials) break;
+
+        Partial partial = partials[i];
+        if (match[i] >= 0) {
+            partial.frequency = peaks[match[i]].frequency;
+            partial.amplitude = peaks[match[i]].amplitude;
+            partial.age = static_cast<uint16_t>(std::min<int>(partial.age + 1, UINT16_MAX));
+            partial.missed = 0;
+        }
+        else if (++partial.missed > MAX_MISSED) {
+            continue;
+        }
+        linked[count++] = partial;
+    }
+
+    std::copy(linked, linked + count, partials);
+    numPartials = count;
+}
+
+float PartialTracker::findFundamental(bool matureOnly, float &frequency) const
+{
+    frequency = 0.0f;
+
+    // The partials seen in this frame and, unless a note just started, in the previous ones
+    size_t strongest[NUM_STRONGEST];
+    size_t numStrongest = 0;
+    float total = 0.0f;
+    for (size_t i = 0; i < numPartials; ++i) {
+        const Partial &partial = partials[i];
+        if (partial.missed > 0 || (matureOnly && partial.age < MIN_AGE)) continue;
+        total += partial.amplitude;
+
+        // Insertion in the few strongest ones
+        size_t position = numStrongest;
+        while (position > 0 && partials[strongest[position - 1]].amplitude < partial.amplitude) --position;
+        if (position >= NUM_STRONGEST) continue;
+        const size_t last = std::min(numStrongest, NUM_STRONGEST - 1);
+        for (size_t k = last; k > position; --k) strongest[k] = strongest[k - 1];
+        strongest[position] = i;
+        numStrongest = std::min(numStrongest + 1, NUM_STRONGEST);
+    }
+    if (total <= 0.0f) return 0.0f;
+
+    // The fundamental is one of the strongest partials, or one of their subharmonics when it is missing
+    float bestScore = 0.0f;
+    float bestExplained = 0.0f;
+    for (size_t s = 0; s < numStrongest; ++s) {
+        for (int divisor = 1; divisor <= MAX_DIVISOR; ++divisor) {
+            const float candidate = partials[strongest[s]].frequency / static_cast<float>(divisor);
+            if (candidate < std::max(binHz, static_cast<float>(notes::frequencies[0]))) break;
+
+            // The higher harmonics count less, so a subharmonic doesn't win with the harmonics of the note
+            float score = 0.0f, explained = 0.0f, weighted = 0.0f;
+            for (size_t i = 0; i < numPartials; ++i) {
+                const Partial &partial = partials[i];
+                if (partial.missed > 0 || (matureOnly && partial.age < MIN_AGE)) continue;
+
+                const int harmonic = static_cast<int>(std::lround(partial.frequency / candidate));
+                if (harmonic < 1 || harmonic > NUM_HARMONICS) continue;
+                const float expected = candidate * static_cast<float>(harmonic);
+                if (std::abs(partial.frequency - expected) > std::max(expected * MAX_DEVIATION, binHz)) continue;
+
+                score += partial.amplitude / static_cast<float>(harmonic);
+                explained += partial.amplitude;
+                weighted += partial.amplitude * partial.frequency / static_cast<float>(harmonic);
+            }
+
+            if (score > bestScore) {
+                bestScore = score;
+                bestExplained = explained;
+                // Every harmonic tells the fundamental, their mean is more precise than any of them
+                frequency = weighted / explained;
+            }
+        }
+    }
+    return bestExplained / total;
+}
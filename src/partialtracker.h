@@ -0,0 +1,141 @@
+#ifndef PARTIALTRACKER_H
+#define PARTIALTRACKER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Follows the partials (the peaks of the spectrum) from frame to frame, and the pitch they make.
+ *
+ * The peaks of each spectrum are linked to the partials of the previous frame closest in frequency: a
+ * partial continues with its peak, is born from a peak no partial was close to, and dies after it missed
+ * MAX_MISSED frames. Peaks and partials are both kept sorted by frequency, so linking is a single merge of
+ * the two lists, O(peaks) per frame, in arrays allocated once by configure().
+ *
+ * The pitch is the fundamental explaining best the partials that lived a few frames, and the note only
+ * changes once another one held for a while (or right away on an onset), so it doesn't flicker between
+ * neighbouring notes and harmonics the way the strongest bin of each spectrum does.
+ */
+class PartialTracker
+{
+public:
+    enum { MAX_PEAKS = 48, MAX_PARTIALS = 64, MAX_MISSED = 2, MIN_AGE = 2 };
+
+    /**
+     * @brief A partial followed across frames
+     */
+    struct Partial
+    {
+        float       frequency;      // Frequency in Hz, interpolated between the bins
+        float       amplitude;      // Amplitude of the sinusoid
+        uint32_t    id;             // Id kept from its birth to its death
+        uint16_t    age;            // Number of frames it was seen in
+        uint16_t    missed;         // Number of frames it was missing from since it was last seen
+    };
+
+    PartialTracker();
+
+    /**
+     * @brief Allocates the peaks, sets the resolution of the spectra and forgets the partials
+     * @param numSamples Size of the transform of the spectra
+     * @param sampleRate Sample rate of the samples
+     */
+    void configure(size_t numSamples, int sampleRate);
+
+    /**
+     * @brief Returns whether configure() was called for a size and a sample rate
+     */
+    bool isConfigured(size_t numSamples, int sampleRate) const { return this->numSamples == numSamples && this->sampleRate == sampleRate; }
+
+    /**
+     * @brief Forgets the partials and the note
+     */
+    void reset();
+
+    /**
+     * @brief Links the peaks of a spectrum to the partials and updates the pitch
+     * @param magnitudes The magnitude spectrum, of the size and sample rate given to configure()
+     * @param frameSize Number of samples transformed, without the zero padding, to scale the magnitudes
+     * @param durationSec Time since the previous spectrum (the hop)
+     * @param onset True if a note starts in the frame, the note then changes without waiting
+     */
+    void process(const double *magnitudes, size_t frameSize, float durationSec, bool onset);
+
+    /**
+     * @brief Returns the pitch in Hz, 0 if there is none
+     */
+    float getPitch() const { return pitch; }
+
+    /**
+     * @brief Returns the index of the note in notes::notes, -1 if none
+     */
+    int getNote() const { return note; }
+
+    /**
+     * @brief Returns the share of the amplitude of the partials explained by the pitch, in range 0.0 - 1.0
+     */
+    float getConfidence() const { return confidence; }
+
+    /**
+     * @brief Returns the partials alive, sorted by frequency
+     */
+    const Partial* getPartials() const { return partials; }
+
+    /**
+     * @brief Returns the number of partials alive
+     */
+    size_t getNumPartials() const { return numPartials; }
+
+private:
+    /**
+     * @brief A peak of the spectrum
+     */
+    struct Peak
+    {
+        float       frequency;      // Frequency in Hz, interpolated between the bins
+        float       amplitude;      // Amplitude of the sinusoid
+    };
+
+    size_t                  numSamples;     // Size of the transform configured
+    int                     sampleRate;     // Sample rate configured
+    float                   binHz;          // Width of a bin in Hz
+    std::vector<Peak>       candidates;     // Every local maximum of the spectrum, before keeping the strongest
+    Peak                    peaks[MAX_PEAKS];       // Strongest peaks of the spectrum, sorted by frequency
+    size_t                  numPeaks;       // Number of peaks
+    Partial                 partials[MAX_PARTIALS]; // Partials alive, sorted by frequency
+    size_t                  numPartials;    // Number of partials alive
+    Partial                 linked[MAX_PARTIALS];   // The partials of the frame being linked, then copied to partials
+    uint32_t                nextId;         // Id of the next partial born
+
+    float                   pitch;          // Frequency of the note in Hz, 0 if none
+    int                     note;           // Index of the note in notes::notes, -1 if none
+    float                   confidence;     // Share of the amplitude of the partials explained by the pitch
+    int                     pendingNote;    // Note about to replace the current one, if it holds
+    size_t                  pendingFrames;  // Number of frames pendingNote held for
+    float                   pendingSec;     // Time pendingNote held for
+    size_t                  staleFrames;    // Number of frames the partials didn't make the note anymore
+    float                   staleSec;       // Time the partials didn't make the note anymore
+
+    /**
+     * @brief Finds the strongest peaks of a spectrum
+     * @param magnitudes The magnitude spectrum
+     * @param frameSize Number of samples transformed, without the zero padding
+     */
+    void findPeaks(const double *magnitudes, size_t frameSize);
+
+    /**
+     * @brief Links the peaks to the partials of the previous frame
+     */
+    void link();
+
+    /**
+     * @brief Finds the fundamental explaining best the partials
+     * @param matureOnly True to only consider the partials seen in MIN_AGE frames
+     * @param frequency Receives the fundamental in Hz, 0 if none
+     * @return The share of the amplitude of the partials it explains
+     */
+    float findFundamental(bool matureOnly, float &frequency) const;
+};
+
+#endif // PARTIALTRACKER_H
@@ -0,0 +1,333 @@
+#include "pitchestimators.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "notes.h"
+
+namespace {
+    // The log of the bins this far below the strongest one (-60 dB) is taken at this level, so the empty bins don't weigh more than noise
+    const double FLOOR_RELATIVE             = 1e-3;
+
+    // Energy of the harmonics of a candidate that aren't harmonics of a multiple of it, relative to the energy of those
+    // that are. Up to it, the multiple explains the whole spectrum: it is the fundamental
+    const double MAX_SUBHARMONIC_ENERGY     = 0.25;
+
+    // A peak this far below the strongest bin (-20 dB) is no harmonic, it neither confirms nor refines a pitch
+    const double MIN_HARMONIC_LEVEL         = 0.1;
+
+    // Confidence of a pitch whose resolution is coarser than a semitone, the neighbouring notes are as likely
+    const double MAX_UNRESOLVED_CONFIDENCE  = 0.25;
+
+    // A fraction of the highest peak of the cepstrum is the period when it peaks at this share of it
+    const double MIN_PERIOD_PEAK            = 0.7;
+
+    // Number of peaks of the cepstrum tried from the highest, before giving up on finding a period
+    const size_t MAX_PERIOD_CANDIDATES      = 4;
+
+    // Confidence of a period next to the bounds of the range of the cepstrum, where it may be a part of a larger peak outside
+    const double EDGE_CONFIDENCE            = 0.5;
+
+    // Ratio of the frequencies of two notes a semitone apart
+    const double SEMITONE_RATIO             = 1.0594630943592953;
+
+    /**
+     * @brief Returns the offset of the top of the parabola through three values, in range -0.5 - 0.5
+     */
+    double parabolicOffset(double alpha, double beta, double gamma)
+    {
+        const double denominator = alpha - 2.0 * beta + gamma;
+        return denominator < 0.0 ? std::clamp(0.5 * (alpha - gamma) / denominator, -0.5, 0.5) : 0.0;
+    }
+
+    /**
+     * @brief Finds the strongest bin around each harmonic of a candidate of the harmonic product spectrum
+     * @param magnitudes The magnitude spectrum
+     * @param numBins Number of bins of the spectrum, the last harmonic of the candidate must be in it
+     * @param candidate Bin of the candidate
+     * @param margin Bins added around the window of each harmonic, 1 to find the fundamentals on a boundary between two bins
+     * @param peaks Receives the strongest bin around harmonics 1 to NUM_PRODUCTS
+     */
+    void findHarmonics(const double *magnitudes, size_t numBins, size_t candidate, size_t margin, size_t *peaks)
+    {
+        // The window of harmonic r spans r bins, the harmonics between two bins are found. The windows of the low
+        // candidates would overlap, each bin only counts for the first of them
+        size_t previousHigh = 0;
+        for (size_t r = 1; r <= PitchEstimators::NUM_PRODUCTS; ++r) {
+            const size_t low = std::max(r * candidate - std::min(r / 2 + margin, r * candidate), r > 1 ? previousHigh + 1 : 0);
+            const size_t high = std::min(r * candidate + r / 2 + margin, numBins - 1);
+            peaks[r - 1] = static_cast<size_t>(std::max_element(magnitudes + low, magnitudes + high + 1) - magnitudes);
+            previousHigh = high;
+        }
+    }
+
+    /**
+     * @brief Returns whether a bin found around a harmonic is a peak of the spectrum, not the slope of a neighbouring one
+     */
+    bool isPeak(const double *magnitudes, size_t numBins, size_t bin)
+    {
+        return bin > 0 && bin + 1 < numBins && magnitudes[bin] >= magnitudes[bin - 1] && magnitudes[bin] >= magnitudes[bin + 1];
+    }
+
+    /**
+     * @brief Returns the multiple of a candidate that explains its harmonics, when the others carry next to no energy
+     * @param magnitudes The magnitude spectrum
+     * @param numBins Number of bins of the spectrum
+     * @param peaks The strongest bin around harmonics 1 to NUM_PRODUCTS of the candidate
+     * @return The multiple, 1 if the candidate is the fundamental
+     */
+    size_t findMultiple(const double *magnitudes, size_t numBins, const size_t *peaks)
+    {
+        for (size_t m = PitchEstimators::NUM_PRODUCTS; m >= 2; --m) {
+            double shared = 0.0;
+            double other = 0.0;
+            for (size_t r = 1; r <= PitchEstimators::NUM_PRODUCTS; ++r) {
+                if (!isPeak(magnitudes, numBins, peaks[r - 1])) continue;
+                const double energy = magnitudes[peaks[r - 1]] * magnitudes[peaks[r - 1]];
+                (r % m == 0 ? shared : other) += energy;
+            }
+            if (shared > 0.0 && other <= MAX_SUBHARMONIC_ENERGY * shared) return m;
+        }
+        return 1;
+    }
+
+    /**
+     * @brief Returns whether a spectrum has the harmonics of a pitch: two of them at least, the strongest bin among them,
+     * and not only those of a multiple of it
+     * @param magnitudes The magnitude spectrum
+     * @param numBins Number of bins of the spectrum
+     * @param fundamental The pitch, in bins
+     */
+    bool hasHarmonics(const double *magnitudes, size_t numBins, double fundamental)
+    {
+        const size_t strongest = static_cast<size_t>(std::max_element(magnitudes + 1, magnitudes + numBins) - magnitudes);
+        size_t peaks[PitchEstimators::NUM_PRODUCTS];
+        size_t numHarmonics = 0;
+        bool hasStrongest = false;
+        for (size_t r = 1; r <= PitchEstimators::NUM_PRODUCTS; ++r) {
+            const size_t centre = static_cast<size_t>(std::lround(fundamental * static_cast<double>(r)));
+            peaks[r - 1] = centre > 0 && centre + 2 < numBins ? static_cast<size_t>(std::max_element(magnitudes + centre - 1, magnitudes + centre + 2) - magnitudes) : 0;
+            if (!isPeak(magnitudes, numBins, peaks[r - 1]) || magnitudes[peaks[r - 1]] < magnitudes[strongest] * MIN_HARMONIC_LEVEL) continue;
+            ++numHarmonics;
+            hasStrongest = hasStrongest || peaks[r - 1] == strongest;
+        }
+        return numHarmonics >= 2 && hasStrongest && findMultiple(magnitudes, numBins, peaks) == 1;
+    }
+
+    /**
+     * @brief Refines a pitch with its harmonics. They are r times further apart than the bins around the fundamental,
+     * each of them found gives the pitch r times more precisely
+     * @param magnitudes The magnitude spectrum
+     * @param numBins Number of bins of the spectrum
+     * @param fundamental The pitch, in bins
+     * @param highest Receives the highest harmonic found, 0 if none
+     * @return The pitch, in bins
+     */
+    double refinePitch(const double *magnitudes, size_t numBins, double fundamental, size_t &highest)
+    {
+        // Each harmonic is looked for next to r times the pitch found from those below it
+        const double strongest = *std::max_element(magnitudes + 1, magnitudes + numBins);
+        double weighted = 0.0;
+        double weights = 0.0;
+        highest = 0;
+        for (size_t r = 1; r <= PitchEstimators::NUM_PRODUCTS; ++r) {
+            const size_t centre = static_cast<size_t>(std::lround(fundamental * static_cast<double>(r)));
+            if (centre == 0 || centre + 2 >= numBins) break;
+            const size_t peak = static_cast<size_t>(std::max_element(magnitudes + centre - 1, magnitudes + centre + 2) - magnitudes);
+            if (magnitudes[peak] < strongest * MIN_HARMONIC_LEVEL || !isPeak(magnitudes, numBins, peak)) continue;
+
+            const double position = static_cast<double>(peak) + parabolicOffset(magnitudes[peak - 1], magnitudes[peak], magnitudes[peak + 1]);
+            const double weight = magnitudes[peak] * static_cast<double>(r);
+            weighted += position / static_cast<double>(r) * weight;
+            weights += weight;
+            fundamental = weighted / weights;
+            highest = r;
+        }
+        return fundamental;
+    }
+
+    /**
+     * @brief Returns the floor of the magnitudes of a spectrum, relative to the strongest one
+     */
+    double findFloor(const double *magnitudes, size_t numBins)
+    {
+        const double strongest = *std::max_element(magnitudes, magnitudes + numBins);
+        return std::max(strongest * FLOOR_RELATIVE, 1e-12);
+    }
+}
+
+PitchEstimators::PitchEstimators(PlanCache &plans)
+    : plans(plans)
+    , logSpectrum{}
+    , quefrencies{}
+    , inversePlan{nullptr}
+    , product{}
+{
+}
+
+PitchEstimators::Estimate PitchEstimators::harmonicProduct(const double *magnitudes, size_t numSamples, int sampleRate)
+{
+    Estimate estimate{-1, 0.0f, 0.0f};
+    const size_t numBins = numSamples / 2 + 1;
+    const double binHz = static_cast<double>(sampleRate) / static_cast<double>(numSamples);
+
+    // The NUM_PRODUCTS harmonics of a candidate must be in the spectrum
+    const size_t first = std::max<size_t>(1, static_cast<size_t>(std::ceil(notes::frequencies[0] / binHz)));
+    const size_t last = (numBins - 1) / NUM_PRODUCTS;
+    if (last <= first + 1) return estimate;
+
+    // The product is a sum of logs, a candidate whose harmonics are missing falls to the floor at each of them. The
+    // sidelobes of a sinusoid alone are harmonics of some candidates too, only those whose harmonics have the strongest
+    // bin of the spectrum are pitches
+    const double floor = findFloor(magnitudes, numBins);
+    const size_t strongestBin = static_cast<size_t>(std::max_element(magnitudes + first, magnitudes + numBins) - magnitudes);
+    product.resize(last + 1);
+    size_t peaks[NUM_PRODUCTS];
+    size_t best = 0;
+    double sum = 0.0;
+    for (size_t k = first; k <= last; ++k) {
+        findHarmonics(magnitudes, numBins, k, 0, peaks);
+        double value = 0.0;
+        for (size_t r = 0; r < NUM_PRODUCTS; ++r) value += std::log(magnitudes[peaks[r]] + floor);
+        product[k] = value;
+        sum += value;
+        if (std::find(peaks, peaks + NUM_PRODUCTS, strongestBin) == peaks + NUM_PRODUCTS) continue;
+        if (best == 0 || value > product[best]) best = k;
+    }
+
+    // The strongest bin is above the harmonics of the highest candidate, its fundamental is out of the range
+    if (best == 0) return estimate;
+
+    // A candidate below the fundamental finds some of its harmonics as well, and as many as the fundamental when it has
+    // few (ie: a sinusoid alone). When the harmonics of the candidate a multiple doesn't share carry next to no energy,
+    // the multiple explains the whole spectrum: it is the fundamental
+    for (;;) {
+        findHarmonics(magnitudes, numBins, best, 1, peaks);
+        // Harmonic m of the candidate is the fundamental of the multiple
+        const size_t multiple = peaks[findMultiple(magnitudes, numBins, peaks) - 1];
+        if (multiple <= best || multiple > last) break;
+        best = multiple;
+    }
+
+    size_t highest = 0;
+    const double frequency = refinePitch(magnitudes, numBins, static_cast<double>(best), highest) * binHz;
+
+    estimate.note = notes::nearest(frequency);
+    if (estimate.note < 0) return estimate;
+    estimate.frequency = static_cast<float>(frequency);
+
+    // How far the peak stands out of the mean product, per harmonic
+    const double mean = sum / static_cast<double>(last - first + 1);
+    double confidence = 1.0 - std::exp((mean - product[best]) / NUM_PRODUCTS);
+    // A low pitch found by its fundamental alone has bins wider than a semitone
+    if (frequency * (SEMITONE_RATIO - 1.0) < binHz / static_cast<double>(std::max<size_t>(highest, 1))) confidence = std::min(confidence, MAX_UNRESOLVED_CONFIDENCE);
+    estimate.confidence = static_cast<float>(confidence);
+    return estimate;
+}
+
+PitchEstimators::Estimate PitchEstimators::cepstrum(const double *magnitudes, size_t numSamples, int sampleRate)
+{
+    Estimate estimate{-1, 0.0f, 0.0f};
+    const size_t numBins = numSamples / 2 + 1;
+    if (!inversePlan || quefrencies.size() != numSamples) {
+        logSpectrum.resize(numBins);
+        quefrencies.resize(numSamples);
+        inversePlan = plans.getInversePlan(numSamples);
+    }
+
+    // The spectrum is real and even, so is its log, and the inverse transform of it is the real cepstrum
+    const double floor = findFloor(magnitudes, numBins);
+    std::transform(magnitudes, magnitudes + numBins, logSpectrum.begin(), [floor](double magnitude) -> std::complex<double> {
+        return std::log(magnitude + floor);
+    });
+    fftw_execute_dft_c2r(inversePlan, reinterpret_cast<fftw_complex*>(logSpectrum.data()), quefrencies.data());
+
+    // The low quefrencies are the envelope of the spectrum. A period needs two periods of harmonics in the spectrum (2 bins)
+    const double rate = static_cast<double>(sampleRate);
+    const size_t first = static_cast<size_t>(std::ceil(rate / MAX_CEPSTRUM_HZ));
+    const double lowest = std::max(notes::frequencies[0], 2.0 * rate / static_cast<double>(numSamples));
+    const size_t last = std::min(static_cast<size_t>(rate / lowest), numSamples / 2 - 1);
+    if (last <= first + 1) return estimate;
+
+    double sum = 0.0;
+    for (size_t q = first; q <= last; ++q) sum += std::abs(quefrencies[q]);
+    const double mean = sum / static_cast<double>(last - first + 1);
+
+    // Only a peak inside the range is a period, the cepstrum keeps falling from the envelope into the range and its
+    // highest value on the bound is no peak of anything. The ripple of the sidelobes (and its alias when the frame is
+    // zero-padded) peaks too: from the highest, the first peak whose harmonics are in the spectrum is the period
+    double below = std::numeric_limits<double>::max();
+    for (size_t attempt = 0; attempt < MAX_PERIOD_CANDIDATES; ++attempt) {
+        size_t best = 0;
+        for (size_t q = first + 1; q < last; ++q) {
+            if (quefrencies[q] >= below || quefrencies[q] <= quefrencies[q - 1] || quefrencies[q] < quefrencies[q + 1]) continue;
+            if (best == 0 || quefrencies[q] > quefrencies[best]) best = q;
+        }
+        if (best == 0 || quefrencies[best] <= 0.0) return estimate;
+        below = quefrencies[best];
+
+        // Every multiple of the period (rahmonic) peaks as well, sometimes higher when it falls on a whole quefrency. From
+        // the shortest, the first fraction of the peak that peaks about as high is the period. It is looked for down to
+        // half the range, a period shorter than the range is a fundamental the cepstrum doesn't tell
+        const double threshold = quefrencies[best] * MIN_PERIOD_PEAK;
+        const size_t shortest = std::max<size_t>(2, first / 2);
+        for (size_t m = best / shortest; m >= 2; --m) {
+            const double fraction = static_cast<double>(best) / static_cast<double>(m);
+            const size_t low = static_cast<size_t>(fraction) - 1;
+            const size_t high = static_cast<size_t>(fraction) + 2;
+            size_t period = 0;
+            for (size_t q = std::max<size_t>(low, 1); q <= high; ++q) {
+                if (quefrencies[q] < threshold || quefrencies[q] <= quefrencies[q - 1] || quefrencies[q] < quefrencies[q + 1]) continue;
+                if (period == 0 || quefrencies[q] > quefrencies[period]) period = q;
+            }
+            if (period != 0) {
+                best = period;
+                break;
+            }
+        }
+        if (best < first) return estimate;
+
+        const double peak = quefrencies[best];
+        const double offset = parabolicOffset(quefrencies[best - 1], peak, quefrencies[best + 1]);
+        const double fundamental = static_cast<double>(numSamples) / (static_cast<double>(best) + offset);
+        if (!hasHarmonics(magnitudes, numBins, fundamental)) continue;
+
+        // The harmonics tell the pitch more precisely than the period, whole quefrencies are coarse at the high pitches
+        size_t highest = 0;
+        const double frequency = refinePitch(magnitudes, numBins, fundamental, highest) * rate / static_cast<double>(numSamples);
+        estimate.note = notes::nearest(frequency);
+        if (estimate.note < 0) return estimate;
+        estimate.frequency = static_cast<float>(frequency);
+
+        // How far the peak stands out of the cepstrum, less next to the bounds where it may be a part of a larger peak outside
+        double confidence = std::max(0.0, 1.0 - mean / peak);
+        if (best <= first + 1 || best + 1 >= last) confidence *= EDGE_CONFIDENCE;
+        estimate.confidence = static_cast<float>(confidence);
+        return estimate;
+    }
+    return estimate;
+}
+
+PitchEstimators::Estimate PitchEstimators::fuse(const Estimate *estimates, size_t count)
+{
+    Estimate fused{-1, 0.0f, 0.0f};
+    if (count == 0) return fused;
+
+    float votes[notes::NB_NOTES] = {};
+    for (size_t i = 0; i < count; ++i) {
+        if (estimates[i].note < 0) continue;
+        votes[estimates[i].note] += estimates[i].confidence;
+        if (fused.note < 0 || votes[estimates[i].note] > votes[fused.note]) fused.note = estimates[i].note;
+    }
+    if (fused.note < 0 || votes[fused.note] <= 0.0f) return Estimate{-1, 0.0f, 0.0f};
+
+    // The estimators that agree on the note each tell its pitch, the most confident ones count more
+    float weighted = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        if (estimates[i].note == fused.note) weighted += estimates[i].frequency * estimates[i].confidence;
+    }
+    fused.frequency = weighted / votes[fused.note];
+    fused.confidence = votes[fused.note] / static_cast<float>(count);
+    return fused;
+}
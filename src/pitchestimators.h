@@ -0,0 +1,98 @@
+#ifndef PITCHESTIMATORS_H
+#define PITCHESTIMATORS_H
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+#include <fftw3.h>
+
+#include "plancache.h"
+
+/**
+ * Pitch estimators working on a magnitude spectrum, and the fusion of their votes.
+ *
+ * From the cheapest to the most robust: the note of the strongest bin (ChannelAnalyzer::calculateNote),
+ * the harmonic product spectrum (the spectrum multiplied by itself compressed by 2, 3...), the real
+ * cepstrum (the inverse transform of the log spectrum, one inverse FFT with a plan of the shared cache)
+ * and the fundamental of the tracked partials (PartialTracker). A deployment picks the ones it can afford,
+ * each votes for a note with its confidence and the note with the most votes wins.
+ *
+ * One instance per channel, it holds the buffers of the cepstrum. Nothing is allocated unless the size of
+ * the spectrum changes.
+ */
+class PitchEstimators
+{
+public:
+    /**
+     * @brief The estimators, to be combined in a mask
+     */
+    enum Estimator {
+        STRONGEST_BIN       = 1 << 0,   // The note of the strongest bin
+        HARMONIC_PRODUCT    = 1 << 1,   // The peak of the harmonic product spectrum
+        CEPSTRUM            = 1 << 2,   // The peak of the real cepstrum, for the fundamentals up to MAX_CEPSTRUM_HZ
+        PARTIALS            = 1 << 3,   // The fundamental of the partials tracked across frames
+        ALL_ESTIMATORS      = STRONGEST_BIN | HARMONIC_PRODUCT | CEPSTRUM | PARTIALS
+    };
+
+    enum { NUM_PRODUCTS = 5, MAX_CEPSTRUM_HZ = 1000 };
+
+    /**
+     * @brief The vote of an estimator
+     */
+    struct Estimate
+    {
+        int         note;           // Index of the note in notes::notes, -1 if none
+        float       frequency;      // Frequency of the pitch in Hz, 0 if none
+        float       confidence;     // Weight of the vote in range 0.0 - 1.0
+    };
+
+    /**
+     * @param plans The cache of the inverse plans
+     */
+    explicit PitchEstimators(PlanCache &plans = PlanCache::shared());
+
+    PitchEstimators(const PitchEstimators&) = delete;
+    PitchEstimators& operator=(const PitchEstimators&) = delete;
+
+    /**
+     * @brief Estimates the pitch with the harmonic product spectrum
+     * @param magnitudes The magnitude spectrum
+     * @param numSamples Size of the transform of the spectrum
+     * @param sampleRate Sample rate of the transform
+     * @return The estimate, its confidence tells how much the peak stands out of the product, it is low when the
+     * harmonics found don't resolve a semitone
+     */
+    Estimate harmonicProduct(const double *magnitudes, size_t numSamples, int sampleRate);
+
+    /**
+     * @brief Estimates the pitch with the real cepstrum
+     * @param magnitudes The magnitude spectrum
+     * @param numSamples Size of the transform of the spectrum
+     * @param sampleRate Sample rate of the transform
+     * @return The estimate, its confidence tells how much the peak stands out of the cepstrum. None when the spectrum
+     * doesn't have the harmonics of a period (ie: a sinusoid alone) or the fundamental is above MAX_CEPSTRUM_HZ
+     */
+    Estimate cepstrum(const double *magnitudes, size_t numSamples, int sampleRate);
+
+    /**
+     * @brief Fuses the votes of several estimators
+     * @param estimates The vote of each estimator
+     * @param count Number of estimates
+     * @return The note with the most votes, its confidence is the mean of the votes for it (counting the
+     * estimators that voted for another note as 0), its frequency the weighted mean of theirs
+     */
+    static Estimate fuse(const Estimate *estimates, size_t count);
+
+private:
+    typedef std::vector<double, FftwAllocator<double>> RealBuffer;
+    typedef std::vector<std::complex<double>, FftwAllocator<std::complex<double>>> ComplexBuffer;
+
+    PlanCache&              plans;          // Where the inverse plan comes from
+    ComplexBuffer           logSpectrum;    // Log magnitude spectrum, the input of the inverse transform
+    RealBuffer              quefrencies;    // The real cepstrum
+    fftw_plan               inversePlan;    // Plan for the size of quefrencies, owned by plans, nullptr until the first cepstrum
+    std::vector<double>     product;        // Log of the harmonic product spectrum
+};
+
+#endif // PITCHESTIMATORS_H
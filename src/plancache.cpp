@@ -0,0 +1,130 @@
+#include "plancache.h"
+
+#include <algorithm>
+#include <complex>
+
+#include "notes.h"
+
+namespace {
+    // Only the execution of a plan is thread safe in FFTW, planning is serialized across every cache
+    std::mutex plannerMutex;
+}
+
+PlanCache::PlanCache()
+    : mutex{}
+    , plans{}
+    , inversePlans{}
+    , noteMaps{}
+{
+}
+
+PlanCache::~PlanCache()
+{
+    std::lock_guard<std::mutex> lock(plannerMutex);
+    for (Plan &entry : plans) fftw_destroy_plan(entry.plan);
+    for (Plan &entry : inversePlans) fftw_destroy_plan(entry.plan);
+}
+
+fftw_plan PlanCache::getPlan(size_t numSamples)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const Plan &entry : plans) {
+        if (entry.numSamples == numSamples) return entry.plan;
+    }
+
+    // Measuring overwrites the arrays, the plan is made on scratch ones with the alignment of FftwAllocator
+    std::vector<double, FftwAllocator<double>> in(numSamples);
+    std::vector<std::complex<double>, FftwAllocator<std::complex<double>>> out(numSamples / 2 + 1);
+
+    std::lock_guard<std::mutex> plannerLock(plannerMutex);
+    const fftw_plan plan = fftw_plan_dft_r2c_1d(static_cast<int>(numSamples), in.data(), reinterpret_cast<fftw_complex*>(out.data()),
+                                                FFTW_MEASURE | FFTW_DESTROY_INPUT);
+    plans.push_back(Plan{numSamples, plan});
+    return plan;
+}
+
+fftw_plan PlanCache::getInversePlan(size_t numSamples)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const Plan &entry : inversePlans) {
+        if (entry.numSamples == numSamples) return entry.plan;
+    }
+
+    std::vector<std::complex<double>, FftwAllocator<std::complex<double>>> in(numSamples / 2 + 1);
+    std::vector<double, FftwAllocator<double>> out(numSamples);
+
+    std::lock_guard<std::mutex> plannerLock(plannerMutex);
+    const fftw_plan plan = fftw_plan_dft_c2r_1d(static_cast<int>(numSamples), reinterpret_cast<fftw_complex*>(in.data()), out.data(),
+                                                FFTW_MEASURE | FFTW_DESTROY_INPUT);
+    inversePlans.push_back(Plan{numSamples, plan});
+    return plan;
+}
+
+const PlanCache::NoteMap& PlanCache::getNoteMap(size_t numSamples, int sampleRate)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const std::unique_ptr<NoteMap> &noteMap : noteMaps) {
+        if (noteMap->numSamples == numSamples && noteMap->sampleRate == sampleRate) return *noteMap;
+    }
+
+    noteMaps.emplace_back(new NoteMap{numSamples, sampleRate, {}});
+    NoteMap &noteMap = *noteMaps.back();
+
+    // Bin k of a transform of numSamples samples is at k * sampleRate / numSamples Hz, the frequency of a note
+    // is between the bin below it and the next one. Only the first half of the spectrum is meaningful
+    const double hz_step = static_cast<double>(sampleRate) / static_cast<double>(numSamples);
+    for (int i = 0; i < notes::NB_NOTES; i++) {
+        const size_t bin = static_cast<size_t>(notes::frequencies[i] / hz_step);
+        if (bin + 1 > numSamples / 2) break;
+        noteMap.bins.push_back(bin);
+    }
+    return noteMap;
+}
+
+size_t PlanCache::getNumPlans()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return plans.size();
+}
+
+bool PlanCache::isFastSize(size_t numSamples, bool powersOfTwo)
+{
+    // Real transforms of odd sizes are slower, the sizes are even
+    if (numSamples < 2 || numSamples % 2 != 0) return false;
+    if (powersOfTwo) return (numSamples & (numSamples - 1)) == 0;
+
+    for (size_t factor : {2, 3, 5}) {
+        while (numSamples % factor == 0) numSamples /= factor;
+    }
+    return numSamples == 1;
+}
+
+size_t PlanCache::nextFastSize(size_t numSamples, bool powersOfTwo)
+{
+    size_t size = 2;
+    if (powersOfTwo) {
+        while (size < numSamples) size <<= 1;
+        return size;
+    }
+
+    // The sizes made of 2, 3 and 5 are dense enough (a few % apart around 4096) for a linear search
+    size = std::max(numSamples, size);
+    while (!isFastSize(size)) ++size;
+    return size;
+}
+
+size_t PlanCache::nearestFastSize(size_t numSamples, bool powersOfTwo)
+{
+    const size_t above = nextFastSize(numSamples, powersOfTwo);
+    if (above == numSamples) return above;
+
+    size_t below = powersOfTwo ? above / 2 : numSamples;
+    while (below > 2 && !isFastSize(below, powersOfTwo)) --below;
+    return numSamples - below <= above - numSamples ? below : above;
+}
+
+PlanCache& PlanCache::shared()
+{
+    static PlanCache cache;
+    return cache;
+}
@@ -0,0 +1,137 @@
+#ifndef PLANCACHE_H
+#define PLANCACHE_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <fftw3.h>
+
+/**
+ * FFT plans (forward and inverse) and note maps shared by every analyzer of the process.
+ *
+ * A plan only depends on the size of the transform and a note map on the size and the sample rate, so the
+ * channels of every stream analyzed at the same size share them instead of each planning their own. They
+ * are made on first use and live as long as the cache, so an analyzer only looks them up when the size of
+ * its frames changes. The plans are executed on the buffers of each analyzer (fftw_execute_dft_r2c is thread
+ * safe), the buffers must come from FftwAllocator so they have the alignment the plans were made for.
+ */
+class PlanCache
+{
+public:
+    /**
+     * @brief Bins of the spectrum of each note, for a size and a sample rate
+     */
+    struct NoteMap
+    {
+        size_t                  numSamples;     // Size of the transform
+        int                     sampleRate;     // Sample rate of the samples
+        std::vector<size_t>     bins;           // Bin of each note, up to the last note below the end of the spectrum
+    };
+
+    PlanCache();
+    ~PlanCache();
+
+    PlanCache(const PlanCache&) = delete;
+    PlanCache& operator=(const PlanCache&) = delete;
+
+    /**
+     * @brief Returns the plan of a real to complex transform, made on the first call for its size
+     * @param numSamples Size of the transform
+     * @return The plan, valid as long as the cache
+     */
+    fftw_plan getPlan(size_t numSamples);
+
+    /**
+     * @brief Returns the plan of a complex to real (inverse) transform, made on the first call for its size
+     * @param numSamples Size of the transform (number of real values)
+     * @return The plan, valid as long as the cache, to run with fftw_execute_dft_c2r (it overwrites its input)
+     */
+    fftw_plan getInversePlan(size_t numSamples);
+
+    /**
+     * @brief Returns the bins of the notes, made on the first call for the size and sample rate
+     * @param numSamples Size of the transform
+     * @param sampleRate Sample rate of the samples
+     * @return The note map, valid as long as the cache
+     */
+    const NoteMap& getNoteMap(size_t numSamples, int sampleRate);
+
+    /**
+     * @brief Returns the number of plans made so far
+     */
+    size_t getNumPlans();
+
+    /**
+     * @brief Returns whether FFTW transforms a size fast: an even size that is a power of two, or only made of
+     * the factors 2, 3 and 5
+     * @param numSamples Size of the transform
+     * @param powersOfTwo True to only accept powers of two
+     */
+    static bool isFastSize(size_t numSamples, bool powersOfTwo = false);
+
+    /**
+     * @brief Returns the smallest fast size not below a size, to zero-pad to
+     * @param numSamples Size of the samples
+     * @param powersOfTwo True to only accept powers of two
+     */
+    static size_t nextFastSize(size_t numSamples, bool powersOfTwo = false);
+
+    /**
+     * @brief Returns the fast size closest to a size (the smaller one on a tie)
+     * @param numSamples Size of the samples
+     * @param powersOfTwo True to only accept powers of two
+     */
+    static size_t nearestFastSize(size_t numSamples, bool powersOfTwo = false);
+
+    /**
+     * @brief Returns the cache shared by the whole process
+     */
+    static PlanCache& shared();
+
+private:
+    /**
+     * @brief A plan and the size it was made for
+     */
+    struct Plan
+    {
+        size_t                  numSamples;     // Size of the transform
+        fftw_plan               plan;           // The plan
+    };
+
+    std::mutex                              mutex;      // Guards the plans and note maps, only taken by lookups
+    std::vector<Plan>                       plans;      // Plans made so far
+    std::vector<Plan>                       inversePlans; // Inverse plans made so far
+    std::vector<std::unique_ptr<NoteMap>>   noteMaps;   // Note maps made so far, never moved once made
+};
+
+/**
+ * Allocator of std::vector giving the alignment of fftw_malloc, the one the plans of PlanCache are made for.
+ */
+template <typename T>
+struct FftwAllocator
+{
+    typedef T value_type;
+
+    FftwAllocator() = default;
+    template <typename U> FftwAllocator(const FftwAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        void *memory = fftw_malloc(n * sizeof(T));
+        if (!memory) throw std::bad_alloc();
+        return static_cast<T*>(memory);
+    }
+
+    void deallocate(T *memory, size_t) { fftw_free(memory); }
+};
+
+template <typename T, typename U>
+bool operator==(const FftwAllocator<T>&, const FftwAllocator<U>&) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const FftwAllocator<T>&, const FftwAllocator<U>&) { return false; }
+
+#endif // PLANCACHE_H
@@ -0,0 +1,214 @@
+#include "resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <tuple>
+
+#if defined(__SSE__) || defined(_M_X64)
+#   include <xmmintrin.h>
+#   define RESAMPLER_SSE
+#endif
+
+// Above this many phases the filter bank gets too big, the usual rates (44.1/48/88.2/96 kHz) need at most 320
+const size_t MAX_PHASES         = 1024;
+
+// Number of taps of each phase when interpolating, more when decimating so the transition band stays as narrow
+const size_t TAPS_PER_PHASE     = 32;
+
+// The cutoff is a bit below the Nyquist frequency of the lowest rate, to leave room to the transition band
+const double CUTOFF_RATIO       = 0.92;
+
+// Kaiser window beta, about 90 dB of stopband attenuation
+const double KAISER_BETA        = 8.6;
+
+namespace {
+    double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 50; ++k) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+            if (term < sum * 1e-12) break;
+        }
+        return sum;
+    }
+
+    /*
+     * Builds the filter bank: a low-pass prototype of up * taps coefficients, at the rate of the input
+     * upsampled by up, split in up phases. The taps of each phase are stored reversed so the dot product
+     * walks the input forward.
+     */
+    std::vector<float> buildFilter(size_t up, size_t down, size_t taps)
+    {
+        const size_t length = up * taps;
+        const double cutoff = 0.5 / static_cast<double>(std::max(up, down)) * CUTOFF_RATIO;
+        const double center = (static_cast<double>(length) - 1.0) / 2.0;
+
+        std::vector<double> prototype(length);
+        for (size_t i = 0; i < length; ++i) {
+            const double x = static_cast<double>(i) - center;
+            const double sinc = x == 0.0 ? 1.0 : std::sin(2.0 * M_PI * cutoff * x) / (M_PI * x) / (2.0 * cutoff);
+            const double r = x / (center + 1.0);
+            const double window = besselI0(KAISER_BETA * std::sqrt(std::max(0.0, 1.0 - r * r))) / besselI0(KAISER_BETA);
+            prototype[i] = sinc * window;
+        }
+
+        // Zero stuffing divides the gain by up, each phase must have a gain of 1
+        const double sum = std::accumulate(prototype.begin(), prototype.end(), 0.0);
+        const double gain = static_cast<double>(up) / sum;
+
+        std::vector<float> filter(length);
+        for (size_t p = 0; p < up; ++p) {
+            for (size_t j = 0; j < taps; ++j) {
+                filter[p * taps + (taps - 1 - j)] = static_cast<float>(prototype[p + j * up] * gain);
+            }
+        }
+        return filter;
+    }
+
+    /*
+     * The filter banks are shared by every resampler with the same rates
+     */
+    std::shared_ptr<const std::vector<float>> sharedFilter(size_t up, size_t down, size_t taps)
+    {
+        static std::mutex mutex;
+        static std::map<std::tuple<size_t, size_t, size_t>, std::weak_ptr<const std::vector<float>>> filters;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::weak_ptr<const std::vector<float>> &cached = filters[std::make_tuple(up, down, taps)];
+        std::shared_ptr<const std::vector<float>> filter = cached.lock();
+        if (!filter) {
+            filter = std::make_shared<const std::vector<float>>(buildFilter(up, down, taps));
+            cached = filter;
+        }
+        return filter;
+    }
+
+    inline float dot(const float *a, const float *b, size_t n)
+    {
+        size_t i = 0;
+#ifdef RESAMPLER_SSE
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+        for (; i + 8 <= n; i += 8) {
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+        float sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#else
+        // Independent accumulators let the compiler vectorize
+        float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (; i + 4 <= n; i += 4) {
+            acc[0] += a[i] * b[i];
+            acc[1] += a[i + 1] * b[i + 1];
+            acc[2] += a[i + 2] * b[i + 2];
+            acc[3] += a[i + 3] * b[i + 3];
+        }
+        float sum = acc[0] + acc[1] + acc[2] + acc[3];
+#endif
+        for (; i < n; ++i) sum += a[i] * b[i];
+        return sum;
+    }
+}
+
+Resampler::Resampler()
+    : upFactor{1}
+    , downFactor{1}
+    , tapsPerPhase{0}
+    , maxInput{0}
+    , filter{}
+    , buffer{}
+    , position{0}
+    , phase{0}
+{
+}
+
+bool Resampler::configure(int inputRate, int outputRate, size_t maxInput)
+{
+    if (inputRate <= 0 || outputRate <= 0) return false;
+
+    const size_t divisor = static_cast<size_t>(std::gcd(inputRate, outputRate));
+    const size_t up = static_cast<size_t>(outputRate) / divisor;
+    const size_t down = static_cast<size_t>(inputRate) / divisor;
+    if (up > MAX_PHASES) return false;
+
+    upFactor = up;
+    downFactor = down;
+    this->maxInput = std::max<size_t>(maxInput, 1);
+
+    if (isPassthrough()) {
+        tapsPerPhase = 0;
+        filter.reset();
+        buffer.clear();
+    }
+    else {
+        // When decimating the cutoff is lower, the filter needs to be longer for the same transition band
+        tapsPerPhase = TAPS_PER_PHASE * std::max<size_t>(1, (down + up - 1) / up);
+        filter = sharedFilter(up, down, tapsPerPhase);
+        buffer.assign(tapsPerPhase - 1 + this->maxInput, 0.0f);
+    }
+
+    reset();
+    return true;
+}
+
+void Resampler::reset()
+{
+    std::fill(buffer.begin(), buffer.end(), 0.0f);
+    position = tapsPerPhase > 0 ? tapsPerPhase - 1 : 0;
+    phase = 0;
+}
+
+size_t Resampler::maxOutput(size_t numIn) const
+{
+    // Every input sample advances the output by up / down, plus one for the phase left from the previous call
+    return numIn * upFactor / downFactor + 1;
+}
+
+size_t Resampler::process(const float *in, size_t numIn, float *out)
+{
+    if (isPassthrough()) {
+        std::memcpy(out, in, numIn * sizeof(float));
+        return numIn;
+    }
+
+    size_t numOut = 0;
+    while (numIn > 0) {
+        const size_t block = std::min(numIn, maxInput);
+        numOut += processBlock(in, block, out + numOut);
+        in += block;
+        numIn -= block;
+    }
+    return numOut;
+}
+
+size_t Resampler::processBlock(const float *in, size_t numIn, float *out)
+{
+    const size_t history = tapsPerPhase - 1;
+    const size_t end = history + numIn;
+    const float *taps = filter->data();
+
+    std::memcpy(buffer.data() + history, in, numIn * sizeof(float));
+
+    size_t numOut = 0;
+    while (position < end) {
+        out[numOut++] = dot(taps + phase * tapsPerPhase, buffer.data() + position - history, tapsPerPhase);
+
+        // Moves down / up input samples forward
+        phase += downFactor;
+        position += phase / upFactor;
+        phase %= upFactor;
+    }
+
+    // Keeps the last samples for the next block
+    std::memmove(buffer.data(), buffer.data() + numIn, history * sizeof(float));
+    position -= numIn;
+
+    return numOut;
+}
@@ -0,0 +1,73 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/**
+ * Streaming polyphase resampler, converting a channel from one sample rate to another.
+ *
+ * The ratio between the rates is reduced to up / down factors and the samples are filtered by a
+ * windowed-sinc (Kaiser) low-pass split in `up` phases. Each output sample is the dot product of one phase
+ * with the last input samples. The filter banks only depend on the rates, so they are built once and shared
+ * by every resampler (every channel) with the same rates.
+ *
+ * The state is kept between calls to process(), so a stream can be resampled block by block.
+ */
+class Resampler
+{
+public:
+    Resampler();
+
+    /**
+     * @brief Sets the rates and allocates everything process() needs
+     * @param inputRate The sample rate of the input
+     * @param outputRate The sample rate of the output
+     * @param maxInput The maximum number of samples given to a single process() call (bigger calls are split)
+     * @return False if the ratio of the rates is too complex to be resampled exactly
+     */
+    bool configure(int inputRate, int outputRate, size_t maxInput);
+
+    /**
+     * @brief Forgets the samples of the previous calls
+     */
+    void reset();
+
+    /**
+     * @brief Resamples a block of samples
+     * @param in The input samples
+     * @param numIn The number of input samples
+     * @param out Receives the output samples, must hold at least maxOutput(numIn) samples
+     * @return The number of output samples
+     */
+    size_t process(const float *in, size_t numIn, float *out);
+
+    /**
+     * @brief Returns the maximum number of output samples for a number of input samples
+     */
+    size_t maxOutput(size_t numIn) const;
+
+    /**
+     * @brief Returns true if the input and output rates are the same, process() then only copies
+     */
+    bool isPassthrough() const { return upFactor == downFactor; }
+
+private:
+    size_t                                  upFactor;       // Interpolation factor (number of phases)
+    size_t                                  downFactor;     // Decimation factor
+    size_t                                  tapsPerPhase;   // Number of taps of each phase
+    size_t                                  maxInput;       // Maximum number of input samples per block
+    std::shared_ptr<const std::vector<float>> filter;       // upFactor phases of tapsPerPhase reversed taps
+
+    std::vector<float>                      buffer;         // Last tapsPerPhase - 1 input samples followed by the block
+    size_t                                  position;       // Index in buffer of the newest sample of the next output
+    size_t                                  phase;          // Phase of the next output
+
+    /**
+     * @brief Resamples a block of at most maxInput samples
+     */
+    size_t processBlock(const float *in, size_t numIn, float *out);
+};
+
+#endif // RESAMPLER_H
@@ -0,0 +1,378 @@
+#include "resultstream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#ifdef _WIN32
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+#include "notes.h"
+#include "spectrumquantizer.h"
+#include "tracer.h"
+
+static_assert(sizeof(resultstream::Header) == resultstream::HEADER_BYTES, "The header is padded to HEADER_BYTES");
+static_assert(sizeof(resultstream::Record) % resultstream::RECORD_ALIGNMENT == 0, "The records keep their alignment");
+
+namespace {
+    const char      HEADER_MAGIC[8]     = {'T', 'A', 'R', 'E', 'S', 'U', 'L', 'T'};
+    const char      TRAILER_MAGIC[8]    = {'T', 'A', 'I', 'N', 'D', 'E', 'X', '1'};
+    const uint32_t  BYTE_ORDER_MARK     = 0x01020304;
+}
+
+ResultStreamWriter::Settings ResultStreamWriter::defaultSettings()
+{
+    return Settings{0, 256, 1024, 4, false};
+}
+
+ResultStreamWriter::ResultStreamWriter()
+    : settings(defaultSettings())
+    , recordBytes{0}
+    , batches{}
+    , freeBatches{}
+    , fullBatches{}
+    , current{0}
+    , index{}
+    , file{nullptr}
+    , failed{false}
+    , numRecords{0}
+    , numDropped{0}
+    , thread{}
+    , mutex{}
+    , batchFull{}
+    , batchFree{}
+    , stopping{false}
+{
+}
+
+ResultStreamWriter::~ResultStreamWriter()
+{
+    close();
+}
+
+bool ResultStreamWriter::open(const char *path, const Settings &settings)
+{
+    close();
+
+    file = std::fopen(path, "wb");
+    if (!file) return false;
+
+    this->settings = settings;
+    this->settings.indexInterval = std::max<size_t>(settings.indexInterval, 1);
+    this->settings.batchRecords = std::max<size_t>(settings.batchRecords, 1);
+    this->settings.numBatches = std::max<size_t>(settings.numBatches, 2);
+    recordBytes = resultstream::recordBytes(settings.spectrumBins);
+
+    batches.resize(this->settings.numBatches);
+    for (Batch &batch : batches) {
+        batch.data.assign(this->settings.batchRecords * recordBytes, 0);
+        batch.count = 0;
+        batch.firstRecord = 0;
+    }
+    freeBatches.reserve(batches.size());
+    fullBatches.reserve(batches.size());
+
+    // Each batch goes to the file in one write, a buffer would only split it
+    std::setvbuf(file, nullptr, _IONBF, 0);
+
+    resultstream::Header header{};
+    std::memcpy(header.magic, HEADER_MAGIC, sizeof(header.magic));
+    header.version = resultstream::VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.headerBytes = resultstream::HEADER_BYTES;
+    header.recordBytes = static_cast<uint32_t>(recordBytes);
+    header.spectrumBins = static_cast<uint32_t>(this->settings.spectrumBins);
+    header.indexInterval = static_cast<uint32_t>(this->settings.indexInterval);
+    header.createdUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    if (std::fwrite(&header, sizeof(header), 1, file) != 1) {
+        std::fclose(file);
+        file = nullptr;
+        return false;
+    }
+
+    failed = false;
+    numRecords = 0;
+    numDropped = 0;
+    index.clear();
+    freeBatches.clear();
+    fullBatches.clear();
+    for (size_t i = 0; i < batches.size(); ++i) freeBatches.push_back(i);
+    current = batches.size();
+    stopping = false;
+    thread = std::thread(&ResultStreamWriter::run, this);
+    return true;
+}
+
+bool ResultStreamWriter::append(int64_t timestampUs, size_t channel, const ChannelResult &result, bool isMix, const double *spectrum, size_t numSamples)
+{
+    if (!file) return false;
+    if (current == batches.size() && !takeBatch()) {
+        ++numDropped;
+        return false;
+    }
+
+    Batch &batch = batches[current];
+    char *address = batch.data.data() + batch.count * recordBytes;
+
+    resultstream::Record record{};
+    record.timestampUs = timestampUs;
+    record.rmsLevel = result.rmsLevel;
+    record.peakLevel = result.peakLevel;
+    record.confidence = result.confidence;
+    record.pitchHz = result.pitchHz;
+    record.note = static_cast<int16_t>(result.note);
+    if (result.note >= 0 && result.pitchHz > 0.0f) {
+        record.cents = static_cast<int16_t>(std::lround(1200.0 * std::log2(result.pitchHz / notes::frequencies[result.note])));
+    }
+    record.channel = static_cast<uint8_t>(channel);
+    record.flags = static_cast<uint8_t>((result.active ? resultstream::Record::ACTIVE : 0)
+                                        | (result.onset ? resultstream::Record::ONSET : 0)
+                                        | (isMix ? resultstream::Record::MIX : 0));
+    record.numNotes = static_cast<uint8_t>(result.numNotes);
+    record.chord = static_cast<int8_t>(result.chord);
+    std::memcpy(address, &record, sizeof(record));
+
+    if (settings.spectrumBins > 0) {
+        uint8_t *quantized = reinterpret_cast<uint8_t*>(address + sizeof(record));
+        spectrumquantizer::quantizeSpectrum(spectrum, spectrum ? numSamples / 2 + 1 : 0, numSamples, 8, quantized, settings.spectrumBins, 1);
+    }
+
+    if (batch.count == 0) batch.firstRecord = numRecords;
+    ++batch.count;
+    ++numRecords;
+    if (batch.count == settings.batchRecords) flush();
+    return true;
+}
+
+size_t ResultStreamWriter::append(const FrameResults &results, const FrameAnalyzer *analyzer)
+{
+    size_t dropped = 0;
+    for (size_t c = 0; c < results.numChannels; ++c) {
+        const bool isMix = results.hasMix && c + 1 == results.numChannels;
+        const double *spectrum = analyzer ? analyzer->getChannel(c).getSpectrum() : nullptr;
+        const size_t numSamples = analyzer ? analyzer->getChannel(c).getSpectrumSize() : 0;
+        if (!append(results.timestampUs, c, results.channels[c], isMix, spectrum, numSamples)) ++dropped;
+    }
+    return dropped;
+}
+
+void ResultStreamWriter::flush()
+{
+    if (current == batches.size() || batches[current].count == 0) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fullBatches.push_back(current);
+    }
+    batchFull.notify_one();
+    current = batches.size();
+}
+
+bool ResultStreamWriter::close()
+{
+    if (!file) return !failed;
+
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    batchFull.notify_one();
+    thread.join();
+
+    // The index and the trailer follow the last record
+    resultstream::Trailer trailer{};
+    trailer.indexOffset = resultstream::HEADER_BYTES + numRecords * recordBytes;
+    trailer.numEntries = index.size();
+    trailer.numRecords = numRecords;
+    std::memcpy(trailer.magic, TRAILER_MAGIC, sizeof(trailer.magic));
+    if (!index.empty() && std::fwrite(index.data(), sizeof(resultstream::IndexEntry), index.size(), file) != index.size()) failed = true;
+    if (std::fwrite(&trailer, sizeof(trailer), 1, file) != 1) failed = true;
+    if (std::fclose(file) != 0) failed = true;
+    file = nullptr;
+
+    return !failed;
+}
+
+
+/************************************************************/
+/*      PRIVATE                                             */
+/************************************************************/
+void ResultStreamWriter::run()
+{
+    TRACE_THREAD_NAME("result stream");
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        batchFull.wait(lock, [this]() { return stopping || !fullBatches.empty(); });
+        if (fullBatches.empty()) return;
+
+        const size_t taken = fullBatches.front();
+        fullBatches.erase(fullBatches.begin());
+        lock.unlock();
+
+        Batch &batch = batches[taken];
+        {
+            TRACE_SCOPE("write results");
+            if (std::fwrite(batch.data.data(), recordBytes, batch.count, file) != batch.count) failed = true;
+        }
+
+        // An entry for every record whose number is a multiple of the interval
+        const uint64_t interval = settings.indexInterval;
+        for (uint64_t record = (batch.firstRecord + interval - 1) / interval * interval; record < batch.firstRecord + batch.count; record += interval) {
+            int64_t timestampUs = 0;
+            std::memcpy(&timestampUs, batch.data.data() + (record - batch.firstRecord) * recordBytes, sizeof(timestampUs));
+            index.push_back(resultstream::IndexEntry{timestampUs, record});
+        }
+        batch.count = 0;
+
+        lock.lock();
+        freeBatches.push_back(taken);
+        batchFree.notify_one();
+    }
+}
+
+bool ResultStreamWriter::takeBatch()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (freeBatches.empty()) {
+        if (!settings.lossless) return false;
+        batchFree.wait(lock, [this]() { return !freeBatches.empty(); });
+    }
+
+    current = freeBatches.back();
+    freeBatches.pop_back();
+    return true;
+}
+
+
+/************************************************************/
+/*      READER                                              */
+/************************************************************/
+ResultStreamReader::ResultStreamReader()
+    : mapping{nullptr}
+    , size{0}
+    , headerBytes{0}
+    , recordBytes{0}
+    , numRecords{0}
+    , index{nullptr}
+    , numEntries{0}
+#ifdef _WIN32
+    , fileHandle{nullptr}
+    , mappingHandle{nullptr}
+#endif
+{
+}
+
+ResultStreamReader::~ResultStreamReader()
+{
+    close();
+}
+
+bool ResultStreamReader::open(const char *path)
+{
+    close();
+
+#ifdef _WIN32
+    fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        fileHandle = nullptr;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart < resultstream::HEADER_BYTES) {
+        close();
+        return false;
+    }
+    size = static_cast<size_t>(fileSize.QuadPart);
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle) mapping = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < resultstream::HEADER_BYTES) {
+        ::close(fd);
+        return false;
+    }
+    size = static_cast<size_t>(status.st_size);
+    void *address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (address != MAP_FAILED) mapping = static_cast<const char*>(address);
+#endif
+    if (!mapping) {
+        close();
+        return false;
+    }
+
+    const resultstream::Header &header = getHeader();
+    if (std::memcmp(header.magic, HEADER_MAGIC, sizeof(header.magic)) != 0 || header.version != resultstream::VERSION
+            || header.byteOrder != BYTE_ORDER_MARK || header.headerBytes < sizeof(resultstream::Header)
+            || header.recordBytes != resultstream::recordBytes(header.spectrumBins) || header.headerBytes > size) {
+        close();
+        return false;
+    }
+    headerBytes = header.headerBytes;
+    recordBytes = header.recordBytes;
+
+    // A closed file ends with its trailer, the records of another one go as far as the file
+    numRecords = (size - headerBytes) / recordBytes;
+    if (size >= headerBytes + sizeof(resultstream::Trailer)) {
+        const resultstream::Trailer &trailer = *reinterpret_cast<const resultstream::Trailer*>(mapping + size - sizeof(resultstream::Trailer));
+        const bool closed = std::memcmp(trailer.magic, TRAILER_MAGIC, sizeof(trailer.magic)) == 0
+            && trailer.indexOffset == headerBytes + trailer.numRecords * recordBytes
+            && trailer.indexOffset + trailer.numEntries * sizeof(resultstream::IndexEntry) + sizeof(trailer) == size;
+        if (closed) {
+            numRecords = trailer.numRecords;
+            index = reinterpret_cast<const resultstream::IndexEntry*>(mapping + trailer.indexOffset);
+            numEntries = trailer.numEntries;
+        }
+    }
+    return true;
+}
+
+void ResultStreamReader::close()
+{
+#ifdef _WIN32
+    if (mapping) UnmapViewOfFile(mapping);
+    if (mappingHandle) CloseHandle(mappingHandle);
+    if (fileHandle) CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    if (mapping) munmap(const_cast<char*>(mapping), size);
+#endif
+    mapping = nullptr;
+    size = 0;
+    numRecords = 0;
+    index = nullptr;
+    numEntries = 0;
+}
+
+size_t ResultStreamReader::seek(int64_t timestampUs) const
+{
+    // The index narrows the search down to the records between two of its entries, a few pages of the file
+    size_t first = 0;
+    size_t last = numRecords;
+    if (index && numEntries > 0) {
+        const resultstream::IndexEntry *entry = std::lower_bound(index, index + numEntries, timestampUs, [](const resultstream::IndexEntry &e, int64_t t) {
+            return e.timestampUs < t;
+        });
+        if (entry != index) first = static_cast<size_t>((entry - 1)->record);
+        if (entry != index + numEntries) last = static_cast<size_t>(entry->record) + 1;
+    }
+
+    while (first < last) {
+        const size_t middle = first + (last - first) / 2;
+        if (record(middle).timestampUs < timestampUs) first = middle + 1;
+        else last = middle;
+    }
+    return first;
+}
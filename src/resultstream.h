@@ -0,0 +1,302 @@
+#ifndef RESULTSTREAM_H
+#define RESULTSTREAM_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "audioframe.h"
+#include "frameanalyzer.h"
+
+/**
+ * Binary stream of the per-frame results, for offline and long-running sessions.
+ *
+ * The file is a header, then one fixed-size record per channel of every frame (the results and, optionally,
+ * a quantized spectrum), then a sparse time index and a trailer written when the stream is closed. Every
+ * part is aligned, so the file can be mapped and its records read in place: record i is at
+ * headerBytes + i * recordBytes. A file whose writer did not close it has no index, its records are still
+ * all there and are found by their size alone.
+ *
+ * The values are stored in the byte order of the machine, the header tells which it was.
+ */
+namespace resultstream {
+    enum { VERSION = 1, HEADER_BYTES = 64, RECORD_ALIGNMENT = 8 };
+
+    /**
+     * @brief Start of the file
+     */
+    struct Header
+    {
+        char        magic[8];       // "TARESULT"
+        uint32_t    version;        // VERSION
+        uint32_t    byteOrder;      // 0x01020304 as written by the machine
+        uint32_t    headerBytes;    // Offset of the first record
+        uint32_t    recordBytes;    // Size of a record, spectrum included
+        uint32_t    spectrumBins;   // Number of bins of the quantized spectrum of each record, 0 for none
+        uint32_t    indexInterval;  // Number of records between two entries of the index
+        int64_t     createdUs;      // Time the stream was opened, in microseconds since the epoch
+        char        reserved[24];
+    };
+
+    /**
+     * @brief Results of one channel of a frame, followed by spectrumBins bytes of quantized spectrum
+     */
+    struct Record
+    {
+        enum Flags { ACTIVE = 1 << 0, ONSET = 1 << 1, MIX = 1 << 2 };
+
+        int64_t     timestampUs;    // Time of the frame in microseconds
+        float       rmsLevel;       // RMS level in range 0.0 - 1.0
+        float       peakLevel;      // Peak level in range 0.0 - 1.0
+        float       confidence;     // Confidence of the note in range 0.0 - 1.0
+        float       pitchHz;        // Pitch of the note in Hz, 0 if none
+        int16_t     note;           // Index of the note in notes::notes, -1 if none
+        int16_t     cents;          // Deviation of the pitch from the note in cents
+        uint8_t     channel;        // Index of the channel in the frame
+        uint8_t     flags;          // Combination of Flags
+        uint8_t     numNotes;       // Number of notes played together
+        int8_t      chord;          // Chord of the notes played together @see{MultiPitchEstimator::chordRoot}, -1 if none
+    };
+
+    /**
+     * @brief Entry of the sparse index, one every indexInterval records
+     */
+    struct IndexEntry
+    {
+        int64_t     timestampUs;    // Time of the record
+        uint64_t    record;         // Number of the record
+    };
+
+    /**
+     * @brief End of a closed file, the index is right before it
+     */
+    struct Trailer
+    {
+        uint64_t    indexOffset;    // Offset of the index
+        uint64_t    numEntries;     // Number of entries of the index
+        uint64_t    numRecords;     // Number of records
+        char        magic[8];       // "TAINDEX1"
+    };
+
+    /**
+     * @brief Returns the size of a record with its spectrum
+     */
+    inline size_t recordBytes(size_t spectrumBins)
+    {
+        return (sizeof(Record) + spectrumBins + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+    }
+}
+
+/**
+ * Writes the results to a result stream from a background thread.
+ *
+ * The analysis thread fills batches of records allocated up front, the writer thread writes each full batch
+ * with a single unbuffered write. Nothing is allocated and nothing waits on the disk while appending: when
+ * every batch is still waiting to be written, the records are dropped and counted. A lossless stream (ie:
+ * offline analysis) waits for a batch instead.
+ */
+class ResultStreamWriter
+{
+public:
+    /**
+     * @brief Size of the spectra, of the index and of the batches
+     */
+    struct Settings
+    {
+        size_t  spectrumBins;   // Number of bins of the quantized spectrum of each record, 0 to store none
+        size_t  indexInterval;  // Number of records between two entries of the index
+        size_t  batchRecords;   // Number of records written at once
+        size_t  numBatches;     // Number of batches, appending goes on in one while the others are written
+        bool    lossless;       // True to wait for a batch when they are all full instead of dropping the records
+    };
+
+    /**
+     * @brief Returns sensible settings for a live session
+     */
+    static Settings defaultSettings();
+
+    ResultStreamWriter();
+    ~ResultStreamWriter();
+
+    ResultStreamWriter(const ResultStreamWriter&) = delete;
+    ResultStreamWriter& operator=(const ResultStreamWriter&) = delete;
+
+    /**
+     * @brief Creates (or truncates) the file, allocates the batches, writes the header and starts the writer thread
+     * @param path Path of the file
+     * @param settings The settings of the stream
+     * @return True if the file could be created
+     */
+    bool open(const char *path, const Settings &settings = defaultSettings());
+
+    /**
+     * @brief Returns whether the stream is open
+     */
+    bool isOpen() const { return file != nullptr; }
+
+    /**
+     * @brief Appends the results of one channel of a frame
+     * @param timestampUs Time of the frame in microseconds, increasing from frame to frame
+     * @param channel Index of the channel
+     * @param result The results of the channel
+     * @param isMix True if the channel is the mix of the others
+     * @param spectrum The magnitude spectrum of the channel, may be nullptr
+     * @param numSamples Size of the transform of the spectrum, its first half and one are stored
+     * @return False if the record was dropped
+     */
+    bool append(int64_t timestampUs, size_t channel, const ChannelResult &result, bool isMix, const double *spectrum, size_t numSamples);
+
+    /**
+     * @brief Appends the results of every channel of a frame
+     * @param results The results of the frame
+     * @param analyzer The analyzer of the frame, for the spectra of the channels, nullptr to store none
+     * @return The number of records dropped
+     */
+    size_t append(const FrameResults &results, const FrameAnalyzer *analyzer = nullptr);
+
+    /**
+     * @brief Hands the records appended so far to the writer thread, even if their batch isn't full
+     */
+    void flush();
+
+    /**
+     * @brief Writes the remaining records, the index and the trailer, then closes the file
+     * @return True if everything could be written
+     */
+    bool close();
+
+    /**
+     * @brief Returns the number of records appended and not dropped
+     */
+    uint64_t getNumRecords() const { return numRecords; }
+
+    /**
+     * @brief Returns the number of records dropped because every batch was waiting to be written
+     */
+    uint64_t getNumDropped() const { return numDropped; }
+
+private:
+    /**
+     * @brief Records appended together, written at once
+     */
+    struct Batch
+    {
+        std::vector<char>       data;           // batchRecords records
+        size_t                  count;          // Number of records in data
+        uint64_t                firstRecord;    // Number of the first record
+    };
+
+    Settings                    settings;       // Size of the spectra, of the index and of the batches
+    size_t                      recordBytes;    // Size of a record with its spectrum
+    std::vector<Batch>          batches;        // The batches, allocated once
+    std::vector<size_t>         freeBatches;    // Batches ready to be filled
+    std::vector<size_t>         fullBatches;    // Batches waiting to be written, in order
+    size_t                      current;        // Batch being filled, batches.size() if none
+    std::vector<resultstream::IndexEntry> index; // The sparse index, built by the writer thread
+
+    FILE*                       file;           // The file, nullptr if closed
+    bool                        failed;         // True if a write failed
+    uint64_t                    numRecords;     // Number of records appended
+    uint64_t                    numDropped;     // Number of records dropped
+
+    std::thread                 thread;         // Writes the full batches
+    std::mutex                  mutex;          // Protects freeBatches, fullBatches and stopping
+    std::condition_variable     batchFull;      // Signaled when a batch is handed to the writer thread, or to stop it
+    std::condition_variable     batchFree;      // Signaled when a batch was written
+    bool                        stopping;       // True once the writer thread must stop after the full batches
+
+    /**
+     * @brief Main loop of the writer thread
+     */
+    void run();
+
+    /**
+     * @brief Takes a free batch to fill, waiting for one if the stream is lossless
+     * @return False if there is none
+     */
+    bool takeBatch();
+};
+
+/**
+ * Maps a result stream to read its records in place.
+ */
+class ResultStreamReader
+{
+public:
+    ResultStreamReader();
+    ~ResultStreamReader();
+
+    ResultStreamReader(const ResultStreamReader&) = delete;
+    ResultStreamReader& operator=(const ResultStreamReader&) = delete;
+
+    /**
+     * @brief Maps a file and checks its header
+     * @param path Path of the file
+     * @return True if the file is a result stream written by a machine of the same byte order
+     */
+    bool open(const char *path);
+
+    /**
+     * @brief Unmaps the file
+     */
+    void close();
+
+    /**
+     * @brief Returns the header of the file
+     */
+    const resultstream::Header& getHeader() const { return *reinterpret_cast<const resultstream::Header*>(mapping); }
+
+    /**
+     * @brief Returns the number of records
+     */
+    size_t getNumRecords() const { return numRecords; }
+
+    /**
+     * @brief Returns whether the file was closed by its writer, with its index
+     */
+    bool isIndexed() const { return index != nullptr; }
+
+    /**
+     * @brief Returns a record
+     * @param i Number of the record, below getNumRecords()
+     */
+    const resultstream::Record& record(size_t i) const
+    {
+        return *reinterpret_cast<const resultstream::Record*>(mapping + headerBytes + i * recordBytes);
+    }
+
+    /**
+     * @brief Returns the quantized spectrum of a record, getHeader().spectrumBins bytes of 8 bits @see{spectrumquantizer::dequantize}
+     * @param i Number of the record, below getNumRecords()
+     */
+    const uint8_t* spectrum(size_t i) const
+    {
+        return reinterpret_cast<const uint8_t*>(mapping + headerBytes + i * recordBytes + sizeof(resultstream::Record));
+    }
+
+    /**
+     * @brief Finds the first record at or after a point in time
+     * @param timestampUs The point in time in microseconds
+     * @return The number of the record, getNumRecords() if every record is before it
+     */
+    size_t seek(int64_t timestampUs) const;
+
+private:
+    const char*                         mapping;        // The mapped file, nullptr if closed
+    size_t                              size;           // Size of the mapping
+    size_t                              headerBytes;    // Offset of the first record
+    size_t                              recordBytes;    // Size of a record
+    size_t                              numRecords;     // Number of records
+    const resultstream::IndexEntry*     index;          // The sparse index in the mapping, nullptr if the file has none
+    size_t                              numEntries;     // Number of entries of the index
+#ifdef _WIN32
+    void*                               fileHandle;     // The file
+    void*                               mappingHandle;  // The mapping of the file
+#endif
+};
+
+#endif // RESULTSTREAM_H
@@ -0,0 +1,269 @@
+#include "sampleconverter.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#   include <emmintrin.h>
+#   define SAMPLECONVERTER_SSE2
+#endif
+
+namespace {
+    /*
+     * Reads an unsigned integer of Bytes bytes. Assembling the bytes with shifts makes it independent of the
+     * byte order of the machine, and the compiler turns it into a plain (or byte swapped) load.
+     */
+    template <size_t Bytes, bool BigEndian>
+    inline uint64_t load(const unsigned char *p)
+    {
+        uint64_t value = 0;
+        for (size_t i = 0; i < Bytes; ++i) {
+            const size_t shift = BigEndian ? (Bytes - 1 - i) * 8 : i * 8;
+            value |= static_cast<uint64_t>(p[i]) << shift;
+        }
+        return value;
+    }
+
+    /*
+     * Decodes an integer sample of Bytes bytes to a float in range -1.0 - 1.0
+     */
+    template <size_t Bytes, bool BigEndian, bool Signed>
+    struct IntDecoder
+    {
+        static const size_t SIZE = Bytes;
+
+        static inline float decode(const unsigned char *p)
+        {
+            const int bits = static_cast<int>(Bytes * 8);
+            uint32_t raw = static_cast<uint32_t>(load<Bytes, BigEndian>(p));
+
+            // Unsigned samples are centered on half their range, flipping the top bit makes them signed
+            if (!Signed) raw ^= 1u << (bits - 1);
+
+            // Sign extends by moving the sample to the top of a 32 bits integer
+            const int32_t value = static_cast<int32_t>(raw << (32 - bits));
+            return static_cast<float>(value) * (1.0f / 2147483648.0f);
+        }
+    };
+
+    template <bool BigEndian>
+    struct Float32Decoder
+    {
+        static const size_t SIZE = 4;
+
+        static inline float decode(const unsigned char *p)
+        {
+            const uint32_t raw = static_cast<uint32_t>(load<4, BigEndian>(p));
+            float value;
+            std::memcpy(&value, &raw, sizeof(value));
+            return value;
+        }
+    };
+
+    template <bool BigEndian>
+    struct Float64Decoder
+    {
+        static const size_t SIZE = 8;
+
+        static inline float decode(const unsigned char *p)
+        {
+            const uint64_t raw = load<8, BigEndian>(p);
+            double value;
+            std::memcpy(&value, &raw, sizeof(value));
+            return static_cast<float>(value);
+        }
+    };
+
+    /*
+     * Generic kernels, one instance per decoder
+     */
+    template <typename Decoder>
+    void convertKernel(const char *data, size_t numFrames, int channelCount, float *out)
+    {
+        const unsigned char *p = reinterpret_cast<const unsigned char*>(data);
+        const size_t numSamples = numFrames * static_cast<size_t>(channelCount);
+
+        for (size_t i = 0; i < numSamples; ++i) out[i] = Decoder::decode(p + i * Decoder::SIZE);
+    }
+
+    template <typename Decoder>
+    void deinterleaveKernel(const char *data, size_t numFrames, int channelCount, float *const *channels)
+    {
+        const unsigned char *p = reinterpret_cast<const unsigned char*>(data);
+        const size_t numChannels = static_cast<size_t>(channelCount);
+
+        for (size_t c = 0; c < numChannels; ++c) {
+            float *out = channels[c];
+            const unsigned char *in = p + c * Decoder::SIZE;
+            const size_t stride = numChannels * Decoder::SIZE;
+            for (size_t i = 0; i < numFrames; ++i) out[i] = Decoder::decode(in + i * stride);
+        }
+    }
+
+    template <typename Decoder>
+    void downmixKernel(const char *data, size_t numFrames, int channelCount, float *out)
+    {
+        if (channelCount == 1) {
+            convertKernel<Decoder>(data, numFrames, 1, out);
+            return;
+        }
+
+        const unsigned char *p = reinterpret_cast<const unsigned char*>(data);
+        const size_t numChannels = static_cast<size_t>(channelCount);
+        const float scale = 1.0f / static_cast<float>(channelCount);
+
+        for (size_t i = 0; i < numFrames; ++i) {
+            const unsigned char *frame = p + i * numChannels * Decoder::SIZE;
+            float sum = 0.0f;
+            for (size_t c = 0; c < numChannels; ++c) sum += Decoder::decode(frame + c * Decoder::SIZE);
+            out[i] = sum * scale;
+        }
+    }
+
+    template <typename Decoder>
+    SampleConverter::Kernels kernelsFor()
+    {
+        return SampleConverter::Kernels{&convertKernel<Decoder>, &deinterleaveKernel<Decoder>, &downmixKernel<Decoder>};
+    }
+
+#ifdef SAMPLECONVERTER_SSE2
+    /*
+     * SSE2 kernels for the most common formats: signed 16 bits and 32 bits float, little endian (as is the machine)
+     */
+    void convertInt16LE(const char *data, size_t numFrames, int channelCount, float *out)
+    {
+        const int16_t *in = reinterpret_cast<const int16_t*>(data);
+        const size_t numSamples = numFrames * static_cast<size_t>(channelCount);
+        const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+
+        size_t i = 0;
+        for (; i + 8 <= numSamples; i += 8) {
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            // Duplicating every sample then shifting right sign extends them to 32 bits
+            const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+            const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+            _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+        }
+        for (; i < numSamples; ++i) out[i] = in[i] * (1.0f / 32768.0f);
+    }
+
+    void downmixInt16LE(const char *data, size_t numFrames, int channelCount, float *out)
+    {
+        if (channelCount == 1) {
+            convertInt16LE(data, numFrames, 1, out);
+            return;
+        }
+        if (channelCount != 2) {
+            downmixKernel<IntDecoder<2, false, true>>(data, numFrames, channelCount, out);
+            return;
+        }
+
+        // Stereo: multiplying by 1 and adding pairs of neighbors sums left and right in one instruction
+        const int16_t *in = reinterpret_cast<const int16_t*>(data);
+        const __m128i ones = _mm_set1_epi16(1);
+        const __m128 scale = _mm_set1_ps(0.5f / 32768.0f);
+
+        size_t i = 0;
+        for (; i + 4 <= numFrames; i += 4) {
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 2));
+            const __m128i sums = _mm_madd_epi16(x, ones);
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(sums), scale));
+        }
+        for (; i < numFrames; ++i) out[i] = (in[i * 2] + in[i * 2 + 1]) * (0.5f / 32768.0f);
+    }
+
+    void convertFloat32LE(const char *data, size_t numFrames, int channelCount, float *out)
+    {
+        std::memcpy(out, data, numFrames * static_cast<size_t>(channelCount) * sizeof(float));
+    }
+
+    void downmixFloat32LE(const char *data, size_t numFrames, int channelCount, float *out)
+    {
+        if (channelCount == 1) {
+            convertFloat32LE(data, numFrames, 1, out);
+            return;
+        }
+        if (channelCount != 2) {
+            downmixKernel<Float32Decoder<false>>(data, numFrames, channelCount, out);
+            return;
+        }
+
+        const float *in = reinterpret_cast<const float*>(data);
+        const __m128 half = _mm_set1_ps(0.5f);
+
+        size_t i = 0;
+        for (; i + 4 <= numFrames; i += 4) {
+            const __m128 a = _mm_loadu_ps(in + i * 2);
+            const __m128 b = _mm_loadu_ps(in + i * 2 + 4);
+            const __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            const __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(left, right), half));
+        }
+        for (; i < numFrames; ++i) out[i] = (in[i * 2] + in[i * 2 + 1]) * 0.5f;
+    }
+#endif
+
+    template <bool BigEndian>
+    bool selectKernels(const SampleFormat &format, SampleConverter::Kernels &kernels)
+    {
+        const bool isSigned = format.type == SampleFormat::SignedInt;
+
+        if (format.type == SampleFormat::Float) {
+            switch (format.sampleSize) {
+            case 32: kernels = kernelsFor<Float32Decoder<BigEndian>>(); return true;
+            case 64: kernels = kernelsFor<Float64Decoder<BigEndian>>(); return true;
+            default: return false;
+            }
+        }
+
+        switch (format.sampleSize) {
+        case 8:  kernels = isSigned ? kernelsFor<IntDecoder<1, BigEndian, true>>() : kernelsFor<IntDecoder<1, BigEndian, false>>(); return true;
+        case 16: kernels = isSigned ? kernelsFor<IntDecoder<2, BigEndian, true>>() : kernelsFor<IntDecoder<2, BigEndian, false>>(); return true;
+        case 24: kernels = isSigned ? kernelsFor<IntDecoder<3, BigEndian, true>>() : kernelsFor<IntDecoder<3, BigEndian, false>>(); return true;
+        case 32: kernels = isSigned ? kernelsFor<IntDecoder<4, BigEndian, true>>() : kernelsFor<IntDecoder<4, BigEndian, false>>(); return true;
+        default: return false;
+        }
+    }
+}
+
+SampleConverter::SampleConverter()
+    : format{SampleFormat::Float, SampleFormat::LittleEndian, 32, 1}
+    , kernels(kernelsFor<Float32Decoder<false>>())
+{
+    setFormat(format);
+}
+
+bool SampleConverter::isSupported(const SampleFormat &format)
+{
+    Kernels kernels;
+    if (format.channelCount < 1) return false;
+    return format.byteOrder == SampleFormat::BigEndian ? selectKernels<true>(format, kernels) : selectKernels<false>(format, kernels);
+}
+
+bool SampleConverter::setFormat(const SampleFormat &format)
+{
+    Kernels selected;
+    if (format.channelCount < 1) return false;
+
+    const bool supported = format.byteOrder == SampleFormat::BigEndian ? selectKernels<true>(format, selected) : selectKernels<false>(format, selected);
+    if (!supported) return false;
+
+#ifdef SAMPLECONVERTER_SSE2
+    // x86 is little endian, the raw samples can be loaded as they are
+    if (format.byteOrder == SampleFormat::LittleEndian) {
+        if (format.type == SampleFormat::SignedInt && format.sampleSize == 16) {
+            selected.convert = &convertInt16LE;
+            selected.downmix = &downmixInt16LE;
+        }
+        else if (format.type == SampleFormat::Float && format.sampleSize == 32) {
+            selected.convert = &convertFloat32LE;
+            selected.downmix = &downmixFloat32LE;
+        }
+    }
+#endif
+
+    this->format = format;
+    kernels = selected;
+    return true;
+}
@@ -0,0 +1,100 @@
+#ifndef SAMPLECONVERTER_H
+#define SAMPLECONVERTER_H
+
+#include <cstddef>
+
+/**
+ * @brief Description of raw PCM samples, independent of Qt (@see{util::sampleFormat} for QAudioFormat)
+ */
+struct SampleFormat
+{
+    enum Type { SignedInt, UnsignedInt, Float };
+    enum Endian { LittleEndian, BigEndian };
+
+    Type        type;           // Type of a sample
+    Endian      byteOrder;      // Byte order of a sample
+    int         sampleSize;     // Number of bits in a sample (8, 16, 24, 32 or 64)
+    int         channelCount;   // Number of interleaved channels
+
+    /**
+     * @brief Returns the number of bytes of a sample of one channel
+     */
+    size_t bytesPerSample() const { return static_cast<size_t>(sampleSize / 8); }
+
+    /**
+     * @brief Returns the number of bytes of a frame (one sample of every channel)
+     */
+    size_t bytesPerFrame() const { return bytesPerSample() * static_cast<size_t>(channelCount); }
+};
+
+/**
+ * Converts raw PCM samples of any supported format to floats in range -1.0 - 1.0.
+ *
+ * The conversion kernel is selected once when the format is set, the kernels themselves are plain loops
+ * over fixed-size samples written to be vectorized by the compiler, with hand-written SSE2 versions for
+ * the most common formats. Deinterleaving and downmixing are done in the same pass as the conversion.
+ */
+class SampleConverter
+{
+public:
+    SampleConverter();
+
+    /**
+     * @brief Returns whether a format can be converted
+     * @param format The format
+     * @return True if there is a kernel for the format
+     */
+    static bool isSupported(const SampleFormat &format);
+
+    /**
+     * @brief Sets the format of the samples to convert and selects the kernels for it
+     * @param format The format
+     * @return True if the format is supported
+     */
+    bool setFormat(const SampleFormat &format);
+
+    /**
+     * @brief Returns the format of the samples converted
+     */
+    const SampleFormat& getFormat() const { return format; }
+
+    /**
+     * @brief Converts frames keeping the channels interleaved
+     * @param data The raw frames
+     * @param numFrames The number of frames
+     * @param out Receives numFrames * channelCount floats
+     */
+    void convert(const char *data, size_t numFrames, float *out) const { kernels.convert(data, numFrames, format.channelCount, out); }
+
+    /**
+     * @brief Converts frames to one buffer per channel
+     * @param data The raw frames
+     * @param numFrames The number of frames
+     * @param channels Receives channelCount buffers of numFrames floats
+     */
+    void deinterleave(const char *data, size_t numFrames, float *const *channels) const { kernels.deinterleave(data, numFrames, format.channelCount, channels); }
+
+    /**
+     * @brief Converts frames to a single channel, the average of all the channels
+     * @param data The raw frames
+     * @param numFrames The number of frames
+     * @param out Receives numFrames floats
+     */
+    void downmix(const char *data, size_t numFrames, float *out) const { kernels.downmix(data, numFrames, format.channelCount, out); }
+
+    /**
+     * @brief The kernels of a format
+     */
+    struct Kernels
+    {
+        void (*convert)(const char *data, size_t numFrames, int channelCount, float *out);
+        void (*deinterleave)(const char *data, size_t numFrames, int channelCount, float *const *channels);
+        void (*downmix)(const char *data, size_t numFrames, int channelCount, float *out);
+    };
+
+private:
+    SampleFormat    format;     // Format of the samples converted
+    Kernels         kernels;    // Kernels selected for the format
+};
+
+#endif // SAMPLECONVERTER_H
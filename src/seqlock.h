@@ -0,0 +1,57 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Sequence lock for a single writer and any number of readers.
+ *
+ * The sequence is odd while the writer modifies the data it protects. The writer never waits on the
+ * readers, a reader copies the data then checks the sequence did not move, and retries if it did. The
+ * sequence is lock-free, so it also works between processes sharing the memory.
+ */
+namespace seqlock {
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "The sequence can be shared between processes");
+
+    /**
+     * @brief Writer side, before modifying the data
+     */
+    inline void beginWrite(std::atomic<uint64_t> &sequence)
+    {
+        sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    /**
+     * @brief Writer side, once the data is modified
+     */
+    inline void endWrite(std::atomic<uint64_t> &sequence)
+    {
+        sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Reader side, before reading the data
+     * @param sequence The sequence
+     * @param seq Receives the sequence to pass to endRead()
+     * @return False if the writer is modifying the data
+     */
+    inline bool beginRead(const std::atomic<uint64_t> &sequence, uint64_t &seq)
+    {
+        seq = sequence.load(std::memory_order_acquire);
+        return (seq & 1) == 0;
+    }
+
+    /**
+     * @brief Reader side, once the data is read
+     * @return True if the data read since beginRead() is consistent
+     */
+    inline bool endRead(const std::atomic<uint64_t> &sequence, uint64_t seq)
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return sequence.load(std::memory_order_relaxed) == seq;
+    }
+}
+
+#endif // SEQLOCK_H
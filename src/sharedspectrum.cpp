@@ -0,0 +1,320 @@
+#include "sharedspectrum.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+#include "notes.h"
+#include "seqlock.h"
+#include "spectrumquantizer.h"
+#include "tracer.h"
+
+static_assert(sizeof(sharedspectrum::Header) % sharedspectrum::ALIGNMENT == 0, "The slots keep their alignment");
+
+namespace {
+    const char      HEADER_MAGIC[8]     = {'T', 'A', 'S', 'H', 'A', 'R', 'E', 'D'};
+
+    // Number of frames kept and bins of their spectra by default, about 10 s of a channel at 10 frames per second
+    const size_t    DEFAULT_SLOTS       = 128;
+    const size_t    DEFAULT_BINS        = 1024;
+
+    /*
+     * Name of the shared memory of a ring, nothing that could escape its namespace
+     */
+    bool objectName(const char *name, std::string &object)
+    {
+        if (!name || !*name) return false;
+        for (const char *c = name; *c; ++c) {
+            if (!std::isalnum(static_cast<unsigned char>(*c)) && *c != '-' && *c != '_') return false;
+        }
+#ifdef _WIN32
+        object = std::string("Local\\") + name;
+#else
+        object = std::string("/") + name;
+#endif
+        return true;
+    }
+}
+
+SharedSpectrumPublisher::Settings SharedSpectrumPublisher::defaultSettings()
+{
+    return Settings{DEFAULT_SLOTS, DEFAULT_BINS};
+}
+
+SharedSpectrumPublisher::SharedSpectrumPublisher()
+    : name{}
+    , header{nullptr}
+    , size{0}
+#ifdef _WIN32
+    , mappingHandle{nullptr}
+#endif
+{
+}
+
+SharedSpectrumPublisher::~SharedSpectrumPublisher()
+{
+    close();
+}
+
+bool SharedSpectrumPublisher::open(const char *name, const Settings &settings)
+{
+    close();
+    if (!objectName(name, this->name)) return false;
+
+    const size_t numSlots = std::max<size_t>(settings.numSlots, 2);
+    const size_t slotBytes = sharedspectrum::slotBytes(settings.spectrumBins);
+    size = sizeof(sharedspectrum::Header) + numSlots * slotBytes;
+
+    void *address = nullptr;
+#ifdef _WIN32
+    mappingHandle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+                                       static_cast<DWORD>(size), this->name.c_str());
+    if (mappingHandle) address = MapViewOfFile(mappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!address) {
+        if (mappingHandle) CloseHandle(mappingHandle);
+        mappingHandle = nullptr;
+        return false;
+    }
+#else
+    // A ring left behind by a publisher that crashed is replaced, its readers keep the old memory
+    shm_unlink(this->name.c_str());
+    const int fd = shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) return false;
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0) address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (!address || address == MAP_FAILED) {
+        shm_unlink(this->name.c_str());
+        return false;
+    }
+#endif
+
+    sharedspectrum::Header *h = new (address) sharedspectrum::Header{};
+    std::memcpy(h->magic, HEADER_MAGIC, sizeof(h->magic));
+    h->version = sharedspectrum::VERSION;
+    h->headerBytes = static_cast<uint32_t>(sizeof(sharedspectrum::Header));
+    h->slotBytes = static_cast<uint32_t>(slotBytes);
+    h->numSlots = static_cast<uint32_t>(numSlots);
+    h->spectrumBins = static_cast<uint32_t>(settings.spectrumBins);
+    h->createdUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    header = h;
+
+    for (size_t i = 0; i < numSlots; ++i) {
+        sharedspectrum::Slot *s = new (slot(i)) sharedspectrum::Slot{};
+        s->frame.number = UINT64_MAX;
+    }
+    h->publishing.store(1, std::memory_order_release);
+    return true;
+}
+
+void SharedSpectrumPublisher::publish(int64_t timestampUs, size_t channel, const ChannelResult &result, bool isMix,
+                                      const double *spectrum, size_t numSamples, int spectrumRate)
+{
+    if (!header) return;
+
+    const uint64_t number = header->head.load(std::memory_order_relaxed);
+    sharedspectrum::Slot *s = slot(number % header->numSlots);
+    float *magnitudes = reinterpret_cast<float*>(s + 1);
+
+    // Never more bins than the transform has
+    const size_t numBins = spectrum ? numSamples / 2 + 1 : 0;
+    const size_t published = std::min<size_t>(numBins, header->spectrumBins);
+
+    seqlock::beginWrite(s->sequence);
+    sharedspectrum::Frame &frame = s->frame;
+    frame.number = number;
+    frame.timestampUs = timestampUs;
+    frame.rmsLevel = result.rmsLevel;
+    frame.peakLevel = result.peakLevel;
+    frame.confidence = result.confidence;
+    frame.pitchHz = result.pitchHz;
+    frame.note = static_cast<int16_t>(result.note);
+    frame.cents = 0;
+    if (result.note >= 0 && result.pitchHz > 0.0f) {
+        frame.cents = static_cast<int16_t>(std::lround(1200.0 * std::log2(result.pitchHz / notes::frequencies[result.note])));
+    }
+    frame.channel = static_cast<uint8_t>(channel);
+    frame.flags = static_cast<uint8_t>((result.active ? sharedspectrum::Frame::ACTIVE : 0)
+                                       | (result.onset ? sharedspectrum::Frame::ONSET : 0)
+                                       | (isMix ? sharedspectrum::Frame::MIX : 0));
+    frame.numNotes = static_cast<uint8_t>(result.numNotes);
+    frame.chord = static_cast<int8_t>(result.chord);
+    frame.numBins = static_cast<uint32_t>(published);
+    frame.binHz = 0.0f;
+    if (published > 0) {
+        spectrumquantizer::reduceSpectrum(spectrum, numBins, numSamples, magnitudes, published);
+        frame.binHz = static_cast<float>(static_cast<double>(spectrumRate) / static_cast<double>(numSamples)
+                                         * static_cast<double>(numBins) / static_cast<double>(published));
+    }
+    seqlock::endWrite(s->sequence);
+
+    header->head.store(number + 1, std::memory_order_release);
+}
+
+void SharedSpectrumPublisher::publish(const FrameResults &results, const FrameAnalyzer &analyzer, int sampleRate)
+{
+    TRACE_SCOPE("publish");
+    for (size_t c = 0; c < results.numChannels; ++c) {
+        const ChannelAnalyzer &channel = analyzer.getChannel(c);
+        const bool isMix = results.hasMix && c + 1 == results.numChannels;
+        publish(results.timestampUs, c, results.channels[c], isMix, channel.getSpectrum(), channel.getSpectrumSize(), channel.getSpectrumRate(sampleRate));
+    }
+}
+
+void SharedSpectrumPublisher::close()
+{
+    if (!header) return;
+
+    header->publishing.store(0, std::memory_order_release);
+#ifdef _WIN32
+    UnmapViewOfFile(header);
+    CloseHandle(mappingHandle);
+    mappingHandle = nullptr;
+#else
+    munmap(header, size);
+    // The readers keep the memory mapped until they close it
+    shm_unlink(name.c_str());
+#endif
+    header = nullptr;
+    size = 0;
+}
+
+
+/************************************************************/
+/*      PRIVATE                                             */
+/************************************************************/
+sharedspectrum::Slot* SharedSpectrumPublisher::slot(size_t index) const
+{
+    return reinterpret_cast<sharedspectrum::Slot*>(reinterpret_cast<char*>(header) + header->headerBytes + index * header->slotBytes);
+}
+
+
+/************************************************************/
+/*      READER                                              */
+/************************************************************/
+SharedSpectrumReader::SharedSpectrumReader()
+    : header{nullptr}
+    , size{0}
+    , cursor{0}
+    , numLost{0}
+#ifdef _WIN32
+    , mappingHandle{nullptr}
+#endif
+{
+}
+
+SharedSpectrumReader::~SharedSpectrumReader()
+{
+    close();
+}
+
+bool SharedSpectrumReader::open(const char *name)
+{
+    close();
+    std::string object;
+    if (!objectName(name, object)) return false;
+
+    const void *address = nullptr;
+#ifdef _WIN32
+    mappingHandle = OpenFileMappingA(FILE_MAP_READ, FALSE, object.c_str());
+    if (!mappingHandle) return false;
+    address = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info;
+    if (address && VirtualQuery(address, &info, sizeof(info)) == sizeof(info)) size = info.RegionSize;
+#else
+    const int fd = shm_open(object.c_str(), O_RDONLY, 0);
+    if (fd < 0) return false;
+    struct stat status;
+    if (fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(sharedspectrum::Header)) {
+        size = static_cast<size_t>(status.st_size);
+        address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) address = nullptr;
+    }
+    ::close(fd);
+#endif
+    header = static_cast<const sharedspectrum::Header*>(address);
+    if (!header) {
+        close();
+        return false;
+    }
+
+    // The publisher fills the header once the memory is created, a reader that comes too early retries later
+    if (size < sizeof(sharedspectrum::Header) || std::memcmp(header->magic, HEADER_MAGIC, sizeof(header->magic)) != 0
+            || header->version != sharedspectrum::VERSION || header->slotBytes < sharedspectrum::slotBytes(header->spectrumBins)
+            || header->numSlots == 0 || header->headerBytes + static_cast<uint64_t>(header->numSlots) * header->slotBytes > size) {
+        close();
+        return false;
+    }
+
+    // Starts with the oldest frame still kept
+    const uint64_t head = getHead();
+    cursor = head > header->numSlots ? head - header->numSlots : 0;
+    numLost = 0;
+    return true;
+}
+
+void SharedSpectrumReader::close()
+{
+#ifdef _WIN32
+    if (header) UnmapViewOfFile(header);
+    if (mappingHandle) CloseHandle(mappingHandle);
+    mappingHandle = nullptr;
+#else
+    if (header) munmap(const_cast<sharedspectrum::Header*>(header), size);
+#endif
+    header = nullptr;
+    size = 0;
+}
+
+bool SharedSpectrumReader::acquire(uint64_t number, View &view) const
+{
+    view.slot = reinterpret_cast<const sharedspectrum::Slot*>(reinterpret_cast<const char*>(header) + header->headerBytes
+                                                              + (number % header->numSlots) * header->slotBytes);
+    view.spectrum = reinterpret_cast<const float*>(view.slot + 1);
+    view.number = number;
+    return seqlock::beginRead(view.slot->sequence, view.sequence);
+}
+
+bool SharedSpectrumReader::validate(const View &view) const
+{
+    const uint64_t number = view.slot->frame.number;
+    return seqlock::endRead(view.slot->sequence, view.sequence) && number == view.number;
+}
+
+bool SharedSpectrumReader::next(sharedspectrum::Frame &frame, std::vector<float> &spectrum)
+{
+    const uint64_t head = getHead();
+    while (cursor < head) {
+        // The frames more than a ring behind are gone
+        if (head - cursor > header->numSlots) {
+            numLost += head - header->numSlots - cursor;
+            cursor = head - header->numSlots;
+        }
+
+        View view;
+        if (acquire(cursor, view)) {
+            frame = view.slot->frame;
+            spectrum.assign(view.spectrum, view.spectrum + std::min(frame.numBins, header->spectrumBins));
+            if (validate(view)) {
+                ++cursor;
+                return true;
+            }
+        }
+
+        // The publisher got round the ring and is overwriting the frame
+        ++numLost;
+        ++cursor;
+    }
+    return false;
+}
@@ -0,0 +1,274 @@
+#ifndef SHAREDSPECTRUM_H
+#define SHAREDSPECTRUM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "audioframe.h"
+#include "frameanalyzer.h"
+
+/**
+ * Ring of the latest analyzed frames in shared memory, so other local processes (recorders, visualizers,
+ * experiments) can follow the spectrum, levels and note live.
+ *
+ * The memory is a header, then numSlots slots each holding the results of one channel of a frame and its
+ * spectrum. Frame n goes to slot n % numSlots, and the header counts the frames published. There is a single
+ * publisher (the analysis thread) and any number of readers in any number of processes. Every slot is
+ * protected by a sequence lock: the publisher never waits on the readers, a reader reads a slot in place
+ * then checks it was not overwritten meanwhile, a reader lagging more than numSlots frames behind loses the
+ * oldest ones.
+ *
+ * The memory is named after the publisher: a POSIX shared memory object ("/name") or, on Windows, a named
+ * file mapping ("Local\name"). The values are in the byte order of the machine, publisher and readers
+ * share it.
+ */
+namespace sharedspectrum {
+    enum { VERSION = 1, ALIGNMENT = 64 };
+
+    /**
+     * @brief Start of the shared memory
+     */
+    struct Header
+    {
+        char                    magic[8];       // "TASHARED"
+        uint32_t                version;        // VERSION
+        uint32_t                headerBytes;    // Offset of the first slot
+        uint32_t                slotBytes;      // Size of a slot, spectrum included
+        uint32_t                numSlots;       // Number of slots of the ring
+        uint32_t                spectrumBins;   // Highest number of bins of the spectrum of a slot
+        uint32_t                reserved;
+        int64_t                 createdUs;      // Time the memory was created, in microseconds since the epoch
+        std::atomic<uint32_t>   publishing;     // 1 while the publisher is running, 0 once it closed the ring
+        alignas(ALIGNMENT) std::atomic<uint64_t> head; // Number of frames published, on its own cache line
+    };
+
+    /**
+     * @brief Results of one channel of a frame, followed by numBins magnitudes (float) in the slot
+     */
+    struct Frame
+    {
+        enum Flags { ACTIVE = 1 << 0, ONSET = 1 << 1, MIX = 1 << 2 };
+
+        uint64_t    number;         // Number of the frame in the ring, from 0
+        int64_t     timestampUs;    // Time of the frame in microseconds
+        float       rmsLevel;       // RMS level in range 0.0 - 1.0
+        float       peakLevel;      // Peak level in range 0.0 - 1.0
+        float       confidence;     // Confidence of the note in range 0.0 - 1.0
+        float       pitchHz;        // Pitch of the note in Hz, 0 if none
+        int16_t     note;           // Index of the note in notes::notes, -1 if none
+        int16_t     cents;          // Deviation of the pitch from the note in cents
+        uint8_t     channel;        // Index of the channel in the frame
+        uint8_t     flags;          // Combination of Flags
+        uint8_t     numNotes;       // Number of notes played together
+        int8_t      chord;          // Chord of the notes played together @see{MultiPitchEstimator::chordRoot}, -1 if none
+        uint32_t    numBins;        // Number of magnitudes of the spectrum, 0 for none
+        float       binHz;          // Width of a bin of the spectrum in Hz, bin j starts at j * binHz
+    };
+
+    /**
+     * @brief A slot: its sequence lock, then the frame, then the spectrum
+     */
+    struct Slot
+    {
+        std::atomic<uint64_t>   sequence;       // Odd while the publisher modifies the slot
+        Frame                   frame;          // Results of the frame
+    };
+
+    /**
+     * @brief Returns the size of a slot with its spectrum
+     */
+    inline size_t slotBytes(size_t spectrumBins)
+    {
+        return (sizeof(Slot) + spectrumBins * sizeof(float) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+}
+
+/**
+ * Publishes the analyzed frames to a ring in shared memory.
+ */
+class SharedSpectrumPublisher
+{
+public:
+    /**
+     * @brief Size of the ring and of the spectra
+     */
+    struct Settings
+    {
+        size_t  numSlots;       // Number of frames kept, a reader may lag behind by as many
+        size_t  spectrumBins;   // Number of bins of the spectrum of each frame, the strongest of the bins they cover
+    };
+
+    /**
+     * @brief Returns sensible settings for a live session
+     */
+    static Settings defaultSettings();
+
+    SharedSpectrumPublisher();
+    ~SharedSpectrumPublisher();
+
+    SharedSpectrumPublisher(const SharedSpectrumPublisher&) = delete;
+    SharedSpectrumPublisher& operator=(const SharedSpectrumPublisher&) = delete;
+
+    /**
+     * @brief Creates (or recreates) the shared memory and maps it
+     * @param name Name of the ring, letters, digits, '-' and '_' only
+     * @param settings Size of the ring and of the spectra
+     * @return True if the memory could be created
+     */
+    bool open(const char *name, const Settings &settings = defaultSettings());
+
+    /**
+     * @brief Returns whether the ring is open
+     */
+    bool isOpen() const { return header != nullptr; }
+
+    /**
+     * @brief Publishes the results of one channel of a frame
+     * @param timestampUs Time of the frame in microseconds
+     * @param channel Index of the channel
+     * @param result The results of the channel
+     * @param isMix True if the channel is the mix of the others
+     * @param spectrum The magnitude spectrum of the channel, may be nullptr
+     * @param numSamples Size of the transform of the spectrum, its first half and one are published
+     * @param spectrumRate Sample rate the spectrum was transformed at
+     */
+    void publish(int64_t timestampUs, size_t channel, const ChannelResult &result, bool isMix, const double *spectrum, size_t numSamples, int spectrumRate);
+
+    /**
+     * @brief Publishes the results of every channel of a frame
+     * @param results The results of the frame
+     * @param analyzer The analyzer of the frame, for the spectra of the channels
+     * @param sampleRate The sample rate of the frame
+     */
+    void publish(const FrameResults &results, const FrameAnalyzer &analyzer, int sampleRate);
+
+    /**
+     * @brief Tells the readers the ring is closed, then unmaps and removes the shared memory
+     */
+    void close();
+
+private:
+    std::string                 name;           // Name of the shared memory
+    sharedspectrum::Header*     header;         // The mapped memory, nullptr if closed
+    size_t                      size;           // Size of the mapping
+#ifdef _WIN32
+    void*                       mappingHandle;  // The named file mapping
+#endif
+
+    /**
+     * @brief Returns a slot from its index in the ring
+     */
+    sharedspectrum::Slot* slot(size_t index) const;
+};
+
+/**
+ * Follows a ring of analyzed frames published by another process.
+ *
+ * The frames can be read in place, without copying: acquire() points at the frame and its spectrum in the
+ * shared memory, validate() tells whether they were overwritten while being read. next() copies the frames
+ * in order instead, skipping those lost.
+ */
+class SharedSpectrumReader
+{
+public:
+    /**
+     * @brief A frame and its spectrum in the shared memory
+     */
+    struct View
+    {
+        const sharedspectrum::Slot* slot;       // The slot of the frame
+        const float*                spectrum;   // The magnitudes of the spectrum in the slot
+        uint64_t                    number;     // Number of the frame
+        uint64_t                    sequence;   // Sequence of the slot when it was acquired
+    };
+
+    SharedSpectrumReader();
+    ~SharedSpectrumReader();
+
+    SharedSpectrumReader(const SharedSpectrumReader&) = delete;
+    SharedSpectrumReader& operator=(const SharedSpectrumReader&) = delete;
+
+    /**
+     * @brief Maps the shared memory of a publisher and checks its header
+     * @param name Name of the ring @see{SharedSpectrumPublisher::open}
+     * @return True if the memory exists and is a ring of this version
+     */
+    bool open(const char *name);
+
+    /**
+     * @brief Unmaps the shared memory
+     */
+    void close();
+
+    /**
+     * @brief Returns whether the ring is mapped
+     */
+    bool isOpen() const { return header != nullptr; }
+
+    /**
+     * @brief Returns the header of the ring
+     */
+    const sharedspectrum::Header& getHeader() const { return *header; }
+
+    /**
+     * @brief Returns whether the publisher is still running
+     */
+    bool isPublishing() const { return header->publishing.load(std::memory_order_acquire) != 0; }
+
+    /**
+     * @brief Returns the number of frames published so far
+     */
+    uint64_t getHead() const { return header->head.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Points a view at a frame in the shared memory, without copying it
+     * @param number Number of the frame, below getHead()
+     * @param view Receives the frame, only valid if validate() returns true once done with it
+     * @return False if the publisher is writing the slot of the frame
+     */
+    bool acquire(uint64_t number, View &view) const;
+
+    /**
+     * @brief Checks that a frame read in place was not overwritten meanwhile
+     * @param view The view of the frame
+     * @return True if the frame and spectrum read since acquire() are consistent and are the frame asked for
+     */
+    bool validate(const View &view) const;
+
+    /**
+     * @brief Copies the next frame, in order, skipping the frames overwritten before they were read
+     * @param frame Receives the frame
+     * @param spectrum Receives the magnitudes of its spectrum
+     * @return False if there is no new frame yet
+     */
+    bool next(sharedspectrum::Frame &frame, std::vector<float> &spectrum);
+
+    /**
+     * @brief Returns the number of the next frame next() will read
+     */
+    uint64_t getCursor() const { return cursor; }
+
+    /**
+     * @brief Moves the cursor, to the latest frame for instance
+     */
+    void setCursor(uint64_t number) { cursor = number; }
+
+    /**
+     * @brief Returns the number of frames skipped by next() because they were overwritten
+     */
+    uint64_t getNumLost() const { return numLost; }
+
+private:
+    const sharedspectrum::Header*   header;         // The mapped memory, nullptr if closed
+    size_t                          size;           // Size of the mapping
+    uint64_t                        cursor;         // Number of the next frame next() reads
+    uint64_t                        numLost;        // Number of frames skipped by next()
+#ifdef _WIN32
+    void*                           mappingHandle;  // The named file mapping
+#endif
+};
+
+#endif // SHAREDSPECTRUM_H
@@ -0,0 +1,346 @@
+#include "spectralhistory.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+#include "seqlock.h"
+#include "spectrumquantizer.h"
+#include "util.h"
+
+// Number of times a reader retries before giving up on a block that keeps changing
+const int MAX_READ_ATTEMPTS     = 64;
+
+// Blocks are cache line aligned so a reader of one block never shares a line with the writer of another
+const size_t BLOCK_ALIGNMENT    = 64;
+
+struct SpectralHistory::BlockHeader
+{
+    std::atomic<uint64_t>   sequence;   // Odd while the writer modifies the block
+    std::atomic<uint64_t>   id;         // Id of the block currently stored
+    std::atomic<uint64_t>   count;      // Number of frames stored in the block
+    std::atomic<int64_t>    firstUs;    // Timestamp of the first frame
+    std::atomic<int64_t>    lastUs;     // Timestamp of the last frame
+};
+
+namespace {
+    size_t aligned(size_t size) { return (size + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT; }
+}
+
+SpectralHistory::SpectralHistory(size_t framesPerBlock, size_t numBlocks, size_t spectrumBins)
+    : framesPerBlock{std::max<size_t>(framesPerBlock, 1)}
+    , numBlocks{std::max<size_t>(numBlocks, 2)}
+    , spectrumBins{spectrumBins}
+    , blockBytes{aligned(sizeof(BlockHeader)) + aligned(this->framesPerBlock * sizeof(HistoryFrame)) + aligned(this->framesPerBlock * spectrumBins)}
+    , memory(this->numBlocks * blockBytes + BLOCK_ALIGNMENT)
+    , spill{nullptr}
+    , spillBlocks{0}
+    , headBlock{0}
+    , quantized(spectrumBins)
+{
+    for (size_t i = 0; i < this->numBlocks; ++i) {
+        char *block = memoryBlock(i);
+        new (header(block)) BlockHeader{};
+        initBlock(block, i == 0 ? 0 : UINT64_MAX);
+    }
+}
+
+SpectralHistory::~SpectralHistory()
+{
+    if (spill) {
+        spillFile.unmap(spill);
+        spillFile.close();
+        spillFile.remove();
+    }
+}
+
+bool SpectralHistory::enableSpill(const QString &path, size_t numBlocks)
+{
+    Q_ASSERT(!spill);
+
+    spillFile.setFileName(path);
+    if (!spillFile.open(QIODevice::ReadWrite | QIODevice::Truncate)) return false;
+    if (!spillFile.resize(static_cast<qint64>(numBlocks * blockBytes))) {
+        spillFile.close();
+        return false;
+    }
+
+    uchar *mapping = spillFile.map(0, static_cast<qint64>(numBlocks * blockBytes));
+    if (!mapping) {
+        spillFile.close();
+        return false;
+    }
+
+    for (size_t i = 0; i < numBlocks; ++i) {
+        char *block = reinterpret_cast<char*>(mapping) + i * blockBytes;
+        new (header(block)) BlockHeader{};
+        initBlock(block, UINT64_MAX);
+    }
+
+    // Readers only touch spill once they see spillBlocks, the release publishes the mapping along with it
+    spill = mapping;
+    spillBlocks.store(numBlocks, std::memory_order_release);
+
+    AUDIOANALYZER_DEBUG << "SpectralHistory::enableSpill" << path << "blocks" << numBlocks << "bytes" << numBlocks * blockBytes;
+
+    return true;
+}
+
+void SpectralHistory::append(const HistoryFrame &frame, const double *spectrum, size_t numBins)
+{
+    uint64_t head = headBlock.load(std::memory_order_relaxed);
+    char *block = memoryBlock(head % numBlocks);
+
+    if (header(block)->count.load(std::memory_order_relaxed) == framesPerBlock) {
+        const uint64_t next = head + 1;
+        char *evicted = memoryBlock(next % numBlocks);
+
+        // Copy the block we are about to overwrite to the file before it is gone
+        const size_t spillBlocks = this->spillBlocks.load(std::memory_order_relaxed);
+        if (spillBlocks > 0 && next >= numBlocks) {
+            const uint64_t evictedId = next - numBlocks;
+            char *destination = reinterpret_cast<char*>(spill) + (evictedId % spillBlocks) * blockBytes;
+            BlockHeader *from = header(evicted);
+            BlockHeader *to = header(destination);
+
+            seqlock::beginWrite(to->sequence);
+            to->id.store(evictedId, std::memory_order_relaxed);
+            to->count.store(from->count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            to->firstUs.store(from->firstUs.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            to->lastUs.store(from->lastUs.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            std::memcpy(frames(destination), frames(evicted), blockBytes - aligned(sizeof(BlockHeader)));
+            seqlock::endWrite(to->sequence);
+        }
+
+        initBlock(evicted, next);
+        headBlock.store(next, std::memory_order_release);
+
+        head = next;
+        block = evicted;
+    }
+
+    // The spectrum is the first half of a transform of (numBins - 1) * 2 samples
+    if (spectrumBins > 0) {
+        const size_t numSamples = numBins > 0 ? (numBins - 1) * 2 : 0;
+        spectrumquantizer::quantizeSpectrum(spectrum, numBins, numSamples, 8, quantized.data(), spectrumBins, 1);
+    }
+
+    BlockHeader *h = header(block);
+    const uint64_t count = h->count.load(std::memory_order_relaxed);
+
+    seqlock::beginWrite(h->sequence);
+    frames(block)[count] = frame;
+    if (spectrumBins > 0) std::memcpy(spectra(block) + count * spectrumBins, quantized.data(), spectrumBins);
+    if (count == 0) h->firstUs.store(frame.timestampUs, std::memory_order_relaxed);
+    h->lastUs.store(frame.timestampUs, std::memory_order_relaxed);
+    h->count.store(count + 1, std::memory_order_relaxed);
+    seqlock::endWrite(h->sequence);
+}
+
+bool SpectralHistory::frameAt(int64_t timestampUs, HistoryFrame &frame) const
+{
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; ++attempt) {
+        uint64_t id = 0;
+        if (!findBlock(timestampUs, id)) return false;
+        if (readFrame(id, timestampUs, frame, nullptr)) return true;
+    }
+    return false;
+}
+
+bool SpectralHistory::spectrumAt(int64_t timestampUs, std::vector<uint8_t> &spectrum) const
+{
+    if (spectrumBins == 0) return false;
+
+    HistoryFrame frame;
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; ++attempt) {
+        uint64_t id = 0;
+        if (!findBlock(timestampUs, id)) return false;
+        if (readFrame(id, timestampUs, frame, &spectrum)) return true;
+    }
+    return false;
+}
+
+size_t SpectralHistory::scan(int64_t fromUs, int64_t toUs, const std::function<void(const HistoryFrame&)> &visitor) const
+{
+    if (toUs < fromUs) return 0;
+
+    // Start with the block holding the frame right before the range, or the oldest block if the range starts before the history
+    uint64_t id = 0;
+    const uint64_t head = headBlock.load(std::memory_order_acquire);
+    const uint64_t kept = numBlocks + spillBlocks.load(std::memory_order_acquire) - 1;
+    if (!findBlock(fromUs, id)) id = head > kept ? head - kept : 0;
+
+    std::vector<HistoryFrame> blockFrames;
+    blockFrames.reserve(framesPerBlock);
+
+    size_t visited = 0;
+    int64_t lastVisitedUs = fromUs - 1;
+    for (; id <= headBlock.load(std::memory_order_acquire); ++id) {
+        // A block evicted while we scan is skipped, the scan continues with the next one still kept
+        if (!readFrames(id, blockFrames)) continue;
+
+        for (const HistoryFrame &frame : blockFrames) {
+            if (frame.timestampUs > toUs) return visited;
+            if (frame.timestampUs > lastVisitedUs) {
+                visitor(frame);
+                lastVisitedUs = frame.timestampUs;
+                ++visited;
+            }
+        }
+    }
+    return visited;
+}
+
+
+/************************************************************/
+/*      PRIVATE                                             */
+/************************************************************/
+char* SpectralHistory::memoryBlock(size_t index) const
+{
+    // std::vector only guarantees the alignment of max_align_t, the blocks start at the first aligned address
+    const uintptr_t base = reinterpret_cast<uintptr_t>(memory.data());
+    const uintptr_t first = (base + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+    return const_cast<char*>(memory.data()) + (first - base) + index * blockBytes;
+}
+
+char* SpectralHistory::blockAddress(uint64_t id) const
+{
+    const uint64_t head = headBlock.load(std::memory_order_acquire);
+    if (id > head) return nullptr;
+
+    if (head - id < numBlocks) return memoryBlock(id % numBlocks);
+    const size_t spillBlocks = this->spillBlocks.load(std::memory_order_acquire);
+    if (spillBlocks > 0 && head - id < numBlocks + spillBlocks) return reinterpret_cast<char*>(spill) + (id % spillBlocks) * blockBytes;
+    return nullptr;
+}
+
+SpectralHistory::BlockHeader* SpectralHistory::header(char *block)
+{
+    return reinterpret_cast<BlockHeader*>(block);
+}
+
+HistoryFrame* SpectralHistory::frames(char *block)
+{
+    return reinterpret_cast<HistoryFrame*>(block + aligned(sizeof(BlockHeader)));
+}
+
+uint8_t* SpectralHistory::spectra(char *block) const
+{
+    return reinterpret_cast<uint8_t*>(block + aligned(sizeof(BlockHeader)) + aligned(framesPerBlock * sizeof(HistoryFrame)));
+}
+
+void SpectralHistory::initBlock(char *block, uint64_t id)
+{
+    BlockHeader *h = header(block);
+
+    seqlock::beginWrite(h->sequence);
+    h->id.store(id, std::memory_order_relaxed);
+    h->count.store(0, std::memory_order_relaxed);
+    h->firstUs.store(0, std::memory_order_relaxed);
+    h->lastUs.store(0, std::memory_order_relaxed);
+    seqlock::endWrite(h->sequence);
+}
+
+bool SpectralHistory::readHeader(uint64_t id, uint64_t &count, int64_t &firstUs, int64_t &lastUs) const
+{
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; ++attempt) {
+        char *block = blockAddress(id);
+        if (!block) return false;
+
+        const BlockHeader *h = header(block);
+        uint64_t seq = 0;
+        if (!seqlock::beginRead(h->sequence, seq)) continue;
+
+        const uint64_t storedId = h->id.load(std::memory_order_relaxed);
+        count = h->count.load(std::memory_order_relaxed);
+        firstUs = h->firstUs.load(std::memory_order_relaxed);
+        lastUs = h->lastUs.load(std::memory_order_relaxed);
+
+        if (seqlock::endRead(h->sequence, seq)) return storedId == id;
+    }
+    return false;
+}
+
+bool SpectralHistory::findBlock(int64_t timestampUs, uint64_t &id) const
+{
+    const uint64_t head = headBlock.load(std::memory_order_acquire);
+    const uint64_t kept = numBlocks + spillBlocks.load(std::memory_order_acquire) - 1;
+
+    // Binary search of the last non-empty block starting at or before timestampUs
+    uint64_t lo = head > kept ? head - kept : 0;
+    uint64_t hi = head;
+    bool found = false;
+
+    while (lo <= hi) {
+        const uint64_t mid = lo + (hi - lo) / 2;
+        uint64_t count = 0;
+        int64_t firstUs = 0, lastUs = 0;
+
+        if (!readHeader(mid, count, firstUs, lastUs)) {
+            // Evicted since we started, only newer blocks can still hold it
+            lo = mid + 1;
+            continue;
+        }
+
+        if (count > 0 && firstUs <= timestampUs) {
+            id = mid;
+            found = true;
+            lo = mid + 1;
+        }
+        else {
+            if (mid == 0) break;
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+bool SpectralHistory::readFrame(uint64_t id, int64_t timestampUs, HistoryFrame &frame, std::vector<uint8_t> *spectrum) const
+{
+    if (spectrum) spectrum->resize(spectrumBins);
+
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; ++attempt) {
+        char *block = blockAddress(id);
+        if (!block) return false;
+
+        const BlockHeader *h = header(block);
+        uint64_t seq = 0;
+        if (!seqlock::beginRead(h->sequence, seq)) continue;
+
+        const uint64_t storedId = h->id.load(std::memory_order_relaxed);
+        const uint64_t count = std::min<uint64_t>(h->count.load(std::memory_order_relaxed), framesPerBlock);
+        const HistoryFrame *first = frames(block);
+        const HistoryFrame *last = std::upper_bound(first, first + count, timestampUs, [](int64_t t, const HistoryFrame &f) {
+            return t < f.timestampUs;
+        });
+
+        const bool valid = last != first;
+        if (valid) {
+            frame = *(last - 1);
+            if (spectrum) std::memcpy(spectrum->data(), spectra(block) + static_cast<size_t>(last - 1 - first) * spectrumBins, spectrumBins);
+        }
+
+        if (seqlock::endRead(h->sequence, seq)) return storedId == id && valid;
+    }
+    return false;
+}
+
+bool SpectralHistory::readFrames(uint64_t id, std::vector<HistoryFrame> &blockFrames) const
+{
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; ++attempt) {
+        char *block = blockAddress(id);
+        if (!block) return false;
+
+        const BlockHeader *h = header(block);
+        uint64_t seq = 0;
+        if (!seqlock::beginRead(h->sequence, seq)) continue;
+
+        const uint64_t storedId = h->id.load(std::memory_order_relaxed);
+        const uint64_t count = std::min<uint64_t>(h->count.load(std::memory_order_relaxed), framesPerBlock);
+        blockFrames.assign(frames(block), frames(block) + count);
+
+        if (seqlock::endRead(h->sequence, seq)) return storedId == id;
+    }
+    return false;
+}
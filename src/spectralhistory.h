@@ -0,0 +1,165 @@
+#ifndef SPECTRALHISTORY_H
+#define SPECTRALHISTORY_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <QFile>
+#include <QString>
+
+/**
+ * @brief Result of the analysis of a single frame, as stored in the history
+ */
+struct HistoryFrame
+{
+    int64_t     timestampUs;    // Time of the frame in microseconds
+    float       rmsLevel;       // RMS level in range 0.0 - 1.0
+    float       peakLevel;      // Peak level in range 0.0 - 1.0
+    int         note;           // Index of the note in notes::notes, -1 if none
+    float       confidence;     // Confidence of the note in range 0.0 - 1.0
+};
+
+/**
+ * Bounded history of the per-frame analysis results.
+ *
+ * The frames are stored in a ring of fixed-size blocks allocated once at construction, so the memory
+ * used never grows no matter how long we keep listening. When a block is about to be overwritten it can
+ * optionally be copied to a memory-mapped file (itself a ring of blocks) to keep a longer history on disk.
+ *
+ * There is a single writer (the analysis thread) and any number of readers. Every block is protected by
+ * a sequence lock: the writer never waits on the readers, the readers simply retry when the block they
+ * were reading changed under them.
+ */
+class SpectralHistory
+{
+public:
+    /**
+     * @brief Creates the history and allocates all of its memory
+     * @param framesPerBlock Number of frames stored in each block
+     * @param numBlocks Number of blocks kept in memory
+     * @param spectrumBins Number of bins of the quantized spectrum stored with each frame, 0 to store none
+     */
+    SpectralHistory(size_t framesPerBlock, size_t numBlocks, size_t spectrumBins);
+    ~SpectralHistory();
+
+    SpectralHistory(const SpectralHistory&) = delete;
+    SpectralHistory& operator=(const SpectralHistory&) = delete;
+
+    /**
+     * @brief Spills the blocks evicted from memory to a memory-mapped file instead of dropping them
+     * @param path Path of the file, it is created (or truncated) to its final size right away
+     * @param numBlocks Number of blocks kept in the file
+     * @return True if the file could be created and mapped
+     * @note Must be called before the first append()
+     */
+    bool enableSpill(const QString &path, size_t numBlocks);
+
+    /**
+     * @brief Appends the results of a frame to the history (writer thread only)
+     * @param frame The results of the frame, timestamps must be increasing
+     * @param spectrum The magnitude spectrum of the frame, may be nullptr
+     * @param numBins Number of values in spectrum
+     */
+    void append(const HistoryFrame &frame, const double *spectrum, size_t numBins);
+
+    /**
+     * @brief Finds the last frame at or before a point in time
+     * @param timestampUs The point in time in microseconds
+     * @param frame Receives the frame
+     * @return True if the history covers that point in time
+     */
+    bool frameAt(int64_t timestampUs, HistoryFrame &frame) const;
+
+    /**
+     * @brief Finds the quantized spectrum of the last frame at or before a point in time
+     * @param timestampUs The point in time in microseconds
+     * @param spectrum Receives the quantized spectrum (@see{spectrumquantizer::dequantize}, 8 bits)
+     * @return True if the history covers that point in time and stores spectra
+     */
+    bool spectrumAt(int64_t timestampUs, std::vector<uint8_t> &spectrum) const;
+
+    /**
+     * @brief Visits, in order, every frame whose timestamp is within [fromUs, toUs]
+     * @param fromUs Start of the range in microseconds
+     * @param toUs End of the range in microseconds
+     * @param visitor Called for every frame of the range
+     * @return The number of frames visited
+     */
+    size_t scan(int64_t fromUs, int64_t toUs, const std::function<void(const HistoryFrame&)> &visitor) const;
+
+    /**
+     * @brief Returns the number of bins of the stored spectra
+     */
+    size_t getSpectrumBins() const { return spectrumBins; }
+
+    /**
+     * @brief Returns the total number of bytes used by the history (memory and file)
+     */
+    size_t getMemoryUsage() const { return memory.size() + spillBlocks.load(std::memory_order_acquire) * blockBytes; }
+
+private:
+    struct BlockHeader;
+
+    size_t                          framesPerBlock;     // Number of frames stored in each block
+    size_t                          numBlocks;          // Number of blocks kept in memory
+    size_t                          spectrumBins;       // Number of bins of the stored spectra
+    size_t                          blockBytes;         // Size of a block (header, frames and spectra)
+
+    std::vector<char>               memory;             // The blocks kept in memory
+    QFile                           spillFile;          // File the evicted blocks are spilled to
+    uchar*                          spill;              // Mapping of spillFile
+    std::atomic<size_t>             spillBlocks;        // Number of blocks kept in spillFile, 0 until spill is mapped
+
+    std::atomic<uint64_t>           headBlock;          // Id of the block currently being written
+    std::vector<uint8_t>            quantized;          // Scratch space for quantizing the spectrum
+
+    /**
+     * @brief Returns the address of a block of memory from its index in the ring
+     */
+    char* memoryBlock(size_t index) const;
+
+    /**
+     * @brief Returns the address of a block from its id, nullptr if it is not kept anymore
+     */
+    char* blockAddress(uint64_t id) const;
+
+    /**
+     * @brief Returns the parts of a block
+     */
+    static BlockHeader* header(char *block);
+    static HistoryFrame* frames(char *block);
+    uint8_t* spectra(char *block) const;
+
+    /**
+     * @brief Initializes an empty block
+     */
+    static void initBlock(char *block, uint64_t id);
+
+    /**
+     * @brief Reads the header of a block, retrying until it is consistent
+     * @return False if the block does not hold the block id anymore
+     */
+    bool readHeader(uint64_t id, uint64_t &count, int64_t &firstUs, int64_t &lastUs) const;
+
+    /**
+     * @brief Finds the id of the block holding the last frame at or before a point in time
+     * @return False if no block holds it
+     */
+    bool findBlock(int64_t timestampUs, uint64_t &id) const;
+
+    /**
+     * @brief Reads the last frame at or before a point in time (and its spectrum) consistently from a block
+     * @return False if the block does not hold the block id anymore or has no such frame
+     */
+    bool readFrame(uint64_t id, int64_t timestampUs, HistoryFrame &frame, std::vector<uint8_t> *spectrum) const;
+
+    /**
+     * @brief Reads all the frames of a block consistently
+     * @return False if the block does not hold the block id anymore
+     */
+    bool readFrames(uint64_t id, std::vector<HistoryFrame> &frames) const;
+};
+
+#endif // SPECTRALHISTORY_H
@@ -0,0 +1,610 @@
+#include "spectrogramarchive.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "spectrumquantizer.h"
+#include "tracer.h"
+
+static_assert(sizeof(spectrogramarchive::Header) == spectrogramarchive::HEADER_BYTES, "The header is padded to HEADER_BYTES");
+
+namespace {
+    const char      HEADER_MAGIC[8]     = {'T', 'A', 'S', 'P', 'E', 'C', 'T', 'R'};
+    const char      TRAILER_MAGIC[8]    = {'T', 'A', 'S', 'I', 'N', 'D', 'E', 'X'};
+    const uint32_t  BLOCK_MAGIC         = 0x4b4c4253; // "SBLK"
+    const uint32_t  BYTE_ORDER_MARK     = 0x01020304;
+
+    // A value whose quotient reaches this many bits is written as is after them, so no value takes more than this plus its bits
+    const unsigned  ESCAPE_QUOTIENT     = 24;
+
+    // Highest Rice parameter, the zigzagged differences of 16 bits values take 17 bits
+    const unsigned  MAX_PARAMETER       = 16;
+
+    inline uint32_t zigzag(int32_t value) { return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31); }
+    inline int32_t unzigzag(uint32_t value) { return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1); }
+
+    /*
+     * Writes bits from the lowest, 64 at a time
+     */
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(std::vector<uint8_t> &out) : out(out), bits{0}, count{0} {}
+
+        void put(uint64_t value, unsigned numBits)
+        {
+            bits |= value << count;
+            count += numBits;
+            if (count >= 64) {
+                flushWord();
+                count -= 64;
+                bits = numBits - count < 64 ? value >> (numBits - count) : 0;
+            }
+        }
+
+        void finish()
+        {
+            while (count > 0) {
+                out.push_back(static_cast<uint8_t>(bits));
+                bits >>= 8;
+                count = count > 8 ? count - 8 : 0;
+            }
+        }
+
+    private:
+        std::vector<uint8_t>   &out;
+        uint64_t                bits;   // Bits not written yet
+        unsigned                count;  // Number of bits in bits
+
+        void flushWord()
+        {
+            uint8_t bytes[8];
+            for (int i = 0; i < 8; ++i) bytes[i] = static_cast<uint8_t>(bits >> (8 * i));
+            out.insert(out.end(), bytes, bytes + 8);
+        }
+    };
+
+    /*
+     * Reads bits from the lowest, the data must be followed by 8 readable bytes
+     */
+    class BitReader
+    {
+    public:
+        BitReader(const uint8_t *data, size_t size) : data(data), end(data + size), bits{0}, count{0} { refill(); }
+
+        uint64_t peek() const { return bits; }
+
+        void skip(unsigned numBits) { bits >>= numBits; count -= numBits; if (count < 32) refill(); }
+
+        uint32_t get(unsigned numBits)
+        {
+            const uint32_t value = numBits == 0 ? 0 : static_cast<uint32_t>(bits & ((uint64_t{1} << numBits) - 1));
+            skip(numBits);
+            return value;
+        }
+
+        bool overrun() const { return data > end + 8; }
+
+    private:
+        const uint8_t          *data;   // Next byte to load
+        const uint8_t          *end;    // End of the coded data
+        uint64_t                bits;   // Bits loaded, from the lowest
+        unsigned                count;  // Number of bits loaded
+
+        void refill()
+        {
+            while (count <= 56) {
+                bits |= static_cast<uint64_t>(*data++) << count;
+                count += 8;
+            }
+        }
+    };
+
+    /*
+     * Variable length integers, 7 bits per byte
+     */
+    void putVarint(std::vector<uint8_t> &out, uint64_t value)
+    {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    bool getVarint(const uint8_t *&data, const uint8_t *end, uint64_t &value)
+    {
+        value = 0;
+        for (unsigned shift = 0; data < end && shift < 64; shift += 7) {
+            const uint8_t byte = *data++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+}
+
+namespace spectrogramarchive {
+    void encodeChunk(const uint16_t *columns, size_t numFrames, size_t numColumns, size_t stride, int bitsPerValue, std::vector<uint8_t> &out)
+    {
+        // The parameter of each column, then the columns
+        const size_t parameters = out.size();
+        out.resize(parameters + numColumns);
+
+        BitWriter writer(out);
+        const unsigned escapeBits = static_cast<unsigned>(bitsPerValue) + 1;
+        int32_t previousFirst = 0;
+        for (size_t c = 0; c < numColumns; ++c) {
+            const uint16_t *column = columns + c * stride;
+
+            // The parameter of a geometric distribution of mean sum / n is the smallest k with n * 2^k >= sum
+            uint64_t sum = zigzag(column[0] - previousFirst);
+            for (size_t t = 1; t < numFrames; ++t) sum += zigzag(column[t] - column[t - 1]);
+            unsigned k = 0;
+            while (k < MAX_PARAMETER && (static_cast<uint64_t>(numFrames) << k) < sum) ++k;
+            out[parameters + c] = static_cast<uint8_t>(k);
+
+            int32_t previous = previousFirst;
+            for (size_t t = 0; t < numFrames; ++t) {
+                const uint32_t value = zigzag(column[t] - previous);
+                previous = column[t];
+
+                const uint32_t quotient = value >> k;
+                if (quotient < ESCAPE_QUOTIENT) {
+                    // The quotient in unary (ones ended by a zero), then the remainder
+                    const uint64_t remainder = value & ((uint32_t{1} << k) - 1);
+                    writer.put(((uint64_t{1} << quotient) - 1) | (remainder << (quotient + 1)), quotient + 1 + k);
+                }
+                else {
+                    writer.put((uint64_t{1} << ESCAPE_QUOTIENT) - 1, ESCAPE_QUOTIENT);
+                    writer.put(value, escapeBits);
+                }
+            }
+            previousFirst = column[0];
+        }
+        writer.finish();
+    }
+
+    bool decodeChunk(const uint8_t *data, size_t size, size_t numFrames, size_t numColumns, size_t stride, int bitsPerValue, uint16_t *columns)
+    {
+        if (size < numColumns) return false;
+
+        BitReader reader(data + numColumns, size - numColumns);
+        const unsigned escapeBits = static_cast<unsigned>(bitsPerValue) + 1;
+        int32_t previousFirst = 0;
+        for (size_t c = 0; c < numColumns; ++c) {
+            const unsigned k = data[c];
+            if (k > MAX_PARAMETER) return false;
+            uint16_t *column = columns + c * stride;
+
+            int32_t previous = previousFirst;
+            for (size_t t = 0; t < numFrames; ++t) {
+                // Counts the ones of the quotient, at most ESCAPE_QUOTIENT of them
+                unsigned quotient = 0;
+                uint64_t bits = reader.peek();
+                while (quotient < ESCAPE_QUOTIENT && (bits & 1)) {
+                    bits >>= 1;
+                    ++quotient;
+                }
+
+                uint32_t value;
+                if (quotient < ESCAPE_QUOTIENT) {
+                    reader.skip(quotient + 1);
+                    value = (quotient << k) | reader.get(k);
+                }
+                else {
+                    reader.skip(ESCAPE_QUOTIENT);
+                    value = reader.get(escapeBits);
+                }
+
+                previous += unzigzag(value);
+                column[t] = static_cast<uint16_t>(previous);
+            }
+            previousFirst = column[0];
+        }
+        return !reader.overrun();
+    }
+}
+
+SpectrogramArchiveWriter::Settings SpectrogramArchiveWriter::defaultSettings()
+{
+    return Settings{512, 8, 256, 64, 3, false};
+}
+
+SpectrogramArchiveWriter::SpectrogramArchiveWriter()
+    : settings(defaultSettings())
+    , blocks{}
+    , freeBlocks{}
+    , fullBlocks{}
+    , current{0}
+    , index{}
+    , encoded{}
+    , file{nullptr}
+    , failed{false}
+    , offset{0}
+    , numFrames{0}
+    , numWritten{0}
+    , numDropped{0}
+    , thread{}
+    , mutex{}
+    , blockFull{}
+    , blockFree{}
+    , stopping{false}
+{
+}
+
+SpectrogramArchiveWriter::~SpectrogramArchiveWriter()
+{
+    close();
+}
+
+bool SpectrogramArchiveWriter::open(const char *path, const Settings &settings)
+{
+    close();
+    if (settings.bitsPerValue != 8 && settings.bitsPerValue != 16) return false;
+
+    file = std::fopen(path, "wb");
+    if (!file) return false;
+
+    this->settings = settings;
+    this->settings.numBins = std::max<size_t>(settings.numBins, 1);
+    this->settings.framesPerBlock = std::max<size_t>(settings.framesPerBlock, 1);
+    this->settings.binsPerChunk = std::max<size_t>(settings.binsPerChunk, 1);
+    this->settings.numBlocks = std::max<size_t>(settings.numBlocks, 2);
+
+    blocks.resize(this->settings.numBlocks);
+    for (Block &block : blocks) {
+        block.values.assign(this->settings.numBins * this->settings.framesPerBlock, 0);
+        block.timestamps.assign(this->settings.framesPerBlock, 0);
+        block.count = 0;
+    }
+    freeBlocks.reserve(blocks.size());
+    fullBlocks.reserve(blocks.size());
+
+    // Each block goes to the file in one write, a buffer would only split it
+    std::setvbuf(file, nullptr, _IONBF, 0);
+
+    spectrogramarchive::Header header{};
+    std::memcpy(header.magic, HEADER_MAGIC, sizeof(header.magic));
+    header.version = spectrogramarchive::VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.numBins = static_cast<uint32_t>(this->settings.numBins);
+    header.bitsPerValue = static_cast<uint32_t>(this->settings.bitsPerValue);
+    header.framesPerBlock = static_cast<uint32_t>(this->settings.framesPerBlock);
+    header.binsPerChunk = static_cast<uint32_t>(this->settings.binsPerChunk);
+    header.floorDb = spectrumquantizer::FLOOR_DB;
+    header.rangeDb = spectrumquantizer::RANGE_DB;
+    header.createdUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    if (std::fwrite(&header, sizeof(header), 1, file) != 1) {
+        std::fclose(file);
+        file = nullptr;
+        return false;
+    }
+
+    failed = false;
+    offset = sizeof(header);
+    numFrames = 0;
+    numWritten = 0;
+    numDropped = 0;
+    index.clear();
+    freeBlocks.clear();
+    fullBlocks.clear();
+    for (size_t i = 0; i < blocks.size(); ++i) freeBlocks.push_back(i);
+    current = blocks.size();
+    stopping = false;
+    thread = std::thread(&SpectrogramArchiveWriter::run, this);
+    return true;
+}
+
+bool SpectrogramArchiveWriter::append(int64_t timestampUs, const double *spectrum, size_t numSamples)
+{
+    if (!file) return false;
+    if (current == blocks.size() && !takeBlock()) {
+        ++numDropped;
+        return false;
+    }
+
+    // The block is column-oriented, each bin of the spectrum goes to its column
+    Block &block = blocks[current];
+    spectrumquantizer::quantizeSpectrum(spectrum, numSamples / 2 + 1, numSamples, settings.bitsPerValue,
+                                        block.values.data() + block.count, settings.numBins, settings.framesPerBlock);
+    block.timestamps[block.count] = timestampUs;
+    ++block.count;
+    ++numFrames;
+    if (block.count == settings.framesPerBlock) flush();
+    return true;
+}
+
+void SpectrogramArchiveWriter::flush()
+{
+    if (current == blocks.size() || blocks[current].count == 0) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fullBlocks.push_back(current);
+    }
+    blockFull.notify_one();
+    current = blocks.size();
+}
+
+bool SpectrogramArchiveWriter::close()
+{
+    if (!file) return !failed;
+
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    blockFull.notify_one();
+    thread.join();
+
+    // The index and the trailer follow the last block
+    spectrogramarchive::Trailer trailer{};
+    trailer.indexOffset = offset;
+    trailer.numBlocks = index.size();
+    trailer.numFrames = numWritten;
+    std::memcpy(trailer.magic, TRAILER_MAGIC, sizeof(trailer.magic));
+    if (!index.empty() && std::fwrite(index.data(), sizeof(spectrogramarchive::IndexEntry), index.size(), file) != index.size()) failed = true;
+    if (std::fwrite(&trailer, sizeof(trailer), 1, file) != 1) failed = true;
+    if (std::fclose(file) != 0) failed = true;
+    file = nullptr;
+    offset += index.size() * sizeof(spectrogramarchive::IndexEntry) + sizeof(trailer);
+
+    return !failed;
+}
+
+
+/************************************************************/
+/*      PRIVATE                                             */
+/************************************************************/
+void SpectrogramArchiveWriter::run()
+{
+    TRACE_THREAD_NAME("spectrogram archive");
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        blockFull.wait(lock, [this]() { return stopping || !fullBlocks.empty(); });
+        if (fullBlocks.empty()) return;
+
+        const size_t taken = fullBlocks.front();
+        fullBlocks.erase(fullBlocks.begin());
+        lock.unlock();
+
+        Block &block = blocks[taken];
+        encode(block);
+        {
+            TRACE_SCOPE("write spectrogram");
+            if (std::fwrite(encoded.data(), 1, encoded.size(), file) != encoded.size()) failed = true;
+        }
+        index.push_back(spectrogramarchive::IndexEntry{offset, block.timestamps[0], block.timestamps[block.count - 1], numWritten});
+        offset += encoded.size();
+        numWritten += block.count;
+        block.count = 0;
+
+        lock.lock();
+        freeBlocks.push_back(taken);
+        blockFree.notify_one();
+    }
+}
+
+void SpectrogramArchiveWriter::encode(const Block &block)
+{
+    TRACE_SCOPE("encode spectrogram");
+    const size_t numChunks = (settings.numBins + settings.binsPerChunk - 1) / settings.binsPerChunk;
+
+    // The header and the size of the chunks are known once the rest is coded, their room is kept
+    encoded.resize(sizeof(spectrogramarchive::BlockHeader) + numChunks * sizeof(uint32_t));
+
+    // The frames are mostly evenly spaced, the difference with the previous spacing is mostly 0
+    const size_t timestampsStart = encoded.size();
+    int64_t previous = block.timestamps[0];
+    int64_t spacing = 0;
+    for (size_t t = 1; t < block.count; ++t) {
+        const int64_t delta = block.timestamps[t] - previous;
+        const int64_t change = delta - spacing;
+        putVarint(encoded, (static_cast<uint64_t>(change) << 1) ^ static_cast<uint64_t>(change >> 63));
+        previous = block.timestamps[t];
+        spacing = delta;
+    }
+
+    spectrogramarchive::BlockHeader header{};
+    header.magic = BLOCK_MAGIC;
+    header.numFrames = static_cast<uint32_t>(block.count);
+    header.firstUs = block.timestamps[0];
+    header.lastUs = block.timestamps[block.count - 1];
+    header.numChunks = static_cast<uint32_t>(numChunks);
+    header.timestampBytes = static_cast<uint32_t>(encoded.size() - timestampsStart);
+
+    for (size_t c = 0; c < numChunks; ++c) {
+        const size_t firstBin = c * settings.binsPerChunk;
+        const size_t numColumns = std::min(settings.binsPerChunk, settings.numBins - firstBin);
+        const size_t start = encoded.size();
+        spectrogramarchive::encodeChunk(block.values.data() + firstBin * settings.framesPerBlock, block.count, numColumns,
+                                        settings.framesPerBlock, settings.bitsPerValue, encoded);
+
+        const uint32_t chunkBytes = static_cast<uint32_t>(encoded.size() - start);
+        std::memcpy(encoded.data() + sizeof(header) + c * sizeof(uint32_t), &chunkBytes, sizeof(chunkBytes));
+    }
+    std::memcpy(encoded.data(), &header, sizeof(header));
+}
+
+bool SpectrogramArchiveWriter::takeBlock()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (freeBlocks.empty()) {
+        if (!settings.lossless) return false;
+        blockFree.wait(lock, [this]() { return !freeBlocks.empty(); });
+    }
+
+    current = freeBlocks.back();
+    freeBlocks.pop_back();
+    return true;
+}
+
+
+/************************************************************/
+/*      READER                                              */
+/************************************************************/
+SpectrogramArchiveReader::SpectrogramArchiveReader()
+    : file{}
+    , header{}
+    , index{}
+    , numFrames{0}
+    , indexed{false}
+    , numChunks{0}
+    , chunkBytes{}
+    , buffer{}
+    , blockTimestamps{}
+    , columns{}
+{
+}
+
+bool SpectrogramArchiveReader::open(const char *path)
+{
+    file.close();
+    file.clear();
+    index.clear();
+    numFrames = 0;
+    indexed = false;
+
+    file.open(path, std::ios::binary);
+    if (!file || !file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (std::memcmp(header.magic, HEADER_MAGIC, sizeof(header.magic)) != 0 || header.version != spectrogramarchive::VERSION
+            || header.byteOrder != BYTE_ORDER_MARK || (header.bitsPerValue != 8 && header.bitsPerValue != 16)
+            || header.numBins == 0 || header.framesPerBlock == 0 || header.binsPerChunk == 0) {
+        return false;
+    }
+    numChunks = (header.numBins + header.binsPerChunk - 1) / header.binsPerChunk;
+    columns.resize(static_cast<size_t>(header.binsPerChunk) * header.framesPerBlock);
+
+    file.seekg(0, std::ios::end);
+    const uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+
+    // A closed file ends with its trailer and the index before it
+    spectrogramarchive::Trailer trailer{};
+    if (fileSize >= sizeof(header) + sizeof(trailer)) {
+        file.seekg(static_cast<std::streamoff>(fileSize - sizeof(trailer)));
+        file.read(reinterpret_cast<char*>(&trailer), sizeof(trailer));
+        indexed = file && std::memcmp(trailer.magic, TRAILER_MAGIC, sizeof(trailer.magic)) == 0
+            && trailer.indexOffset + trailer.numBlocks * sizeof(spectrogramarchive::IndexEntry) + sizeof(trailer) == fileSize;
+    }
+    if (indexed) {
+        index.resize(trailer.numBlocks);
+        file.seekg(static_cast<std::streamoff>(trailer.indexOffset));
+        if (!index.empty()) file.read(reinterpret_cast<char*>(index.data()), static_cast<std::streamsize>(index.size() * sizeof(spectrogramarchive::IndexEntry)));
+        numFrames = trailer.numFrames;
+        if (!file) return false;
+    }
+    else {
+        file.clear();
+        walkBlocks(fileSize);
+    }
+    return true;
+}
+
+size_t SpectrogramArchiveReader::read(int64_t fromUs, int64_t toUs, size_t firstBin, size_t numBins, std::vector<int64_t> &timestamps, std::vector<uint16_t> &values)
+{
+    timestamps.clear();
+    values.clear();
+    if (firstBin >= header.numBins || toUs < fromUs) return 0;
+    numBins = std::min<size_t>(numBins, header.numBins - firstBin);
+
+    // The blocks are in time order, the first one to read is the first one ending at or after the range
+    const auto first = std::lower_bound(index.begin(), index.end(), fromUs, [](const spectrogramarchive::IndexEntry &entry, int64_t t) {
+        return entry.lastUs < t;
+    });
+    const size_t firstChunk = firstBin / header.binsPerChunk;
+    const size_t lastChunk = (firstBin + numBins - 1) / header.binsPerChunk;
+
+    for (auto entry = first; entry != index.end() && entry->firstUs <= toUs; ++entry) {
+        spectrogramarchive::BlockHeader block{};
+        if (!readBlockHeader(entry->offset, block)) return 0;
+
+        const size_t begin = static_cast<size_t>(std::lower_bound(blockTimestamps.begin(), blockTimestamps.end(), fromUs) - blockTimestamps.begin());
+        const size_t end = static_cast<size_t>(std::upper_bound(blockTimestamps.begin(), blockTimestamps.end(), toUs) - blockTimestamps.begin());
+        if (begin >= end) continue;
+
+        // The chunks of the band are next to each other, a single read brings them all
+        uint64_t chunkOffset = entry->offset + sizeof(block) + numChunks * sizeof(uint32_t) + block.timestampBytes;
+        for (size_t c = 0; c < firstChunk; ++c) chunkOffset += chunkBytes[c];
+        size_t bandBytes = 0;
+        for (size_t c = firstChunk; c <= lastChunk; ++c) bandBytes += chunkBytes[c];
+        buffer.resize(bandBytes + 8);
+        std::fill(buffer.end() - 8, buffer.end(), 0);
+        file.seekg(static_cast<std::streamoff>(chunkOffset));
+        if (!file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(bandBytes))) return 0;
+
+        const size_t frame = timestamps.size();
+        timestamps.insert(timestamps.end(), blockTimestamps.begin() + static_cast<long>(begin), blockTimestamps.begin() + static_cast<long>(end));
+        values.resize(timestamps.size() * numBins);
+
+        size_t position = 0;
+        for (size_t c = firstChunk; c <= lastChunk; ++c) {
+            const size_t chunkFirstBin = c * header.binsPerChunk;
+            const size_t numColumns = std::min<size_t>(header.binsPerChunk, header.numBins - chunkFirstBin);
+            if (!spectrogramarchive::decodeChunk(buffer.data() + position, chunkBytes[c], block.numFrames, numColumns,
+                                                 block.numFrames, static_cast<int>(header.bitsPerValue), columns.data())) {
+                return 0;
+            }
+            position += chunkBytes[c];
+
+            // From the columns of the chunk to the frames of the band
+            const size_t from = std::max(firstBin, chunkFirstBin);
+            const size_t to = std::min(firstBin + numBins, chunkFirstBin + numColumns);
+            for (size_t bin = from; bin < to; ++bin) {
+                const uint16_t *column = columns.data() + (bin - chunkFirstBin) * block.numFrames;
+                for (size_t t = begin; t < end; ++t) values[(frame + t - begin) * numBins + bin - firstBin] = column[t];
+            }
+        }
+    }
+    return timestamps.size();
+}
+
+
+/************************************************************/
+/*      PRIVATE                                             */
+/************************************************************/
+bool SpectrogramArchiveReader::readBlockHeader(uint64_t offset, spectrogramarchive::BlockHeader &block)
+{
+    file.seekg(static_cast<std::streamoff>(offset));
+    if (!file.read(reinterpret_cast<char*>(&block), sizeof(block))) return false;
+    if (block.magic != BLOCK_MAGIC || block.numChunks != numChunks || block.numFrames == 0 || block.numFrames > header.framesPerBlock) return false;
+
+    chunkBytes.resize(numChunks);
+    buffer.resize(block.timestampBytes);
+    if (!file.read(reinterpret_cast<char*>(chunkBytes.data()), static_cast<std::streamsize>(numChunks * sizeof(uint32_t)))) return false;
+    if (!file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()))) return false;
+
+    blockTimestamps.resize(block.numFrames);
+    blockTimestamps[0] = block.firstUs;
+    const uint8_t *data = buffer.data();
+    const uint8_t *end = data + buffer.size();
+    int64_t spacing = 0;
+    for (size_t t = 1; t < block.numFrames; ++t) {
+        uint64_t value = 0;
+        if (!getVarint(data, end, value)) return false;
+        spacing += static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+        blockTimestamps[t] = blockTimestamps[t - 1] + spacing;
+    }
+    return true;
+}
+
+void SpectrogramArchiveReader::walkBlocks(uint64_t fileSize)
+{
+    uint64_t offset = sizeof(header);
+    spectrogramarchive::BlockHeader block{};
+    while (offset + sizeof(block) <= fileSize && readBlockHeader(offset, block)) {
+        uint64_t size = sizeof(block) + numChunks * sizeof(uint32_t) + block.timestampBytes;
+        for (uint32_t bytes : chunkBytes) size += bytes;
+
+        // The last block may have been cut short by the end of the writer
+        if (offset + size > fileSize) break;
+        index.push_back(spectrogramarchive::IndexEntry{offset, block.firstUs, block.lastUs, numFrames});
+        numFrames += block.numFrames;
+        offset += size;
+    }
+    file.clear();
+}
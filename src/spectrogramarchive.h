@@ -0,0 +1,316 @@
+#ifndef SPECTROGRAMARCHIVE_H
+#define SPECTROGRAMARCHIVE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Compressed archive of the spectra of a channel, for hours of waterfall.
+ *
+ * The spectra are quantized to 8 or 16 bits of log magnitude and stored by blocks of framesPerBlock frames.
+ * A block is column-oriented: its bins are split into chunks of binsPerChunk bins, and each bin of a chunk is
+ * a column of values over time. A column is coded as its difference with the previous frame (with the previous
+ * bin for its first frame), zigzagged and Rice-coded with the parameter that fits it best. A spectrogram
+ * changes slowly from frame to frame, the differences are small and take a few bits each.
+ *
+ * The file is a header, then the blocks, each starting with its own header (time range and size of its
+ * chunks), then an index of the blocks and a trailer written when the archive is closed. A time range is
+ * decoded from the blocks overlapping it only, a band from the chunks holding its bins only. A file whose
+ * writer did not close it has no index, its blocks are then found by walking their headers.
+ *
+ * The values are stored in the byte order of the machine, the header tells which it was.
+ */
+namespace spectrogramarchive {
+    enum { VERSION = 1, HEADER_BYTES = 64 };
+
+    /**
+     * @brief Start of the file
+     */
+    struct Header
+    {
+        char        magic[8];       // "TASPECTR"
+        uint32_t    version;        // VERSION
+        uint32_t    byteOrder;      // 0x01020304 as written by the machine
+        uint32_t    numBins;        // Number of bins of each spectrum
+        uint32_t    bitsPerValue;   // 8 or 16
+        uint32_t    framesPerBlock; // Highest number of frames of a block
+        uint32_t    binsPerChunk;   // Number of bins of each chunk of a block, the last one may have less
+        double      floorDb;        // Magnitude of the quantized value 0 @see{spectrumquantizer::FLOOR_DB}
+        double      rangeDb;        // Range of the magnitudes of the quantized values @see{spectrumquantizer::RANGE_DB}
+        int64_t     createdUs;      // Time the archive was created, in microseconds since the epoch
+        char        reserved[8];
+    };
+
+    /**
+     * @brief Start of a block, followed by the size of each chunk (uint32_t), the timestamps, then the chunks
+     */
+    struct BlockHeader
+    {
+        uint32_t    magic;          // BLOCK_MAGIC
+        uint32_t    numFrames;      // Number of frames of the block
+        int64_t     firstUs;        // Time of the first frame in microseconds
+        int64_t     lastUs;         // Time of the last frame in microseconds
+        uint32_t    numChunks;      // Number of chunks
+        uint32_t    timestampBytes; // Size of the timestamps
+    };
+
+    /**
+     * @brief Entry of the index, one per block
+     */
+    struct IndexEntry
+    {
+        uint64_t    offset;         // Offset of the block header in the file
+        int64_t     firstUs;        // Time of the first frame of the block
+        int64_t     lastUs;         // Time of the last frame of the block
+        uint64_t    firstFrame;     // Number of the first frame of the block
+    };
+
+    /**
+     * @brief End of a closed file, the index is right before it
+     */
+    struct Trailer
+    {
+        uint64_t    indexOffset;    // Offset of the index
+        uint64_t    numBlocks;      // Number of blocks
+        uint64_t    numFrames;      // Number of frames of all the blocks
+        char        magic[8];       // "TASINDEX"
+    };
+
+    /**
+     * @brief Codes the columns of a chunk
+     * @param columns The values, column after column
+     * @param numFrames Number of values of each column
+     * @param numColumns Number of columns
+     * @param stride Distance between two columns in columns
+     * @param bitsPerValue 8 or 16
+     * @param out Receives the coded chunk, appended
+     */
+    void encodeChunk(const uint16_t *columns, size_t numFrames, size_t numColumns, size_t stride, int bitsPerValue, std::vector<uint8_t> &out);
+
+    /**
+     * @brief Decodes the columns of a chunk
+     * @param data The coded chunk, followed by at least 8 readable bytes
+     * @param size Size of the coded chunk
+     * @param numFrames Number of values of each column
+     * @param numColumns Number of columns
+     * @param stride Distance between two columns in columns
+     * @param bitsPerValue 8 or 16
+     * @param columns Receives the values, column after column
+     * @return False if the chunk is corrupt
+     */
+    bool decodeChunk(const uint8_t *data, size_t size, size_t numFrames, size_t numColumns, size_t stride, int bitsPerValue, uint16_t *columns);
+}
+
+/**
+ * Writes the spectra of a channel to a spectrogram archive from a background thread.
+ *
+ * The analysis thread quantizes each spectrum into a block allocated up front, the writer thread codes each
+ * full block and writes it at once. Nothing is allocated and nothing waits on the disk while appending: when
+ * every block is still waiting to be written, the spectra are dropped and counted. A lossless archive (ie:
+ * offline analysis) waits for a block instead.
+ */
+class SpectrogramArchiveWriter
+{
+public:
+    /**
+     * @brief Resolution of the archive and size of its blocks
+     */
+    struct Settings
+    {
+        size_t  numBins;        // Number of bins stored of each spectrum, the strongest of the bins they cover
+        int     bitsPerValue;   // 8 or 16
+        size_t  framesPerBlock; // Number of frames of a block
+        size_t  binsPerChunk;   // Number of bins of a chunk, the narrowest band decoded alone
+        size_t  numBlocks;      // Number of blocks, appending goes on in one while the others are written
+        bool    lossless;       // True to wait for a block when they are all full instead of dropping the spectra
+    };
+
+    /**
+     * @brief Returns sensible settings for a live session
+     */
+    static Settings defaultSettings();
+
+    SpectrogramArchiveWriter();
+    ~SpectrogramArchiveWriter();
+
+    SpectrogramArchiveWriter(const SpectrogramArchiveWriter&) = delete;
+    SpectrogramArchiveWriter& operator=(const SpectrogramArchiveWriter&) = delete;
+
+    /**
+     * @brief Creates (or truncates) the file, allocates the blocks, writes the header and starts the writer thread
+     * @param path Path of the file
+     * @param settings The settings of the archive
+     * @return True if the file could be created
+     */
+    bool open(const char *path, const Settings &settings = defaultSettings());
+
+    /**
+     * @brief Returns whether the archive is open
+     */
+    bool isOpen() const { return file != nullptr; }
+
+    /**
+     * @brief Appends the spectrum of a frame
+     * @param timestampUs Time of the frame in microseconds, increasing from frame to frame
+     * @param spectrum The magnitude spectrum
+     * @param numSamples Size of the transform of the spectrum, its first half and one are stored
+     * @return False if the spectrum was dropped
+     */
+    bool append(int64_t timestampUs, const double *spectrum, size_t numSamples);
+
+    /**
+     * @brief Hands the spectra appended so far to the writer thread, even if their block isn't full
+     */
+    void flush();
+
+    /**
+     * @brief Writes the remaining spectra, the index and the trailer, then closes the file
+     * @return True if everything could be written
+     */
+    bool close();
+
+    /**
+     * @brief Returns the number of spectra appended and not dropped
+     */
+    uint64_t getNumFrames() const { return numFrames; }
+
+    /**
+     * @brief Returns the number of spectra dropped because every block was waiting to be written
+     */
+    uint64_t getNumDropped() const { return numDropped; }
+
+    /**
+     * @brief Returns the number of bytes written so far, valid once closed
+     */
+    uint64_t getBytesWritten() const { return offset; }
+
+private:
+    /**
+     * @brief Spectra appended together, coded and written at once
+     */
+    struct Block
+    {
+        std::vector<uint16_t>   values;         // numBins columns of framesPerBlock values
+        std::vector<int64_t>    timestamps;     // Time of each frame
+        size_t                  count;          // Number of frames in the block
+    };
+
+    Settings                    settings;       // Resolution of the archive and size of its blocks
+    std::vector<Block>          blocks;         // The blocks, allocated once
+    std::vector<size_t>         freeBlocks;     // Blocks ready to be filled
+    std::vector<size_t>         fullBlocks;     // Blocks waiting to be written, in order
+    size_t                      current;        // Block being filled, blocks.size() if none
+    std::vector<spectrogramarchive::IndexEntry> index; // Index of the blocks, built by the writer thread
+    std::vector<uint8_t>        encoded;        // The block being written, coded by the writer thread
+
+    FILE*                       file;           // The file, nullptr if closed
+    bool                        failed;         // True if a write failed
+    uint64_t                    offset;         // Number of bytes written
+    uint64_t                    numFrames;      // Number of spectra appended
+    uint64_t                    numWritten;     // Number of spectra written
+    uint64_t                    numDropped;     // Number of spectra dropped
+
+    std::thread                 thread;         // Codes and writes the full blocks
+    std::mutex                  mutex;          // Protects freeBlocks, fullBlocks and stopping
+    std::condition_variable     blockFull;      // Signaled when a block is handed to the writer thread, or to stop it
+    std::condition_variable     blockFree;      // Signaled when a block was written
+    bool                        stopping;       // True once the writer thread must stop after the full blocks
+
+    /**
+     * @brief Main loop of the writer thread
+     */
+    void run();
+
+    /**
+     * @brief Codes a block into encoded
+     */
+    void encode(const Block &block);
+
+    /**
+     * @brief Takes a free block to fill, waiting for one if the archive is lossless
+     * @return False if there is none
+     */
+    bool takeBlock();
+};
+
+/**
+ * Decodes time ranges and bands of a spectrogram archive.
+ */
+class SpectrogramArchiveReader
+{
+public:
+    SpectrogramArchiveReader();
+
+    SpectrogramArchiveReader(const SpectrogramArchiveReader&) = delete;
+    SpectrogramArchiveReader& operator=(const SpectrogramArchiveReader&) = delete;
+
+    /**
+     * @brief Opens a file, checks its header and reads its index (or walks its blocks if it has none)
+     * @param path Path of the file
+     * @return True if the file is a spectrogram archive written by a machine of the same byte order
+     */
+    bool open(const char *path);
+
+    /**
+     * @brief Returns the header of the file
+     */
+    const spectrogramarchive::Header& getHeader() const { return header; }
+
+    /**
+     * @brief Returns the number of frames
+     */
+    uint64_t getNumFrames() const { return numFrames; }
+
+    /**
+     * @brief Returns the number of blocks
+     */
+    size_t getNumBlocks() const { return index.size(); }
+
+    /**
+     * @brief Returns whether the file was closed by its writer, with its index
+     */
+    bool isIndexed() const { return indexed; }
+
+    /**
+     * @brief Decodes the spectra of a time range, in a band
+     * @param fromUs Start of the range in microseconds
+     * @param toUs End of the range in microseconds, included
+     * @param firstBin First bin of the band
+     * @param numBins Number of bins of the band
+     * @param timestamps Receives the time of each frame of the range
+     * @param values Receives the quantized values of the band of each frame, frame after frame
+     * @return The number of frames decoded, 0 if none or if the file is corrupt
+     */
+    size_t read(int64_t fromUs, int64_t toUs, size_t firstBin, size_t numBins, std::vector<int64_t> &timestamps, std::vector<uint16_t> &values);
+
+private:
+    std::ifstream                       file;           // The file
+    spectrogramarchive::Header          header;         // Header of the file
+    std::vector<spectrogramarchive::IndexEntry> index;  // Index of the blocks
+    uint64_t                            numFrames;      // Number of frames
+    bool                                indexed;        // True if the index was read from the file
+    size_t                              numChunks;      // Number of chunks of each block
+    std::vector<uint32_t>               chunkBytes;     // Size of each chunk of the block being read
+    std::vector<uint8_t>                buffer;         // Coded data of the block being read
+    std::vector<int64_t>                blockTimestamps; // Timestamps of the block being read
+    std::vector<uint16_t>               columns;        // Decoded columns of the chunk being read
+
+    /**
+     * @brief Reads the header of a block, the size of its chunks and its timestamps
+     * @return False if the block is corrupt or truncated
+     */
+    bool readBlockHeader(uint64_t offset, spectrogramarchive::BlockHeader &block);
+
+    /**
+     * @brief Builds the index by walking the blocks of a file that has none
+     */
+    void walkBlocks(uint64_t fileSize);
+};
+
+#endif // SPECTROGRAMARCHIVE_H
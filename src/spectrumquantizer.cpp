@@ -0,0 +1,73 @@
+#include "spectrumquantizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    /**
+     * @brief Returns the amplitude of the strongest bin of a spectrum covered by a reduced bin
+     */
+    double strongest(const double *spectrum, size_t numBins, double scale, size_t i, size_t numOut)
+    {
+        const size_t begin = i * numBins / numOut;
+        const size_t end = std::max(begin + 1, (i + 1) * numBins / numOut);
+
+        double magnitude = 0.0;
+        for (size_t j = begin; j < end && j < numBins; ++j) magnitude = std::max(magnitude, spectrum[j]);
+        return magnitude * scale;
+    }
+
+    /**
+     * @brief Returns the factor turning the magnitudes of a transform of numSamples into amplitudes
+     */
+    double amplitudeScale(size_t numSamples)
+    {
+        // A sinusoid of amplitude a adds up to a * numSamples / 2 in its bin
+        return 2.0 / static_cast<double>(std::max<size_t>(numSamples, 1));
+    }
+
+    template<typename T>
+    void quantize(const double *spectrum, size_t numBins, size_t numSamples, int bits, T *out, size_t numOut, size_t stride)
+    {
+        if (!spectrum || numBins == 0) {
+            for (size_t i = 0; i < numOut; ++i) out[i * stride] = 0;
+            return;
+        }
+
+        const double scale = amplitudeScale(numSamples);
+        const double levels = static_cast<double>((1u << bits) - 1);
+        for (size_t i = 0; i < numOut; ++i) {
+            const double db = 20.0 * std::log10(std::max(strongest(spectrum, numBins, scale, i, numOut), 1e-12));
+            const double value = (db - spectrumquantizer::FLOOR_DB) / spectrumquantizer::RANGE_DB * levels;
+            out[i * stride] = static_cast<T>(std::clamp(value + 0.5, 0.0, levels));
+        }
+    }
+}
+
+namespace spectrumquantizer {
+    void reduceSpectrum(const double *spectrum, size_t numBins, size_t numSamples, float *amplitudes, size_t numOut)
+    {
+        if (!spectrum || numBins == 0) {
+            std::fill(amplitudes, amplitudes + numOut, 0.0f);
+            return;
+        }
+
+        const double scale = amplitudeScale(numSamples);
+        for (size_t i = 0; i < numOut; ++i) amplitudes[i] = static_cast<float>(strongest(spectrum, numBins, scale, i, numOut));
+    }
+
+    void quantizeSpectrum(const double *spectrum, size_t numBins, size_t numSamples, int bits, uint16_t *out, size_t numOut, size_t stride)
+    {
+        quantize(spectrum, numBins, numSamples, bits, out, numOut, stride);
+    }
+
+    void quantizeSpectrum(const double *spectrum, size_t numBins, size_t numSamples, int bits, uint8_t *out, size_t numOut, size_t stride)
+    {
+        quantize(spectrum, numBins, numSamples, std::min(bits, 8), out, numOut, stride);
+    }
+
+    double dequantize(unsigned value, int bits)
+    {
+        return FLOOR_DB + value * RANGE_DB / static_cast<double>((1u << bits) - 1);
+    }
+}
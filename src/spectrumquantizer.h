@@ -0,0 +1,54 @@
+#ifndef SPECTRUMQUANTIZER_H
+#define SPECTRUMQUANTIZER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Reduces the magnitude spectra to fewer bins of amplitude or of quantized log amplitude, for the files and
+ * the rings keeping them (@see{ResultStreamWriter}, @see{SpectrogramArchiveWriter}, @see{SharedSpectrumPublisher}).
+ *
+ * Every reduced bin keeps the strongest of the bins of the spectrum it covers, so a narrow peak survives the
+ * reduction. The quantized values cover FLOOR_DB to FLOOR_DB + RANGE_DB in as many steps as their bits allow,
+ * the same scale for every file, whatever its number of bits.
+ */
+namespace spectrumquantizer {
+    const double FLOOR_DB       = -100.0;   // Amplitude of the quantized value 0, in dBFS
+    const double RANGE_DB       = 120.0;    // Amplitudes covered by the quantized values
+
+    /**
+     * @brief Reduces a magnitude spectrum to the amplitudes of fewer bins
+     * @param spectrum The magnitude spectrum, may be nullptr
+     * @param numBins Number of values in spectrum
+     * @param numSamples Size of the transform of the spectrum, for the scale of the magnitudes
+     * @param amplitudes Receives numOut amplitudes, zeros without a spectrum
+     * @param numOut Number of amplitudes
+     */
+    void reduceSpectrum(const double *spectrum, size_t numBins, size_t numSamples, float *amplitudes, size_t numOut);
+
+    /**
+     * @brief Quantizes a magnitude spectrum to fewer bins of log amplitude
+     * @param spectrum The magnitude spectrum, may be nullptr
+     * @param numBins Number of values in spectrum
+     * @param numSamples Size of the transform of the spectrum, for the scale of the magnitudes
+     * @param bits Bits of each value, up to 16
+     * @param out Receives numOut values, zeros without a spectrum
+     * @param numOut Number of values
+     * @param stride Distance between two values in out
+     */
+    void quantizeSpectrum(const double *spectrum, size_t numBins, size_t numSamples, int bits, uint16_t *out, size_t numOut, size_t stride);
+
+    /**
+     * @brief Quantizes a magnitude spectrum to fewer bins of log amplitude, of up to 8 bits
+     */
+    void quantizeSpectrum(const double *spectrum, size_t numBins, size_t numSamples, int bits, uint8_t *out, size_t numOut, size_t stride);
+
+    /**
+     * @brief Converts a quantized value back to decibels
+     * @param value The quantized value
+     * @param bits Bits of the value
+     */
+    double dequantize(unsigned value, int bits);
+}
+
+#endif // SPECTRUMQUANTIZER_H
@@ -0,0 +1,163 @@
+#include "streamreader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#ifdef _WIN32
+#   include <fcntl.h>
+#   include <io.h>
+#else
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+#include "tracer.h"
+
+namespace {
+#ifdef _WIN32
+    int openStream(const char *path) { return _open(path, _O_RDONLY | _O_BINARY); }
+    long readStream(int fd, char *data, size_t size) { return _read(fd, data, static_cast<unsigned>(std::min<size_t>(size, INT_MAX))); }
+    void closeStream(int fd) { _close(fd); }
+#else
+    int openStream(const char *path) { return ::open(path, O_RDONLY); }
+    long readStream(int fd, char *data, size_t size) { return static_cast<long>(::read(fd, data, size)); }
+    void closeStream(int fd) { ::close(fd); }
+#endif
+}
+
+StreamReader::StreamReader()
+    : blocks{}
+    , first{0}
+    , numFull{0}
+    , held{0}
+    , fd{-1}
+    , ownsFd{false}
+    , ended{false}
+    , failed{false}
+    , stopping{false}
+    , bytesRead{0}
+    , thread{}
+    , mutex{}
+    , blockFull{}
+    , blockFree{}
+{
+}
+
+StreamReader::~StreamReader()
+{
+    close();
+}
+
+bool StreamReader::open(const char *path, size_t blockBytes, size_t numBlocks)
+{
+    close();
+
+    if (std::strcmp(path, "-") == 0) {
+        fd = 0;
+        ownsFd = false;
+#ifdef _WIN32
+        // The standard input translates line endings unless told otherwise
+        _setmode(fd, _O_BINARY);
+#endif
+    }
+    else {
+        fd = openStream(path);
+        ownsFd = true;
+        if (fd < 0) return false;
+    }
+
+    blocks.resize(std::max<size_t>(numBlocks, 2));
+    for (Block &block : blocks) {
+        block.data.assign(std::max<size_t>(blockBytes, 1), 0);
+        block.size = 0;
+    }
+    first = 0;
+    numFull = 0;
+    held = blocks.size();
+    ended = false;
+    failed = false;
+    stopping = false;
+    bytesRead = 0;
+    thread = std::thread(&StreamReader::run, this);
+    return true;
+}
+
+bool StreamReader::read(const char *&data, size_t &numBytes)
+{
+    if (fd < 0) return false;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (held != blocks.size()) {
+        // The block held is the oldest one, handing it back frees its slot of the ring
+        held = blocks.size();
+        first = (first + 1) % blocks.size();
+        --numFull;
+        blockFree.notify_one();
+    }
+
+    blockFull.wait(lock, [this]() { return numFull > 0 || ended; });
+    if (numFull == 0) return false;
+
+    held = first;
+    data = blocks[held].data.data();
+    numBytes = blocks[held].size;
+    bytesRead += numBytes;
+    return true;
+}
+
+void StreamReader::close()
+{
+    if (fd < 0) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    blockFree.notify_one();
+    // A reader thread waiting on a pipe only notices once the pipe has data or is closed
+    thread.join();
+
+    if (ownsFd) closeStream(fd);
+    fd = -1;
+}
+
+
+/************************************************************/
+/*      PRIVATE                                             */
+/************************************************************/
+void StreamReader::run()
+{
+    TRACE_THREAD_NAME("stream reader");
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        // Every block is full until the consumer hands one back
+        blockFree.wait(lock, [this]() { return stopping || numFull < blocks.size(); });
+        if (stopping) break;
+
+        Block &block = blocks[(first + numFull) % blocks.size()];
+        lock.unlock();
+
+        long count;
+        {
+            TRACE_SCOPE("read stream");
+            do {
+                count = readStream(fd, block.data.data(), block.data.size());
+            } while (count < 0 && errno == EINTR);
+        }
+
+        lock.lock();
+        if (count <= 0) {
+            failed = count < 0;
+            break;
+        }
+        block.size = static_cast<size_t>(count);
+        ++numFull;
+        blockFull.notify_one();
+    }
+
+    ended = true;
+    blockFull.notify_one();
+}
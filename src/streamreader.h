@@ -0,0 +1,95 @@
+#ifndef STREAMREADER_H
+#define STREAMREADER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Reads a byte stream (a file, a pipe, the standard input) ahead of its consumer, from a background thread.
+ *
+ * The reader thread fills a ring of blocks allocated when the stream is opened, the consumer takes them in
+ * order. The memory used is the same however long the stream is, and the consumer analyzes a block while the
+ * next ones are being read. A read returns what the stream has, up to a block: the whole block for a file,
+ * what the writer of a pipe has written so far for a pipe, so a live stream isn't held back until a block
+ * is full.
+ */
+class StreamReader
+{
+public:
+    enum { DEFAULT_BLOCK_BYTES = 1 << 20, DEFAULT_BLOCKS = 4 };
+
+    StreamReader();
+    ~StreamReader();
+
+    StreamReader(const StreamReader&) = delete;
+    StreamReader& operator=(const StreamReader&) = delete;
+
+    /**
+     * @brief Opens a stream, allocates the blocks and starts reading ahead
+     * @param path Path of the file, "-" for the standard input
+     * @param blockBytes Largest number of bytes read at once
+     * @param numBlocks Number of blocks, the reader thread fills the others while the consumer holds one
+     * @return True if the stream could be opened
+     */
+    bool open(const char *path, size_t blockBytes = DEFAULT_BLOCK_BYTES, size_t numBlocks = DEFAULT_BLOCKS);
+
+    /**
+     * @brief Waits for the next block of the stream, handing the previous one back to the reader thread
+     * @param data Receives the bytes of the block, valid until the next call
+     * @param numBytes Receives the number of bytes of the block
+     * @return False at the end of the stream, when reading it failed @see{hasFailed} or when it is not open
+     */
+    bool read(const char *&data, size_t &numBytes);
+
+    /**
+     * @brief Stops reading and closes the stream
+     */
+    void close();
+
+    /**
+     * @brief Returns whether reading the stream failed before its end
+     */
+    bool hasFailed() const { return failed; }
+
+    /**
+     * @brief Returns the number of bytes handed to the consumer
+     */
+    uint64_t getBytesRead() const { return bytesRead; }
+
+private:
+    /**
+     * @brief Bytes read at once
+     */
+    struct Block
+    {
+        std::vector<char>       data;           // blockBytes bytes
+        size_t                  size;           // Number of bytes read into data
+    };
+
+    std::vector<Block>          blocks;         // The ring of blocks, allocated once
+    size_t                      first;          // Oldest block read and not taken yet by the consumer
+    size_t                      numFull;        // Number of blocks read and not taken yet
+    size_t                      held;           // Block held by the consumer, blocks.size() if none
+    int                         fd;             // The stream, -1 if closed
+    bool                        ownsFd;         // False for the standard input, left open
+    bool                        ended;          // True once the reader thread reached the end of the stream
+    bool                        failed;         // True if reading the stream failed
+    bool                        stopping;       // True once the reader thread must stop
+    uint64_t                    bytesRead;      // Number of bytes handed to the consumer
+
+    std::thread                 thread;         // Reads the stream into the free blocks
+    std::mutex                  mutex;          // Protects first, numFull, held, ended, failed and stopping
+    std::condition_variable     blockFull;      // Signaled when a block was read, or at the end of the stream
+    std::condition_variable     blockFree;      // Signaled when the consumer hands a block back, or to stop the thread
+
+    /**
+     * @brief Main loop of the reader thread
+     */
+    void run();
+};
+
+#endif // STREAMREADER_H
@@ -0,0 +1,99 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "notes.h"
+#include "sharedspectrum.h"
+
+/*
+ * Follows the frames another process publishes to shared memory (the application with
+ * TONEANALYZER_SHARED_SPECTRUM=NAME in its environment, or the command line tool with --publish NAME) and prints
+ * them one line each, as the command line tool does. Both a tool and the example of a reader.
+ */
+namespace {
+    // Time between two looks at the ring when there is no new frame
+    const std::chrono::milliseconds POLL_INTERVAL(5);
+
+    struct Options
+    {
+        std::string     name;       // Name of the ring
+        long            count;      // Number of frames to print, 0 for all until the publisher closes the ring
+        bool            latest;     // True to start at the latest frame instead of the oldest one kept
+    };
+
+    void usage(const char *program)
+    {
+        std::fprintf(stderr,
+                     "Usage: %s [options] NAME\n"
+                     "  --count N             exit after N frames (default: when the publisher stops)\n"
+                     "  --latest              start at the latest frame instead of the oldest one kept\n",
+                     program);
+    }
+
+    /*
+     * The strongest bin of the spectrum, in Hz
+     */
+    double strongestHz(const sharedspectrum::Frame &frame, const std::vector<float> &spectrum)
+    {
+        size_t strongest = 0;
+        for (size_t j = 1; j < spectrum.size(); ++j) if (spectrum[j] > spectrum[strongest]) strongest = j;
+        return spectrum.empty() ? 0.0 : (static_cast<double>(strongest) + 0.5) * frame.binHz;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Options options{"", 0, false};
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--count" && i + 1 < argc) options.count = std::atol(argv[++i]);
+        else if (arg == "--latest") options.latest = true;
+        else if (arg.compare(0, 2, "--") != 0 && options.name.empty()) options.name = arg;
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (options.name.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    SharedSpectrumReader reader;
+    if (!reader.open(options.name.c_str())) {
+        std::fprintf(stderr, "No ring named %s\n", options.name.c_str());
+        return 1;
+    }
+    if (options.latest) reader.setCursor(reader.getHead());
+
+    std::printf("time\tchannel\trms\tpeak\tnote\tpitch\tconfidence\tstrongest\n");
+    sharedspectrum::Frame frame;
+    std::vector<float> spectrum;
+    long printed = 0;
+    while (options.count == 0 || printed < options.count) {
+        // Looked at before reading, so every frame published before the ring was closed is read
+        const bool publishing = reader.isPublishing();
+        if (!reader.next(frame, spectrum)) {
+            if (!publishing) break;
+            std::this_thread::sleep_for(POLL_INTERVAL);
+            continue;
+        }
+
+        std::printf("%.3f\t%s\t%.6f\t%.6f\t%s\t%.2f\t%.3f\t%.1f\n",
+                    static_cast<double>(frame.timestampUs) / 1000000.0,
+                    (frame.flags & sharedspectrum::Frame::MIX) ? "mix" : std::to_string(frame.channel).c_str(),
+                    static_cast<double>(frame.rmsLevel),
+                    static_cast<double>(frame.peakLevel),
+                    frame.note >= 0 ? notes::notes[frame.note] : "-",
+                    static_cast<double>(frame.pitchHz),
+                    static_cast<double>(frame.confidence),
+                    strongestHz(frame, spectrum));
+        ++printed;
+    }
+
+    if (reader.getNumLost() > 0) std::fprintf(stderr, "%llu frames lost\n", static_cast<unsigned long long>(reader.getNumLost()));
+    return 0;
+}
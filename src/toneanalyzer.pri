@@ -12,3 +12,18 @@
 
 # Debug output from audio input silly
 # DEFINES += LOG_AUDIOINPUT_S
+
+# Print the latency of the stages of the pipeline on exit
+# DEFINES += REPORT_LATENCY
+
+# Record a Chrome trace of the activity of the pipeline (when started, @see{tracer.h})
+# DEFINES += TRACE_EVENTS
+
+# Report the heap allocations made by the capture and analysis threads after warm-up
+# DEFINES += AUDIT_ALLOCATIONS
+
+# The allocation audit also sees the calls to malloc when the linker can wrap it
+linux:contains(DEFINES, AUDIT_ALLOCATIONS) {
+    DEFINES += AUDIT_WRAP_MALLOC
+    QMAKE_LFLAGS += -Wl,--wrap=malloc
+}
@@ -0,0 +1,12 @@
+include(toneanalyzer.pri)
+include(toneanalyzer_core.pri)
+
+# Micro-benchmarks of the kernels of the core, on synthetic input
+TARGET = toneanalyzer-bench
+TEMPLATE = app
+
+CONFIG -= qt app_bundle
+CONFIG += console c++17 release
+
+SOURCES += \
+    bench.cpp
@@ -0,0 +1,12 @@
+include(toneanalyzer.pri)
+include(toneanalyzer_core.pri)
+
+# Headless front end, links only the core library
+TARGET = toneanalyzer-cli
+TEMPLATE = app
+
+CONFIG -= qt app_bundle
+CONFIG += console c++17
+
+SOURCES += \
+    cli.cpp
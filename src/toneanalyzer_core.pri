@@ -0,0 +1,19 @@
+# Links a target against the core library (toneanalyzer_core.pro)
+include(dependencies.pri)
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+win32:CONFIG(release, debug|release): CORE_DIR = $$OUT_PWD/release
+else:win32:CONFIG(debug, debug|release): CORE_DIR = $$OUT_PWD/debug
+else: CORE_DIR = $$OUT_PWD
+
+LIBS = -L$$CORE_DIR -ltoneanalyzer_core $$LIBS
+
+win32-g++|!win32: PRE_TARGETDEPS += $$CORE_DIR/libtoneanalyzer_core.a
+else: PRE_TARGETDEPS += $$CORE_DIR/toneanalyzer_core.lib
+
+unix: LIBS += -lpthread
+
+# shm_open lives in librt before glibc 2.34
+linux: LIBS += -lrt
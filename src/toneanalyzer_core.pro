@@ -0,0 +1,60 @@
+include(toneanalyzer.pri)
+include(dependencies.pri)
+
+# Framing, sample conversion, resampling, FFT, level and pitch analysis. Plain C++, no Qt
+TARGET = toneanalyzer_core
+TEMPLATE = lib
+
+CONFIG -= qt
+CONFIG += staticlib c++17
+
+SOURCES += \
+    activitygate.cpp \
+    allocationaudit.cpp \
+    channelanalyzer.cpp \
+    frameanalyzer.cpp \
+    framearena.cpp \
+    framer.cpp \
+    latencystats.cpp \
+    multipitchestimator.cpp \
+    noteevents.cpp \
+    onsetdetector.cpp \
+    partialtracker.cpp \
+    pitchestimators.cpp \
+    plancache.cpp \
+    resampler.cpp \
+    resultstream.cpp \
+    sampleconverter.cpp \
+    sharedspectrum.cpp \
+    spectrogramarchive.cpp \
+    spectrumquantizer.cpp \
+    streamreader.cpp \
+    tracer.cpp \
+    workerpool.cpp
+
+HEADERS += \
+    activitygate.h \
+    allocationaudit.h \
+    audioframe.h \
+    channelanalyzer.h \
+    frameanalyzer.h \
+    framearena.h \
+    framer.h \
+    latencystats.h \
+    multipitchestimator.h \
+    noteevents.h \
+    notes.h \
+    onsetdetector.h \
+    partialtracker.h \
+    pitchestimators.h \
+    plancache.h \
+    resampler.h \
+    resultstream.h \
+    sampleconverter.h \
+    seqlock.h \
+    sharedspectrum.h \
+    spectrogramarchive.h \
+    spectrumquantizer.h \
+    streamreader.h \
+    tracer.h \
+    workerpool.h
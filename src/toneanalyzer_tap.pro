@@ -0,0 +1,12 @@
+include(toneanalyzer.pri)
+include(toneanalyzer_core.pri)
+
+# Prints the frames another process publishes to shared memory, example of a reader
+TARGET = toneanalyzer-tap
+TEMPLATE = app
+
+CONFIG -= qt app_bundle
+CONFIG += console c++17
+
+SOURCES += \
+    tap.cpp
@@ -0,0 +1,150 @@
+#include "tracer.h"
+
+#ifdef TRACE_EVENTS
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include "allocationaudit.h"
+
+namespace {
+    // Number of events kept per thread, the oldest ones are overwritten
+    const size_t EVENTS_PER_THREAD = 1 << 16;
+
+    struct Event
+    {
+        const char* name;       // Name of the slice or flow
+        int64_t     startNs;    // Start of the slice, time of the flow
+        int64_t     endNs;      // End of the slice
+        uint64_t    id;         // Id of the flow
+        char        phase;      // 'X' for a slice, 's' / 'f' for the beginning / end of a flow
+    };
+
+    struct ThreadBuffer
+    {
+        std::atomic<uint64_t>       head{0};            // Number of events recorded, the next one goes at head % EVENTS_PER_THREAD
+        std::atomic<const char*>    name{nullptr};      // Name of the thread
+        unsigned int                tid = 0;            // Id of the thread in the trace
+        Event                       events[EVENTS_PER_THREAD];
+    };
+
+    // The buffers live as long as the process, a thread may end before the trace is written
+    std::mutex                  registryMutex;
+    std::vector<ThreadBuffer*>  registry;
+    std::atomic<int64_t>        originNs{0};
+
+    thread_local ThreadBuffer*  threadBuffer = nullptr;
+    thread_local const char*    threadName = nullptr;
+
+    ThreadBuffer& buffer()
+    {
+        if (!threadBuffer) {
+            // Once per thread, the first time it records while tracing
+            allocationaudit::ScopedAllow allow;
+            ThreadBuffer *created = new ThreadBuffer;
+            created->name.store(threadName, std::memory_order_relaxed);
+
+            std::lock_guard<std::mutex> lock(registryMutex);
+            created->tid = static_cast<unsigned int>(registry.size() + 1);
+            registry.push_back(created);
+            threadBuffer = created;
+        }
+        return *threadBuffer;
+    }
+
+    void record(const Event &event)
+    {
+        // Only the owning thread writes to its buffer
+        ThreadBuffer &target = buffer();
+        const uint64_t head = target.head.load(std::memory_order_relaxed);
+        target.events[head % EVENTS_PER_THREAD] = event;
+        target.head.store(head + 1, std::memory_order_release);
+    }
+
+    double toUs(int64_t ns)
+    {
+        return static_cast<double>(ns - originNs.load(std::memory_order_relaxed)) / 1000.0;
+    }
+}
+
+namespace tracer {
+    namespace detail {
+        std::atomic<bool> enabled{false};
+
+        int64_t nowNs()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        void recordSlice(const char *name, int64_t startNs, int64_t endNs)
+        {
+            record(Event{name, startNs, endNs, 0, 'X'});
+        }
+
+        void recordFlow(const char *name, uint64_t id, bool begin)
+        {
+            const int64_t now = nowNs();
+            record(Event{name, now, now, id, begin ? 's' : 'f'});
+        }
+    }
+
+    void start()
+    {
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            for (ThreadBuffer *target : registry) target->head.store(0, std::memory_order_relaxed);
+        }
+        originNs.store(detail::nowNs(), std::memory_order_relaxed);
+        detail::enabled.store(true, std::memory_order_release);
+    }
+
+    void stop()
+    {
+        detail::enabled.store(false, std::memory_order_release);
+    }
+
+    void setThreadName(const char *name)
+    {
+        threadName = name;
+        if (threadBuffer) threadBuffer->name.store(name, std::memory_order_relaxed);
+    }
+
+    bool write(const char *path)
+    {
+        FILE *file = std::fopen(path, "w");
+        if (!file) return false;
+
+        std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        std::fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"ToneAnalyzer\"}}");
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (const ThreadBuffer *target : registry) {
+            const char *name = target->name.load(std::memory_order_relaxed);
+            if (name) {
+                std::fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", target->tid, name);
+            }
+
+            const uint64_t head = target->head.load(std::memory_order_acquire);
+            const uint64_t first = head > EVENTS_PER_THREAD ? head - EVENTS_PER_THREAD : 0;
+            for (uint64_t i = first; i < head; ++i) {
+                const Event &event = target->events[i % EVENTS_PER_THREAD];
+                if (event.phase == 'X') {
+                    std::fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                                 event.name, target->tid, toUs(event.startNs), static_cast<double>(event.endNs - event.startNs) / 1000.0);
+                }
+                else {
+                    // Flows bind to the slice enclosing them, on both ends
+                    std::fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"flow\",\"ph\":\"%c\",\"bp\":\"e\",\"id\":%llu,\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+                                 event.name, event.phase, static_cast<unsigned long long>(event.id), target->tid, toUs(event.startNs));
+                }
+            }
+        }
+
+        std::fprintf(file, "\n]}\n");
+        return std::fclose(file) == 0;
+    }
+}
+
+#endif // TRACE_EVENTS
@@ -0,0 +1,100 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Opt-in tracing of the activity of the pipeline, written in the Chrome trace event format (to be opened
+ * with chrome://tracing or https://ui.perfetto.dev).
+ *
+ * Built only when TRACE_EVENTS is defined (@see{toneanalyzer.pri}), and recording only between start()
+ * and stop(). Every thread records to its own buffer, a ring of the latest events allocated at its first
+ * event, so recording never locks and never allocates afterwards. While stopped, a trace point only costs
+ * a relaxed load and a branch. Without TRACE_EVENTS the trace points compile to nothing.
+ *
+ * Use the macros rather than the functions so the trace points disappear from builds without tracing:
+ *   TRACE_SCOPE("fft");                    a slice from here to the end of the scope
+ *   TRACE_FLOW_BEGIN("frame", id);         an arrow from the enclosing slice...
+ *   TRACE_FLOW_END("frame", id);           ...to the enclosing slice of another thread
+ *   TRACE_THREAD_NAME("analysis");         the name of the calling thread in the trace
+ */
+namespace tracer {
+#ifdef TRACE_EVENTS
+    namespace detail {
+        extern std::atomic<bool> enabled;
+
+        int64_t nowNs();
+        void recordSlice(const char *name, int64_t startNs, int64_t endNs);
+        void recordFlow(const char *name, uint64_t id, bool begin);
+    }
+
+    /**
+     * @brief Starts recording, forgetting the events of a previous recording
+     */
+    void start();
+
+    /**
+     * @brief Stops recording, the events recorded are kept until the next start()
+     */
+    void stop();
+
+    /**
+     * @brief Returns whether events are being recorded
+     */
+    inline bool isEnabled() { return detail::enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Names the calling thread in the trace
+     * @param name The name, must outlive the tracer (ie: a string literal)
+     */
+    void setThreadName(const char *name);
+
+    /**
+     * @brief Writes the events recorded to a JSON file, to be called after stop()
+     * @param path The path of the file
+     * @return True if the file was written
+     */
+    bool write(const char *path);
+
+    /**
+     * @brief Records a slice from its construction to its destruction
+     */
+    class Scope
+    {
+    public:
+        explicit Scope(const char *name) : name(isEnabled() ? name : nullptr), startNs(this->name ? detail::nowNs() : 0) {}
+        ~Scope() { if (name) detail::recordSlice(name, startNs, detail::nowNs()); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char*     name;       // Name of the slice, nullptr if not recording
+        int64_t         startNs;    // Start of the slice
+    };
+
+    inline void flowBegin(const char *name, uint64_t id) { if (isEnabled()) detail::recordFlow(name, id, true); }
+    inline void flowEnd(const char *name, uint64_t id) { if (isEnabled()) detail::recordFlow(name, id, false); }
+
+#   define TRACER_CONCAT_(a, b) a##b
+#   define TRACER_CONCAT(a, b) TRACER_CONCAT_(a, b)
+#   define TRACE_SCOPE(name) tracer::Scope TRACER_CONCAT(traceScope, __LINE__)(name)
+#   define TRACE_FLOW_BEGIN(name, id) tracer::flowBegin(name, id)
+#   define TRACE_FLOW_END(name, id) tracer::flowEnd(name, id)
+#   define TRACE_THREAD_NAME(name) tracer::setThreadName(name)
+#else
+    inline void start() {}
+    inline void stop() {}
+    inline bool isEnabled() { return false; }
+    inline void setThreadName(const char *) {}
+    inline bool write(const char *) { return false; }
+
+#   define TRACE_SCOPE(name) do {} while (false)
+#   define TRACE_FLOW_BEGIN(name, id) do {} while (false)
+#   define TRACE_FLOW_END(name, id) do {} while (false)
+#   define TRACE_THREAD_NAME(name) do {} while (false)
+#endif
+}
+
+#endif // TRACER_H
@@ -21,38 +21,25 @@ namespace util {
         return static_cast<size_t>((format.sampleRate() * format.channelCount() * (format.sampleSize() / 8)) / (1000 / interval));
     }
 
-    std::vector<float> charToFloatVector(const std::vector<char>& data, size_t size)
+    SampleFormat sampleFormat(const QAudioFormat &format)
     {
-        Q_ASSERT(data.size() >= size && size % 4 == 0);
-        std::vector<float> floats(size / sizeof(float));
-        std::memcpy(floats.data(), &*data.begin(), size);
-        return floats;
+        SampleFormat sampleFormat;
+        switch (format.sampleType()) {
+        case QAudioFormat::SignedInt:   sampleFormat.type = SampleFormat::SignedInt; break;
+        case QAudioFormat::UnSignedInt: sampleFormat.type = SampleFormat::UnsignedInt; break;
+        default:                        sampleFormat.type = SampleFormat::Float; break;
+        }
+        sampleFormat.byteOrder = format.byteOrder() == QAudioFormat::BigEndian ? SampleFormat::BigEndian : SampleFormat::LittleEndian;
+        sampleFormat.sampleSize = format.sampleSize();
+        sampleFormat.channelCount = format.channelCount();
+        return sampleFormat;
     }
 
-    std::vector<float> charToFloatVector(const boost::circular_buffer<char>& data, size_t size)
+    bool isFormatConvertible(const QAudioFormat &format)
     {
-        Q_ASSERT(data.size() >= size && size % 4 == 0);
-        std::vector<float> floats(size / sizeof(float));
-        std::memcpy(floats.data(), &*data.begin(), size);
-        return floats;
-    }
-
-    std::vector<float> charToFloatVector(const boost::circular_buffer<char>& data, size_t start, size_t size)
-    {
-        Q_ASSERT(data.size() >= size && size % 4 == 0);
-        std::vector<float> floats(size / sizeof(float));
-        std::memcpy(floats.data(), &*(data.begin() + static_cast<int>(start)), size);
-        return floats;
-    }
-
-    std::vector<char> overlap(std::vector<char> first_half, const boost::circular_buffer<char>& rest, size_t size)
-    {
-        Q_ASSERT(rest.size() >= size / 2);
-        Q_ASSERT(first_half.size() == size / 2);
-
-        std::vector<char> overlapped(size);
-        std::memcpy(overlapped.data(), first_half.data(), size / 2);
-        std::memcpy(overlapped.data() + (size / 2), &*rest.begin(), size / 2);
-        return overlapped;
+        return format.isValid()
+            && format.codec() == "audio/pcm"
+            && format.sampleType() != QAudioFormat::Unknown
+            && SampleConverter::isSupported(sampleFormat(format));
     }
 }
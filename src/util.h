@@ -4,7 +4,7 @@
 #include <QAudioFormat>
 #include <QDebug>
 
-#include <boost/circular_buffer.hpp>
+#include "sampleconverter.h"
 
 class NullDebug
 {
@@ -60,10 +60,21 @@ namespace util {
      * @return The size the buffer should have
      */
     size_t bufferLength(const QAudioFormat &format, const int interval);
-    std::vector<float> charToFloatVector(const std::vector<char>& data, size_t size);
-    std::vector<float> charToFloatVector(const boost::circular_buffer<char>& data, size_t size);
-    std::vector<float> charToFloatVector(const boost::circular_buffer<char>& data, size_t start, size_t size);
-    std::vector<char> overlap(std::vector<char> first_half, const boost::circular_buffer<char>& rest,  size_t size);
+
+    /**
+     * @brief Returns the description of the samples of an audio format, for the sample converter
+     * @param format The audio format
+     * @return The sample format
+     */
+    SampleFormat sampleFormat(const QAudioFormat &format);
+
+    /**
+     * @brief Returns whether the samples of an audio format can be converted to floats
+     * @param format The audio format
+     * @return True if the format is PCM in a layout SampleConverter supports
+     */
+    bool isFormatConvertible(const QAudioFormat &format);
+
 }
 
 #endif // UTIL_H
@@ -0,0 +1,108 @@
+#include "workerpool.h"
+
+#include "tracer.h"
+
+WorkerPool::WorkerPool(size_t numThreads)
+    : loops{nullptr}
+    , stopping{false}
+{
+    threads.reserve(numThreads);
+    for (size_t i = 0; i < numThreads; ++i) threads.emplace_back(&WorkerPool::work, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (std::thread &thread : threads) thread.join();
+}
+
+size_t WorkerPool::defaultNumThreads()
+{
+    const unsigned int cores = std::thread::hardware_concurrency();
+    return cores > 1 ? cores - 1 : 0;
+}
+
+void WorkerPool::run(size_t count, Task task, void *context)
+{
+    if (count == 0) return;
+
+    // Nothing to share, don't bother waking anyone up
+    if (count == 1 || threads.empty()) {
+        for (size_t i = 0; i < count; ++i) task(context, i);
+        return;
+    }
+
+    Loop loop;
+    loop.task = task;
+    loop.context = context;
+    loop.count = count;
+    loop.next.store(0, std::memory_order_relaxed);
+    loop.numWorkers = 0;
+    loop.nextLoop = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Loop **last = &loops;
+        while (*last) last = &(*last)->nextLoop;
+        *last = &loop;
+    }
+    wake.notify_all();
+
+    runTasks(loop);
+
+    // Every task is taken, once out of the list and left by every thread of the pool, every task is done and
+    // none of them is still looking at the loop
+    std::unique_lock<std::mutex> lock(mutex);
+    Loop **link = &loops;
+    while (*link != &loop) link = &(*link)->nextLoop;
+    *link = loop.nextLoop;
+    done.wait(lock, [&loop] { return loop.numWorkers == 0; });
+}
+
+
+/************************************************************/
+/*      PRIVATE                                             */
+/************************************************************/
+WorkerPool::Loop* WorkerPool::findLoop() const
+{
+    for (Loop *loop = loops; loop; loop = loop->nextLoop) {
+        if (loop->next.load(std::memory_order_relaxed) < loop->count) return loop;
+    }
+    return nullptr;
+}
+
+void WorkerPool::runTasks(Loop &loop)
+{
+    for (;;) {
+        const size_t index = loop.next.fetch_add(1, std::memory_order_relaxed);
+        if (index >= loop.count) return;
+
+        loop.task(loop.context, index);
+    }
+}
+
+void WorkerPool::work()
+{
+    TRACE_THREAD_NAME("analysis worker");
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [this] { return stopping || findLoop(); });
+        if (stopping) return;
+
+        Loop *loop = findLoop();
+        ++loop->numWorkers;
+        lock.unlock();
+
+        runTasks(*loop);
+
+        lock.lock();
+        // Its thread may be waiting for the loop, as well as the threads of other loops
+        if (--loop->numWorkers == 0) done.notify_all();
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of threads running the tasks of parallel loops.
+ *
+ * The threads are created once, a loop only wakes them up, so running one never allocates. The calling
+ * thread takes tasks too and returns once they are all done. Several threads can run loops at the same time
+ * (the analyzer threads of several sessions sharing the pool): the threads of the pool take the tasks of
+ * whichever loop has some left, and each calling thread only waits for the tasks of its own loop.
+ */
+class WorkerPool
+{
+public:
+    typedef void (*Task)(void *context, size_t index);
+
+    /**
+     * @brief Creates the pool
+     * @param numThreads Number of threads besides the calling one, 0 runs everything on the calling thread
+     */
+    explicit WorkerPool(size_t numThreads);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     * @brief Runs task(context, i) for every i in [0, count) and waits for all of them to be done, safe to call
+     * from several threads at once
+     * @param count Number of tasks
+     * @param task The task
+     * @param context Passed to the task
+     */
+    void run(size_t count, Task task, void *context);
+
+    /**
+     * @brief Returns the number of threads of the pool, besides the calling one
+     */
+    size_t getNumThreads() const { return threads.size(); }
+
+    /**
+     * @brief Returns a sensible number of threads for the machine
+     */
+    static size_t defaultNumThreads();
+
+private:
+    /**
+     * @brief A loop being run, lives on the stack of the thread running it
+     */
+    struct Loop
+    {
+        Task                    task;           // The task
+        void*                   context;        // Passed to the task
+        size_t                  count;          // Number of tasks
+        std::atomic<size_t>     next;           // Index of the next task to take
+        size_t                  numWorkers;     // Number of threads of the pool taking its tasks, guarded by mutex
+        Loop*                   nextLoop;       // Next loop of the list, guarded by mutex
+    };
+
+    std::vector<std::thread>    threads;        // The threads of the pool
+
+    std::mutex                  mutex;          // Guards the state below
+    std::condition_variable     wake;           // Signaled when a loop starts or the pool stops
+    std::condition_variable     done;           // Signaled when the last thread of the pool leaves a loop
+
+    Loop*                       loops;          // The loops being run, the oldest first
+    bool                        stopping;       // True when the pool is destroyed
+
+    /**
+     * @brief Returns the oldest loop with tasks left to take, nullptr if none, with mutex locked
+     */
+    Loop* findLoop() const;
+
+    /**
+     * @brief Takes and runs tasks of a loop until there is none left
+     */
+    static void runTasks(Loop &loop);
+
+    /**
+     * @brief Body of the threads of the pool
+     */
+    void work();
+};
+
+#endif // WORKERPOOL_H